@@ -29,17 +29,23 @@
  * program then send it a USR1 signal. When it gets the signal, it will dump the dot-ready graph represenation into an output file. 'dot' is a
  * program that can generate images/PDF files for graphs. See http://www.graphviz.org for more details.
  *
+ * Given an export interval, it instead writes the graph out continuously: a time-stamped dot file per
+ * snapshot, or snapshots or edge changes appended to a CSV or binary edge list (see GraphExporter
+ * for the formats). Given an event database, it reads the events from it directly instead of from
+ * watcherd, writing one snapshot per interval of event time.
+ *
  * Usage: 
  * @{
- * <b>connectivity2dot -s server [optional args]</b>
+ * <b>connectivity2dot [optional args]</b>
  *
  * @}
- * @{
- * Args:
- * @arg <b>-s, --server=address|name</b>, The address or name of the node running watcherd
- * @}
  * Optional args:
  * @arg <b>-c, --config=file</b>, The cfg file for connectivity2dot. If not given <i>connectivity2dot.cfg</i> is assumed.
+ * @arg <b>-d, --database=file</b>, Read events from this event database rather than from the server.
+ * @arg <b>-i, --interval=ms</b>, Write the graph every ms milliseconds, 0 to write only on USR1.
+ * @arg <b>-f, --format=dot|csv|binary</b>, Output format.
+ * @arg <b>-m, --mode=snapshot|delta</b>, For csv and binary output, write whole snapshots or only the edges which changed.
+ * @arg <b>-o, --outfile=file</b>, Where to write the graph.
  * @arg <b>-h, --help</b>, Show help message
  *
  * Here is a sample cfg file:
@@ -48,6 +54,9 @@
  * server = "glory";
  * service = "watcherd";
  * outfile = "connectivity.dot";
+ * exportInterval = 0;
+ * exportFormat = "dot";
+ * exportMode = "snapshot";
  * @endcode
  *
  * Here's an example of a dot generated graph: 
@@ -66,14 +75,14 @@
  * }
  * @enddot
  *
- * Here is a bash script that will dump a new pdf of the test bed every 5 seconds (it assumes connectivity2dot is already running):
+ * To dump a new dot file of the test bed every 5 seconds, named after the time of each:
  * @code
- * #!/usr/bin/env bash
+ * connectivity2dot -i 5000 -o connectivity.dot
+ * @endcode
  *
- * while true; do 
- *      pkill -USR1 connectivity2 && dot -Tpdf < connectivity.dot > connectivity.$(date +%Y%m%d_%H%M%S).pdf
- *      sleep 5
- * done
+ * To record every change to the topology in an existing event database as a CSV edge list:
+ * @code
+ * connectivity2dot -d event.db -i 1000 -f csv -m delta -o edges.csv
  * @endcode
  *
  */
@@ -81,11 +90,18 @@
 #include <fstream>
 #include <csignal>
 #include <stdlib.h>     // for EXIT_SUCCESS/FAILURE
+#include <getopt.h>
+#include <unistd.h>
+#include <boost/ref.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include "initConfig.h"
 #include "singletonConfig.h"
 #include "libwatcher/messageStream.h"
 #include "libwatcher/watcherGraph.h"
+#include "libwatcher/eventQueryMessage.h"
+#include "database.h"
+#include "graphExporter.h"
 #include "logger.h"
 
 DECLARE_GLOBAL_LOGGER("connectivity2dot"); 
@@ -100,6 +116,7 @@ namespace connectivity2dot
 {
     sig_atomic_t dumpGraph;
     sig_atomic_t dumpConfig;
+    sig_atomic_t done;
 }
 
 void sigUsr1Handler(int)
@@ -112,21 +129,37 @@ void sigUsr2Handler(int)
     connectivity2dot::dumpConfig=1;
 }
 
+void sigTermHandler(int)
+{
+    connectivity2dot::done=1;
+}
+
 void usage(const char *progName, bool exitp)
 {
-    cout << "Usage: " << basename(progName) << " [-c config filename]" << endl;
+    cout << "Usage: " << basename(progName) << " [-c config filename] [-d database] [-i ms] [-f format] [-m mode] [-o outfile]" << endl;
     cout << "Args: " << endl; 
     cout << "   -h, show this messsage and exit." << endl; 
     cout << "   -c configfile - If not given a filename of the form \""<< basename(progName) << ".cfg\" is assumed." << endl;
+    cout << "   -d, --database=file - read events from this event database instead of the server, and exit at the end." << endl;
+    cout << "   -i, --interval=ms - write the graph every ms milliseconds (of event time with -d). 0 writes it only on USR1." << endl;
+    cout << "   -f, --format=dot|csv|binary - the output format." << endl;
+    cout << "   -m, --mode=snapshot|delta - write whole snapshots, or only the edges that changed (csv and binary only)." << endl;
+    cout << "   -o, --outfile=file - where to write the graph." << endl;
+    cout << "The last four override the config file." << endl;
     cout << "If a configuration file is not found on startup, a default one will be created, used, and saved on program exit." << endl;
     cout << "Config file settings:" << endl;
     cout << "   logPropertiesFile - the location of the log.properties file" << endl;
     cout << "   server - name or ipaddress of the server to connect to." << endl;
     cout << "   service - name of service (usaully \"watcherd\") or port number on which the server is listening." << endl;
-    cout << "   outfile - filename where the dot file is written" << endl;
+    cout << "   outfile - filename where the graph is written" << endl;
+    cout << "   exportInterval - milliseconds between writes of the graph, 0 to write it only on USR1" << endl;
+    cout << "   exportFormat - \"dot\", \"csv\" or \"binary\"" << endl;
+    cout << "   exportMode - \"snapshot\" or \"delta\"" << endl;
     cout << endl;
     cout << "To use this program: run " << basename(progName) << " when it receives a USR1 signal, it'll write the "; 
     cout << "    current state of the topology to the output file specified in the cfg file." << endl;
+    cout << "With an export interval, dot files are named after the time of each snapshot, and csv and binary" << endl;
+    cout << "    edge lists are appended to the output file." << endl;
 
     if(exitp)
         exit(EXIT_FAILURE); 
@@ -156,6 +189,90 @@ string getConfigValue(Config &config, const string &key, const string &defaultVa
     return retVal;
 }
 
+int getConfigValue(Config &config, const string &key, int defaultVal)
+{
+    TRACE_ENTER();
+    int retVal=defaultVal;
+    if (!config.lookupValue(key, retVal))
+    {
+        LOG_INFO("'" << key << "' not found in the configuration file, using default: " << retVal  
+                << " and adding this to the configuration file.");
+        config.getRoot().add(key, libconfig::Setting::TypeInt)=retVal;
+    }
+    TRACE_EXIT();
+    return retVal;
+}
+
+namespace connectivity2dot
+{
+    /** Feeds events read from the database into the graph, taking a
+     * snapshot each time event time passes another interval. */
+    class OfflineExport
+    {
+        public:
+            OfflineExport(WatcherGraph &g, GraphExporter &e, Timestamp i) : 
+                graph(g), exporter(e), interval(i), next(0) {}
+
+            void operator()(MessagePtr m)
+            {
+                if (interval) {
+                    if (!next)
+                        next=m->timestamp+interval;
+                    for ( ; m->timestamp>=next; next+=interval)
+                        exportAt(next); 
+                }
+                graph.updateGraph(m);
+            }
+
+            void exportAt(Timestamp ts)
+            {
+                graph.doMaintanence(ts); 
+                snapshot.take(graph, ts);
+                exporter.submit(snapshot, true);    // don't lose any when reading from a file
+            }
+
+        private:
+            WatcherGraph &graph;
+            GraphExporter &exporter;
+            GraphSnapshot snapshot;
+            Timestamp interval;
+            Timestamp next;
+    };
+
+    int exportDatabase(const string &dbName, GraphExporter &exporter, Timestamp interval)
+    {
+        TRACE_ENTER();
+        boost::scoped_ptr<Database> db;
+        try {
+            db.reset(Database::connect(dbName));
+        } catch (std::exception &e) {
+            LOG_FATAL("Unable to open database " << dbName << ": " << e.what());
+            TRACE_EXIT_RET(EXIT_FAILURE);
+            return EXIT_FAILURE;
+        }
+
+        TimeRange range=db->eventRange();
+        LOG_INFO("Reading events from " << range.first << " to " << range.second << " from " << dbName);
+
+        WatcherGraph theGraph(1000, 50); 
+        OfflineExport replay(theGraph, exporter, interval);
+        boost::function<void(MessagePtr)> output(boost::ref(replay));
+
+        // an hour at a time, to keep each query's result set small
+        const Timestamp window=60*60*1000;
+        EventQueryMessage q;
+        for (Timestamp t=range.first; t<=range.second; t+=window) {
+            q.begin=t;
+            q.end=std::min(t+window-1, range.second);
+            db->queryEvents(output, q);
+        }
+        replay.exportAt(range.second);
+
+        TRACE_EXIT_RET(EXIT_SUCCESS);
+        return EXIT_SUCCESS;
+    }
+}
+
 int main(int argc, char **argv)
 {
     TRACE_ENTER(); 
@@ -166,6 +283,7 @@ int main(int argc, char **argv)
 
     connectivity2dot::dumpGraph=0;
     connectivity2dot::dumpConfig=0;
+    connectivity2dot::done=0;
 
     string configFilename;
     Config &config=SingletonConfig::instance();
@@ -183,9 +301,56 @@ int main(int argc, char **argv)
     string serverName(getConfigValue(config, "server", "127.0.0.1")); 
     string service(getConfigValue(config, "service", "watcherd"));
     string outfileName(getConfigValue(config, "outfile", "connectivity.dot"));
+    int interval=getConfigValue(config, "exportInterval", 0); 
+    string formatName(getConfigValue(config, "exportFormat", "dot"));
+    string modeName(getConfigValue(config, "exportMode", "snapshot"));
+    string dbName;
+
+    const option options[] = {
+        { "config", required_argument, 0, 'c' },
+        { "database", required_argument, 0, 'd' },
+        { "interval", required_argument, 0, 'i' },
+        { "format", required_argument, 0, 'f' },
+        { "mode", required_argument, 0, 'm' },
+        { "outfile", required_argument, 0, 'o' },
+        { 0, 0, 0, 0 }
+    };
+    for (int c; (c=getopt_long(argc, argv, "c:d:i:f:m:o:", options, 0))!=-1; ) {
+        switch (c) {
+            case 'c': break;        // handled by initConfig()
+            case 'd': dbName=optarg; break;
+            case 'i': interval=atoi(optarg); break;
+            case 'f': formatName=optarg; break;
+            case 'm': modeName=optarg; break;
+            case 'o': outfileName=optarg; break;
+            default: usage(argv[0], true); 
+        }
+    }
+
+    connectivity2dot::GraphExporter::Format format;
+    connectivity2dot::GraphExporter::Mode mode;
+    if (!connectivity2dot::GraphExporter::parseFormat(formatName, format)) {
+        LOG_FATAL("Unknown export format \"" << formatName << "\"");
+        usage(argv[0], true); 
+    }
+    if (!connectivity2dot::GraphExporter::parseMode(modeName, mode)) {
+        LOG_FATAL("Unknown export mode \"" << modeName << "\"");
+        usage(argv[0], true); 
+    }
 
     saveConfig(configFilename);
 
+    // Dot files are time-stamped whenever more than one may be written.
+    connectivity2dot::GraphExporter exporter(outfileName, format, mode, interval>0);
+    exporter.start();
+
+    if (!dbName.empty()) {
+        int rv=connectivity2dot::exportDatabase(dbName, exporter, interval);
+        exporter.stop();
+        TRACE_EXIT_RET(rv); 
+        return rv;
+    }
+
     // setup signal handling.
     void (*prevFn)(int)=signal(SIGUSR1, sigUsr1Handler);
     if (prevFn==SIG_IGN) 
@@ -193,6 +358,8 @@ int main(int argc, char **argv)
     prevFn=signal(SIGUSR2, sigUsr2Handler); 
     if (prevFn==SIG_IGN) 
         signal(SIGUSR2, SIG_IGN);
+    signal(SIGINT, sigTermHandler);
+    signal(SIGTERM, sigTermHandler);
 
     MessageStreamPtr ms=MessageStream::createNewMessageStream(serverName, service); 
 
@@ -206,17 +373,21 @@ int main(int argc, char **argv)
     ms->startStream(); 
 
     WatcherGraph theGraph(1000, 50); 
+    connectivity2dot::GraphSnapshot snapshot;
     MessagePtr mp(new Message);
+    Timestamp nextExport=getCurrentTime()+interval;
 
-    while(1)
+    while(!connectivity2dot::done)
     {
-        if(connectivity2dot::dumpGraph)
+        Timestamp now=getCurrentTime();
+        if(connectivity2dot::dumpGraph || (interval>0 && now>=nextExport))
         {
             connectivity2dot::dumpGraph=false;
-            LOG_INFO("Dumping current connectivity graph to " << outfileName); 
-            ofstream fout(outfileName.c_str()); 
-            fout << theGraph;
-            fout.close();
+            while (interval>0 && nextExport<=now)
+                nextExport+=interval;
+            // Only the copy happens here; the writer thread formats and writes it. 
+            snapshot.take(theGraph, now);
+            exporter.submit(snapshot, false);
         }
         if(connectivity2dot::dumpConfig)
         {
@@ -230,9 +401,13 @@ int main(int argc, char **argv)
             LOG_DEBUG("Got message: " << *mp);
             theGraph.updateGraph(mp);
         }
-        sleep(1); 
+        Timestamp wait=100;     // milliseconds
+        if (interval>0 && nextExport-getCurrentTime()<wait)
+            wait=std::max<Timestamp>(nextExport-getCurrentTime(), 0);
+        usleep(wait*1000); 
     }
 
+    exporter.stop();
     saveConfig(configFilename);
 
     TRACE_EXIT_RET(EXIT_SUCCESS); 
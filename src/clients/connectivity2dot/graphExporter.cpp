@@ -0,0 +1,342 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ * 
+ * This file is part of WATCHER.
+ * 
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ * 
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ * 
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** 
+ * @file graphExporter.cpp
+ * @date 2010-06-24
+ */
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <sstream>
+#include <boost/bind.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+#include "graphExporter.h"
+#include "logger.h"
+
+using namespace std;
+using namespace watcher;
+using namespace connectivity2dot;
+
+INIT_LOGGER(GraphExporter, "GraphExporter");
+
+namespace
+{
+    string addrString(uint32_t addr)
+    {
+        return boost::asio::ip::address_v4(addr).to_string();
+    }
+
+    string colorString(const Color& c)
+    {
+        char buf[sizeof("#rrggbb")];
+        snprintf(buf, sizeof(buf), "#%02x%02x%02x", c.r, c.g, c.b);
+        return buf;
+    }
+
+    string csvQuote(const string& s)
+    {
+        if (s.find_first_of(",\"\n") == string::npos)
+            return s;
+        string out("\"");
+        for (string::const_iterator c = s.begin(); c != s.end(); ++c) {
+            if (*c == '"')
+                out += '"';
+            out += *c;
+        }
+        return out + '"';
+    }
+
+    template <typename T> void put(ostream& os, T v)
+    {
+        os.write(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+}
+
+void GraphSnapshot::take(const WatcherGraph& graph, Timestamp t)
+{
+    ts = t;
+
+    for (size_t l = layers.size(); l < graph.numValidLayers; ++l)
+        layers.push_back(graph.layers[l].layerName);
+    layerColors.resize(graph.numValidLayers);
+    for (size_t l = 0; l < graph.numValidLayers; ++l)
+        layerColors[l] = graph.layers[l].edgeDisplayInfo.color;
+
+    const size_t numNodes = graph.numValidNodes;
+    nodes.resize(numNodes);
+    for (size_t n = 0; n < numNodes; ++n) {
+        const NodeDisplayInfo& ni = graph.nodes[n];
+        Node& node = nodes[n];
+        node.addr = ni.isActive ? graph.index2Nid(n) : 0;
+        node.x = ni.x;
+        node.y = ni.y;
+        node.z = ni.z;
+        node.color = ni.color;
+    }
+
+    // Most of each adjacency row is zeros, so skip through it a word at a time.
+    edges.clear();
+    for (size_t l = 0; l < graph.numValidLayers; ++l) {
+        if (!graph.layers[l].isActive)
+            continue;
+        for (size_t i = 0; i < numNodes; ++i) {
+            if (!nodes[i].addr)
+                continue;
+            const WatcherLayerData::EdgeType *row = graph.layers[l].edges[i];
+            for (size_t j = 0; j < numNodes; ) {
+                uint64_t word;
+                if (j + sizeof(word) <= numNodes) {
+                    memcpy(&word, row + j, sizeof(word));
+                    if (!word) {
+                        j += sizeof(word);
+                        continue;
+                    }
+                }
+                if (row[j] && nodes[j].addr)
+                    edges.push_back(Edge(l, i, j));
+                ++j;
+            }
+        }
+    }
+}
+
+void GraphSnapshot::swap(GraphSnapshot& other)
+{
+    std::swap(ts, other.ts);
+    layers.swap(other.layers);
+    layerColors.swap(other.layerColors);
+    nodes.swap(other.nodes);
+    edges.swap(other.edges);
+}
+
+GraphExporter::GraphExporter(const string& outfile, Format format, Mode mode, bool timestamped) :
+    outfile_(outfile), format_(format), mode_(mode), timestamped_(timestamped),
+    havePending_(false), stopping_(false), dropped_(0), havePrevious_(false), layersWritten_(0)
+{
+}
+
+GraphExporter::~GraphExporter()
+{
+    stop();
+}
+
+bool GraphExporter::parseFormat(const string& name, Format& f)
+{
+    if (name == "dot")
+        f = dot;
+    else if (name == "csv")
+        f = csv;
+    else if (name == "binary")
+        f = binary;
+    else
+        return false;
+    return true;
+}
+
+bool GraphExporter::parseMode(const string& name, Mode& m)
+{
+    if (name == "snapshot")
+        m = snapshots;
+    else if (name == "delta")
+        m = deltas;
+    else
+        return false;
+    return true;
+}
+
+void GraphExporter::start()
+{
+    TRACE_ENTER();
+    if (format_ != dot) {
+        ios::openmode mode = ios::out | ios::app;
+        if (format_ == binary)
+            mode |= ios::binary;
+        out_.open(outfile_.c_str(), mode);
+        if (!out_)
+            LOG_ERROR("Unable to open " << outfile_ << " for writing");
+        out_.seekp(0, ios::end);
+        if (out_.tellp() == streampos(0)) {
+            if (format_ == csv)
+                out_ << "timestamp,op,layer,from,to\n";
+            else
+                out_.write("WCG\1", 4);
+        }
+    }
+    thread_ = boost::thread(boost::bind(&GraphExporter::run, this));
+    TRACE_EXIT();
+}
+
+void GraphExporter::stop()
+{
+    TRACE_ENTER();
+    {
+        boost::mutex::scoped_lock lock(lock_);
+        stopping_ = true;
+        cond_.notify_all();
+    }
+    if (thread_.joinable())
+        thread_.join();
+    if (dropped_)
+        LOG_WARN(dropped_ << " snapshots were dropped because the writer fell behind");
+    TRACE_EXIT();
+}
+
+void GraphExporter::submit(GraphSnapshot& s, bool wait)
+{
+    boost::mutex::scoped_lock lock(lock_);
+    while (wait && havePending_)
+        cond_.wait(lock);
+    if (havePending_) {
+        LOG_DEBUG("Writer is behind, dropping the snapshot at " << pending_.ts);
+        ++dropped_;
+    }
+    pending_.swap(s);
+    havePending_ = true;
+    cond_.notify_all();
+}
+
+void GraphExporter::run()
+{
+    TRACE_ENTER();
+    for (;;) {
+        {
+            boost::mutex::scoped_lock lock(lock_);
+            while (!havePending_ && !stopping_)
+                cond_.wait(lock);
+            if (!havePending_)
+                break;
+            current_.swap(pending_);
+            havePending_ = false;
+            cond_.notify_all();
+        }
+        write();
+        previous_.swap(current_);
+        havePrevious_ = true;
+    }
+    TRACE_EXIT();
+}
+
+void GraphExporter::write()
+{
+    if (format_ == dot)
+        writeDot();
+    else
+        writeEdgeList();
+}
+
+void GraphExporter::writeDot()
+{
+    string filename(outfile_);
+    if (timestamped_) {
+        string ext;
+        string::size_type dot = filename.rfind('.');
+        if (dot != string::npos && filename.find('/', dot) == string::npos) {
+            ext = filename.substr(dot);
+            filename.erase(dot);
+        }
+        ostringstream name;
+        name << filename << '.' << current_.ts << ext;
+        filename = name.str();
+    }
+
+    LOG_INFO("Dumping current connectivity graph to " << filename); 
+    string tmp(filename + ".tmp");
+    ofstream fout(tmp.c_str());
+    fout << "digraph G {\n";
+    fout << "label=\"" << current_.ts << "\";\n";
+    for (size_t n = 0; n < current_.nodes.size(); ++n) {
+        const GraphSnapshot::Node& node = current_.nodes[n];
+        if (node.addr)
+            fout << n << "[label=\"nodeId: " << addrString(node.addr) << "\\ngps: " <<
+                node.x << "," << node.y << "," << node.z << "\" color=\"" << colorString(node.color) << "\"];\n";
+    }
+    for (vector<GraphSnapshot::Edge>::const_iterator e = current_.edges.begin(); e != current_.edges.end(); ++e)
+        fout << e->from << "->" << e->to << " [color=\"" << colorString(current_.layerColors[e->layer]) << "\"];\n";
+    fout << "}\n";
+    fout.close();
+
+    if (!fout)
+        LOG_ERROR("Unable to write " << tmp);
+    else if (rename(tmp.c_str(), filename.c_str()) == -1)
+        LOG_ERROR("rename " << tmp << " to " << filename << ": " << strerror(errno));
+}
+
+void GraphExporter::writeLayer(size_t layer)
+{
+    const string& name = current_.layers[layer];
+    put<int64_t>(out_, current_.ts);
+    put<char>(out_, 'L');
+    put<uint16_t>(out_, layer);
+    put<uint16_t>(out_, name.size());
+    out_.write(name.data(), name.size());
+}
+
+void GraphExporter::writeRecord(char op, const GraphSnapshot& s, const GraphSnapshot::Edge& e)
+{
+    if (format_ == csv) {
+        out_ << current_.ts << ',' << op;
+        if (op != 'S')
+            out_ << ',' << csvQuote(s.layers[e.layer]) << ',' << addrString(s.nodes[e.from].addr) << ',' << addrString(s.nodes[e.to].addr);
+        else
+            out_ << ",,,";
+        out_ << '\n';
+    } else {
+        put<int64_t>(out_, current_.ts);
+        put<char>(out_, op);
+        if (op != 'S') {
+            put<uint16_t>(out_, e.layer);
+            put<uint32_t>(out_, s.nodes[e.from].addr);
+            put<uint32_t>(out_, s.nodes[e.to].addr);
+        }
+    }
+}
+
+void GraphExporter::writeEdgeList()
+{
+    typedef vector<GraphSnapshot::Edge>::const_iterator Iter;
+
+    if (format_ == binary)
+        for (; layersWritten_ < current_.layers.size(); ++layersWritten_)
+            writeLayer(layersWritten_);
+
+    if (mode_ == deltas && havePrevious_) {
+        // both lists are sorted, so walk them together
+        Iter p = previous_.edges.begin(), pend = previous_.edges.end();
+        Iter c = current_.edges.begin(), cend = current_.edges.end();
+        while (p != pend || c != cend) {
+            if (c == cend || (p != pend && *p < *c))
+                writeRecord('-', previous_, *p++);
+            else if (p == pend || *c < *p)
+                writeRecord('+', current_, *c++);
+            else {
+                ++p;
+                ++c;
+            }
+        }
+    } else {
+        writeRecord('S', current_, GraphSnapshot::Edge(0, 0, 0));
+        for (Iter e = current_.edges.begin(); e != current_.edges.end(); ++e)
+            writeRecord('=', current_, *e);
+    }
+
+    out_.flush();
+    if (!out_)
+        LOG_ERROR("Unable to write to " << outfile_);
+}
@@ -0,0 +1,172 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ * 
+ * This file is part of WATCHER.
+ * 
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ * 
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ * 
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** 
+ * @file graphExporter.h
+ * @date 2010-06-24
+ */
+#ifndef CONNECTIVITY2DOT_GRAPH_EXPORTER_H
+#define CONNECTIVITY2DOT_GRAPH_EXPORTER_H
+
+#include <stdint.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/utility.hpp>
+
+#include "libwatcher/watcherGraph.h"
+#include "declareLogger.h"
+
+namespace connectivity2dot
+{
+    /** The active nodes and edges of a WatcherGraph at one point in time.
+     * Nodes and layers keep the indices they have in the graph, which never
+     * reuses an index, so two snapshots of the same graph can be compared
+     * edge by edge.
+     */
+    struct GraphSnapshot
+    {
+        struct Node
+        {
+            uint32_t addr;      ///< IPv4 address in host byte order, 0 if the node is not active
+            double x;
+            double y;
+            double z;
+            watcher::Color color;
+        };
+
+        struct Edge
+        {
+            uint16_t layer;
+            uint32_t from;      ///< node index
+            uint32_t to;        ///< node index
+
+            Edge(uint16_t l, uint32_t f, uint32_t t) : layer(l), from(f), to(t) {}
+            bool operator<(const Edge& e) const
+            {
+                return layer != e.layer ? layer < e.layer : from != e.from ? from < e.from : to < e.to;
+            }
+            bool operator==(const Edge& e) const { return layer == e.layer && from == e.from && to == e.to; }
+        };
+
+        watcher::Timestamp ts;
+        std::vector<std::string> layers;        ///< layer names, by layer index
+        std::vector<watcher::Color> layerColors;
+        std::vector<Node> nodes;                ///< by node index
+        std::vector<Edge> edges;                ///< sorted
+
+        GraphSnapshot() : ts(0) {}
+
+        /** Copy the current state of the graph, reusing this snapshot's storage. */
+        void take(const watcher::WatcherGraph& graph, watcher::Timestamp t);
+
+        void swap(GraphSnapshot& other);
+    };
+
+    /** Writes graph snapshots out on a thread of its own, so that formatting
+     * and disk I/O never hold up reading messages into the graph.
+     *
+     * The caller fills in a GraphSnapshot and hands it over with submit(),
+     * which swaps buffers with the writer rather than copying.
+     *
+     * Output formats:
+     * - dot: one graphviz file per snapshot.  When timestamped, each is
+     *   named after the snapshot's time, e.g. connectivity.1277400000000.dot;
+     *   otherwise the output file is replaced.  Files are written under a
+     *   temporary name and renamed, so readers never see half a file.
+     * - csv: one line per edge, "timestamp,op,layer,from,to", appended to
+     *   the output file.
+     * - binary: the same records, packed and appended to the output file.
+     *
+     * Both edge list formats use these ops:
+     * - S: start of a snapshot; forget every edge seen so far.
+     * - =: an edge present in the snapshot.
+     * - +: an edge added since the previous snapshot written.
+     * - -: an edge removed since the previous snapshot written.
+     *
+     * In delta mode only + and - records are written, after a full snapshot
+     * the first time.
+     *
+     * A binary file begins with the four bytes "WCG\1".  Every record starts
+     * with an int64 timestamp (milliseconds) and a one byte op, and all values
+     * are in host byte order.  S records have nothing more.  Edge records
+     * follow with a uint16 layer and the uint32 IPv4 addresses of both nodes.
+     * An L record binds a layer number to a name, as a uint16 layer, a uint16
+     * length and that many bytes of name.  Each run of connectivity2dot binds
+     * its layers again before it uses them.
+     */
+    class GraphExporter : private boost::noncopyable
+    {
+        public:
+            enum Format { dot, csv, binary };
+            enum Mode { snapshots, deltas };
+
+            /** @param timestamped for dot output, write each snapshot to a file named after its time */
+            GraphExporter(const std::string& outfile, Format format, Mode mode, bool timestamped);
+
+            /** Stop after writing any snapshot still pending. */
+            ~GraphExporter();
+
+            void start();
+            void stop();
+
+            /** Hand a snapshot to the writer.  s is swapped with a spare buffer
+             * for the caller to fill next time.  If the writer has yet to pick
+             * up the previous snapshot, that one is either dropped in favour of
+             * this one or, when wait is true, waited for.
+             */
+            void submit(GraphSnapshot& s, bool wait);
+
+            static bool parseFormat(const std::string& name, Format& f);
+            static bool parseMode(const std::string& name, Mode& m);
+
+        private:
+            void run();
+            void write();
+            void writeDot();
+            void writeEdgeList();
+            void writeRecord(char op, const GraphSnapshot& s, const GraphSnapshot::Edge& e);
+            void writeLayer(size_t layer);
+
+            const std::string outfile_;
+            const Format format_;
+            const Mode mode_;
+            const bool timestamped_;
+
+            boost::mutex lock_;
+            boost::condition_variable cond_;
+            GraphSnapshot pending_;     ///< submitted but not yet picked up by the writer
+            bool havePending_;
+            bool stopping_;
+            unsigned int dropped_;
+
+            // used only by the writer thread
+            GraphSnapshot current_;     ///< being written
+            GraphSnapshot previous_;    ///< last written, to compute deltas from
+            bool havePrevious_;
+            std::ofstream out_;
+            size_t layersWritten_;      ///< layers bound so far in binary output
+
+            boost::thread thread_;
+
+            DECLARE_LOGGER();
+    };
+}
+
+#endif /* CONNECTIVITY2DOT_GRAPH_EXPORTER_H */
@@ -10,12 +10,14 @@ INCLUDEPATH += .
 include(Makefile.config)
 
 # Input
-HEADERS += seriesGraphDialog.h \
+HEADERS += seriesData.h \
+           seriesGraphDialog.h \
            watcherConfig.h \
            watcherMainWindow.h \
            watcherStreamListDialog.h
 FORMS += graph.ui mainwindow.ui streamlist.ui
 SOURCES += main.cpp \
+           seriesData.cpp \
            seriesGraphDialog.cpp \
            watcherConfig.cpp \
            watcherMainWindow.cpp \
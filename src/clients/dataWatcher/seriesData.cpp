@@ -0,0 +1,265 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "seriesData.h"
+
+namespace {
+
+    const size_t BlockSize = 32; // samples summed up by each of a chunk's blocks
+
+    /** Is t in a column ending at end?  The last column includes its end. */
+    bool inColumn(double t, double end, bool lastColumn)
+    {
+	return lastColumn ? t <= end : t < end;
+    }
+
+} //namespace
+
+namespace watcher {
+namespace ui {
+
+struct SeriesData::Column {
+    size_t n;
+    double firstT, firstV, lastT, lastV;
+    Extremes extremes;
+    double rawT[4], rawV[4]; // the samples, while there are only a few
+
+    Column() : n(0) { }
+
+    void add(double t, double v) {
+	if (!n) {
+	    firstT = t, firstV = v;
+	    extremes.reset(t, v);
+	} else
+	    extremes.add(t, v);
+	if (n < 4)
+	    rawT[n] = t, rawV[n] = v;
+	lastT = t, lastV = v;
+	++n;
+    }
+
+    /** Add k > 4 samples at once, from first to last. */
+    void add(const Extremes& e, double fT, double fV, double lT, double lV, size_t k) {
+	if (!n) {
+	    firstT = fT, firstV = fV;
+	    extremes = e;
+	} else
+	    extremes.add(e);
+	lastT = lT, lastV = lV;
+	n += k;
+    }
+
+    void emit(std::vector<double>& x, std::vector<double>& y) const {
+	if (n <= 4) {
+	    x.insert(x.end(), rawT, rawT + n);
+	    y.insert(y.end(), rawV, rawV + n);
+	    return;
+	}
+	x.push_back(firstT), y.push_back(firstV);
+	if (extremes.minT <= extremes.maxT) {
+	    x.push_back(extremes.minT), y.push_back(extremes.minV);
+	    x.push_back(extremes.maxT), y.push_back(extremes.maxV);
+	} else {
+	    x.push_back(extremes.maxT), y.push_back(extremes.maxV);
+	    x.push_back(extremes.minT), y.push_back(extremes.minV);
+	}
+	x.push_back(lastT), y.push_back(lastV);
+    }
+};
+
+void SeriesData::Chunk::summarize() const
+{
+    if (summarized)
+	return;
+    blocks.clear();
+    for (size_t i = 0; i < t.size(); ++i) {
+	if (i % BlockSize == 0) {
+	    blocks.push_back(Extremes());
+	    blocks.back().reset(t[i], v[i]);
+	} else
+	    blocks.back().add(t[i], v[i]);
+	if (i == 0)
+	    all.reset(t[i], v[i]);
+	else
+	    all.add(t[i], v[i]);
+    }
+    summarized = true;
+}
+
+SeriesData::SeriesData(size_t maxPoints_, size_t chunkSize_) :
+    count(0), maxPoints(std::max<size_t>(maxPoints_, 1)), numDropped(0)
+{
+    // Keep several chunks under maxPoints, so dropping one doesn't drop everything.
+    chunkSize = std::max<size_t>(std::min(chunkSize_, maxPoints / 4), 1);
+}
+
+void SeriesData::clear()
+{
+    chunks.clear();
+    count = 0;
+}
+
+void SeriesData::add(double t, double v)
+{
+    Chunks::iterator c = chunks.upper_bound(t);
+    if (c == chunks.begin()) {
+	// Earlier than everything: it starts the first chunk, which is now known by t.
+	Chunk moved;
+	if (c != chunks.end()) {
+	    moved.t.swap(c->second.t);
+	    moved.v.swap(c->second.v);
+	    chunks.erase(c);
+	}
+	c = chunks.insert(std::make_pair(t, Chunk())).first;
+	c->second.t.swap(moved.t);
+	c->second.v.swap(moved.v);
+	c->second.summarized = false;
+    } else
+	--c;
+
+    Chunk& chunk = c->second;
+    if (chunk.t.empty() || t >= chunk.t.back()) {
+	// The usual case, data arriving in order. Keep the summary up to date.
+	chunk.t.push_back(t);
+	chunk.v.push_back(v);
+	size_t i = chunk.t.size() - 1;
+	if (chunk.summarized) {
+	    if (i % BlockSize == 0) {
+		chunk.blocks.push_back(Extremes());
+		chunk.blocks.back().reset(t, v);
+	    } else
+		chunk.blocks.back().add(t, v);
+	    if (i == 0)
+		chunk.all.reset(t, v);
+	    else
+		chunk.all.add(t, v);
+	}
+    } else {
+	size_t i = std::upper_bound(chunk.t.begin(), chunk.t.end(), t) - chunk.t.begin();
+	chunk.t.insert(chunk.t.begin() + i, t);
+	chunk.v.insert(chunk.v.begin() + i, v);
+	chunk.summarized = false;
+    }
+    ++count;
+
+    if (chunk.t.size() > chunkSize)
+	split(c);
+
+    while (count > maxPoints && chunks.size() > 1) {
+	count -= chunks.begin()->second.t.size();
+	numDropped += chunks.begin()->second.t.size();
+	chunks.erase(chunks.begin());
+    }
+}
+
+void SeriesData::split(Chunks::iterator c)
+{
+    Chunk& chunk = c->second;
+
+    // Split near the middle, between samples at different times, as the
+    // second half is known by the time of its first sample.
+    size_t mid = chunk.t.size() / 2;
+    size_t i = mid;
+    while (i < chunk.t.size() && chunk.t[i] == chunk.t[i - 1])
+	++i;
+    if (i == chunk.t.size()) {
+	for (i = mid; i > 0 && chunk.t[i] == chunk.t[i - 1]; --i)
+	    ;
+	if (i == 0)
+	    return; // all at the same time, let it grow
+    }
+    if (chunks.find(chunk.t[i]) != chunks.end())
+	return; // the next chunk starts at the same time
+
+    Chunk& second = chunks.insert(c, std::make_pair(chunk.t[i], Chunk()))->second;
+    second.t.assign(chunk.t.begin() + i, chunk.t.end());
+    second.v.assign(chunk.v.begin() + i, chunk.v.end());
+    second.summarized = false;
+    chunk.t.erase(chunk.t.begin() + i, chunk.t.end());
+    chunk.v.erase(chunk.v.begin() + i, chunk.v.end());
+    chunk.summarized = false;
+}
+
+size_t SeriesData::decimate(double t0, double t1, size_t columns, std::vector<double>& x, std::vector<double>& y) const
+{
+    if (chunks.empty() || !columns || !(t1 > t0))
+	return 0;
+    size_t before = x.size();
+
+    // Find the first sample at or after t0.
+    Chunks::const_iterator c = chunks.upper_bound(t0);
+    if (c != chunks.begin())
+	--c;
+    size_t i = std::lower_bound(c->second.t.begin(), c->second.t.end(), t0) - c->second.t.begin();
+
+    // The line comes in from the sample before.
+    if (i > 0)
+	x.push_back(c->second.t[i - 1]), y.push_back(c->second.v[i - 1]);
+    else if (c != chunks.begin()) {
+	Chunks::const_iterator p = c;
+	--p;
+	x.push_back(p->second.t.back()), y.push_back(p->second.v.back());
+    }
+
+    double width = (t1 - t0) / columns;
+    for (size_t col = 0; col < columns; ++col) {
+	bool last = col + 1 == columns;
+	double end = last ? t1 : t0 + (col + 1) * width;
+	Column column;
+	while (c != chunks.end()) {
+	    const Chunk& chunk = c->second;
+	    if (i >= chunk.t.size()) {
+		++c, i = 0;
+		continue;
+	    }
+	    if (!inColumn(chunk.t[i], end, last))
+		break;
+	    if (i == 0 && chunk.t.size() > 4 && inColumn(chunk.t.back(), end, last)) {
+		// the whole chunk is in this column
+		chunk.summarize();
+		column.add(chunk.all, chunk.t.front(), chunk.v.front(), chunk.t.back(), chunk.v.back(), chunk.t.size());
+		++c, i = 0;
+	    } else if (i % BlockSize == 0 && i + BlockSize <= chunk.t.size() && inColumn(chunk.t[i + BlockSize - 1], end, last)) {
+		// a whole block is
+		chunk.summarize();
+		column.add(chunk.blocks[i / BlockSize], chunk.t[i], chunk.v[i],
+			chunk.t[i + BlockSize - 1], chunk.v[i + BlockSize - 1], BlockSize);
+		i += BlockSize;
+	    } else {
+		column.add(chunk.t[i], chunk.v[i]);
+		++i;
+	    }
+	}
+	column.emit(x, y);
+    }
+
+    // And goes out to the sample after.
+    while (c != chunks.end() && i >= c->second.t.size())
+	++c, i = 0;
+    if (c != chunks.end())
+	x.push_back(c->second.t[i]), y.push_back(c->second.v[i]);
+
+    return x.size() - before;
+}
+
+} // namespace
+} // namespace
+
+// vim:sw=4
@@ -0,0 +1,114 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DATAWATCHER_SERIES_DATA_H
+#define DATAWATCHER_SERIES_DATA_H
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+namespace watcher {
+namespace ui {
+
+/** The samples of one node's data series, in time order, for plotting.
+ *
+ * Samples are kept in chunks of a few hundred, each holding a time column
+ * and a value column.  The chunks are kept in a map by their first time, so
+ * a sample which arrives out of order is found a place in O(log n), and
+ * only its chunk is shifted to make room.  A full chunk is split in two.
+ *
+ * Memory is bounded: once there are more than maxPoints samples, the
+ * oldest chunk is dropped, as in a ring buffer.
+ *
+ * For plotting, decimate() reduces the samples in a time range to at most
+ * four per pixel column: the first, smallest, largest and last in it,
+ * which draws the same picture as every sample would.  Each chunk keeps
+ * the minimum and maximum of each block of its samples, so a column
+ * covering many samples is summed up from the blocks (and whole chunks)
+ * in it, and the cost is in the number of columns, not samples.
+ */
+class SeriesData {
+    public:
+	/**
+	 * @param maxPoints the most samples to keep
+	 * @param chunkSize samples in a chunk before it is split
+	 */
+	explicit SeriesData(size_t maxPoints = 1 << 20, size_t chunkSize = 512);
+
+	/** Add a sample. Samples at the same time are kept in the order added. */
+	void add(double t, double v);
+
+	/** Forget all the samples. */
+	void clear();
+
+	/** Number of samples kept. */
+	size_t size() const { return count; }
+
+	/** Number of samples dropped to stay under maxPoints. */
+	unsigned long dropped() const { return numDropped; }
+
+	/**
+	 * Get the samples to plot for times t0 to t1 across the given number of
+	 * pixel columns. The points, in time order, are appended to x and y. The
+	 * sample just before t0 and the one just after t1 are included so the line
+	 * runs off the edges of the plot.
+	 * @return the number of points appended
+	 */
+	size_t decimate(double t0, double t1, size_t columns, std::vector<double>& x, std::vector<double>& y) const;
+
+    private:
+	struct Extremes {
+	    double minT, minV;
+	    double maxT, maxV;
+	    void reset(double t, double v) { minT = maxT = t; minV = maxV = v; }
+	    void add(double t, double v) {
+		if (v < minV) minT = t, minV = v;
+		if (v > maxV) maxT = t, maxV = v;
+	    }
+	    void add(const Extremes& e) { add(e.minT, e.minV); add(e.maxT, e.maxV); }
+	};
+
+	struct Chunk {
+	    Chunk() : summarized(false) { }
+	    std::vector<double> t, v;
+	    mutable std::vector<Extremes> blocks; // of each BlockSize samples
+	    mutable Extremes all;
+	    mutable bool summarized; // are blocks and all up to date?
+	    void summarize() const;
+	};
+	typedef std::map<double, Chunk> Chunks; // by the time of their first sample
+
+	/** One pixel column's worth of samples, as decimate() goes along. */
+	struct Column;
+
+	void split(Chunks::iterator c);
+
+	Chunks chunks;
+	size_t count;
+	size_t maxPoints;
+	size_t chunkSize;
+	unsigned long numDropped;
+};
+
+} // namespace
+} // namespace
+
+#endif // DATAWATCHER_SERIES_DATA_H
+
+// vim:sw=4
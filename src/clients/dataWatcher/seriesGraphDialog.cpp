@@ -16,6 +16,7 @@
  *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <cstdlib>
 #include <tr1/memory>
 
@@ -29,6 +30,7 @@
 #include <libwatcher/watcherTypes.h>
 
 #include "seriesGraphDialog.h"
+#include "seriesData.h"
 
 namespace watcher {
 namespace ui {
@@ -60,8 +62,18 @@ INIT_LOGGER(SeriesGraphDialog, "SeriesGraphDialog");
 /** Contains information for each node in the dialog. */
 class NodeInfo {
     QString id;
-    std::vector<double> xdata;
-    std::vector<double> ydata;
+    SeriesData data;
+
+    /** What a curve is showing: data decimated to the plot's range and width. */
+    struct CurveData {
+	std::vector<double> x, y;
+	double begin, end;
+	int width;
+	CurveData() : begin(0), end(0), width(0) { }
+    };
+    CurveData detailData;
+    CurveData globalData;
+    bool changed; // data since the curves were last set
 
     //QwtPlotCurve is not a QObject, so QPointer is not an option.
     std::tr1::shared_ptr<QwtPlotCurve> detailCurve;
@@ -74,7 +86,7 @@ class NodeInfo {
 
     public:
 
-    NodeInfo(const QString& id_, QwtPlot *detailPlot, QwtPlot *globalPlot) : id(id_), attached(false) {
+    NodeInfo(const QString& id_, QwtPlot *detailPlot, QwtPlot *globalPlot) : id(id_), changed(false), attached(false) {
 	QPen pen(QColor(random() % 256, random() % 256, random() % 256));
 
 	detailCurve.reset(new QwtPlotCurve(id_));
@@ -91,15 +103,30 @@ class NodeInfo {
     void data_point(qlonglong when, double value) {
 	/* the x-axis (time) is number of seconds elapsed since the first event in the stream */
 	double t = (double)(when - EpochTS) / 1000.0;
-	if (xdata.size() && t <= xdata[0]) {
-	    xdata.insert(xdata.begin(), t);
-	    ydata.insert(ydata.begin(), value);
-	} else {
-	    xdata.push_back(t);
-	    ydata.push_back(value);
-	}
-	detailCurve->setRawData(&xdata[0], &ydata[0], xdata.size());
-	globalCurve->setRawData(&xdata[0], &ydata[0], xdata.size());
+	data.add(t, value);
+	changed = true;
+    }
+
+    /** Point the curves at the data between begin and end, at most a few points per pixel. 
+     * Does nothing if neither the data nor the plots have changed since last time.
+     */
+    void updateCurves(double detailBegin, double detailEnd, int detailWidth, double globalBegin, double globalEnd, int globalWidth) {
+	updateCurve(*detailCurve, detailData, detailBegin, detailEnd, detailWidth);
+	updateCurve(*globalCurve, globalData, globalBegin, globalEnd, globalWidth);
+	changed = false;
+    }
+
+    void updateCurve(QwtPlotCurve& curve, CurveData& d, double begin, double end, int width) {
+	if (!changed && begin == d.begin && end == d.end && width == d.width)
+	    return;
+	d.begin = begin, d.end = end, d.width = width;
+	d.x.clear();
+	d.y.clear();
+	data.decimate(begin, end, std::max(width, 1), d.x, d.y);
+	if (d.x.empty())
+	    curve.setRawData(0, 0, 0);
+	else
+	    curve.setRawData(&d.x[0], &d.y[0], d.x.size());
     }
 
     void attachPlot(QwtPlot *detailPlot, QwtPlot *globalPlot) {
@@ -120,10 +147,11 @@ class NodeInfo {
 
     QListWidgetItem* getItem() { return item; }
     QString& getId() { return id; }
+    bool isAttached() const { return attached; }
 
 }; // NodeInfo
 
-SeriesGraphDialog::SeriesGraphDialog(const QString& name) : firstEvent(-1), lastEvent(0), detailBegin(0), detailEnd(0)
+SeriesGraphDialog::SeriesGraphDialog(const QString& name_) : name(name_), firstEvent(-1), lastEvent(0), globalMax(MaxTS), detailBegin(0), detailEnd(0)
 {
     TRACE_ENTER();
 
@@ -224,6 +252,13 @@ void SeriesGraphDialog::dataPoint(const QString& fromID, qlonglong when, double
 	    // automatically select new nodes
 	    int row = listWidget->row(nodeInfo->getItem());
 	    listWidget->setCurrentRow(row, QItemSelectionModel::SelectCurrent);
+
+	    // ask watcherd for what the node sent before the stream got here,
+	    // summarized to about one bucket per pixel of the global plot
+	    if (when > EpochTS) {
+		qlonglong resolution = (when - EpochTS) / std::max(globalPlot->canvas()->width(), 1);
+		emit requestHistory(name, fromID, EpochTS, when - 1, std::max(resolution, 1000LL));
+	    }
 	} else {
 	    nodeInfo = it->second;
 	}
@@ -253,6 +288,31 @@ void SeriesGraphDialog::dataPoint(const QString& fromID, qlonglong when, double
     TRACE_EXIT();
 }
 
+/** Add a node's history from watcherd.
+ * @param fromID id of the node
+ * @param buckets the summary buckets, in time order
+ */
+void SeriesGraphDialog::history(const QString& fromID, const watcher::event::DataSeriesMessage::BucketList& buckets)
+{
+    TRACE_ENTER();
+    NodeMap::iterator it = nodeMap.find(fromID);
+    if (it != nodeMap.end() && !buckets.empty()) {
+	for (watcher::event::DataSeriesMessage::BucketList::const_iterator b = buckets.begin(); b != buckets.end(); ++b) {
+	    it->second->data_point(b->time, b->min);
+	    if (b->max != b->min)
+		it->second->data_point(b->time, b->max);
+	}
+	if (buckets.front().time < firstEvent) {
+	    firstEvent = buckets.front().time;
+	    double start = tsToOffset(firstEvent);
+	    beginSlider->setMinimum(start);
+	    endSlider->setMinimum(start);
+	}
+	replot();
+    }
+    TRACE_EXIT();
+}
+
 /** Updates the current time and redraws the plot.
  * @param t timestamp to use as the current time.
  */
@@ -336,6 +396,16 @@ void SeriesGraphDialog::selectionChanged()
 void SeriesGraphDialog::replot()
 {
     TRACE_ENTER();
+
+    // The detail graph shows everything until it has been given a range.
+    double globalBegin = 0, globalEnd = tsToOffset(globalMax);
+    double begin = globalBegin, end = globalEnd;
+    if (detailEnd > detailBegin)
+	begin = detailBegin, end = detailEnd;
+    for (NodeMap::iterator it = nodeMap.begin(); it != nodeMap.end(); ++it)
+	if (it->second->isAttached())
+	    it->second->updateCurves(begin, end, detailPlot->canvas()->width(), globalBegin, globalEnd, globalPlot->canvas()->width());
+
     detailPlot->replot();
     globalPlot->replot();
     TRACE_EXIT();
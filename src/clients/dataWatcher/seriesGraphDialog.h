@@ -19,6 +19,7 @@
 #include <tr1/memory>
 
 #include <libwatcher/watcherTypes.h>
+#include <libwatcher/dataSeriesMessage.h>
 #include <declareLogger.h>
 
 #include "ui_graph.h"
@@ -55,6 +56,7 @@ class SeriesGraphDialog : public QWidget, Ui::Form {
 	std::tr1::shared_ptr<QwtPlotPicker> detailPicker;
 	std::tr1::shared_ptr<QwtPlotPicker> globalPicker;
 	
+	QString name; // of the data series
 	Timestamp firstEvent; // lowest timestamp received
 	Timestamp lastEvent; // highest timestamp received
 	Timestamp globalMax; // upper time bound in the global graph
@@ -65,6 +67,7 @@ class SeriesGraphDialog : public QWidget, Ui::Form {
 	explicit SeriesGraphDialog(const QString&);
 	~SeriesGraphDialog();
 	void dataPoint(const QString&, qlonglong, double);
+	void history(const QString&, const watcher::event::DataSeriesMessage::BucketList&);
 
     public slots:
 	void handleClock(qlonglong);
@@ -75,6 +78,7 @@ class SeriesGraphDialog : public QWidget, Ui::Form {
 	
     signals:
 	void seekStream(qlonglong);
+	void requestHistory(const QString& dataName, const QString& fromID, qlonglong begin, qlonglong end, qlonglong resolution);
 };
 
 } // namespace
@@ -18,6 +18,7 @@
 
 #include <libwatcher/messageStream.h>
 #include <libwatcher/dataPointMessage.h>
+#include <libwatcher/dataSeriesMessage.h>
 #include <libwatcher/playbackTimeRange.h>
 #include <libwatcher/speedWatcherMessage.h>
 #include <libwatcher/seekWatcherMessage.h>
@@ -68,6 +69,8 @@ void MainWindow::dataPointHandler(const QString& dataName, const QString& fromID
 	menuSeries->addAction(dataName, series, SLOT(show()));
 	QObject::connect(this, SIGNAL(clockTick(qlonglong)), series, SLOT(handleClock(qlonglong)));
 	QObject::connect(series, SIGNAL(seekStream(qlonglong)), this, SLOT(seekStream(qlonglong)));
+	QObject::connect(series, SIGNAL(requestHistory(const QString&, const QString&, qlonglong, qlonglong, qlonglong)),
+		this, SLOT(requestHistory(const QString&, const QString&, qlonglong, qlonglong, qlonglong)));
     } else {
 	series = it->second;
     }
@@ -76,6 +79,28 @@ void MainWindow::dataPointHandler(const QString& dataName, const QString& fromID
     TRACE_EXIT();
 }
 
+void MainWindow::historyHandler(const watcher::event::DataSeriesMessagePtr& series)
+{
+    TRACE_ENTER();
+    SeriesMap::iterator it = seriesMap.find(QString::fromStdString(series->dataName));
+    if (it != seriesMap.end())
+	it->second->history(QString::fromStdString(series->node.to_string()), series->buckets);
+    TRACE_EXIT();
+}
+
+/** Slot for asking watcherd for the summary of a node's data series. */
+void MainWindow::requestHistory(const QString& dataName, const QString& fromID, qlonglong begin, qlonglong end, qlonglong resolution)
+{
+    TRACE_ENTER();
+    if (MsgStream && MsgStream->connected()) {
+	LOG_INFO("requesting " << dataName.toStdString() << " history of " << fromID.toStdString());
+	DataSeriesMessagePtr m(new DataSeriesMessage(NodeIdentifier::from_string(fromID.toStdString()),
+		    dataName.toStdString(), begin, end, resolution));
+	MsgStream->requestDataSeries(m);
+    }
+    TRACE_EXIT();
+}
+
 void MainWindow::checkIO()
 {
     TRACE_ENTER();
@@ -93,7 +118,7 @@ void MainWindow::checkIO()
     // We only care about data point (and (some) control) messages. 
     MsgStream->enableFiltering(true); 
     MessageStreamFilterPtr f(new MessageStreamFilter); 
-    unsigned int ourMessageTypes[] = { DATA_POINT_MESSAGE_TYPE, PLAYBACK_TIME_RANGE_MESSAGE_TYPE, 
+    unsigned int ourMessageTypes[] = { DATA_POINT_MESSAGE_TYPE, DATA_SERIES_MESSAGE_TYPE, PLAYBACK_TIME_RANGE_MESSAGE_TYPE, 
         SPEED_MESSAGE_TYPE, SEEK_MESSAGE_TYPE, LIST_STREAMS_MESSAGE_TYPE }; 
     for (size_t t=0; t<(sizeof(ourMessageTypes)/sizeof(ourMessageTypes[0])); t++) 
         f->addMessageType(ourMessageTypes[t]); 
@@ -117,6 +142,10 @@ void MainWindow::checkIO()
 	    emit dataPointReceived(QString::fromStdString(dp->dataName),
 		    QString::fromStdString(dp->fromNodeID.to_string()),
 		    layer, dp->timestamp, dp->dataPoints.front());
+	} else if (msg->type == DATA_SERIES_MESSAGE_TYPE) {
+	    watcher::event::DataSeriesMessagePtr ds = boost::dynamic_pointer_cast<DataSeriesMessage>(msg);
+	    LOG_DEBUG("got " << ds->buckets.size() << " buckets of " << ds->dataName);
+	    emit historyReceived(ds);
 	} else if (msg->type == PLAYBACK_TIME_RANGE_MESSAGE_TYPE) {
 	    LOG_DEBUG("got playback time range");
 	    watcher::event::PlaybackTimeRangeMessagePtr m = boost::dynamic_pointer_cast<PlaybackTimeRangeMessage>(msg);
@@ -152,6 +181,12 @@ void MainWindow::setup()
        	this,
 	SLOT(dataPointHandler(const QString& , const QString& , const QString& , qlonglong , double )));
 
+    qRegisterMetaType<watcher::event::DataSeriesMessagePtr>("watcher::event::DataSeriesMessagePtr");
+    QObject::connect(this,
+	SIGNAL(historyReceived(const watcher::event::DataSeriesMessagePtr&)),
+	this,
+	SLOT(historyHandler(const watcher::event::DataSeriesMessagePtr&)));
+
     QObject::connect(actionChange_Stream, SIGNAL(triggered()), this, SLOT(listStreams()));
 
     LOG_INFO("spawning checkIO thread");
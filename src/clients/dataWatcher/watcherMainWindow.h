@@ -18,11 +18,16 @@
 
 #include <map>
 #include <boost/thread.hpp>
+#include <QMetaType>
 
 #include "declareLogger.h"
+#include <libwatcher/dataSeriesMessage.h>
 
 #include "ui_mainwindow.h"
 
+// passed from the checkIO thread to the GUI thread by historyReceived()
+Q_DECLARE_METATYPE(watcher::event::DataSeriesMessagePtr)
+
 namespace watcher {
 namespace ui {
 
@@ -49,10 +54,13 @@ class MainWindow : public QMainWindow, public Ui::MainWindow {
 
     signals:
 	void dataPointReceived(const QString& dataName, const QString& fromID, const QString& layer, qlonglong when, double value);
+	void historyReceived(const watcher::event::DataSeriesMessagePtr& series);
 	void clockTick(qlonglong);
 
     public slots:
 	void dataPointHandler(const QString& dataName, const QString& fromID, const QString& layer, qlonglong when, double value);
+	void historyHandler(const watcher::event::DataSeriesMessagePtr& series);
+	void requestHistory(const QString& dataName, const QString& fromID, qlonglong begin, qlonglong end, qlonglong resolution);
         void listStreams();
 	void reconnect();
         void seekStream(qlonglong);
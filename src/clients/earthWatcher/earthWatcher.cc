@@ -48,6 +48,7 @@ using namespace watcher;
 
 namespace earthwatcher {
     void write_kml(const WatcherGraph& graph, const std::string& outputFile); // kml.cc
+    void reset_kml(); // kml.cc
 
     float LayerPadding = 10;
     float Lonoff = 0.0;
@@ -57,6 +58,9 @@ namespace earthwatcher {
     int SplineSteps = 2;
     bool autoRewind = false;
     std::string IconPath ( "placemark_circle.png") ;
+    unsigned int Refresh = 1; // seconds between writes of the output
+    bool IncrementalKml = false; // write a snapshot and NetworkLinkControl updates instead of one file
+    int SnapshotInterval = 60; // seconds between snapshots in incremental mode
 }
 
 using namespace earthwatcher;
@@ -80,6 +84,7 @@ const option OPTIONS[] = {
     { "icon-scale", required_argument, 0, 'i' },
     { "icon-path", required_argument, 0, 'I' },
     { "join", required_argument, 0, 'j' },
+    { "incremental", no_argument, 0, 'u' },
     { 0, 0, 0, 0 }
 };
 
@@ -87,7 +92,7 @@ const char *CONFIG_FILE = TOOL_NAME ".cfg";
 const char *OUTPUT_FILE = "watcher.kml";
 const char *PROPERTY_FILE = TOOL_NAME ".log.properties";
 const char *DEFAULT_HOST = "127.0.0.1";
-const unsigned int DEFAULT_REFRESH = 1; // SECONDS
+const time_t CONFIG_CHECK_INTERVAL = 5; // seconds between checks for changes to the config file
 uint32_t StreamUID = -1;
 uint32_t maxNodes = 0; 
 uint32_t maxLayers = 0; 
@@ -111,12 +116,14 @@ void usage()
         "  -n, --maxNodes=NUM" << SEP << "maximum number of nodes used in the test run\n"
         "  -o, --output FILE" << SEP << "specifies the output KML file (default: " << OUTPUT_FILE << ")\n"
         "  -O, --lonoff OFF" << SEP << "translate GPS coordinates relative to a given longitude\n"
-        "  -r, --refresh SECS" << SEP << "write the the output every SECS seconds (default: " << DEFAULT_REFRESH << ")\n"
+        "  -r, --refresh SECS" << SEP << "write the the output every SECS seconds (default: " << Refresh << ")\n"
         "  -s, --server HOST" << SEP << "connect to the watcher server on the given host (default: " << DEFAULT_HOST << ")\n"
         "  -S, --seek POS" << SEP << "start event playback at timestamp POS (default: -1)\n"
         "\tPOS may be specified relative to the first and last timestamps in the Watcher database by prefixing the offset with + or -\n"
         "\tExample: +5000 means 5 seconds after the first event in the database.\n"
         "  -t, --steps NUM" << SEP << "number of points to use when drawing a spline (default: " << SplineSteps << ")\n"
+        "  -u, --incremental" << SEP << "make the output file a loader for a snapshot, rewritten every snapshotInterval\n"
+        "\t\t\t\tseconds (default: " << SnapshotInterval << "), and NetworkLinkControl updates to it\n"
         << std::endl;
 }
 
@@ -138,7 +145,6 @@ std::string Service("watcherd");
 std::string ConfigFilename; //filled by initConfig()
 std::string OutputFile(OUTPUT_FILE);
 Timestamp StartTimestamp = -1 ; // default to EOF (live playback)
-unsigned int Refresh = DEFAULT_REFRESH;
 float Speed = 1.0;
 bool RelativeTS = false; // when true, start_timestamp is relative to first or last event in the Watcher DB
 std::string Description(DEFAULT_DESCRIPTION); // what this client calls itself
@@ -176,11 +182,12 @@ void *process_events(void *)
     bool needTimeRange = RelativeTS;
 
     watcher::Timestamp currentMessageTimestamp; 
-    watcher::Timestamp playbackRangeEnd; 
+    watcher::Timestamp playbackRangeEnd = 0; 
 
     const char *cfname = ConfigFilename.c_str();
     struct stat sb;
     time_t cftime;      // time at which config file was last modified
+    time_t cfchecked = time(0); // time at which config file was last checked for changes
     if (stat(cfname, &sb) == -1) {
         LOG_ERROR("stat: " << strerror(errno));
         exit( EXIT_FAILURE );
@@ -190,12 +197,13 @@ void *process_events(void *)
     LOG_INFO("Waiting for events ");
     while (ms->getNextMessage(mp)) {
 
-        if (needTimeRange) {
-            PlaybackTimeRangeMessagePtr trp(boost::dynamic_pointer_cast<PlaybackTimeRangeMessage>(mp));
-            if (trp.get() != 0) {
+        // watcherd sends the range again each time the database grows
+        PlaybackTimeRangeMessagePtr trp(boost::dynamic_pointer_cast<PlaybackTimeRangeMessage>(mp));
+        if (trp.get() != 0) {
+            playbackRangeEnd = trp->max_;
+            if (needTimeRange) {
                 LOG_INFO( "first offset=" << trp->min_ << ", last offset=" << trp->max_ );
                 needTimeRange = false;
-                playbackRangeEnd = trp->max_;
                 currentMessageTimestamp=trp->min_;
 
                 Timestamp off = StartTimestamp + ((StartTimestamp >= 0 ) ? trp->min_ : trp->max_ );
@@ -203,8 +211,8 @@ void *process_events(void *)
 
                 LOG_INFO("Starting event playback at time " << off);
                 ms->startStream(); 
-                continue;
             }
+            continue;
         }
 
         changed |= graph.updateGraph(mp);
@@ -213,16 +221,20 @@ void *process_events(void *)
             time_t now = time(0);
             if (now - last_output >= Refresh) {
                 // reload config file if changed
-                if (stat(cfname, &sb) == -1) {
-                    LOG_ERROR( "stat: " << strerror(errno) );
-                    exit( EXIT_FAILURE) ;
-                }
-                if (sb.st_mtime > cftime) {
-                    cftime = sb.st_mtime;
-                    LOG_INFO("reloading configuration file");
-                    SingletonConfig::lock();
-                    SingletonConfig::instance().readFile(cfname);
-                    SingletonConfig::unlock();
+                if (now - cfchecked >= CONFIG_CHECK_INTERVAL) {
+                    cfchecked = now;
+                    if (stat(cfname, &sb) == -1) {
+                        LOG_ERROR( "stat: " << strerror(errno) );
+                        exit( EXIT_FAILURE) ;
+                    }
+                    if (sb.st_mtime > cftime) {
+                        cftime = sb.st_mtime;
+                        LOG_INFO("reloading configuration file");
+                        SingletonConfig::lock();
+                        SingletonConfig::instance().readFile(cfname);
+                        SingletonConfig::unlock();
+                        reset_kml(); // layers may have been hidden or shown
+                    }
                 }
 
                 graph.doMaintanence(); // expire stale links
@@ -273,10 +285,11 @@ int main(int argc, char **argv)
         argDescription = (1<<9),
         argMaxNodes = (1<<0xa),
         argMaxLayers = (1<<0xb),
+        argIncremental = (1<<0xc),
 
     };
 
-    for (int i; (i = getopt_long(argc, argv, "a:A:hi:j:I:c:d:D:l:n:o:O:r:s:S:t:", OPTIONS, 0)) != -1; ) {
+    for (int i; (i = getopt_long(argc, argv, "a:A:hi:j:I:c:d:D:l:n:o:O:r:s:S:t:u", OPTIONS, 0)) != -1; ) {
         switch (i) {
             case 'c':
                 break; //handled by initConfig()
@@ -358,6 +371,11 @@ int main(int argc, char **argv)
                 args |= argSplineSteps;
                 break;
 
+            case 'u':
+                IncrementalKml = true;
+                args |= argIncremental;
+                break;
+
             case 'h':
             default:
                 usage();
@@ -438,6 +456,7 @@ int main(int argc, char **argv)
         { "splineSteps", &SplineSteps, argSplineSteps },
         { "maxNodes", (int*)&maxNodes, argMaxNodes },
         { "maxLayers", (int*)&maxLayers, argMaxLayers },
+        { "snapshotInterval", &SnapshotInterval, 0 },
         { 0, 0, 0 } // terminator
     };
 
@@ -461,6 +480,7 @@ int main(int argc, char **argv)
         unsigned int bit;
     } ConfigBool[] = {
         { "autorewind", &autoRewind, false },
+        { "incrementalKml", &IncrementalKml, argIncremental },
         { 0, 0, 0 } // terminator
     };
 
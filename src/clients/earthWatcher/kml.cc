@@ -1,4 +1,4 @@
-/* Copyright 2009 SPARTA, Inc., dba Cobham Analytic Solutions
+/* Copyright 2009,2010 SPARTA, Inc., dba Cobham Analytic Solutions
  * 
  * This file is part of WATCHER.
  * 
@@ -19,6 +19,23 @@
 /* 
  * Use Google's libkml to out a KML file based upon the current network topology.
  * @author michael.elkins@cobham.com
+ *
+ * Each placemark is serialized on its own and kept along with the values it
+ * was made from, so a write only regenerates the placemarks whose node, edge
+ * or label changed; the file itself is streamed out from the cached pieces.
+ *
+ * In incremental mode the output file is a small loader with two
+ * NetworkLinks: one to a full snapshot, rewritten every SnapshotInterval
+ * seconds, and one to an update file, rewritten every write, holding a
+ * NetworkLinkControl <Update>.  Google Earth then only re-reads the whole
+ * document once a snapshot interval, however often the update file is
+ * polled.  As the two links are polled independently, Google Earth may hold
+ * the latest snapshot or the one before it, and may skip updates or apply
+ * one several times, so each update covers everything that changed since
+ * the snapshot before last.  A placemark in both of those snapshots is
+ * brought up to date with a <Change>, which sets every value outright and so
+ * may be applied twice.  One which may be missing from them is deleted and
+ * created again, as is the folder of a layer which may be missing.
  */
 
 // libkml
@@ -31,22 +48,26 @@
 
 #include "initConfig.h"
 #include "singletonConfig.h"
-
-#include <list>
+#include "logger.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <vector>
 
 #include <boost/lexical_cast.hpp>
 #include <boost/foreach.hpp>
 
-using kmldom::ChangePtr;
-using kmldom::CreatePtr;
 using kmldom::CoordinatesPtr;
-using kmldom::DocumentPtr;
-using kmldom::FeaturePtr;
-using kmldom::FolderPtr;
 using kmldom::IconStyleIconPtr;
 using kmldom::IconStylePtr;
 using kmldom::KmlFactory;
-using kmldom::KmlPtr;
 using kmldom::LabelStylePtr;
 using kmldom::LineStringPtr;
 using kmldom::LineStylePtr;
@@ -54,9 +75,8 @@ using kmldom::MultiGeometryPtr;
 using kmldom::PlacemarkPtr;
 using kmldom::PointPtr;
 using kmldom::StylePtr;
-using kmldom::UpdatePtr;
-using kmlengine::KmlFile;
-using kmlengine::KmlFilePtr;
+
+DECLARE_GLOBAL_LOGGER("earthWatcher");
 
 namespace earthwatcher {
     // set from config file
@@ -67,6 +87,9 @@ namespace earthwatcher {
     extern int SplineSteps;
     extern float IconScale;
     extern std::string IconPath;
+    extern bool IncrementalKml;
+    extern int SnapshotInterval;
+    extern unsigned int Refresh;
 }
 
 using namespace watcher;
@@ -75,100 +98,178 @@ using namespace earthwatcher;
 namespace {
 
 const std::string BASE_ICON_URL = "http://maps.google.com/mapfiles/kml/shapes/";
+const char *DOCUMENT_ID = "watcher-doc";
+
+/*
+ * Convert a watcher color to the KML format.
+ */
+std::string watcher_color_to_kml(const watcher::Color& color)
+{
+    char buf[sizeof("aabbggrr")];
+    sprintf(buf, "%02x%02x%02x%02x", color.a, color.b, color.g, color.r);
+    return std::string(buf);
+}
+
+std::string xml_escape(const std::string& s)
+{
+    std::string out;
+    out.reserve(s.size());
+    BOOST_FOREACH(char c, s) {
+        switch (c) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            default: out += c; break;
+        }
+    }
+    return out;
+}
+
+bool ends_with(const std::string& s, const std::string& suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::string base_name(const std::string& path)
+{
+    std::string::size_type slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
 
-// template to get the number of items in an array
-template <typename T, int N> size_t sizeof_array( T (&)[N] ) { return N; }
+/*
+ * Write a file through a temporary in the same directory and rename it into
+ * place, so that Google Earth never reads one half written.
+ */
+class AtomicFile {
+    public:
+        AtomicFile(const std::string& p) : path(p), tmp(p + ".tmp"), os(tmp.c_str()) {}
+
+        bool commit()
+        {
+            os.close();
+            if (!os) {
+                LOG_ERROR("unable to write " << tmp);
+                unlink(tmp.c_str());
+                return false;
+            }
+            if (rename(tmp.c_str(), path.c_str()) == -1) {
+                LOG_ERROR("rename " << tmp << " to " << path << ": " << strerror(errno));
+                unlink(tmp.c_str());
+                return false;
+            }
+            return true;
+        }
+
+        const std::string path;
+        const std::string tmp;
+        std::ofstream os;
+};
+
+/*
+ * Write a KMZ archive holding the given KML, again renaming it into place.
+ */
+bool write_kmz(const std::string& path, const std::string& kml)
+{
+    std::string tmp(path + ".tmp");
+    if (!kmlengine::KmzFile::WriteKmz(tmp.c_str(), kml) || rename(tmp.c_str(), path.c_str()) == -1) {
+        LOG_ERROR("unable to write " << path);
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+/*
+ * A placemark or style already serialized to KML, and the values it was
+ * generated from.  As long as the values stay the same the XML is reused.
+ */
+struct Feature {
+    std::string values;
+    std::string xml;
+    std::string change; // <Change> children giving an existing placemark these values
+    bool seen;  // still in the graph as of the current write
+    unsigned int created;   // snapshots written before it was first output
+    unsigned int changed;   // snapshots written before it last changed
+    Feature() : seen(false), created(0), changed(0) {}
+};
+typedef std::map<std::string, Feature> FeatureMap;
 
 struct LayerInfo {
+    std::string id; // KML id of the folder for this layer
     float zpad; // alt padding value to order layers vertically
-    FolderPtr folder; // folder for this layer
     bool visible; // control whether this layer is output to the KML file
-    LayerInfo(float zp, FolderPtr p, bool v) : zpad(zp), folder(p), visible(v) {}
-    LayerInfo() : zpad(0.0), visible(true) {}  // required for use in std::map
+    unsigned int created; // snapshots written before the layer appeared
+    FeatureMap features;
+    LayerInfo(const std::string& i, float zp, bool v, unsigned int c) : id(i), zpad(zp), visible(v), created(c) {}
+    LayerInfo() : zpad(0.0), visible(true), created(0) {}  // required for use in std::map
 };
 
 typedef std::map<GUILayer, LayerInfo> LayerMap;
 typedef LayerMap::iterator LayerMapIterator;
 
-struct DefinedLabelStyle {
-    std::string id;
-    watcher::Color color;
-    DefinedLabelStyle(const watcher::Color& col, const std::string& name) : id(name), color(col) {}
-};
-
-typedef boost::shared_ptr<DefinedLabelStyle> DefinedLabelStylePtr;
-typedef std::list<DefinedLabelStylePtr> DefinedLabelStyleList;
-
-class Render {
+class KmlWriter {
     public:
-        Render(const WatcherGraph&);
-        KmlPtr kml;
-        void start();
+        KmlWriter();
+        void write(const WatcherGraph& graph, const std::string& outputFile);
+        void reset();
     private:
         KmlFactory *kmlFac;
-        const WatcherGraph& graph;
-        DocumentPtr doc;
-        FolderPtr topFolder;
         LayerMap layerMap;
-        int label_count;
-        DefinedLabelStyleList definedLabelStyles;
+        std::vector<GUILayer> layerOrder; // folders are written in the order the layers were created
+        FeatureMap styles;
+        typedef std::map<std::string, unsigned int> RemovedMap;
+        RemovedMap removed; // ids of dropped placemarks, and snapshots written before they went
         float zpad;
+        unsigned int snapshots; // number of snapshots written
+        time_t lastSnapshot; // 0 until the first snapshot after a reset
 
-        const LayerInfo& get_layer(const GUILayer& name, bool visible);
+        LayerInfo& get_layer(const GUILayer& name, bool visible = true);
         void create_layers();
-        void output_nodes();
-        void output_edges();
-        void output_floating_labels();
-        void add_label(const GUILayer& layer, const std::string& label, const watcher::Color& color, const double &lat, const double &lng, const double &alt);
-        void add_label(const LabelDisplayInfo &dispInfo, const double &lat, const double &lng, const double &alt);
-        void add_labels(const WatcherLayerData::NodeLabels &labels, const double &lat, const double &lng, const double &alt);
+        Feature *update(LayerInfo& layer, const std::string& id, const std::string& values);
+        void output_nodes(const WatcherGraph& graph);
+        void output_edges(const WatcherGraph& graph);
+        void output_floating_labels(const WatcherGraph& graph);
+        void add_label(const GUILayer& layer, const std::string& id, const std::string& label, const watcher::Color& color, const double &lat, const double &lng, const double &alt);
         PointPtr create_point(double lat, double lng, double alt);
+        std::string change_placemark(const std::string& id, const std::string& name, const std::string& styleUrl);
+        bool need_style(const std::string& id);
+        void add_style(const StylePtr& style);
         std::string get_label_style(const watcher::Color&);
-        std::string get_edge_style(const EdgeDisplayInfo& edge, unsigned int edgenum);
+        std::string get_node_style(const watcher::Color&);
+        std::string get_edge_style(const EdgeDisplayInfo& edge);
+        unsigned int update_since() const;
+        void write_snapshot(std::ostream& os);
+        void write_update(std::ostream& os, const std::string& targetHref);
+        void write_loader(std::ostream& os, const std::string& dataHref, const std::string& updateHref);
 };
 
-/*
- * Convert a watcher color to the KML format.
- */
-std::string watcher_color_to_kml(const watcher::Color& color)
-{
-    char buf[sizeof("aabbggrr")];
-    sprintf(buf, "%02x%02x%02x%02x", color.a, color.b, color.g, color.r);
-    return std::string(buf);
-}
-
-Render::Render(const WatcherGraph& g) :
-    // libkml boilerplate
+KmlWriter::KmlWriter() :
     kmlFac(kmldom::KmlFactory::GetFactory()),
-    graph(g),
-    kml(kmlFac->CreateKml()),
-    doc(kmlFac->CreateDocument()),
-    topFolder(kmlFac->CreateFolder()),
-    label_count(0),
-    zpad(0.0)
+    zpad(0.0),
+    snapshots(0),
+    lastSnapshot(0)
 {
-    /*
-     * create initial DOM tree.  As nodes appear, they get added to the tree. 
-     * As nodes move, we update the position attribute
-     * in the DOM, and regenerate the KML file.
-     */
-    kml->set_feature(doc);
-    topFolder->set_name("Watcher");
-    doc->add_feature(topFolder);
 }
 
-void Render::start()
+/*
+ * Forget everything written so far, so the next write starts over from the
+ * configuration and produces a complete snapshot.
+ */
+void KmlWriter::reset()
 {
-    create_layers();
-    output_nodes();
-    output_edges();
-    output_floating_labels();
+    layerMap.clear();
+    layerOrder.clear();
+    styles.clear();
+    removed.clear();
+    zpad = 0.0;
+    lastSnapshot = 0;
 }
 
 /*
  * Return the KML folder associated with the given layer name.  Creates the layer if it does not already exist.
  */
-const LayerInfo& Render::get_layer(const GUILayer& name, bool visible = true)
+LayerInfo& KmlWriter::get_layer(const GUILayer& name, bool visible)
 {
     LayerMapIterator it = layerMap.find(name);
     if (it == layerMap.end()) {
@@ -176,17 +277,11 @@ const LayerInfo& Render::get_layer(const GUILayer& name, bool visible = true)
          * GE doesn't seem to honor the <visibility> attribute, so avoid
          * creating a folder for this layer if it is not visible.
          */
-        FolderPtr layer;
-        if (visible) {
-            layer = kmlFac->CreateFolder();
-            layer->set_name(name);
-            //layer->set_visibility(visible);
-            topFolder->add_feature(layer);
-            if (!layerMap.empty())
-                zpad += LayerPadding;
-        }
-        layerMap[name] = LayerInfo(zpad, layer, visible);
-        return layerMap[name];
+        if (visible && !layerOrder.empty())
+            zpad += LayerPadding;
+        std::string id("layer-" + boost::lexical_cast<std::string>(layerMap.size()));
+        layerOrder.push_back(name);
+        return layerMap[name] = LayerInfo(id, zpad, visible, snapshots);
     } else
         return it->second;
 }
@@ -196,7 +291,7 @@ const LayerInfo& Render::get_layer(const GUILayer& name, bool visible = true)
  * the stacking order to be fixed between runs.  This also allows layers to be
  * hidden.
  */
-void Render::create_layers()
+void KmlWriter::create_layers()
 {
     libconfig::Config& cfg = SingletonConfig::instance();
     SingletonConfig::lock();
@@ -219,64 +314,138 @@ void Render::create_layers()
 }
 
 /*
- * many labels will probably share the same attributes, so we cache
- * them to make the KML file smaller
-  */
-std::string Render::get_label_style(const watcher::Color& color)
+ * Note that the placemark with the given id is still present, made from the
+ * given values.  Returns the cache entry if its XML needs to be regenerated,
+ * or 0 if the cached XML is still current.
+ */
+Feature *KmlWriter::update(LayerInfo& layer, const std::string& id, const std::string& values)
 {
-    BOOST_FOREACH(DefinedLabelStylePtr lsp, definedLabelStyles) {
-        if (color == lsp->color)
-            return lsp->id;
-    }
-    // not found, create a new style
-
-    // no icon for labels
-    IconStylePtr iconStyle(kmlFac->CreateIconStyle());
-    iconStyle->set_scale(0); // scale to 0 means hide it
-
-    kmldom::LabelStylePtr labelStyle(kmlFac->CreateLabelStyle());
-    labelStyle->set_color(watcher_color_to_kml(color));
-    //TODO: KML doesn't support background colors for placemark labels
+    Feature& f = layer.features[id];
+    f.seen = true;
+    if (f.xml.empty())
+        f.created = snapshots;
+    else if (f.values == values)
+        return 0;
+    f.values = values;
+    f.changed = snapshots;
+    removed.erase(id);
+    return &f;
+}
 
-    std::string url("label-style-" + boost::lexical_cast<std::string>(label_count));
-    ++label_count;
+/*
+ * Styles are named after their attributes, so each is defined once and
+ * shared by every placemark which looks the same.
+ */
+bool KmlWriter::need_style(const std::string& id)
+{
+    return styles.find(id) == styles.end();
+}
 
-    StylePtr style(kmlFac->CreateStyle());
-    style->set_id(url);
-    style->set_iconstyle(iconStyle);
-    style->set_labelstyle(labelStyle);
+void KmlWriter::add_style(const StylePtr& style)
+{
+    Feature& f = styles[style->get_id()];
+    f.xml = kmldom::SerializePretty(style);
+    f.changed = snapshots;
+}
 
-    doc->add_styleselector(style);
+std::string KmlWriter::get_label_style(const watcher::Color& color)
+{
+    std::string id("label-style-" + watcher_color_to_kml(color));
+    if (need_style(id)) {
+        // no icon for labels
+        IconStylePtr iconStyle(kmlFac->CreateIconStyle());
+        iconStyle->set_scale(0); // scale to 0 means hide it
 
-    definedLabelStyles.push_back( DefinedLabelStylePtr(new DefinedLabelStyle(color, url)));
+        kmldom::LabelStylePtr labelStyle(kmlFac->CreateLabelStyle());
+        labelStyle->set_color(watcher_color_to_kml(color));
+        //TODO: KML doesn't support background colors for placemark labels
 
-    return url;
+        StylePtr style(kmlFac->CreateStyle());
+        style->set_id(id);
+        style->set_iconstyle(iconStyle);
+        style->set_labelstyle(labelStyle);
+        add_style(style);
+    }
+    return "#" + id;
 }
 
-void Render::add_label(const GUILayer& layer, const std::string& label, const watcher::Color& color, const double & lat, const double & lng, const double & alt)
+std::string KmlWriter::get_node_style(const watcher::Color& color)
 {
-    const LayerInfo& li (get_layer(layer));
+    std::string id("node-style-" + watcher_color_to_kml(color));
+    if (need_style(id)) {
+        // create style for the icon
+        IconStyleIconPtr icon(kmlFac->CreateIconStyleIcon());
+        std::string url(BASE_ICON_URL + IconPath);
+        icon->set_href(url.c_str());
 
-    if (li.visible) {
-        PlacemarkPtr place(kmlFac->CreatePlacemark());
-        place->set_name(label);
-        place->set_geometry(create_point(lat, lng, alt + li.zpad));
-        place->set_styleurl("#" + get_label_style(color));
+        IconStylePtr iconStyle(kmlFac->CreateIconStyle());
+        iconStyle->set_icon(icon);
+        iconStyle->set_color(watcher_color_to_kml(color));
+        iconStyle->set_scale(IconScale);
+
+        LabelStylePtr labelStyle(kmlFac->CreateLabelStyle());
+        labelStyle->set_scale(0); // hide the label, we use separate placemarks for the labels so they can have their own style
 
-        li.folder->add_feature(place);
+        StylePtr style(kmlFac->CreateStyle());
+        style->set_id(id);
+        style->set_iconstyle(iconStyle);
+        style->set_labelstyle(labelStyle);
+        add_style(style);
     }
+    return "#" + id;
 }
 
-void Render::add_label(const LabelDisplayInfo &dispInfo, const double & lat, const double & lng, const double & alt)
+std::string KmlWriter::get_edge_style(const EdgeDisplayInfo& edge)
 {
-    add_label(dispInfo.layer, dispInfo.labelText, dispInfo.foregroundColor, lat, lng, alt);
+    std::string id("edge-style-" + watcher_color_to_kml(edge.color) + "-" +
+            boost::lexical_cast<std::string>(edge.width) + "-" + watcher_color_to_kml(edge.labelColor));
+    if (edge.label == "none")
+        id += "-nolabel";
+    if (need_style(id)) {
+        LineStylePtr lineStyle(kmlFac->CreateLineStyle());
+        lineStyle->set_color(watcher_color_to_kml(edge.color));
+        lineStyle->set_width(edge.width);
+
+        IconStylePtr iconStyle(kmlFac->CreateIconStyle());
+        iconStyle->set_scale(0); // scale to 0 means hide it
+
+        StylePtr style ( kmlFac->CreateStyle() );
+        style->set_id(id);
+        style->set_linestyle(lineStyle);
+        style->set_iconstyle(iconStyle);
+
+        kmldom::LabelStylePtr labelStyle(kmlFac->CreateLabelStyle());
+        if (edge.label == "none") {
+            labelStyle->set_scale(0); // hide the label
+        }
+        labelStyle->set_color(watcher_color_to_kml(edge.labelColor));
+        style->set_labelstyle(labelStyle);
+        add_style(style);
+    }
+    return "#" + id;
 }
 
-// create a placemark for each label, putting into the appropriate layer
-void Render::add_labels(const WatcherLayerData::NodeLabels &labels, const double &lat, const double &lng, const double &alt)
+void KmlWriter::add_label(const GUILayer& layer, const std::string& id, const std::string& label, const watcher::Color& color, const double & lat, const double & lng, const double & alt)
 {
-    BOOST_FOREACH(const WatcherLayerData::NodeLabels::value_type &dispInfo, labels) {
-        add_label(dispInfo, lat, lng, alt);
+    LayerInfo& li (get_layer(layer));
+
+    if (li.visible) {
+        std::ostringstream values;
+        values << std::setprecision(12) << label << '\n' << watcher_color_to_kml(color) << ' ' << lat << ' ' << lng << ' ' << alt;
+        if (Feature *f = update(li, id, values.str())) {
+            PlacemarkPtr place(kmlFac->CreatePlacemark());
+            place->set_id(id);
+            place->set_name(label);
+            PointPtr point(create_point(lat, lng, alt + li.zpad));
+            point->set_id(id + "-point");
+            place->set_geometry(point);
+            place->set_styleurl(get_label_style(color));
+            f->xml = kmldom::SerializePretty(place);
+
+            point = create_point(lat, lng, alt + li.zpad);
+            point->set_targetid(id + "-point");
+            f->change = change_placemark(id, label, place->get_styleurl()) + kmldom::SerializePretty(point);
+        }
     }
 }
 
@@ -284,7 +453,7 @@ void Render::add_labels(const WatcherLayerData::NodeLabels &labels, const double
  * Point's can not be shared because even though they are marked const, libKML does modify them.
  * Therefore, we must duplicate the points for each Placemark
  */
-PointPtr Render::create_point(double lat, double lng, double alt)
+PointPtr KmlWriter::create_point(double lat, double lng, double alt)
 {
     CoordinatesPtr coords(kmlFac->CreateCoordinates());
     coords->add_latlngalt(lat + Latoff, lng + Lonoff, alt);
@@ -296,18 +465,33 @@ PointPtr Render::create_point(double lat, double lng, double alt)
     return point;
 }
 
-void Render::output_floating_labels()
+/*
+ * The part of a <Change> which sets a placemark's own values.  Its geometry
+ * is changed through the ids of the Points and LineStrings in it.
+ */
+std::string KmlWriter::change_placemark(const std::string& id, const std::string& name, const std::string& styleUrl)
+{
+    PlacemarkPtr place(kmlFac->CreatePlacemark());
+    place->set_targetid(id);
+    place->set_name(name);  // even when empty, so a label which went away goes from the map
+    place->set_styleurl(styleUrl);
+    return kmldom::SerializePretty(place);
+}
+
+void KmlWriter::output_floating_labels(const WatcherGraph& graph)
 {
     for (size_t l=0; l<graph.numValidLayers; l++) 
         if (graph.layers[l].isActive) {
             boost::shared_lock<boost::shared_mutex> readLock(graph.layers[l].floatingLabelsMutex); 
-            if (graph.layers[l].floatingLabels.size())  
-                BOOST_FOREACH(const WatcherLayerData::FloatingLabels::value_type &label, graph.layers[l].floatingLabels) 
-                    add_label(graph.layers[l].layerName, label.labelText, label.foregroundColor, label.lat, label.lng, label.alt);
+            size_t k = 0;
+            BOOST_FOREACH(const WatcherLayerData::FloatingLabels::value_type &label, graph.layers[l].floatingLabels) {
+                std::string id("floating-label-" + boost::lexical_cast<std::string>(l) + "-" + boost::lexical_cast<std::string>(k++));
+                add_label(graph.layers[l].layerName, id, label.labelText, label.foregroundColor, label.lat, label.lng, label.alt);
+            }
         }
 }
 
-void Render::output_nodes()
+void KmlWriter::output_nodes(const WatcherGraph& graph)
 {
     // output icons for active nodes and labels for active nodes. 
     for (size_t n=0; n<graph.numValidNodes; n++) { 
@@ -315,45 +499,29 @@ void Render::output_nodes()
 
             const NodeDisplayInfo &node=graph.nodes[n];
             const GUILayer &layerName=PHYSICAL_LAYER;     // nodes are on physcal layer by definition
-            const LayerInfo& layer(get_layer(layerName));  
+            LayerInfo& layer(get_layer(layerName));  
             
             if (layer.visible) { 
-                PlacemarkPtr ptr = kmlFac->CreatePlacemark();
-                //ptr->set_name(node.get_label()); // textual label, can be html
-                //ptr->set_geometry(create_point(node.y, node.x, node.z + layer.zpad));
-                ptr->set_geometry(create_point(node.y, node.x, layer.zpad));
-                ptr->set_id(node.nodeId.to_string());
-                // target id is required when changing some attribute of a feature already in the dom
-                //ptr->set_targetid("node0");
-
-                // create style for the icon
-                IconStyleIconPtr icon(kmlFac->CreateIconStyleIcon());
-                std::string url(BASE_ICON_URL + IconPath);
-                icon->set_href(url.c_str());
-
-                IconStylePtr iconStyle(kmlFac->CreateIconStyle());
-                iconStyle->set_icon(icon);
-                iconStyle->set_color(watcher_color_to_kml(node.color));
-                iconStyle->set_scale(IconScale);
-
-                LabelStylePtr labelStyle(kmlFac->CreateLabelStyle());
-                labelStyle->set_scale(0); // hide the label, we use separate placemarks for the labels so they can have their own style
-
-                StylePtr style(kmlFac->CreateStyle());
-                style->set_iconstyle(iconStyle);
-                style->set_labelstyle(labelStyle);
-
-                std::string styleId("node-style-" + boost::lexical_cast<std::string>(n));
-                style->set_id(styleId);
-
-                doc->add_styleselector(style);
-
-                ptr->set_styleurl("#" + styleId);
-
-                layer.folder->add_feature(ptr); // add placemark to DOM
+                std::string nid(node.nodeId.to_string());
+                std::ostringstream values;
+                values << std::setprecision(12) << node.y << ' ' << node.x << ' ' << watcher_color_to_kml(node.color);
+                if (Feature *f = update(layer, "node-" + nid, values.str())) {
+                    std::string id("node-" + nid);
+                    PlacemarkPtr ptr = kmlFac->CreatePlacemark();
+                    PointPtr point(create_point(node.y, node.x, layer.zpad));
+                    point->set_id(id + "-point");
+                    ptr->set_geometry(point);
+                    ptr->set_id(id);
+                    ptr->set_styleurl(get_node_style(node.color));
+                    f->xml = kmldom::SerializePretty(ptr);
+
+                    point = create_point(node.y, node.x, layer.zpad);
+                    point->set_targetid(id + "-point");
+                    f->change = change_placemark(id, "", ptr->get_styleurl()) + kmldom::SerializePretty(point);
+                }
 
                 // add a label for the node separate from its placemark icon
-                add_label(layerName, node.get_label(), node.labelColor, node.y, node.x, 0);
+                add_label(layerName, "node-label-" + nid, node.get_label(), node.labelColor, node.y, node.x, 0);
             }
         }
     }
@@ -361,44 +529,21 @@ void Render::output_nodes()
     // now output all labels on active nodes on active layers. 
     for (size_t n=0; n<graph.numValidNodes; n++) { 
         if (graph.nodes[n].isActive) {
+            std::string nid(graph.nodes[n].nodeId.to_string());
             for (size_t l=0; l<graph.numValidLayers; l++) { 
                 if (graph.layers[l].isActive) { 
                     boost::shared_lock<boost::shared_mutex> readLock(graph.layers[l].nodeLabelsMutexes[n]); 
-                    add_labels(graph.layers[l].nodeLabels[n], graph.nodes[n].y, graph.nodes[n].x, 0);
+                    size_t k = 0;
+                    BOOST_FOREACH(const WatcherLayerData::NodeLabels::value_type &dispInfo, graph.layers[l].nodeLabels[n]) {
+                        std::string id("label-" + boost::lexical_cast<std::string>(l) + "-" + nid + "-" + boost::lexical_cast<std::string>(k++));
+                        add_label(dispInfo.layer, id, dispInfo.labelText, dispInfo.foregroundColor, graph.nodes[n].y, graph.nodes[n].x, 0);
+                    }
                 }
             }
         }
     }
 }
 
-std::string Render::get_edge_style(const EdgeDisplayInfo& edge, unsigned int edgenum)
-{
-        std::string edgeid = "edge-style-" + boost::lexical_cast<std::string>(edgenum);
-
-        LineStylePtr lineStyle(kmlFac->CreateLineStyle());
-        lineStyle->set_color(watcher_color_to_kml(edge.color));
-        lineStyle->set_width(edge.width);
-
-        IconStylePtr iconStyle(kmlFac->CreateIconStyle());
-        iconStyle->set_scale(0); // scale to 0 means hide it
-
-        StylePtr style ( kmlFac->CreateStyle() );
-        style->set_id(edgeid);
-        style->set_linestyle(lineStyle);
-        style->set_iconstyle(iconStyle);
-
-        kmldom::LabelStylePtr labelStyle(kmlFac->CreateLabelStyle());
-        if (edge.label == "none") {
-            labelStyle->set_scale(0); // hide the label
-        }
-        labelStyle->set_color(watcher_color_to_kml(edge.labelColor));
-        style->set_labelstyle(labelStyle);
-
-        doc->add_styleselector(style);
-
-        return "#" + edgeid;
-}
-
 // Draw a spline between the given points at the given altitude
 void drawSpline(const double &x1, const double &y1, const double &x2, const double &y2, const float &alt, CoordinatesPtr& coords)
 {
@@ -413,28 +558,36 @@ void drawSpline(const double &x1, const double &y1, const double &x2, const doub
     }
 }
 
-void Render::output_edges()
+void KmlWriter::output_edges(const WatcherGraph& graph)
 {
-    int edgenum = 0;
-
     for (size_t l=0; l<graph.numValidLayers; l++) { 
         if (graph.layers[l].isActive) {
-            const LayerInfo& layer(get_layer(graph.layers[l].layerName)); 
+            LayerInfo& layer(get_layer(graph.layers[l].layerName)); 
             if (layer.visible) {
+                const EdgeDisplayInfo &edge = graph.layers[l].edgeDisplayInfo; 
+                const std::string layerNum(boost::lexical_cast<std::string>(l));
                 for (size_t i=0; i<graph.numValidNodes; i++) { 
                     if (graph.nodes[i].isActive) {
                         for (size_t j=0; j<graph.numValidNodes; j++) { 
                             if (graph.nodes[j].isActive) {
                                 if (graph.layers[l].edges[i][j]) {
                                     // If we're here, then the edge exists and both nodes and the layer are active. 
-                                    const EdgeDisplayInfo &edge = graph.layers[l].edgeDisplayInfo; 
                                     const NodeDisplayInfo &node1 = graph.nodes[i];
                                     const NodeDisplayInfo &node2 = graph.nodes[j];
 
+                                    std::string id("edge-" + layerNum + "-" + boost::lexical_cast<std::string>(i) + "-" + boost::lexical_cast<std::string>(j));
+                                    std::ostringstream values;
+                                    values << std::setprecision(12) << node1.x << ' ' << node1.y << ' ' << node2.x << ' ' << node2.y << ' ' <<
+                                        watcher_color_to_kml(edge.color) << ' ' << edge.width << ' ' << watcher_color_to_kml(edge.labelColor) << '\n' << edge.label;
+                                    Feature *f = update(layer, id, values.str());
+                                    if (!f)
+                                        continue;
+
                                     CoordinatesPtr coords = kmlFac->CreateCoordinates();
                                     drawSpline(node1.x, node1.y, node2.x, node2.y, layer.zpad, coords);
 
                                     LineStringPtr lineString = kmlFac->CreateLineString();
+                                    lineString->set_id(id + "-line");
                                     lineString->set_coordinates(coords);
                                     //lineString->set_altitudemode(kmldom::ALTITUDEMODE_ABSOLUTE);    // avoid clamping points to the ground
                                     //lineString->set_tessellate(true);
@@ -442,6 +595,7 @@ void Render::output_edges()
 
                                     // place label at the midpoint on the line between the two nodes
                                     PointPtr point(create_point((node1.y + node2.y)/2,(node1.x + node2.x)/2, layer.zpad ));
+                                    point->set_id(id + "-point");
 
                                     /*
                                      * Google Earth doesn't allow a label to be attached to something without a Point, so
@@ -455,11 +609,23 @@ void Render::output_edges()
                                     multiGeo->add_geometry(point);
 
                                     PlacemarkPtr ptr = kmlFac->CreatePlacemark();
+                                    ptr->set_id(id);
                                     ptr->set_geometry(multiGeo);
                                     ptr->set_name(edge.label);
-                                    ptr->set_styleurl(get_edge_style(edge, edgenum++));
+                                    ptr->set_styleurl(get_edge_style(edge));
+
+                                    f->xml = kmldom::SerializePretty(ptr);
 
-                                    layer.folder->add_feature(ptr);
+                                    // the same again, addressed to the parts of the existing placemark
+                                    coords = kmlFac->CreateCoordinates();
+                                    drawSpline(node1.x, node1.y, node2.x, node2.y, layer.zpad, coords);
+                                    lineString = kmlFac->CreateLineString();
+                                    lineString->set_targetid(id + "-line");
+                                    lineString->set_coordinates(coords);
+                                    point = create_point((node1.y + node2.y)/2,(node1.x + node2.x)/2, layer.zpad);
+                                    point->set_targetid(id + "-point");
+                                    f->change = change_placemark(id, edge.label, ptr->get_styleurl()) +
+                                        kmldom::SerializePretty(lineString) + kmldom::SerializePretty(point);
                                 }
                             }
                         }
@@ -470,16 +636,208 @@ void Render::output_edges()
     }
 }
 
+void KmlWriter::write_snapshot(std::ostream& os)
+{
+    os << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<kml xmlns=\"http://www.opengis.net/kml/2.2\">\n"
+        "<Document id=\"" << DOCUMENT_ID << "\">\n";
+    for (FeatureMap::const_iterator s = styles.begin(); s != styles.end(); ++s)
+        os << s->second.xml;
+    os << "<Folder><name>Watcher</name>\n";
+    BOOST_FOREACH(const GUILayer& name, layerOrder) {
+        LayerInfo& layer(layerMap[name]);
+        if (!layer.visible)
+            continue;
+        os << "<Folder id=\"" << layer.id << "\"><name>" << xml_escape(name) << "</name>\n";
+        for (FeatureMap::const_iterator f = layer.features.begin(); f != layer.features.end(); ++f)
+            os << f->second.xml;
+        os << "</Folder>\n";
+    }
+    os << "</Folder>\n</Document>\n</kml>\n";
+
+    ++snapshots;
+    unsigned int since = update_since();
+    for (RemovedMap::iterator r = removed.begin(); r != removed.end(); )
+        if (r->second < since)
+            removed.erase(r++);
+        else
+            ++r;
+}
+
+/*
+ * Updates hold changes made since the snapshot before last.  Nothing
+ * predates the first one.
+ */
+unsigned int KmlWriter::update_since() const
+{
+    return snapshots > 1 ? snapshots - 1 : 1;
+}
+
+/*
+ * Styles are only ever added, and as a style's id names its attributes,
+ * creating one twice is harmless.  A layer's folder which may be missing
+ * is created in the Document with all of its placemarks, as they are all
+ * at least as new as the layer.
+ */
+void KmlWriter::write_update(std::ostream& os, const std::string& targetHref)
+{
+    const unsigned int since = update_since();
+    std::ostringstream deletes, folderCreates, creates, changes, styleCreates;
+    for (RemovedMap::const_iterator r = removed.begin(); r != removed.end(); ++r)
+        deletes << "<Placemark targetId=\"" << r->first << "\"/>\n";
+    for (FeatureMap::const_iterator s = styles.begin(); s != styles.end(); ++s)
+        if (s->second.changed >= since)
+            styleCreates << s->second.xml;
+    BOOST_FOREACH(const GUILayer& name, layerOrder) {
+        const LayerInfo& layer(layerMap[name]);
+        if (!layer.visible)
+            continue;
+        if (layer.created >= since) {
+            deletes << "<Folder targetId=\"" << layer.id << "\"/>\n";
+            folderCreates << "<Folder id=\"" << layer.id << "\"><name>" << xml_escape(name) << "</name>\n";
+            for (FeatureMap::const_iterator f = layer.features.begin(); f != layer.features.end(); ++f)
+                folderCreates << f->second.xml;
+            folderCreates << "</Folder>\n";
+            continue;
+        }
+        std::ostringstream layerCreates;
+        for (FeatureMap::const_iterator f = layer.features.begin(); f != layer.features.end(); ++f)
+            if (f->second.created >= since) {
+                deletes << "<Placemark targetId=\"" << f->first << "\"/>\n";
+                layerCreates << f->second.xml;
+            } else if (f->second.changed >= since)
+                changes << f->second.change;
+        if (!layerCreates.str().empty())
+            creates << "<Create><Folder targetId=\"" << layer.id << "\">\n" << layerCreates.str() << "</Folder></Create>\n";
+    }
+
+    os << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<kml xmlns=\"http://www.opengis.net/kml/2.2\">\n"
+        "<NetworkLinkControl>\n";
+    if (!deletes.str().empty() || !folderCreates.str().empty() || !creates.str().empty() ||
+            !changes.str().empty() || !styleCreates.str().empty()) {
+        os << "<Update>\n<targetHref>" << xml_escape(targetHref) << "</targetHref>\n";
+        if (!styleCreates.str().empty())
+            os << "<Create><Document targetId=\"" << DOCUMENT_ID << "\">\n" << styleCreates.str() << "</Document></Create>\n";
+        if (!deletes.str().empty())
+            os << "<Delete>\n" << deletes.str() << "</Delete>\n";
+        if (!folderCreates.str().empty())
+            os << "<Create><Document targetId=\"" << DOCUMENT_ID << "\">\n" << folderCreates.str() << "</Document></Create>\n";
+        os << creates.str();
+        if (!changes.str().empty())
+            os << "<Change>\n" << changes.str() << "</Change>\n";
+        os << "</Update>\n";
+    }
+    os << "</NetworkLinkControl>\n</kml>\n";
+}
+
+void KmlWriter::write_loader(std::ostream& os, const std::string& dataHref, const std::string& updateHref)
+{
+    struct {
+        const char *name;
+        const std::string& href;
+        int interval;
+    } links[] = {
+        { "Watcher", dataHref, SnapshotInterval },
+        { "Watcher updates", updateHref, static_cast<int>(Refresh) }
+    };
+
+    os << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<kml xmlns=\"http://www.opengis.net/kml/2.2\">\n"
+        "<Document><name>Watcher</name>\n";
+    for (size_t i = 0; i < sizeof(links) / sizeof(links[0]); ++i)
+        os << "<NetworkLink><name>" << links[i].name << "</name><Link><href>" << xml_escape(links[i].href) <<
+            "</href><refreshMode>onInterval</refreshMode><refreshInterval>" << links[i].interval <<
+            "</refreshInterval></Link></NetworkLink>\n";
+    os << "</Document>\n</kml>\n";
+}
+
+void KmlWriter::write(const WatcherGraph& graph, const std::string& outputFile)
+{
+    if (layerMap.empty())
+        create_layers();
+
+    for (LayerMapIterator l = layerMap.begin(); l != layerMap.end(); ++l)
+        for (FeatureMap::iterator f = l->second.features.begin(); f != l->second.features.end(); ++f)
+            f->second.seen = false;
+
+    output_nodes(graph);
+    output_edges(graph);
+    output_floating_labels(graph);
+
+    // drop whatever was not output this time around
+    for (LayerMapIterator l = layerMap.begin(); l != layerMap.end(); ++l) {
+        FeatureMap& features(l->second.features);
+        for (FeatureMap::iterator f = features.begin(); f != features.end(); ) {
+            if (f->second.seen)
+                ++f;
+            else {
+                removed[f->first] = snapshots;
+                features.erase(f++);
+            }
+        }
+    }
+
+    if (!IncrementalKml) {
+        if (ends_with(outputFile, ".kmz")) {
+            std::ostringstream os;
+            write_snapshot(os);
+            write_kmz(outputFile, os.str());
+        } else {
+            AtomicFile f(outputFile);
+            write_snapshot(f.os);
+            f.commit();
+        }
+        return;
+    }
+
+    /* The snapshots and updates are always plain KML beside the loader.  A
+     * loader written as KMZ reaches them through "..", as relative links
+     * in a KMZ start from inside the archive. */
+    const bool kmz = ends_with(outputFile, ".kmz");
+    std::string stem(kmz || ends_with(outputFile, ".kml") ? outputFile.substr(0, outputFile.size() - 4) : outputFile);
+    std::string dataFile(stem + "-data.kml");
+    std::string updateFile(stem + "-update.kml");
+
+    time_t now = time(0);
+    if (!lastSnapshot || now - lastSnapshot >= SnapshotInterval) {
+        if (!lastSnapshot) {
+            std::string up(kmz ? "../" : "");
+            if (kmz) {
+                std::ostringstream os;
+                write_loader(os, up + base_name(dataFile), up + base_name(updateFile));
+                write_kmz(outputFile, os.str());
+            } else {
+                AtomicFile f(outputFile);
+                write_loader(f.os, base_name(dataFile), base_name(updateFile));
+                f.commit();
+            }
+        }
+        AtomicFile f(dataFile);
+        write_snapshot(f.os);
+        f.commit();
+        lastSnapshot = now;
+    }
+
+    AtomicFile f(updateFile);
+    write_update(f.os, base_name(dataFile));
+    f.commit();
+}
+
+KmlWriter Writer;
+
 } // end namespace
 
 namespace earthwatcher {
 
 void write_kml(const WatcherGraph& graph, const std::string& outputFile)
 {
-    Render args(graph);
-    args.start();
+    Writer.write(graph, outputFile);
+}
 
-    kmlbase::File::WriteStringToFile(kmldom::SerializePretty(args.kml), outputFile);
+void reset_kml()
+{
+    Writer.reset();
 }
 
 } // namespace
@@ -87,6 +87,12 @@ int main(int argc, char *argv[])
     vector<Node> nodes;
     buildNodeVector(scenFile, nodes);
 
+    // Store the events in large transactions, building indices at the end.
+    const size_t batchSize=10000;
+    EncodedEventList batch;
+    batch.reserve(batchSize);
+    db->beginBulkLoad();
+
     CEarth earth;
     GPSMessagePtr gpsMess=(GPSMessagePtr)new GPSMessage;
     ConnectivityMessagePtr conMess=(ConnectivityMessagePtr)new ConnectivityMessage;
@@ -101,7 +107,8 @@ int main(int argc, char *argv[])
             gpsMess->y=n.y;
             gpsMess->z=n.z;
             gpsMess->fromNodeID=naddr;
-            db->storeEvent(gpsMess);
+            batch.push_back(EncodedEvent());
+            encode_event(gpsMess, batch.back());
             totalEvents++;
             gpsEvents++;
 
@@ -130,11 +137,18 @@ int main(int argc, char *argv[])
             conMess->neighbors=nbrs;
             conMess->timestamp=(Timestamp)n.ts;
             conMess->fromNodeID=naddr;
-            db->storeEvent(conMess);
+            batch.push_back(EncodedEvent());
+            encode_event(conMess, batch.back());
             totalEvents++;
             nbrEvents++;
         }
+        if (batch.size()>=batchSize) {
+            db->storeEvents(batch);
+            batch.clear();
+        }
     }
+    db->storeEvents(batch);
+    db->endBulkLoad();
 
     freeNodeVector(nodes); 
 
@@ -0,0 +1,704 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file graphRenderer.cpp
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libwatcher/watcherGraph.h>
+
+#include "graphRenderer.h"
+#include "watcherGUIConfig.h"
+#include "logger.h"
+
+using namespace std;
+using namespace watcher;
+using namespace watcher::event;
+
+INIT_LOGGER(GraphRenderer, "GraphRenderer");
+
+namespace {
+
+    // Attribute locations, shared by both programs. Instances are 11 floats:
+    //   nodes: x, y, z, size,  r, g, b, a,  spin x, spin y, spin z
+    //   edges: x1, y1, z1, width,  r, g, b, a,  x2, y2, z2
+    enum { vertexAttrib=0, normalAttrib, instanceAttrib0, instanceAttrib1, instanceAttrib2 };
+    const size_t instanceFloats=11;
+    const size_t meshFloats=6;          // x, y, z, nx, ny, nz
+
+    // Fixed function lighting for one light with GL_COLOR_MATERIAL set to
+    // GL_AMBIENT_AND_DIFFUSE, which is how manetGLView sets things up.
+    const char *lightingSource=
+        "#version 120\n"
+        "varying vec4 frontColor;\n"
+        "vec4 light(vec3 normal, vec4 color, vec4 eyePos)\n"
+        "{\n"
+        "    vec3 n=normalize(gl_NormalMatrix*normal);\n"
+        "    vec3 l=normalize(gl_LightSource[0].position.xyz-eyePos.xyz*gl_LightSource[0].position.w);\n"
+        "    float d=max(dot(n, l), 0.0);\n"
+        "    vec3 c=color.rgb*(gl_LightModel.ambient.rgb+gl_LightSource[0].ambient.rgb+gl_LightSource[0].diffuse.rgb*d);\n"
+        "    if (d>0.0) {\n"
+        "        vec3 h=normalize(l+vec3(0.0, 0.0, 1.0));\n"
+        "        c+=gl_FrontMaterial.specular.rgb*gl_LightSource[0].specular.rgb*pow(max(dot(n, h), 0.0), gl_FrontMaterial.shininess);\n"
+        "    }\n"
+        "    return vec4(c, color.a);\n"
+        "}\n";
+
+    // The transformations manetGLView::drawNode() does: translate, scale, and
+    // spin about x, y, and z.
+    const char *nodeVertexSource=
+        "attribute vec3 vertex;\n"
+        "attribute vec3 normal;\n"
+        "attribute vec4 position;\n"
+        "attribute vec4 color;\n"
+        "attribute vec3 spin;\n"
+        "mat3 rotX(float a) { float c=cos(a), s=sin(a); return mat3(1.0, 0.0, 0.0,  0.0, c, s,  0.0, -s, c); }\n"
+        "mat3 rotY(float a) { float c=cos(a), s=sin(a); return mat3(c, 0.0, -s,  0.0, 1.0, 0.0,  s, 0.0, c); }\n"
+        "mat3 rotZ(float a) { float c=cos(a), s=sin(a); return mat3(c, s, 0.0,  -s, c, 0.0,  0.0, 0.0, 1.0); }\n"
+        "void main()\n"
+        "{\n"
+        "    vec3 a=radians(spin);\n"
+        "    mat3 r=rotX(a.x)*rotY(a.y)*rotZ(a.z);\n"
+        "    vec4 eye=gl_ModelViewMatrix*vec4(position.xyz+position.w*(r*vertex), 1.0);\n"
+        "    gl_Position=gl_ProjectionMatrix*eye;\n"
+        "    frontColor=light(r*normal, color, eye);\n"
+        "}\n";
+
+    // Edges are tapered: in 2D a triangle with its base across the first node,
+    // in 3D a cone with its base on the first node, as manetGLView::drawEdge()
+    // draws them. The mesh is in edge coordinates: in 2D, x runs from the first
+    // node (0) to the second (1) and y across the edge (-1..1). In 3D, x and y
+    // are the direction around the cone and z runs from the base (0) to the tip (1).
+    const char *edgeVertexSource=
+        "attribute vec3 vertex;\n"
+        "attribute vec4 from;\n"
+        "attribute vec4 color;\n"
+        "attribute vec3 to;\n"
+        "uniform bool flatEdges;\n"
+        "void main()\n"
+        "{\n"
+        "    vec3 d=to-from.xyz;\n"
+        "    float width=from.w;\n"
+        "    vec3 p, n;\n"
+        "    if (flatEdges) {\n"
+        "        float len=length(d.xy);\n"
+        "        vec2 across=len>0.0 ? vec2(d.y, -d.x)*width/len : vec2(width, 0.0);\n"
+        "        p=from.xyz+vertex.x*d+vertex.y*vec3(across, 0.0);\n"
+        "        n=vec3(0.0, 0.0, 1.0);\n"
+        "    }\n"
+        "    else {\n"
+        "        float len=length(d);\n"
+        "        vec3 w=len>0.0 ? d/len : vec3(0.0, 0.0, 1.0);\n"
+        "        vec3 u=normalize(cross(abs(w.z)<0.9 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0), w));\n"
+        "        vec3 v=cross(w, u);\n"
+        "        vec3 radial=vertex.x*u+vertex.y*v;\n"
+        "        p=from.xyz+(1.0-vertex.z)*width*radial+vertex.z*len*w;\n"
+        "        n=radial*len+w*width;\n"
+        "    }\n"
+        "    vec4 eye=gl_ModelViewMatrix*vec4(p, 1.0);\n"
+        "    gl_Position=gl_ProjectionMatrix*eye;\n"
+        "    frontColor=light(n, color, eye);\n"
+        "}\n";
+
+    const char *fragmentSource=
+        "#version 120\n"
+        "varying vec4 frontColor;\n"
+        "void main()\n"
+        "{\n"
+        "    gl_FragColor=frontColor;\n"
+        "}\n";
+
+    void vertex(vector<GLfloat> &v, GLfloat x, GLfloat y, GLfloat z, GLfloat nx=0.0, GLfloat ny=0.0, GLfloat nz=1.0)
+    {
+        v.push_back(x); v.push_back(y); v.push_back(z);
+        v.push_back(nx); v.push_back(ny); v.push_back(nz);
+    }
+
+    // Two triangles from a quad given counterclockwise, all with normal n.
+    void quad(vector<GLfloat> &v, const GLfloat p[4][3], const GLfloat n[3])
+    {
+        const int order[]={ 0, 1, 2, 0, 2, 3 };
+        for (size_t i=0; i<sizeof(order)/sizeof(order[0]); i++)
+            vertex(v, p[order[i]][0], p[order[i]][1], p[order[i]][2], n[0], n[1], n[2]);
+    }
+
+    // gluSphere(radius, slices, stacks)
+    void sphere(vector<GLfloat> &v, GLfloat radius, int slices, int stacks)
+    {
+        for (int i=0; i<stacks; i++) {
+            GLfloat phi[2]={ M_PI*i/stacks-M_PI_2, M_PI*(i+1)/stacks-M_PI_2 };
+            for (int j=0; j<slices; j++) {
+                GLfloat theta[2]={ 2*M_PI*j/slices, 2*M_PI*(j+1)/slices };
+                const int corners[6][2]={ {0,0}, {0,1}, {1,1}, {0,0}, {1,1}, {1,0} };
+                for (int k=0; k<6; k++) {
+                    GLfloat p=phi[corners[k][0]], t=theta[corners[k][1]];
+                    GLfloat nx=cos(p)*cos(t), ny=cos(p)*sin(t), nz=sin(p);
+                    vertex(v, radius*nx, radius*ny, radius*nz, nx, ny, nz);
+                }
+            }
+        }
+    }
+
+    // glutSolidTorus(inner, outer, sides, rings)
+    void torus(vector<GLfloat> &v, GLfloat inner, GLfloat outer, int sides, int rings)
+    {
+        for (int i=0; i<rings; i++) {
+            GLfloat theta[2]={ 2*M_PI*i/rings, 2*M_PI*(i+1)/rings };
+            for (int j=0; j<sides; j++) {
+                GLfloat phi[2]={ 2*M_PI*j/sides, 2*M_PI*(j+1)/sides };
+                const int corners[6][2]={ {0,0}, {1,0}, {1,1}, {0,0}, {1,1}, {0,1} };
+                for (int k=0; k<6; k++) {
+                    GLfloat t=theta[corners[k][0]], p=phi[corners[k][1]];
+                    GLfloat nx=cos(p)*cos(t), ny=cos(p)*sin(t), nz=sin(p);
+                    GLfloat r=outer+inner*cos(p);
+                    vertex(v, r*cos(t), r*sin(t), inner*nz, nx, ny, nz);
+                }
+            }
+        }
+    }
+
+    // gluDisk(inner, outer, slices, 1)
+    void disk(vector<GLfloat> &v, GLfloat inner, GLfloat outer, int slices)
+    {
+        for (int j=0; j<slices; j++) {
+            GLfloat t0=2*M_PI*j/slices, t1=2*M_PI*(j+1)/slices;
+            const GLfloat p[4][3]={
+                { inner*cos(t0), inner*sin(t0), 0 },
+                { outer*cos(t0), outer*sin(t0), 0 },
+                { outer*cos(t1), outer*sin(t1), 0 },
+                { inner*cos(t1), inner*sin(t1), 0 }
+            };
+            const GLfloat n[3]={ 0, 0, 1 };
+            quad(v, p, n);
+        }
+    }
+
+    // A cube of the given half width with a normal per face.
+    void cube(vector<GLfloat> &v, GLfloat s)
+    {
+        const GLfloat faces[6][5][3]={
+            { { 0, 0, 1 }, {-1,-1, 1 }, { 1,-1, 1 }, { 1, 1, 1 }, {-1, 1, 1 } },
+            { { 0, 0,-1 }, {-1,-1,-1 }, {-1, 1,-1 }, { 1, 1,-1 }, { 1,-1,-1 } },
+            { { 0, 1, 0 }, {-1, 1,-1 }, {-1, 1, 1 }, { 1, 1, 1 }, { 1, 1,-1 } },
+            { { 0,-1, 0 }, {-1,-1,-1 }, { 1,-1,-1 }, { 1,-1, 1 }, {-1,-1, 1 } },
+            { { 1, 0, 0 }, { 1,-1,-1 }, { 1, 1,-1 }, { 1, 1, 1 }, { 1,-1, 1 } },
+            { {-1, 0, 0 }, {-1,-1,-1 }, {-1,-1, 1 }, {-1, 1, 1 }, {-1, 1,-1 } }
+        };
+        for (int f=0; f<6; f++) {
+            GLfloat p[4][3];
+            for (int i=0; i<4; i++)
+                for (int k=0; k<3; k++)
+                    p[i][k]=faces[f][i+1][k]*s;
+            quad(v, p, faces[f][0]);
+        }
+    }
+
+    // manetGLView::drawPyramid() in 3D
+    void pyramid(vector<GLfloat> &v, GLfloat s)
+    {
+        const GLfloat sides[4][4][3]={
+            { { 0, 0, 1 }, { 0, 1, 0 }, {-1,-1, 1 }, { 1,-1, 1 } },
+            { { 1, 0, 0 }, { 0, 1, 0 }, { 1,-1, 1 }, { 1,-1,-1 } },
+            { { 0, 0,-1 }, { 0, 1, 0 }, { 1,-1,-1 }, {-1,-1,-1 } },
+            { {-1, 0, 0 }, { 0, 1, 0 }, {-1,-1,-1 }, {-1,-1, 1 } }
+        };
+        for (int f=0; f<4; f++)
+            for (int i=1; i<4; i++)
+                vertex(v, sides[f][i][0]*s, sides[f][i][1]*s, sides[f][i][2]*s, sides[f][0][0], sides[f][0][1], sides[f][0][2]);
+        const GLfloat bottom[4][3]={ {-s,-s, s }, { s,-s, s }, { s,-s,-s }, {-s,-s,-s } };
+        const GLfloat down[3]={ 0,-1, 0 };
+        quad(v, bottom, down);
+    }
+
+    // The outline of a polygon, for GL_LINE_LOOP
+    void outline(vector<GLfloat> &v, const GLfloat p[][2], size_t n)
+    {
+        for (size_t i=0; i<n; i++)
+            vertex(v, p[i][0], p[i][1], 0);
+    }
+
+    void mix(size_t &h, const void *p, size_t n)
+    {
+        const unsigned char *c=static_cast<const unsigned char *>(p);
+        for (size_t i=0; i<n; i++) {
+            h^=c[i];
+            h*=static_cast<size_t>(1099511628211ULL);
+        }
+    }
+
+    template<typename T> void mix(size_t &h, const T &v) { mix(h, &v, sizeof(v)); }
+
+    void mix(size_t &h, const Color &c)
+    {
+        const unsigned char rgba[]={ c.r, c.g, c.b, c.a };
+        mix(h, rgba, sizeof(rgba));
+    }
+}
+
+GraphRenderer::GraphRenderer() :
+    nodeRebuilds(0), edgeRebuilds(0), nodeCount(0), nodesThreeD(false), graphChanges(0),
+    nodeProgram(0), edgeProgram(0), flatEdgesUniform(-1), valid(false)
+{
+    memset(nodeMeshes, 0, sizeof(nodeMeshes));
+    memset(edgeMeshes, 0, sizeof(edgeMeshes));
+    memset(shapeFirst, 0, sizeof(shapeFirst));
+    memset(shapeCount, 0, sizeof(shapeCount));
+}
+
+GraphRenderer::~GraphRenderer()
+{
+    // GL objects have to be freed with the context current, by release().
+}
+
+bool GraphRenderer::initialize(const ProcAddressFunction &getProcAddress)
+{
+    TRACE_ENTER();
+
+    release();
+
+#define RESOLVE(var, type, name) var=reinterpret_cast<type>(getProcAddress(name))
+    RESOLVE(genBuffers, PFNGLGENBUFFERSPROC, "glGenBuffers");
+    RESOLVE(deleteBuffers, PFNGLDELETEBUFFERSPROC, "glDeleteBuffers");
+    RESOLVE(bindBuffer, PFNGLBINDBUFFERPROC, "glBindBuffer");
+    RESOLVE(bufferData, PFNGLBUFFERDATAPROC, "glBufferData");
+    RESOLVE(bufferSubData, PFNGLBUFFERSUBDATAPROC, "glBufferSubData");
+    RESOLVE(createShader, PFNGLCREATESHADERPROC, "glCreateShader");
+    RESOLVE(deleteShader, PFNGLDELETESHADERPROC, "glDeleteShader");
+    RESOLVE(shaderSource, PFNGLSHADERSOURCEPROC, "glShaderSource");
+    RESOLVE(compileShader, PFNGLCOMPILESHADERPROC, "glCompileShader");
+    RESOLVE(getShaderiv, PFNGLGETSHADERIVPROC, "glGetShaderiv");
+    RESOLVE(getShaderInfoLog, PFNGLGETSHADERINFOLOGPROC, "glGetShaderInfoLog");
+    RESOLVE(createProgram, PFNGLCREATEPROGRAMPROC, "glCreateProgram");
+    RESOLVE(deleteProgram, PFNGLDELETEPROGRAMPROC, "glDeleteProgram");
+    RESOLVE(attachShader, PFNGLATTACHSHADERPROC, "glAttachShader");
+    RESOLVE(bindAttribLocation, PFNGLBINDATTRIBLOCATIONPROC, "glBindAttribLocation");
+    RESOLVE(linkProgram, PFNGLLINKPROGRAMPROC, "glLinkProgram");
+    RESOLVE(getProgramiv, PFNGLGETPROGRAMIVPROC, "glGetProgramiv");
+    RESOLVE(getProgramInfoLog, PFNGLGETPROGRAMINFOLOGPROC, "glGetProgramInfoLog");
+    RESOLVE(useProgram, PFNGLUSEPROGRAMPROC, "glUseProgram");
+    RESOLVE(getUniformLocation, PFNGLGETUNIFORMLOCATIONPROC, "glGetUniformLocation");
+    RESOLVE(uniform1i, PFNGLUNIFORM1IPROC, "glUniform1i");
+    RESOLVE(vertexAttribPointer, PFNGLVERTEXATTRIBPOINTERPROC, "glVertexAttribPointer");
+    RESOLVE(enableVertexAttribArray, PFNGLENABLEVERTEXATTRIBARRAYPROC, "glEnableVertexAttribArray");
+    RESOLVE(disableVertexAttribArray, PFNGLDISABLEVERTEXATTRIBARRAYPROC, "glDisableVertexAttribArray");
+#undef RESOLVE
+
+    // Core in 3.3, and the ARB names in older contexts which have the extensions.
+    const char *ext=reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+    const char *version=reinterpret_cast<const char *>(glGetString(GL_VERSION));
+    bool core=version && atof(version)>=3.3-1e-6;
+    bool arb=ext && strstr(ext, "GL_ARB_instanced_arrays") && strstr(ext, "GL_ARB_draw_instanced");
+    vertexAttribDivisor=reinterpret_cast<PFNGLVERTEXATTRIBDIVISORARBPROC>(
+            getProcAddress(core ? "glVertexAttribDivisor" : "glVertexAttribDivisorARB"));
+    drawArraysInstanced=reinterpret_cast<PFNGLDRAWARRAYSINSTANCEDARBPROC>(
+            getProcAddress(core ? "glDrawArraysInstanced" : "glDrawArraysInstancedARB"));
+
+    if (!(core || arb) || !genBuffers || !deleteBuffers || !bindBuffer || !bufferData || !bufferSubData ||
+            !createShader || !deleteShader || !shaderSource || !compileShader || !getShaderiv ||
+            !getShaderInfoLog || !createProgram || !deleteProgram || !attachShader ||
+            !bindAttribLocation || !linkProgram || !getProgramiv || !getProgramInfoLog ||
+            !useProgram || !getUniformLocation || !uniform1i || !vertexAttribPointer ||
+            !enableVertexAttribArray || !disableVertexAttribArray || !vertexAttribDivisor ||
+            !drawArraysInstanced) {
+        LOG_WARN("OpenGL " << (version ? version : "(unknown)") << " does not support instanced drawing, "
+                "nodes and edges will be drawn in immediate mode");
+        TRACE_EXIT_RET_BOOL(false);
+        return false;
+    }
+
+    nodeProgram=buildProgram(nodeVertexSource, "node");
+    edgeProgram=buildProgram(edgeVertexSource, "edge");
+    if (!nodeProgram || !edgeProgram) {
+        release();
+        TRACE_EXIT_RET_BOOL(false);
+        return false;
+    }
+    flatEdgesUniform=getUniformLocation(edgeProgram, "flatEdges");
+
+    buildMeshes();
+    genBuffers(1, &nodeInstances.buffer);
+
+    valid=true;
+    LOG_INFO("Drawing nodes and edges with instanced vertex buffers (OpenGL " << version << ")");
+
+    TRACE_EXIT_RET_BOOL(true);
+    return true;
+}
+
+void GraphRenderer::release()
+{
+    if (!valid && !nodeProgram && !edgeProgram)
+        return;
+
+    for (size_t d=0; d<2; d++) {
+        for (size_t s=0; s<numShapes; s++)
+            if (nodeMeshes[d][s].buffer)
+                deleteBuffers(1, &nodeMeshes[d][s].buffer);
+        if (edgeMeshes[d].buffer)
+            deleteBuffers(1, &edgeMeshes[d].buffer);
+    }
+    memset(nodeMeshes, 0, sizeof(nodeMeshes));
+    memset(edgeMeshes, 0, sizeof(edgeMeshes));
+
+    if (nodeInstances.buffer)
+        deleteBuffers(1, &nodeInstances.buffer);
+    nodeInstances=Instances();
+    for (vector<LayerEdges>::iterator l=layers.begin(); l!=layers.end(); ++l)
+        if (l->buffer)
+            deleteBuffers(1, &l->buffer);
+    layers.clear();
+    nodeCount=0;
+
+    if (nodeProgram)
+        deleteProgram(nodeProgram);
+    if (edgeProgram)
+        deleteProgram(edgeProgram);
+    nodeProgram=edgeProgram=0;
+
+    valid=false;
+}
+
+GLuint GraphRenderer::buildProgram(const char *vertexSource, const char *name)
+{
+    const char *vertexSources[]={ lightingSource, vertexSource };
+    GLuint vs=createShader(GL_VERTEX_SHADER);
+    shaderSource(vs, 2, vertexSources, NULL);
+    compileShader(vs);
+
+    GLuint fs=createShader(GL_FRAGMENT_SHADER);
+    shaderSource(fs, 1, &fragmentSource, NULL);
+    compileShader(fs);
+
+    GLuint program=createProgram();
+    attachShader(program, vs);
+    attachShader(program, fs);
+    bool nodes=vertexSource==nodeVertexSource;
+    bindAttribLocation(program, vertexAttrib, "vertex");
+    bindAttribLocation(program, normalAttrib, "normal");
+    bindAttribLocation(program, instanceAttrib0, nodes ? "position" : "from");
+    bindAttribLocation(program, instanceAttrib1, "color");
+    bindAttribLocation(program, instanceAttrib2, nodes ? "spin" : "to");
+    linkProgram(program);
+
+    // The shaders are deleted along with the program.
+    deleteShader(vs);
+    deleteShader(fs);
+
+    GLint ok=GL_FALSE;
+    getProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char log[4096]="";
+        getProgramInfoLog(program, sizeof(log), NULL, log);
+        LOG_ERROR("Unable to build the " << name << " shaders, using immediate mode: " << log);
+        deleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void GraphRenderer::buildMesh(Mesh &mesh, GLenum mode, const vector<GLfloat> &vertices, GLfloat lineWidth)
+{
+    mesh.mode=mode;
+    mesh.count=vertices.size()/meshFloats;
+    mesh.lineWidth=lineWidth;
+    if (!mesh.count)
+        return;
+    genBuffers(1, &mesh.buffer);
+    bindBuffer(GL_ARRAY_BUFFER, mesh.buffer);
+    bufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(GLfloat), &vertices[0], GL_STATIC_DRAW);
+    bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+//
+// The shapes manetGLView draws, at the sizes drawNode() asks for.
+//
+void GraphRenderer::buildMeshes()
+{
+    const GLfloat radius=4.0;
+    vector<GLfloat> v;
+
+    // 3D
+    sphere(v, radius, 15, 15);
+    buildMesh(nodeMeshes[1][NodePropertiesMessage::CIRCLE], GL_TRIANGLES, v);
+    v.clear();
+    cube(v, radius*1.2);
+    buildMesh(nodeMeshes[1][NodePropertiesMessage::SQUARE], GL_TRIANGLES, v);
+    v.clear();
+    pyramid(v, radius*1.2);
+    buildMesh(nodeMeshes[1][NodePropertiesMessage::TRIANGLE], GL_TRIANGLES, v);
+    v.clear();
+    torus(v, 2, radius, 15, 15);
+    buildMesh(nodeMeshes[1][NodePropertiesMessage::TORUS], GL_TRIANGLES, v);
+    v.clear();
+
+    // 2D
+    disk(v, radius-1, radius, 36);
+    buildMesh(nodeMeshes[0][NodePropertiesMessage::CIRCLE], GL_TRIANGLES, v);
+    v.clear();
+    const GLfloat square[][2]={ {-radius,-radius }, { radius,-radius }, { radius, radius }, {-radius, radius } };
+    outline(v, square, 4);
+    buildMesh(nodeMeshes[0][NodePropertiesMessage::SQUARE], GL_LINE_LOOP, v, 2.0);
+    buildMesh(nodeMeshes[0][NodePropertiesMessage::TEAPOT], GL_LINE_LOOP, v, 2.0);  // a flat teapot is a square
+    v.clear();
+    const GLfloat offset=2.0*radius*sin(M_PI_4);
+    const GLfloat triangle[][2]={ {-offset,-offset }, { offset,-offset }, { 0, radius } };
+    outline(v, triangle, 3);
+    buildMesh(nodeMeshes[0][NodePropertiesMessage::TRIANGLE], GL_LINE_LOOP, v, 2.0);
+    v.clear();
+    disk(v, 2, radius, 36);
+    buildMesh(nodeMeshes[0][NodePropertiesMessage::TORUS], GL_TRIANGLES, v);
+    v.clear();
+
+    // edges
+    vertex(v, 0, 1, 0);
+    vertex(v, 0,-1, 0);
+    vertex(v, 1,-1, 0);
+    buildMesh(edgeMeshes[0], GL_TRIANGLES, v);
+    v.clear();
+    const int slices=15;
+    for (int j=0; j<slices; j++) {
+        GLfloat t0=2*M_PI*j/slices, t1=2*M_PI*(j+1)/slices, tm=(t0+t1)/2;
+        vertex(v, cos(t0), sin(t0), 0);
+        vertex(v, cos(t1), sin(t1), 0);
+        vertex(v, cos(tm), sin(tm), 1);
+    }
+    buildMesh(edgeMeshes[1], GL_TRIANGLES, v);
+}
+
+// static
+bool GraphRenderer::isBatched(int shape, bool threeD)
+{
+    return !(threeD && shape==NodePropertiesMessage::TEAPOT);
+}
+
+void GraphRenderer::upload(Instances &inst, const vector<GLfloat> &data)
+{
+    if (data.empty())
+        return;
+    if (!inst.buffer)
+        genBuffers(1, &inst.buffer);
+    bindBuffer(GL_ARRAY_BUFFER, inst.buffer);
+    if (data.size()>inst.capacity) {
+        inst.capacity=data.size()+data.size()/2;
+        bufferData(GL_ARRAY_BUFFER, inst.capacity*sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
+    }
+    bufferSubData(GL_ARRAY_BUFFER, 0, data.size()*sizeof(GLfloat), &data[0]);
+    bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GraphRenderer::update(const WatcherGraph &graph, const WatcherGUIConfig &conf)
+{
+    if (!valid)
+        return;
+
+    // Nodes can be changed by the GUI without going through the graph, so
+    // look at what is drawn rather than trusting changeCount().
+    size_t nodeKey=static_cast<size_t>(14695981039346656037ULL);
+    mix(nodeKey, conf.threeDView);
+    mix(nodeKey, conf.monochromeMode);
+    mix(nodeKey, graph.numValidNodes);
+    for (size_t n=0; n<graph.numValidNodes; n++) {
+        const NodeDisplayInfo &node=graph.nodes[n];
+        mix(nodeKey, node.isActive);
+        if (!node.isActive)
+            continue;
+        mix(nodeKey, node.x);
+        mix(nodeKey, node.y);
+        mix(nodeKey, node.z);
+        mix(nodeKey, node.color);
+        mix(nodeKey, node.shape);
+        mix(nodeKey, node.size);
+        mix(nodeKey, node.spin);
+        if (node.spin) {
+            mix(nodeKey, node.spinRotation_x);
+            mix(nodeKey, node.spinRotation_y);
+            mix(nodeKey, node.spinRotation_z);
+        }
+    }
+    if (nodeKey!=nodeInstances.key)
+        rebuildNodes(graph, conf, nodeKey);
+
+    // Edges only change when the graph does, or when the nodes move.
+    unsigned long changes=graph.changeCount();
+    bool graphChanged=changes!=graphChanges;
+    graphChanges=changes;
+    if (layers.size()<graph.numValidLayers)
+        layers.resize(graph.numValidLayers);
+    for (size_t l=0; l<graph.numValidLayers; l++) {
+        const WatcherLayerData &layer=graph.layers[l];
+        if (!layer.isActive)
+            continue;
+        size_t key=nodeKey;
+        mix(key, layer.edgeDisplayInfo.color);
+        mix(key, layer.edgeDisplayInfo.width);
+        if (graphChanged || key!=layers[l].key)
+            rebuildEdges(graph, l, conf, key);
+    }
+}
+
+void GraphRenderer::rebuildNodes(const WatcherGraph &graph, const WatcherGUIConfig &conf, size_t key)
+{
+    TRACE_ENTER();
+
+    nodesThreeD=conf.threeDView;
+    vector<GLfloat> data;
+    data.reserve(graph.numValidNodes*instanceFloats);
+    nodeCount=0;
+    for (size_t s=0; s<numShapes; s++) {
+        shapeFirst[s]=data.size()/instanceFloats;
+        for (size_t n=0; n<graph.numValidNodes; n++) {
+            const NodeDisplayInfo &node=graph.nodes[n];
+            if (!node.isActive || node.shape!=static_cast<int>(s) || !isBatched(node.shape, nodesThreeD))
+                continue;
+            bool spin=node.spin;
+            GLfloat instance[instanceFloats]={
+                node.x, node.y, node.z, node.size,
+                conf.monochromeMode ? 0.0 : node.color.r/255.0,
+                conf.monochromeMode ? 0.0 : node.color.g/255.0,
+                conf.monochromeMode ? 0.0 : node.color.b/255.0,
+                conf.monochromeMode ? 1.0 : node.color.a/255.0,
+                spin && nodesThreeD ? node.spinRotation_x : 0.0,
+                spin && nodesThreeD ? node.spinRotation_y : 0.0,
+                spin ? node.spinRotation_z : 0.0
+            };
+            data.insert(data.end(), instance, instance+instanceFloats);
+        }
+        shapeCount[s]=data.size()/instanceFloats-shapeFirst[s];
+        nodeCount+=shapeCount[s];
+    }
+    upload(nodeInstances, data);
+    nodeInstances.key=key;
+    nodeRebuilds++;
+
+    TRACE_EXIT();
+}
+
+void GraphRenderer::rebuildEdges(const WatcherGraph &graph, size_t l, const WatcherGUIConfig &conf, size_t key)
+{
+    TRACE_ENTER();
+
+    const WatcherLayerData &layer=graph.layers[l];
+    LayerEdges &le=layers[l];
+    const Color &c=layer.edgeDisplayInfo.color;
+    const GLfloat color[]={
+        conf.monochromeMode ? 0.0 : c.r/255.0,
+        conf.monochromeMode ? 0.0 : c.g/255.0,
+        conf.monochromeMode ? 0.0 : c.b/255.0,
+        conf.monochromeMode ? 1.0 : c.a/255.0
+    };
+    const GLfloat width=layer.edgeDisplayInfo.width;
+
+    vector<GLfloat> data;
+    data.reserve(le.count*instanceFloats);
+    le.edges.clear();
+    for (size_t i=0; i<graph.numValidNodes; i++) {
+        const NodeDisplayInfo &n1=graph.nodes[i];
+        if (!n1.isActive)
+            continue;
+        for (size_t j=0; j<graph.numValidNodes; j++) {
+            const NodeDisplayInfo &n2=graph.nodes[j];
+            if (!n2.isActive || !layer.edges[i][j])
+                continue;
+            GLfloat instance[instanceFloats]={
+                n1.x, n1.y, n1.z, width,
+                color[0], color[1], color[2], color[3],
+                n2.x, n2.y, n2.z
+            };
+            data.insert(data.end(), instance, instance+instanceFloats);
+            le.edges.push_back(Edge(i, j));
+        }
+    }
+    upload(le, data);
+    le.count=le.edges.size();
+    le.threeD=conf.threeDView;
+    le.key=key;
+    edgeRebuilds++;
+
+    TRACE_EXIT();
+}
+
+const GraphRenderer::EdgeList &GraphRenderer::edges(size_t l) const
+{
+    static const EdgeList none;
+    return l<layers.size() ? layers[l].edges : none;
+}
+
+void GraphRenderer::drawInstanced(const Mesh &mesh, GLuint instances, size_t first, size_t count)
+{
+    if (!mesh.count || !count)
+        return;
+
+    bindBuffer(GL_ARRAY_BUFFER, mesh.buffer);
+    vertexAttribPointer(vertexAttrib, 3, GL_FLOAT, GL_FALSE, meshFloats*sizeof(GLfloat), 0);
+    vertexAttribPointer(normalAttrib, 3, GL_FLOAT, GL_FALSE, meshFloats*sizeof(GLfloat), reinterpret_cast<const GLvoid *>(3*sizeof(GLfloat)));
+    enableVertexAttribArray(vertexAttrib);
+    enableVertexAttribArray(normalAttrib);
+
+    const GLsizei stride=instanceFloats*sizeof(GLfloat);
+    const size_t base=first*stride;
+    const GLint sizes[]={ 4, 4, 3 };
+    bindBuffer(GL_ARRAY_BUFFER, instances);
+    for (GLuint a=0, offset=0; a<3; offset+=sizes[a], a++) {
+        vertexAttribPointer(instanceAttrib0+a, sizes[a], GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const GLvoid *>(base+offset*sizeof(GLfloat)));
+        enableVertexAttribArray(instanceAttrib0+a);
+        vertexAttribDivisor(instanceAttrib0+a, 1);
+    }
+
+    GLfloat lineWidth=1.0;
+    if (mesh.mode==GL_LINE_LOOP) {
+        glGetFloatv(GL_LINE_WIDTH, &lineWidth);
+        glLineWidth(mesh.lineWidth);
+    }
+
+    drawArraysInstanced(mesh.mode, 0, mesh.count, count);
+
+    if (mesh.mode==GL_LINE_LOOP)
+        glLineWidth(lineWidth);
+    for (GLuint a=0; a<3; a++) {
+        vertexAttribDivisor(instanceAttrib0+a, 0);
+        disableVertexAttribArray(instanceAttrib0+a);
+    }
+    disableVertexAttribArray(vertexAttrib);
+    disableVertexAttribArray(normalAttrib);
+    bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GraphRenderer::drawNodes()
+{
+    if (!valid || !nodeCount)
+        return;
+
+    useProgram(nodeProgram);
+    for (size_t s=0; s<numShapes; s++)
+        drawInstanced(nodeMeshes[nodesThreeD][s], nodeInstances.buffer, shapeFirst[s], shapeCount[s]);
+    useProgram(0);
+}
+
+void GraphRenderer::drawEdges(size_t l)
+{
+    if (!valid || l>=layers.size() || !layers[l].count)
+        return;
+
+    useProgram(edgeProgram);
+    uniform1i(flatEdgesUniform, !layers[l].threeD);
+    drawInstanced(edgeMeshes[layers[l].threeD], layers[l].buffer, 0, layers[l].count);
+    useProgram(0);
+}
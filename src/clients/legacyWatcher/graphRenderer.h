@@ -0,0 +1,193 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file graphRenderer.h
+ * Retained mode drawing of the nodes and edges of a WatcherGraph.
+ */
+#ifndef GRAPH_RENDERER_H
+#define GRAPH_RENDERER_H
+
+#include <vector>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <boost/function.hpp>
+#include "declareLogger.h"
+
+namespace watcher
+{
+    class WatcherGraph;
+    class WatcherGUIConfig;
+
+    /**
+     * Draws the nodes and edges of a WatcherGraph from vertex buffers which are
+     * only rebuilt when the graph changes, instead of issuing every vertex of
+     * every node and edge each frame.
+     *
+     * Each node shape is a mesh which is drawn once per node with a single
+     * instanced draw call: the position, size, color and spin of each node are
+     * per-instance attributes. Edges are done the same way, with one instanced
+     * call per layer. The shaders do the lighting the fixed function pipeline
+     * would have done, using the lights and material set up by the caller, and
+     * use the caller's modelview and projection matrices, so batched and
+     * immediate mode drawing can be mixed.
+     *
+     * Needs GLSL 1.20, vertex buffer objects, and ARB_instanced_arrays (or
+     * OpenGL 3.3), which Mesa's software rasterizers have. initialize() returns
+     * false if the context doesn't have them, in which case the caller should
+     * keep drawing in immediate mode.
+     *
+     * All functions must be called from the thread which owns the GL context,
+     * with the context current.
+     */
+    class GraphRenderer
+    {
+        public:
+            /** Looks up a GL function by name in the current context. */
+            typedef boost::function<void *(const char *)> ProcAddressFunction;
+
+            GraphRenderer();
+            ~GraphRenderer();
+
+            /**
+             * Compile the shaders and build the shape meshes in the current context.
+             * @return false if the context cannot do batched drawing.
+             */
+            bool initialize(const ProcAddressFunction &getProcAddress);
+
+            /** Free the GL objects. Call before the context goes away. */
+            void release();
+
+            bool isValid() const { return valid; }
+
+            /**
+             * Bring the buffers up to date with the graph. Nodes are rebuilt when
+             * their display data changes; a layer's edges are rebuilt when the graph's
+             * changeCount() moves or the layer's display info changes. Otherwise this
+             * only costs a pass over the nodes.
+             */
+            void update(const WatcherGraph &graph, const WatcherGUIConfig &conf);
+
+            /** Draw the nodes of the physical layer. */
+            void drawNodes();
+
+            /** Draw the edges of layer l. */
+            void drawEdges(size_t l);
+
+            /** The (node, node) index pairs of the edges drawn by drawEdges(l). */
+            typedef std::pair<size_t, size_t> Edge;
+            typedef std::vector<Edge> EdgeList;
+            const EdgeList &edges(size_t l) const;
+
+            /** Number of nodes drawn by drawNodes() */
+            size_t numNodes() const { return nodeCount; }
+
+            /**
+             * True if drawNodes() draws a node of this shape. Shapes which are
+             * not batched (glut's teapot) must be drawn by the caller.
+             */
+            static bool isBatched(int shape, bool threeD);
+
+            /** Number of times update() rebuilt the node and edge buffers */
+            unsigned long nodeRebuilds, edgeRebuilds;
+
+        private:
+            DECLARE_LOGGER();
+
+            /** A shape to be drawn once per instance. */
+            struct Mesh {
+                GLuint buffer;
+                GLenum mode;
+                GLsizei count;
+                GLfloat lineWidth;
+            };
+
+            /** The meshes for each NodeShape, for the 2D and 3D views */
+            enum { numShapes=6 };
+            Mesh nodeMeshes[2][numShapes];
+            Mesh edgeMeshes[2];
+
+            struct Instances {
+                Instances() : buffer(0), capacity(0), key(0) { }
+                GLuint buffer;
+                size_t capacity;        // floats the buffer has room for
+                size_t key;             // hash of what the instances were built from
+            };
+
+            /** node instances, sorted by shape */
+            Instances nodeInstances;
+            size_t shapeFirst[numShapes], shapeCount[numShapes];
+            size_t nodeCount;
+            bool nodesThreeD;
+
+            struct LayerEdges : public Instances {
+                LayerEdges() : count(0), threeD(false) { }
+                EdgeList edges;
+                size_t count;
+                bool threeD;
+            };
+            std::vector<LayerEdges> layers;
+            unsigned long graphChanges;
+
+            GLuint nodeProgram, edgeProgram;
+            GLint flatEdgesUniform;
+            bool valid;
+
+            void buildMeshes();
+            void buildMesh(Mesh &mesh, GLenum mode, const std::vector<GLfloat> &vertices, GLfloat lineWidth=1.0);
+            void upload(Instances &inst, const std::vector<GLfloat> &data);
+            GLuint buildProgram(const char *vertexSource, const char *name);
+            void rebuildNodes(const WatcherGraph &graph, const WatcherGUIConfig &conf, size_t key);
+            void rebuildEdges(const WatcherGraph &graph, size_t l, const WatcherGUIConfig &conf, size_t key);
+            void drawInstanced(const Mesh &mesh, GLuint instances, size_t first, size_t count);
+
+            /** GL 1.5+ entry points, looked up in initialize() */
+            PFNGLGENBUFFERSPROC genBuffers;
+            PFNGLDELETEBUFFERSPROC deleteBuffers;
+            PFNGLBINDBUFFERPROC bindBuffer;
+            PFNGLBUFFERDATAPROC bufferData;
+            PFNGLBUFFERSUBDATAPROC bufferSubData;
+            PFNGLCREATESHADERPROC createShader;
+            PFNGLDELETESHADERPROC deleteShader;
+            PFNGLSHADERSOURCEPROC shaderSource;
+            PFNGLCOMPILESHADERPROC compileShader;
+            PFNGLGETSHADERIVPROC getShaderiv;
+            PFNGLGETSHADERINFOLOGPROC getShaderInfoLog;
+            PFNGLCREATEPROGRAMPROC createProgram;
+            PFNGLDELETEPROGRAMPROC deleteProgram;
+            PFNGLATTACHSHADERPROC attachShader;
+            PFNGLBINDATTRIBLOCATIONPROC bindAttribLocation;
+            PFNGLLINKPROGRAMPROC linkProgram;
+            PFNGLGETPROGRAMIVPROC getProgramiv;
+            PFNGLGETPROGRAMINFOLOGPROC getProgramInfoLog;
+            PFNGLUSEPROGRAMPROC useProgram;
+            PFNGLGETUNIFORMLOCATIONPROC getUniformLocation;
+            PFNGLUNIFORM1IPROC uniform1i;
+            PFNGLVERTEXATTRIBPOINTERPROC vertexAttribPointer;
+            PFNGLENABLEVERTEXATTRIBARRAYPROC enableVertexAttribArray;
+            PFNGLDISABLEVERTEXATTRIBARRAYPROC disableVertexAttribArray;
+            PFNGLVERTEXATTRIBDIVISORARBPROC vertexAttribDivisor;
+            PFNGLDRAWARRAYSINSTANCEDARBPROC drawArraysInstanced;
+
+            // no copying or assignment
+            GraphRenderer(const GraphRenderer &);
+            GraphRenderer &operator=(const GraphRenderer &);
+    };
+}
+
+#endif // GRAPH_RENDERER_H
@@ -0,0 +1,367 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file labelAtlas.cpp
+ */
+#include <math.h>
+#include <QFont>
+#include <QFontMetrics>
+#include <QImage>
+#include <QPainter>
+#include <QGLWidget>
+#include <GL/glu.h>
+
+#include "labelAtlas.h"
+#include "logger.h"
+
+using namespace std;
+using namespace watcher;
+
+INIT_LOGGER(LabelAtlas, "LabelAtlas");
+
+bool LabelAtlas::Key::operator<(const Key &other) const
+{
+    if (text!=other.text)
+        return text<other.text;
+    if (font!=other.font)
+        return font<other.font;
+    if (pointSize!=other.pointSize)
+        return pointSize<other.pointSize;
+    return color<other.color;
+}
+
+LabelAtlas::LabelAtlas(GLsizei pageSize_, size_t maxPages_) :
+    hits(0), misses(0), pageSize(pageSize_), maxPages(maxPages_), frame(0)
+{
+}
+
+LabelAtlas::~LabelAtlas()
+{
+    // textures have to be freed with the context current, by release().
+}
+
+void LabelAtlas::release()
+{
+    for (vector<Page>::iterator p=pages.begin(); p!=pages.end(); ++p)
+        glDeleteTextures(1, &p->texture);
+    pages.clear();
+    entries.clear();
+}
+
+bool LabelAtlas::add(GLdouble x, GLdouble y, GLdouble z, const string &text, const string &font, int pointSize, const unsigned char color[4])
+{
+    GLdouble modelview[16], projection[16];
+    GLint viewport[4];
+    glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
+    glGetDoublev(GL_PROJECTION_MATRIX, projection);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLdouble wx, wy, wz;
+    if (!gluProject(x, y, z, modelview, projection, viewport, &wx, &wy, &wz))
+        return true;
+    if (wz<0.0 || wz>1.0)
+        return true;        // behind the eye or past the far plane, renderText() wouldn't show it either.
+
+    Key key;
+    key.text=text;
+    key.font=font;
+    key.pointSize=pointSize;
+    key.color=color[0]<<24 | color[1]<<16 | color[2]<<8 | color[3];
+
+    Entries::iterator e=entries.find(key);
+    if (e==entries.end()) {
+        misses++;
+        e=insert(key);
+        if (e==entries.end())
+            return false;
+    }
+    else
+        hits++;
+
+    Entry &entry=e->second;
+    entry.lastUsed=frame;
+
+    // Whole pixels, so the texels land on pixels and the text stays sharp.
+    GLfloat left=floor(wx+0.5)-1, bottom=floor(wy+0.5)-entry.below;
+    GLfloat right=left+entry.w, top=bottom+entry.h;
+    GLfloat s0=GLfloat(entry.x)/pageSize, s1=GLfloat(entry.x+entry.w)/pageSize;
+    GLfloat t0=GLfloat(entry.y)/pageSize, t1=GLfloat(entry.y+entry.h)/pageSize;
+    GLfloat depth=-wz;
+    const GLfloat quad[]={
+        s0, t0, left, bottom, depth,
+        s1, t0, right, bottom, depth,
+        s1, t1, right, top, depth,
+        s0, t1, left, top, depth
+    };
+    vector<GLfloat> &quads=pages[entry.page].quads;
+    quads.insert(quads.end(), quad, quad+sizeof(quad)/sizeof(quad[0]));
+
+    return true;
+}
+
+void LabelAtlas::flush()
+{
+    bool any=false;
+    for (vector<Page>::const_iterator p=pages.begin(); p!=pages.end() && !any; ++p)
+        any=!p->quads.empty();
+    if (!any)
+        return;
+
+    // The quads are in window coordinates, with gluProject()'s depth.
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(viewport[0], viewport[0]+viewport[2], viewport[1], viewport[1]+viewport[3], 0.0, 1.0);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_TEXTURE_2D);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+    for (vector<Page>::iterator p=pages.begin(); p!=pages.end(); ++p) {
+        if (p->quads.empty())
+            continue;
+        glBindTexture(GL_TEXTURE_2D, p->texture);
+        glInterleavedArrays(GL_T2F_V3F, 0, &p->quads[0]);
+        glDrawArrays(GL_QUADS, 0, p->quads.size()/5);
+        p->quads.clear();
+    }
+
+    glPopClientAttrib();
+    glPopAttrib();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+}
+
+void LabelAtlas::beginFrame()
+{
+    frame++;
+
+    vector<Key> keys;
+    {
+        boost::mutex::scoped_lock lock(expiredMutex);
+        keys.swap(expired);
+    }
+
+    // The atlas doesn't know which color the label was drawn in, so drop all
+    // of them. A label with the same text which is still around will be
+    // rendered again the next time it's drawn.
+    for (vector<Key>::const_iterator key=keys.begin(); key!=keys.end(); ++key) {
+        Entries::iterator e=entries.lower_bound(*key);
+        while (e!=entries.end() && e->first.text==key->text && e->first.font==key->font && e->first.pointSize==key->pointSize) {
+            free(e->second);
+            entries.erase(e++);
+        }
+    }
+}
+
+void LabelAtlas::expire(const LabelDisplayInfo &label)
+{
+    Key key;
+    key.text=label.labelText;
+    key.font=label.fontName;
+    key.pointSize=(int)label.pointSize;
+    key.color=0;
+
+    boost::mutex::scoped_lock lock(expiredMutex);
+    expired.push_back(key);
+}
+
+LabelAtlas::Entries::iterator LabelAtlas::insert(const Key &key)
+{
+    TRACE_ENTER();
+
+    QFont font(key.font.c_str(), key.pointSize);
+    QFontMetrics metrics(font);
+    QString text=QString::fromUtf8(key.text.c_str());
+
+    // A pixel of padding all round, so neighbors don't bleed in.
+    GLint w=metrics.width(text)+2, h=metrics.height()+2;
+    if (w>pageSize || h>pageSize) {
+        LOG_WARN("Label \"" << key.text << "\" is too big for the label atlas.");
+        TRACE_EXIT();
+        return entries.end();
+    }
+
+    Entry entry;
+    if (!allocate(w, h, entry) &&
+            !(addPage() && allocate(w, h, entry)) &&
+            !(evictOlderThan(frame) && allocate(w, h, entry))) {
+        LOG_WARN("Label atlas is full, " << entries.size() << " labels in " << pages.size() << " pages.");
+        TRACE_EXIT();
+        return entries.end();
+    }
+    entry.below=h-1-metrics.ascent();
+    entry.lastUsed=frame;
+
+    QImage image(w, h, QImage::Format_ARGB32_Premultiplied);
+    image.fill(0);
+    {
+        QPainter painter(&image);
+        painter.setFont(font);
+        painter.setPen(QColor(key.color>>24 & 0xff, key.color>>16 & 0xff, key.color>>8 & 0xff, key.color & 0xff));
+        painter.drawText(1, 1+metrics.ascent(), text);
+    }
+    // flips the image, so the bottom of the text is at entry.y
+    QImage glImage=QGLWidget::convertToGLFormat(image.convertToFormat(QImage::Format_ARGB32));
+
+    GLint bound=0;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+    glBindTexture(GL_TEXTURE_2D, pages[entry.page].texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, entry.x, entry.y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, glImage.bits());
+    glBindTexture(GL_TEXTURE_2D, bound);
+
+    TRACE_EXIT();
+    return entries.insert(Entries::value_type(key, entry)).first;
+}
+
+bool LabelAtlas::addPage()
+{
+    if (pages.size()>=maxPages)
+        return false;
+
+    Page page;
+    page.top=0;
+    glGenTextures(1, &page.texture);
+
+    GLint bound=0;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+    glBindTexture(GL_TEXTURE_2D, page.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, pageSize, pageSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, bound);
+
+    pages.push_back(page);
+    LOG_DEBUG("Added label atlas page " << pages.size() << " of " << maxPages);
+    return true;
+}
+
+bool LabelAtlas::allocate(GLint w, GLint h, Entry &entry)
+{
+    for (size_t p=0; p<pages.size(); p++)
+        if (allocate(p, w, h, entry))
+            return true;
+    return false;
+}
+
+//
+// Shelf packing: text goes into the first shelf which is not much taller than
+// it, at the first free span which is wide enough. A new shelf is started at
+// the top of the page if there isn't one.
+//
+bool LabelAtlas::allocate(size_t p, GLint w, GLint h, Entry &entry)
+{
+    Page &page=pages[p];
+    for (size_t s=0; s<=page.shelves.size(); s++) {
+        if (s==page.shelves.size()) {
+            if (page.top+h>pageSize)
+                return false;
+            Shelf shelf;
+            shelf.y=page.top;
+            shelf.height=h;
+            shelf.free.push_back(Span(0, pageSize));
+            page.shelves.push_back(shelf);
+            page.top+=h;
+        }
+        Shelf &shelf=page.shelves[s];
+        if (shelf.height<h || shelf.height>h+h/4+2)
+            continue;
+        for (list<Span>::iterator span=shelf.free.begin(); span!=shelf.free.end(); ++span) {
+            if (span->w<w)
+                continue;
+            entry.page=p;
+            entry.shelf=s;
+            entry.x=span->x;
+            entry.y=shelf.y;
+            entry.w=w;
+            entry.h=h;
+            span->x+=w;
+            span->w-=w;
+            if (!span->w)
+                shelf.free.erase(span);
+            return true;
+        }
+    }
+    return false;
+}
+
+void LabelAtlas::free(const Entry &entry)
+{
+    Page &page=pages[entry.page];
+    Shelf &shelf=page.shelves[entry.shelf];
+
+    list<Span>::iterator next=shelf.free.begin();
+    while (next!=shelf.free.end() && next->x<entry.x)
+        ++next;
+    list<Span>::iterator span=shelf.free.insert(next, Span(entry.x, entry.w));
+
+    // merge with the neighbors
+    if (next!=shelf.free.end() && span->x+span->w==next->x) {
+        span->w+=next->w;
+        shelf.free.erase(next);
+    }
+    if (span!=shelf.free.begin()) {
+        list<Span>::iterator prev=span;
+        --prev;
+        if (prev->x+prev->w==span->x) {
+            prev->w+=span->w;
+            shelf.free.erase(span);
+        }
+    }
+
+    // Give empty shelves at the top back to the page, so they can be reused at another height.
+    while (!page.shelves.empty()) {
+        const Shelf &last=page.shelves.back();
+        if (last.free.size()!=1 || last.free.front().w!=pageSize)
+            break;
+        page.top=last.y;
+        page.shelves.pop_back();
+    }
+}
+
+size_t LabelAtlas::evictOlderThan(unsigned long f)
+{
+    size_t evicted=0;
+    for (Entries::iterator e=entries.begin(); e!=entries.end(); ) {
+        if (e->second.lastUsed<f) {
+            free(e->second);
+            entries.erase(e++);
+            evicted++;
+        }
+        else
+            ++e;
+    }
+    LOG_DEBUG("Evicted " << evicted << " labels from the label atlas");
+    return evicted;
+}
@@ -0,0 +1,162 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file labelAtlas.h
+ * A cache of rendered label text.
+ */
+#ifndef LABEL_ATLAS_H
+#define LABEL_ATLAS_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <list>
+#include <GL/gl.h>
+#include <boost/thread/mutex.hpp>
+#include "libwatcher/labelDisplayInfo.h"
+#include "declareLogger.h"
+
+namespace watcher
+{
+    /**
+     * Keeps the text of labels rendered in textures, so a label's text is laid
+     * out and rasterized once instead of by QGLWidget::renderText() every
+     * frame.
+     *
+     * Each distinct (text, font, point size, color) is drawn with QPainter into
+     * a free spot on one of a few large texture pages. Labels are queued with
+     * add(), which projects them to the window with the current matrices, and
+     * drawn by flush() as screen aligned, textured quads, one draw call per
+     * page. Call flush() before the matrices change in a way that matters,
+     * at the end of each layer say.
+     *
+     * Text which is no longer used is dropped when the graph expires its
+     * label (see expire()), or when the pages are full and it hasn't been
+     * drawn for a while.
+     *
+     * Everything except expire() must be called from the GL thread, with the
+     * context current.
+     */
+    class LabelAtlas
+    {
+        public:
+            /**
+             * @param pageSize width and height of each texture page
+             * @param maxPages most texture pages to use
+             */
+            LabelAtlas(GLsizei pageSize=1024, size_t maxPages=4);
+            ~LabelAtlas();
+
+            /** Free the textures. Call before the context goes away. */
+            void release();
+
+            /**
+             * Queue text to be drawn with its baseline starting at (x, y, z) in
+             * the current modelview, as QGLWidget::renderText() would.
+             * @param color r, g, b, a, 0-255
+             * @return false if the text could not be put in the atlas. Draw it
+             * some other way.
+             */
+            bool add(GLdouble x, GLdouble y, GLdouble z, const std::string &text, const std::string &font,
+                    int pointSize, const unsigned char color[4]);
+
+            /** Draw everything queued by add() since the last flush(). */
+            void flush();
+
+            /**
+             * Start a new frame: drop text that expire() was told about. Text
+             * not drawn for a while is dropped first when space runs out.
+             */
+            void beginFrame();
+
+            /**
+             * Note that label has gone from the graph, so its text may be dropped.
+             * May be called from any thread (WatcherGraph::labelExpiredFunction).
+             */
+            void expire(const LabelDisplayInfo &label);
+
+            /** Number of distinct labels in the atlas */
+            size_t size() const { return entries.size(); }
+
+            /** add()s which found their text already rendered, and which had to render it */
+            unsigned long hits, misses;
+
+        private:
+            DECLARE_LOGGER();
+
+            struct Key {
+                std::string text;
+                std::string font;
+                int pointSize;
+                unsigned int color;
+                bool operator<(const Key &other) const;
+            };
+
+            /** A free stretch of a shelf */
+            struct Span {
+                Span(GLint x_, GLint w_) : x(x_), w(w_) { }
+                GLint x, w;
+            };
+
+            /** A row of text of about the same height, packed left to right */
+            struct Shelf {
+                GLint y, height;
+                std::list<Span> free;
+            };
+
+            struct Page {
+                GLuint texture;
+                std::vector<Shelf> shelves;
+                GLint top;              // first row not in a shelf
+                std::vector<GLfloat> quads;     // queued by add(): s, t, x, y, z per vertex
+            };
+            std::vector<Page> pages;
+            GLsizei pageSize;
+            size_t maxPages;
+
+            struct Entry {
+                size_t page, shelf;
+                GLint x, y, w, h;
+                GLint below;            // pixels below the baseline
+                unsigned long lastUsed;
+            };
+            typedef std::map<Key, Entry> Entries;
+            Entries entries;
+            unsigned long frame;
+
+            /** Labels expire()d since the last beginFrame(), with no color */
+            std::vector<Key> expired;
+            boost::mutex expiredMutex;
+
+            Entries::iterator insert(const Key &key);
+            bool allocate(GLint w, GLint h, Entry &entry);
+            bool allocate(size_t page, GLint w, GLint h, Entry &entry);
+            bool addPage();
+            void free(const Entry &entry);
+
+            /** Drop entries not used since frame, to make room */
+            size_t evictOlderThan(unsigned long frame);
+
+            // no copying or assignment
+            LabelAtlas(const LabelAtlas &);
+            LabelAtlas &operator=(const LabelAtlas &);
+    };
+}
+
+#endif // LABEL_ATLAS_H
@@ -49,6 +49,8 @@
 #include "nodeConfigurationDialog.h"
 #include "skybox.h"
 #include "watcherGUIConfig.h"
+#include "graphRenderer.h"
+#include "labelAtlas.h"
 
 INIT_LOGGER(manetGLView, "manetGLView");
 
@@ -644,30 +646,20 @@ void manetGLView::getNodeRectangle(double &xMin, double &xMax, double &yMin, dou
 	bool includeAntenna = false;     // antenna currently broken
 	// bool includeHierarchy = isActive(HIERARCHY_LAYER); 
 
-	// find drawing extents
-	for (size_t i=0; i<wGraph->numValidNodes; i++) 
+	// find drawing extents - the graph keeps track of them as nodes move. 
+	SpatialBox nodeBox;
+	if (wGraph->spatialIndex.bounds(nodeBox)) 
 	{
-		if (!wGraph->nodes[i].isActive) 
-			continue;
-
 		double r = 0;
 		if(includeAntenna)
 			r = conf->antennaRadius; 
 
-		{
-			double nodeXMin = wGraph->nodes[i].x - r;
-			double nodeXMax = wGraph->nodes[i].x + r;
-			double nodeYMin = wGraph->nodes[i].y - r;
-			double nodeYMax = wGraph->nodes[i].y + r;
-			double nodeZMin = wGraph->nodes[i].z - r;
-			double nodeZMax = wGraph->nodes[i].z + r;
-			if(nodeXMin < xMin) xMin = nodeXMin;
-			if(nodeXMax > xMax) xMax = nodeXMax;
-			if(nodeYMin < yMin) yMin = nodeYMin;
-			if(nodeYMax > yMax) yMax = nodeYMax;
-			if(nodeZMin < zMin) zMin = nodeZMin;
-			if(nodeZMax > zMax) zMax = nodeZMax;
-		}
+		xMin = nodeBox.xMin - r;
+		xMax = nodeBox.xMax + r;
+		yMin = nodeBox.yMin - r;
+		yMax = nodeBox.yMax + r;
+		zMin = nodeBox.zMin - r;
+		zMax = nodeBox.zMax + r;
 	}
 	if (conf->backgroundImage) {
 		BackgroundImage &bgi=BackgroundImage::getInstance();
@@ -682,6 +674,85 @@ void manetGLView::getNodeRectangle(double &xMin, double &xMax, double &yMin, dou
 	}
 }
 
+//
+// Find the part of the nodes' x, y plane which shows through the window rectangle 
+// (x0, y0)-(x1, y1) (GL window coordinates), for nodes between zMin and zMax. 
+// That's the bounding box of where the rays through the corners of the rectangle 
+// cross the planes at zMin and zMax. Returns false if the near or far clipping plane 
+// cuts through the nodes, or we're looking at them edge on, as then the corners 
+// don't tell the whole story. 
+//
+bool manetGLView::nodeAreaInWindowRect(
+        GLdouble x0, GLdouble y0, GLdouble x1, GLdouble y1, 
+        const GLdouble modelmatrix[16], const GLdouble projmatrix[16], const GLint viewport[4],
+        double zMin, double zMax, 
+        double &xMin, double &yMin, double &xMax, double &yMax)
+{
+    GLdouble corners[4][2]={ { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y1 } };
+    GLdouble planes[2]={ zMin, zMax };
+
+    xMin=yMin=DBL_MAX;
+    xMax=yMax=-DBL_MAX;
+    for (size_t c=0; c<4; c++) {
+        GLdouble nx, ny, nz, fx, fy, fz; 
+        if (gluUnProject(corners[c][0], corners[c][1], 0.0, modelmatrix, projmatrix, viewport, &nx, &ny, &nz)!=GL_TRUE ||
+            gluUnProject(corners[c][0], corners[c][1], 1.0, modelmatrix, projmatrix, viewport, &fx, &fy, &fz)!=GL_TRUE)
+            return false;
+        if (fabs(fz-nz)<1e-9) 
+            return false;
+        for (size_t p=0; p<2; p++) {
+            GLdouble t=(planes[p]-nz)/(fz-nz); 
+            if (t<0.0 || t>1.0) 
+                return false;
+            GLdouble x=nx+t*(fx-nx), y=ny+t*(fy-ny);
+            if (x<xMin) xMin=x;
+            if (x>xMax) xMax=x;
+            if (y<yMin) yMin=y;
+            if (y>yMax) yMax=y;
+        }
+    }
+    return true;
+}
+
+manetGLView::VisibleArea manetGLView::visibleArea()
+{
+    VisibleArea area;
+    area.all=true;
+
+    SpatialBox nodeBox;
+    if (!conf->cullOffscreen || !wGraph->spatialIndex.bounds(nodeBox))
+        return area;
+
+    GLdouble modelmatrix[16];
+    GLdouble projmatrix[16];
+    GLint viewport[4];
+    glGetDoublev(GL_MODELVIEW_MATRIX, modelmatrix);
+    glGetDoublev(GL_PROJECTION_MATRIX, projmatrix);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    // Leave plenty of room for node shapes and labels which hang into the window 
+    // from nodes which are just outside it, labels hang off to the right. 
+    GLdouble mx=viewport[2]/2.0, my=viewport[3]/4.0;
+    area.all=!nodeAreaInWindowRect(viewport[0]-mx, viewport[1]-my, viewport[0]+viewport[2]+mx/2, viewport[1]+viewport[3]+my, 
+            modelmatrix, projmatrix, viewport, nodeBox.zMin, nodeBox.zMax, area.xMin, area.yMin, area.xMax, area.yMax); 
+    return area;
+}
+
+const vector<size_t> &manetGLView::nodesIn(const WatcherGraph *graph, const VisibleArea &area)
+{
+    shownNodes.clear();
+    if (area.all) {
+        for (size_t n=0; n<graph->numValidNodes; n++) 
+            shownNodes.push_back(n);
+    }
+    else {
+        graph->spatialIndex.query(area.xMin, area.yMin, area.xMax, area.yMax, shownNodes); 
+        std::sort(shownNodes.begin(), shownNodes.end());   // draw in the same order as ever
+        nodesCulled+=graph->numValidNodes-shownNodes.size(); 
+    }
+    return shownNodes;
+}
+
 void manetGLView::getShiftAmount(GLdouble &x_ret, GLdouble &y_ret)
 {
     GLdouble z;
@@ -1017,7 +1088,6 @@ manetGLView::manetGLView(QWidget *parent) :
     streamsDialog(NULL),
     wGraph(NULL),
     watcherdConnectionThread(NULL),
-    maintainGraphThread(NULL),
     checkIOThread(NULL),
     streamRate(1.0),
     playbackPaused(false),
@@ -1026,8 +1096,11 @@ manetGLView::manetGLView(QWidget *parent) :
     playbackRangeEnd(0),
     playbackRangeStart(0),
     autoCenterNodesFlag(false),
-    nodesDrawn(0), edgesDrawn(0), labelsDrawn(0),
+    renderer(NULL),
+    labelAtlas(new LabelAtlas),
+    nodesDrawn(0), edgesDrawn(0), labelsDrawn(0), nodesCulled(0), clustersDrawn(0),
     framesDrawn(0), fpsTimeBase(0), framesPerSec(0.0),
+    frameTimer(NULL), frameTime(0.0), messagesPerFrame(0), applyTimePerFrame(0.0), applyBacklog(0), 
     layerConfigurationDialog(NULL),
     nodeConfigurationDialog(new NodeConfigurationDialog(wGraph, NULL, NULL)),
     prevClickedNodeId(-1) // since unsigned, will set to large value.
@@ -1056,6 +1129,19 @@ manetGLView::manetGLView(QWidget *parent) :
 manetGLView::~manetGLView()
 {
     shutdown();
+
+    if (renderer) {
+        makeCurrent();
+        renderer->release();
+        delete renderer;
+        renderer=NULL;
+    }
+    if (labelAtlas) {
+        makeCurrent();
+        labelAtlas->release();
+        delete labelAtlas;
+        labelAtlas=NULL;
+    }
 }
 
 void manetGLView::shutdown() 
@@ -1083,7 +1169,6 @@ void manetGLView::shutdown()
     // order is important here. Destroy in dependency order. 
     boost::thread *threads[]={
         checkIOThread,
-        maintainGraphThread, 
         watcherdConnectionThread, 
     };
     for (unsigned int i=0; i<sizeof(threads)/sizeof(threads[0]); i++) {
@@ -1177,6 +1262,11 @@ QSize manetGLView::sizeHint() const
     return retVal;
 }
 
+static void *glProcAddress(const QGLContext *context, const char *name)
+{
+    return context->getProcAddress(QString::fromAscii(name)); 
+}
+
 // Values figure out by hand using Number and shift keys.
 static GLfloat matShine=0.6;
 static GLfloat specReflection[] = { 0.05, 0.05, 0.05, 1.0f };
@@ -1219,6 +1309,11 @@ void manetGLView::initializeGL()
     glMaterialfv(GL_FRONT, GL_SPECULAR, specReflection);
     glMaterialf(GL_FRONT, GL_SHININESS, matShine);
 
+    if (!renderer)
+        renderer=new GraphRenderer;
+    if (!renderer->initialize(boost::bind(glProcAddress, context(), _1)))
+        LOG_WARN("Batched rendering is not available, drawing the graph in immediate mode."); 
+
     TRACE_EXIT();
 }
 
@@ -1268,8 +1363,6 @@ void manetGLView::connectStream()
         // spawn work threads
         if (!checkIOThread) 
             checkIOThread=new boost::thread(boost::bind(&manetGLView::checkIO, this));
-        if (!maintainGraphThread) 
-            maintainGraphThread=new boost::thread(boost::bind(&manetGLView::maintainGraph, this));
 
         /* check every two seconds that the connection is still alive */
         do {
@@ -1284,89 +1377,124 @@ void manetGLView::connectStream()
     TRACE_EXIT();
 }
 
+void manetGLView::handleControlMessage(const MessagePtr &message)
+{
+    if (message->type==PLAYBACK_TIME_RANGE_MESSAGE_TYPE) {
+        PlaybackTimeRangeMessagePtr trm(dynamic_pointer_cast<PlaybackTimeRangeMessage>(message));
+        playbackRangeEnd=trm->max_;
+        playbackRangeStart=trm->min_;
+        if (!currentMessageTimestamp)
+            currentMessageTimestamp=
+                conf->playbackStartTime==SeekMessage::epoch ? playbackRangeStart : 
+                conf->playbackStartTime==SeekMessage::eof ? playbackRangeEnd : conf->playbackStartTime;
+        boost::mutex::scoped_lock lock(streamStateMutex);
+        streamState.rangeChanged=true;
+    } else if (message->type == LIST_STREAMS_MESSAGE_TYPE) {
+        ListStreamsMessagePtr m(dynamic_pointer_cast<ListStreamsMessage>(message));
+        boost::mutex::scoped_lock lock(streamStateMutex);
+        BOOST_FOREACH(EventStreamInfoPtr ev, m->evstreams) 
+            streamState.newStreams.push_back(make_pair(static_cast<unsigned long>(ev->uid), ev->description));
+    } else if (message->type == SPEED_MESSAGE_TYPE) {
+        // notification from the watcher daemon that the shared stream speed has changed
+        SpeedMessagePtr sm(dynamic_pointer_cast<SpeedMessage>(message));
+        changeSpeed(sm->speed);
+        if (sm->speed == 0)
+            playbackPaused = true;
+    } else if (message->type == STOP_MESSAGE_TYPE) {
+        playbackPaused = true;
+    } else if (message->type == START_MESSAGE_TYPE) {
+        playbackPaused = false;
+    } else if (message->type == STREAM_DESCRIPTION_MESSAGE_TYPE) {
+        StreamDescriptionMessagePtr m(dynamic_pointer_cast<StreamDescriptionMessage>(message));
+        streamDescription = m->desc;
+    }
+}
+
+//
+// Takes whatever has arrived from the stream in one go, then applies it to the graph 
+// for at most half a frame at a time, so a flood of messages can't starve the 
+// renderer of the graph and the CPU. Also does the graph maintenance. 
+// Nothing in here touches the widgets: what the GUI needs to know goes in 
+// streamState for watcherIdle() to pick up. 
+//
 void manetGLView::checkIO()
 {
     TRACE_ENTER();
 
+    deque<MessagePtr> pending;
+    vector<MessagePtr> arrived;
+    size_t layersSeen=wGraph->numValidLayers;
+    unsigned long seeksSeen=0;
+    ptime lastMaintenance=posix_time::microsec_clock::universal_time();
+
     while (true) {
         this_thread::interruption_point();
-        bool timeRangeMessageSent=false;
-        MessagePtr message;
-        while(messageStream && messageStream->getNextMessage(message)) {
+
+        posix_time::time_duration period=milliseconds(1000/std::max(conf->targetFrameRate, 1));
+        posix_time::time_duration budget=period/2;
+        bool renderBehind;
+        {
+            boost::mutex::scoped_lock lock(streamStateMutex);
+            renderBehind=streamState.renderBehind;
+            if (seeksSeen!=streamState.seeks) {
+                // the stream was restarted somewhere else, anything we have is stale. 
+                seeksSeen=streamState.seeks;
+                pending.clear();
+            }
+        }
+
+        // Wait for messages if there is nothing to do. If there is, only wait (for 
+        // the rest of the frame) when the renderer isn't keeping up, to give it the CPU.
+        posix_time::time_duration wait=pending.empty() ? posix_time::time_duration(milliseconds(100)) : renderBehind ? period-budget : posix_time::time_duration(0, 0, 0);
+        arrived.clear();
+        if (!messageStream || !messageStream->getNextMessages(arrived, wait)) {
+            usleep(100000);     // not connected (yet)
+            continue;
+        }
+
+        BOOST_FOREACH(const MessagePtr &message, arrived) {
             static unsigned long long messageCount=0;
             LOG_DEBUG("Got message number " <<  ++messageCount << " : " << *message);
+            if (isFeederEvent(message->type))
+                pending.push_back(message);
+            else 
+                handleControlMessage(message);  // including the range updates watcherd pushes as the database grows
+        }
 
-            if (!isFeederEvent(message->type)) {
-                if (message->type==PLAYBACK_TIME_RANGE_MESSAGE_TYPE) {
-                    PlaybackTimeRangeMessagePtr trm(dynamic_pointer_cast<PlaybackTimeRangeMessage>(message));
-                    playbackRangeEnd=trm->max_;
-                    playbackRangeStart=trm->min_;
-                    if (playbackSlider)
-                        playbackSlider->setRange(playbackRangeStart/1000, playbackRangeEnd/1000);
-                    if (!currentMessageTimestamp)
-                        currentMessageTimestamp=
-                            conf->playbackStartTime==SeekMessage::epoch ? playbackRangeStart : 
-                            conf->playbackStartTime==SeekMessage::eof ? playbackRangeEnd : conf->playbackStartTime;
-                    timeRangeMessageSent=false;
-                } else if (message->type == LIST_STREAMS_MESSAGE_TYPE) {
-                    ListStreamsMessagePtr m(dynamic_pointer_cast<ListStreamsMessage>(message));
-                    BOOST_FOREACH(EventStreamInfoPtr ev, m->evstreams) {
-                        streamsDialog->addStream(ev->uid, ev->description);
-                    }
-                } else if (message->type == SPEED_MESSAGE_TYPE) {
-                    // notification from the watcher daemon that the shared stream speed has changed
-                    SpeedMessagePtr sm(dynamic_pointer_cast<SpeedMessage>(message));
-                    changeSpeed(sm->speed);
-                    if (sm->speed == 0)
-                        playbackPaused = true;
-                } else if (message->type == STOP_MESSAGE_TYPE) {
-                    playbackPaused = true;
-                } else if (message->type == START_MESSAGE_TYPE) {
-                    playbackPaused = false;
-                } else if (message->type == STREAM_DESCRIPTION_MESSAGE_TYPE) {
-                    StreamDescriptionMessagePtr m(dynamic_pointer_cast<StreamDescriptionMessage>(message));
-                    streamDescription = m->desc;
-                }
-
-                // End of handling non feeder messages. 
-                continue;
-            }
+        ptime start=posix_time::microsec_clock::universal_time();
+        unsigned long applied=0;
+        while (!pending.empty()) {
+            MessagePtr message=pending.front();
+            pending.pop_front();
 
             // When control reaches this point, events are being streamed
             playbackPaused = false;
-
             currentMessageTimestamp=message->timestamp;
-            if (!sliderPressed)
-                playbackSlider->setValue(currentMessageTimestamp/1000); 
 
-            if (currentMessageTimestamp>playbackRangeEnd+10000 && !timeRangeMessageSent) { 
-                messageStream->getMessageTimeRange();
-                timeRangeMessageSent=true;
-            }
+            // update graph is thread-safe and creates the message's layer if needed.
+            wGraph->updateGraph(message);
 
-            // Really need to make layers a member of a base class...
-            GUILayer layer;
-            switch (message->type)
-            {
-                case LABEL_MESSAGE_TYPE: layer=(dynamic_pointer_cast<LabelMessage>(message))->layer; break;
-                case EDGE_MESSAGE_TYPE: layer=(dynamic_pointer_cast<EdgeMessage>(message))->layer; break;
-                case COLOR_MESSAGE_TYPE: layer=(dynamic_pointer_cast<ColorMessage>(message))->layer; break;
-                case CONNECTIVITY_MESSAGE_TYPE: layer=(dynamic_pointer_cast<ConnectivityMessage>(message))->layer; break;
-                case NODE_PROPERTIES_MESSAGE_TYPE: layer=(dynamic_pointer_cast<NodePropertiesMessage>(message))->layer; break;
-                default: break;
-            }
+            // checking the clock is not free, so only do it every so often. 
+            if (!(++applied%32) && posix_time::microsec_clock::universal_time()-start>=budget)
+                break;
+        }
+        ptime now=posix_time::microsec_clock::universal_time();
 
-            // do this before calling updateGraph() as it will create the layer if not found. 
-            if (!layer.empty()) {
-                if (!wGraph->layerExists(layer)) {
-                    LOG_DEBUG("Adding new layer to layer menu: " << layer); 
-                    addLayerMenuItem(layer, true); 
-                }
-            }
+        if (!playbackPaused && now-lastMaintenance>=milliseconds(100)) {
+            wGraph->doMaintanence(currentMessageTimestamp); // check expiration, etc. 
+            lastMaintenance=now;
+        }
 
-            // update graph is now thread-safe
-            wGraph->updateGraph(message);
+        boost::mutex::scoped_lock lock(streamStateMutex);
+        if (layersSeen>wGraph->numValidLayers)  // graph was cleared
+            layersSeen=0;
+        for ( ; layersSeen<wGraph->numValidLayers; layersSeen++) {
+            LOG_DEBUG("Adding new layer to layer menu: " << wGraph->layers[layersSeen].layerName); 
+            streamState.newLayers.push_back(wGraph->layers[layersSeen].layerName);
         }
+        streamState.messagesApplied+=applied;
+        streamState.applyTime+=(now-start).total_microseconds()/1000.0;
+        streamState.backlog=pending.size();
     }
     /* not reached */
 }
@@ -1384,10 +1512,54 @@ void manetGLView::updatePlaybackSliderRange()
     TRACE_EXIT();
 }
 
+void manetGLView::streamRestarted()
+{
+    boost::mutex::scoped_lock lock(streamStateMutex);
+    streamState.seeks++;
+}
+
+void manetGLView::updateFromStream()
+{
+    TRACE_ENTER();
+
+    StreamState state;
+    {
+        boost::mutex::scoped_lock lock(streamStateMutex);
+        state=streamState;
+        streamState.rangeChanged=false;
+        streamState.newLayers.clear();
+        streamState.newStreams.clear();
+        streamState.messagesApplied=0;
+        streamState.applyTime=0.0;
+    }
+
+    messagesPerFrame=state.messagesApplied;
+    applyTimePerFrame=state.applyTime;
+    applyBacklog=state.backlog;
+
+    if (playbackSlider) {
+        if (state.rangeChanged)
+            playbackSlider->setRange(playbackRangeStart/1000, playbackRangeEnd/1000);
+        if (!sliderPressed)
+            playbackSlider->setValue(currentMessageTimestamp/1000); 
+    }
+    if (streamsDialog) {
+        for (vector<pair<unsigned long, string> >::const_iterator s=state.newStreams.begin(); s!=state.newStreams.end(); ++s)
+            streamsDialog->addStream(s->first, s->second);
+    }
+    BOOST_FOREACH(const string &layer, state.newLayers) 
+        if (layerMenu)
+            emit connectNewLayer(QString(layer.c_str())); 
+
+    TRACE_EXIT();
+}
+
 void manetGLView::watcherIdle()
 {
     TRACE_ENTER();
 
+    ptime start=posix_time::microsec_clock::universal_time();
+
     if (conf->autorewind) {
         static time_t noNewMessagesForSeconds=0;
         if (currentMessageTimestamp==playbackRangeEnd) { 
@@ -1406,20 +1578,20 @@ void manetGLView::watcherIdle()
             noNewMessagesForSeconds=0;
     }
 
+    updateFromStream();
     updateGL();
 
-    TRACE_EXIT();
-}
-
-void manetGLView::maintainGraph() 
-{
-    TRACE_ENTER();
-    while (true) {
-        this_thread::interruption_point(); 
-        if (!playbackPaused)       // If paused, just keep things as they are.
-            wGraph->doMaintanence(currentMessageTimestamp); // check expiration, etc. 
-        usleep(100000);
+    // Schedule the next frame for a frame period after this one started, rather 
+    // than a period after it finished, so slow frames don't drag the rate down further.
+    int period=1000/std::max(conf->targetFrameRate, 1);
+    frameTime=(posix_time::microsec_clock::universal_time()-start).total_microseconds()/1000.0;
+    {
+        boost::mutex::scoped_lock lock(streamStateMutex);
+        streamState.renderBehind=frameTime>period;
     }
+    if (frameTimer)
+        frameTimer->start(std::max(0, period-static_cast<int>(frameTime)));
+
     TRACE_EXIT();
 }
 
@@ -1434,6 +1606,8 @@ void manetGLView::paintGL()
     else 
     {
         // Draw MANET normally.
+        if (labelAtlas)
+            labelAtlas->beginFrame();
         drawManet();
 
         if (conf->showGlobalView)  
@@ -1472,8 +1646,10 @@ void manetGLView::drawDebugInfo(QPainter &painter)
     info << "Messages dropped: " << messageStream->messagesDropped << endl;
     info << "Messages queued: " << messageStream->messageQueueSize() << endl;
 
-    info << "N/E/L: " << nodesDrawn << "/" << edgesDrawn << "/" << labelsDrawn << endl;
-    nodesDrawn=edgesDrawn=labelsDrawn=0;
+    info << "N/E/L: " << nodesDrawn << "/" << edgesDrawn << "/" << labelsDrawn << " (culled " << nodesCulled << " node passes)" << endl;
+    if (clustersDrawn)
+        info << "Clusters: " << clustersDrawn << " of " << wGraph->clusters.cellSize() << " units" << endl;
+    nodesDrawn=edgesDrawn=labelsDrawn=nodesCulled=clustersDrawn=0;
 
     framesDrawn++;
     int time=glutGet(GLUT_ELAPSED_TIME);
@@ -1482,7 +1658,9 @@ void manetGLView::drawDebugInfo(QPainter &painter)
         fpsTimeBase = time;        
         framesDrawn = 0;
     }
-    info << "FPS: " << framesPerSec << endl;
+    info << "FPS: " << framesPerSec << " (target " << conf->targetFrameRate << ")" << endl;
+    info << "Frame time: " << frameTime << " ms" << endl;
+    info << "Applied: " << messagesPerFrame << " messages in " << applyTimePerFrame << " ms, " << applyBacklog << " waiting" << endl;
     // info << "mat shine: " << matShine << endl;
     // info << "spec reflect: " << specReflection[0] << endl;
     // info << "amb light: " << ambLight0[0] << endl;
@@ -1818,60 +1996,359 @@ void manetGLView::drawManet(void)
 
 void manetGLView::drawGraph(WatcherGraph *&graph)
 {
-    // draw all physical layer nodes
+    if (levelOfDetail(graph)) {
+        drawClusteredGraph(graph);
+        return;
+    }
+    if (conf->batchedRendering && renderer && renderer->isValid()) {
+        drawBatchedGraph(graph);
+        return;
+    }
+
+    // draw all physical layer nodes which can be seen
     if (isActive(PHYSICAL_LAYER))
-        for (size_t n=0; n<graph->numValidNodes; n++) 
+        BOOST_FOREACH(size_t n, nodesIn(graph, visibleArea()))
             if (graph->nodes[n].isActive)
                 drawNode(graph->nodes[n], true);
+    flushLabels();
 
     // draw all edges and labels on all active layers
     // (must grab read lock around dynamic data like label lists)
     for (size_t l=0; l<graph->numValidLayers; l++) { 
         if (!graph->layers[l].isActive) 
             continue;
+        VisibleArea area=visibleArea();     // each layer is drawn a bit higher than the last
         bool layerEmpty=true;
         for (size_t i=0; i<graph->numValidNodes; i++) {
             if (graph->nodes[i].isActive) {
                 // drawNode(graph->nodes[i], false);      // "ghost" nodes
                 for (unsigned int j=0; j<graph->numValidNodes; j++) 
                     if (graph->nodes[j].isActive && graph->layers[l].edges[i][j]) {
-                        drawEdge(graph->layers[l].edgeDisplayInfo, graph->nodes[i], graph->nodes[j]);
                         layerEmpty=false;
+                        if (!area.overlaps(graph->nodes[i].x, graph->nodes[i].y, graph->nodes[j].x, graph->nodes[j].y)) 
+                            continue;
+                        drawEdge(graph->layers[l].edgeDisplayInfo, graph->nodes[i], graph->nodes[j]);
+                        GLdouble lx=(graph->nodes[i].x+graph->nodes[j].x)/2.0;  
+                        GLdouble ly=(graph->nodes[i].y+graph->nodes[j].y)/2.0;  
+                        GLdouble lz=(graph->nodes[i].z+graph->nodes[j].z)/2.0;  
+                        if (!area.contains(lx, ly))
+                            continue;
                         WatcherLayerData::ReadLock readLock(graph->layers[l].edgeLabelsMutexes[i][j]);
                         int labelCount=0;
-                        BOOST_FOREACH(const WatcherLayerData::EdgeLabels::value_type &label, graph->layers[l].edgeLabels[i][j]) {
-                            GLdouble lx=(graph->nodes[i].x+graph->nodes[j].x)/2.0;  
-                            GLdouble ly=(graph->nodes[i].y+graph->nodes[j].y)/2.0;  
-                            GLdouble lz=(graph->nodes[i].z+graph->nodes[j].z)/2.0;  
+                        BOOST_FOREACH(const WatcherLayerData::EdgeLabels::value_type &label, graph->layers[l].edgeLabels[i][j]) 
                             drawLabel(lx, ly, lz, label, labelCount++); 
-                        }
                     }
             }
         }
 
-        {
+        drawFloatingLabels(graph, l, area); 
+        drawNodeLabels(graph, l, area); 
+        flushLabels();
+
+        // move up "layerPadding" units before drawing the next layer if the previous layer was not empty.
+        if (!layerEmpty) 
+            glTranslatef(0.0, 0.0, conf->layerPadding);  
+    }
+}
+
+// Same as drawGraph(), but the nodes and edges come out of the renderer's
+// buffers in a handful of draw calls. Labels, node properties, and shapes the
+// renderer doesn't have are still drawn one at a time.
+void manetGLView::drawBatchedGraph(WatcherGraph *&graph)
+{
+    renderer->update(*graph, *conf);
+
+    // The renderer draws every node and edge, the GL clips the ones out of 
+    // sight cheaply enough. What's drawn one at a time is culled. 
+    if (isActive(PHYSICAL_LAYER)) {
+        renderer->drawNodes();
+        BOOST_FOREACH(size_t n, nodesIn(graph, visibleArea()))
+            if (graph->nodes[n].isActive)
+                drawNode(graph->nodes[n], true, !GraphRenderer::isBatched(graph->nodes[n].shape, conf->threeDView));
+        flushLabels();
+    }
+
+    for (size_t l=0; l<graph->numValidLayers; l++) { 
+        if (!graph->layers[l].isActive) 
+            continue;
+        VisibleArea area=visibleArea(); 
+
+        renderer->drawEdges(l);
+        const GraphRenderer::EdgeList &edges=renderer->edges(l);
+        edgesDrawn+=edges.size();
+        BOOST_FOREACH(const GraphRenderer::Edge &e, edges) {
+            size_t i=e.first, j=e.second;
+            GLdouble lx=(graph->nodes[i].x+graph->nodes[j].x)/2.0;  
+            GLdouble ly=(graph->nodes[i].y+graph->nodes[j].y)/2.0;  
+            GLdouble lz=(graph->nodes[i].z+graph->nodes[j].z)/2.0;  
+            if (!area.contains(lx, ly))
+                continue;
+            drawEdgeLabel(graph->layers[l].edgeDisplayInfo, graph->nodes[i], graph->nodes[j]);
+            WatcherLayerData::ReadLock readLock(graph->layers[l].edgeLabelsMutexes[i][j]);
             int labelCount=0;
-            WatcherLayerData::ReadLock readLock(graph->layers[l].floatingLabelsMutex); 
-            BOOST_FOREACH(const WatcherLayerData::FloatingLabels::value_type &label, graph->layers[l].floatingLabels)  {
-                drawLabel(label.lat, label.lng, label.alt, label, labelCount++); 
+            BOOST_FOREACH(const WatcherLayerData::EdgeLabels::value_type &label, graph->layers[l].edgeLabels[i][j]) 
+                drawLabel(lx, ly, lz, label, labelCount++); 
+        }
+
+        drawFloatingLabels(graph, l, area); 
+        drawNodeLabels(graph, l, area); 
+        flushLabels();
+        if (!edges.empty()) 
+            glTranslatef(0.0, 0.0, conf->layerPadding);  
+    }
+}
+
+void manetGLView::drawFloatingLabels(WatcherGraph *graph, size_t l, const VisibleArea &area)
+{
+    int labelCount=0;
+    WatcherLayerData::ReadLock readLock(graph->layers[l].floatingLabelsMutex); 
+    BOOST_FOREACH(const WatcherLayerData::FloatingLabels::value_type &label, graph->layers[l].floatingLabels)  {
+        if (area.contains(label.lat, label.lng))
+            drawLabel(label.lat, label.lng, label.alt, label, labelCount);
+        labelCount++; 
+    }
+}
+
+void manetGLView::drawNodeLabels(WatcherGraph *graph, size_t l, const VisibleArea &area)
+{
+    BOOST_FOREACH(size_t n, nodesIn(graph, area)) 
+        if (graph->nodes[n].isActive) 
+            drawNodeLabels(graph, l, n); 
+}
+
+void manetGLView::drawNodeLabels(WatcherGraph *graph, size_t l, size_t n)
+{
+    int labelCount=0;
+    WatcherLayerData::ReadLock readLock(graph->layers[l].nodeLabelsMutexes[n]); 
+    BOOST_FOREACH(const WatcherLayerData::NodeLabels::value_type &label, graph->layers[l].nodeLabels[n]) {
+        drawLabel(graph->nodes[n].x, graph->nodes[n].y, graph->nodes[n].z, label, labelCount++); 
+    }
+}
+
+bool manetGLView::levelOfDetail(const WatcherGraph *graph) const
+{
+    return conf->levelOfDetail && graph->numValidNodes>=static_cast<size_t>(std::max(conf->levelOfDetailNodes, 1)); 
+}
+
+double manetGLView::clusterCellSize(const WatcherGraph *graph)
+{
+    SpatialBox nodeBox;
+    if (conf->clusterPixels<=0 || !graph->spatialIndex.bounds(nodeBox))
+        return 0.0;
+
+    GLdouble modelmatrix[16];
+    GLdouble projmatrix[16];
+    GLint viewport[4];
+    glGetDoublev(GL_MODELVIEW_MATRIX, modelmatrix);
+    glGetDoublev(GL_PROJECTION_MATRIX, projmatrix);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    // Measure a cell in the middle of the window, half way up the nodes. 
+    GLdouble cx=viewport[0]+viewport[2]/2.0, cy=viewport[1]+viewport[3]/2.0, p=conf->clusterPixels/2.0;
+    double z=(nodeBox.zMin+nodeBox.zMax)/2.0;
+    double xMin, yMin, xMax, yMax;
+    if (!nodeAreaInWindowRect(cx-p, cy-p, cx+p, cy+p, modelmatrix, projmatrix, viewport, z, z, xMin, yMin, xMax, yMax))
+        return 0.0;
+    return std::max(xMax-xMin, yMax-yMin);
+}
+
+// Like drawGraph(), but nodes which would be drawn within conf->clusterPixels 
+// of each other are drawn as one glyph, and the edges between two such crowds as 
+// one line. The clusters are kept up to date by the graph as nodes move, so the 
+// work here is in the number of clusters and edges, not nodes. A cluster of one 
+// node, and a lone edge between two of them, are drawn as ever, so zooming in far 
+// enough looks just like drawGraph(). 
+void manetGLView::drawClusteredGraph(WatcherGraph *graph)
+{
+    double cellSize=clusterCellSize(graph); 
+    if (cellSize>0.0)
+        graph->clusters.setCellSize(cellSize); 
+    cellSize=graph->clusters.cellSize(); 
+
+    clusterSummaries.clear();
+    graph->clusters.clusters(clusterSummaries); 
+    graph->clusters.membership(nodeClusters); 
+    size_t numIds=0;
+    BOOST_FOREACH(const NodeClusters::Summary &c, clusterSummaries) 
+        numIds=std::max(numIds, c.id+1); 
+    clusterIndex.assign(numIds, NodeClusters::none); 
+    for (size_t i=0; i<clusterSummaries.size(); i++)
+        clusterIndex[clusterSummaries[i].id]=i;
+
+    if (conf->batchedRendering && renderer && renderer->isValid())
+        renderer->update(*graph, *conf);    // for its edge lists
+
+    if (isActive(PHYSICAL_LAYER)) {
+        VisibleArea area=visibleArea(); 
+        BOOST_FOREACH(const NodeClusters::Summary &c, clusterSummaries) {
+            if (c.node>=graph->numValidNodes || !area.contains(c.x, c.y))
+                continue;
+            if (c.count==1) {
+                if (graph->nodes[c.node].isActive)
+                    drawNode(graph->nodes[c.node], true);
             }
+            else
+                drawCluster(c, graph->nodes[c.node], cellSize); 
         }
+        flushLabels();
+    }
 
-        for (unsigned int n=0; n<graph->numValidNodes; n++) {
-            if (graph->nodes[n].isActive) {
-                int labelCount=0;
-                WatcherLayerData::ReadLock readLock(graph->layers[l].nodeLabelsMutexes[n]); 
-                BOOST_FOREACH(const WatcherLayerData::NodeLabels::value_type &label, graph->layers[l].nodeLabels[n]) {
-                    drawLabel(graph->nodes[n].x, graph->nodes[n].y, graph->nodes[n].z, label, labelCount++); 
-                }
+    EdgeBundles bundles;
+    for (size_t l=0; l<graph->numValidLayers; l++) { 
+        if (!graph->layers[l].isActive) 
+            continue;
+        VisibleArea area=visibleArea(); 
+
+        bundles.clear();
+        bundleEdges(graph, l, bundles); 
+        BOOST_FOREACH(const EdgeBundles::value_type &b, bundles) {
+            const NodeClusters::Summary &c1=clusterSummaries[clusterIndex[b.first.first]];
+            const NodeClusters::Summary &c2=clusterSummaries[clusterIndex[b.first.second]];
+            if (!area.overlaps(c1.x, c1.y, c2.x, c2.y)) 
+                continue;
+            const EdgeBundle &bundle=b.second;
+            if (bundle.count>1 || c1.count>1 || c2.count>1) {
+                drawEdgeBundle(graph->layers[l].edgeDisplayInfo, c1, c2, bundle.count); 
+                continue;
             }
+            size_t i=bundle.from, j=bundle.to;
+            drawEdge(graph->layers[l].edgeDisplayInfo, graph->nodes[i], graph->nodes[j]);
+            GLdouble lx=(graph->nodes[i].x+graph->nodes[j].x)/2.0;  
+            GLdouble ly=(graph->nodes[i].y+graph->nodes[j].y)/2.0;  
+            GLdouble lz=(graph->nodes[i].z+graph->nodes[j].z)/2.0;  
+            if (!area.contains(lx, ly))
+                continue;
+            WatcherLayerData::ReadLock readLock(graph->layers[l].edgeLabelsMutexes[i][j]);
+            int labelCount=0;
+            BOOST_FOREACH(const WatcherLayerData::EdgeLabels::value_type &label, graph->layers[l].edgeLabels[i][j]) 
+                drawLabel(lx, ly, lz, label, labelCount++); 
         }
-        // move up "layerPadding" units before drawing the next layer if the previous layer was not empty.
-        if (!layerEmpty) 
+
+        // The labels of nodes in a crowd would only pile up on each other. 
+        drawFloatingLabels(graph, l, area); 
+        BOOST_FOREACH(const NodeClusters::Summary &c, clusterSummaries) 
+            if (c.count==1 && c.node<graph->numValidNodes && graph->nodes[c.node].isActive && area.contains(c.x, c.y))
+                drawNodeLabels(graph, l, c.node); 
+        flushLabels();
+
+        if (!bundles.empty()) 
             glTranslatef(0.0, 0.0, conf->layerPadding);  
     }
 }
 
+void manetGLView::bundleEdges(const WatcherGraph *graph, size_t l, EdgeBundles &bundles)
+{
+    GraphRenderer::EdgeList scanned;
+    const GraphRenderer::EdgeList *edges=&scanned;
+    if (conf->batchedRendering && renderer && renderer->isValid()) 
+        edges=&renderer->edges(l);
+    else {
+        for (size_t i=0; i<graph->numValidNodes; i++) 
+            if (graph->nodes[i].isActive) 
+                for (size_t j=0; j<graph->numValidNodes; j++) 
+                    if (graph->nodes[j].isActive && graph->layers[l].edges[i][j]) 
+                        scanned.push_back(GraphRenderer::Edge(i, j)); 
+    }
+
+    BOOST_FOREACH(const GraphRenderer::Edge &e, *edges) {
+        if (e.first>=nodeClusters.size() || e.second>=nodeClusters.size())
+            continue;
+        size_t c1=nodeClusters[e.first], c2=nodeClusters[e.second];
+        if (c1==c2 || c1>=clusterIndex.size() || c2>=clusterIndex.size() || 
+            clusterIndex[c1]==NodeClusters::none || clusterIndex[c2]==NodeClusters::none)
+            continue;       // inside a cluster, or the node moved since we looked 
+        EdgeBundles::iterator b=bundles.find(std::make_pair(std::min(c1, c2), std::max(c1, c2)));
+        if (b==bundles.end()) {
+            EdgeBundle bundle={ 1, e.first, e.second };
+            bundles.insert(std::make_pair(std::make_pair(std::min(c1, c2), std::max(c1, c2)), bundle)); 
+        }
+        else
+            b->second.count++;
+    }
+}
+
+void manetGLView::drawCluster(const NodeClusters::Summary &cluster, const NodeDisplayInfo &node, double cellSize)
+{
+    TRACE_ENTER(); 
+    clustersDrawn++;
+
+    // Bigger crowds get bigger glyphs, but a glyph stays inside its cell. 
+    GLdouble radius=cellSize*std::min(0.5, 0.1+0.04*log((double)cluster.count)/M_LN2); 
+
+    glPushMatrix();
+    glTranslated(cluster.x, cluster.y, cluster.z);
+
+    const GLfloat black[]={0.0,0.0,0.0,1.0};
+    GLfloat nodeColor[]={
+        node.color.r/255.0, 
+        node.color.g/255.0, 
+        node.color.b/255.0, 
+        node.color.a/255.0
+    };
+    if (conf->monochromeMode)
+        glColor4fv(black);
+    else
+        glColor4fv(nodeColor);
+
+    GLUquadricObj *quadric=gluNewQuadric();
+    if (conf->threeDView) {
+        gluQuadricNormals(quadric, GLU_SMOOTH);
+        gluSphere(quadric, radius, 15, 15);
+    }
+    else
+        gluDisk(quadric, 0, radius, 36, 1);
+    gluDeleteQuadric(quadric);
+
+    GLfloat labelColor[]={
+        node.labelColor.r/255.0, 
+        node.labelColor.g/255.0, 
+        node.labelColor.b/255.0, 
+        node.labelColor.a/255.0
+    };
+    if (conf->monochromeMode)
+        glColor4fv(black);
+    else
+        glColor4fv(labelColor);
+    ostringstream count;
+    count << cluster.count;
+    renderLabelText(radius, radius, 3, count.str(), node.labelFont, (int)(node.labelPointSize*conf->scaleText)); 
+
+    glPopMatrix();
+
+    TRACE_EXIT(); 
+}
+
+void manetGLView::drawEdgeBundle(const EdgeDisplayInfo &edge, const NodeClusters::Summary &cluster1, 
+        const NodeClusters::Summary &cluster2, size_t count)
+{
+    TRACE_ENTER(); 
+    edgesDrawn++;
+
+    GLfloat edgeColor[]={
+        edge.color.r/255.0, 
+        edge.color.g/255.0, 
+        edge.color.b/255.0, 
+        edge.color.a/255.0, 
+    };
+    const GLfloat black[]={0.0,0.0,0.0,1.0};
+    if (conf->monochromeMode)
+        glColor4fv(black);
+    else
+        glColor4fv(edgeColor);
+
+    // A line in pixels, so it reads the same at any zoom, thicker for more edges. 
+    glPushAttrib(GL_ENABLE_BIT | GL_LINE_BIT); 
+    glDisable(GL_LIGHTING); 
+    glLineWidth(std::min(8.0, 1.0+log((double)count)/M_LN2)); 
+    glBegin(GL_LINES);
+    glVertex3d(cluster1.x, cluster1.y, cluster1.z);
+    glVertex3d(cluster2.x, cluster2.y, cluster2.z);
+    glEnd();
+    glPopAttrib(); 
+
+    TRACE_EXIT(); 
+}
+
 void manetGLView::drawStatusString(QPainter &painter)
 {
     ptime now = from_time_t(time(NULL));
@@ -1968,6 +2445,7 @@ void manetGLView::setWatcherGUIConfig(WatcherGUIConfig *c)
 
     wGraph=new WatcherGraph(conf->maxNodes, conf->maxLayers); 
     wGraph->locationTranslationFunction=boost::bind(&manetGLView::gps2openGLPixels, this, _1, _2, _3, _4); 
+    wGraph->labelExpiredFunction=boost::bind(&LabelAtlas::expire, labelAtlas, _1); 
     nodeConfigurationDialog->setGraph(wGraph);
 
     BOOST_FOREACH(WatcherGUIConfig::ActiveLayers::value_type const &l, conf->initialLayers)
@@ -1976,9 +2454,10 @@ void manetGLView::setWatcherGUIConfig(WatcherGUIConfig *c)
     // 
     // Set up timer callbacks.
     //
-    QTimer *watcherIdleTimer = new QTimer(this);
-    QObject::connect(watcherIdleTimer, SIGNAL(timeout()), this, SLOT(watcherIdle()));
-    watcherIdleTimer->start(40);  // This is ~25 FPS
+    frameTimer = new QTimer(this);
+    frameTimer->setSingleShot(true);    // watcherIdle() reschedules it to keep conf->targetFrameRate
+    QObject::connect(frameTimer, SIGNAL(timeout()), this, SLOT(watcherIdle()));
+    frameTimer->start(0);
 
     // start work threads
     // we wait until here so that we know the server string is set. 
@@ -2018,6 +2497,7 @@ void manetGLView::updatePlaybackSliderFromGUI()
 
     currentMessageTimestamp=newStart;  // So it displays in status string immediately. 
     playbackSlider->setValue(newStart/1000); 
+    streamRestarted(); 
     messageStream->clearMessageCache();
     messageStream->setStreamTimeStart(newStart); 
     messageStream->startStream(); 
@@ -2105,6 +2585,22 @@ void manetGLView::drawEdge(const EdgeDisplayInfo &edge, const NodeDisplayInfo &n
         gluDeleteQuadric(quadric);
     }
 
+    drawEdgeLabel(edge, node1, node2);
+
+    TRACE_EXIT(); 
+}
+
+void manetGLView::drawEdgeLabel(const EdgeDisplayInfo &edge, const NodeDisplayInfo &node1, const NodeDisplayInfo &node2)
+{
+    TRACE_ENTER(); 
+
+    GLdouble x1=node1.x;
+    GLdouble y1=node1.y;
+    GLdouble z1=node1.z;
+    GLdouble x2=node2.x;
+    GLdouble y2=node2.y;
+    GLdouble z2=node2.z;
+
     // draw the edge's label, if there is one.
     if (edge.label!="none")
     {
@@ -2130,9 +2626,8 @@ void manetGLView::drawEdge(const EdgeDisplayInfo &edge, const NodeDisplayInfo &n
         GLdouble lz=(z1+z2)/2.0; 
         GLdouble a=fast_arctan2(x1-x2 , y1-y2);
         GLdouble th=10.0;
-        renderText(lx+sin(a-M_PI_2),ly+cos(a-M_PI_2)*th, lz, 
-                QString(edge.label.c_str()),
-                QFont(QString(edge.labelFont.c_str()), (int)edge.labelPointSize));
+        renderLabelText(lx+sin(a-M_PI_2),ly+cos(a-M_PI_2)*th, lz, 
+                edge.label, edge.labelFont, (int)edge.labelPointSize);
     }
     TRACE_EXIT(); 
 }
@@ -2147,7 +2642,7 @@ bool manetGLView::isActive(const watcher::GUILayer &layer)
     return retVal;
 }
 
-void manetGLView::drawNode(const NodeDisplayInfo &node, bool physical)
+void manetGLView::drawNode(const NodeDisplayInfo &node, bool physical, bool drawShape)
 {
     TRACE_ENTER(); 
     if (physical)
@@ -2182,7 +2677,7 @@ void manetGLView::drawNode(const NodeDisplayInfo &node, bool physical)
     handleProperties(node);
     handleSpin(conf->threeDView, node);
 
-    switch(node.shape)
+    if (drawShape) switch(node.shape)
     {
         case NodePropertiesMessage::CIRCLE: drawSphere(4); break;
         case NodePropertiesMessage::SQUARE: drawCube(4); break;
@@ -2216,9 +2711,8 @@ void manetGLView::drawNodeLabel(const NodeDisplayInfo &node, bool physical)
 
     // LOG_DEBUG("drawing node - font: " << node.labelFont << ", size: " << node.labelPointSize); 
 
-    renderText(0, 6, 3, QString(node.get_label().c_str()),
-            QFont(node.labelFont.c_str(), 
-                (int)(node.labelPointSize*conf->scaleText))); 
+    renderLabelText(0, 6, 3, node.get_label(), node.labelFont, 
+            (int)(node.labelPointSize*conf->scaleText)); 
 
     TRACE_EXIT();
 }
@@ -2250,13 +2744,33 @@ void manetGLView::drawLabel(GLfloat inx, GLfloat iny, GLfloat inz, const LabelDi
 
     float offset=4.0;
 
-    QFont f(label.fontName.c_str(), (int)label.pointSize); 
     qglColor(QColor(fgColor[0], fgColor[1], fgColor[2], fgColor[3])); 
-    renderText(inx+offset, iny, inz+(labelCount*label.pointSize), label.labelText.c_str(), f); 
+    renderLabelText(inx+offset, iny, inz+(labelCount*label.pointSize), label.labelText, label.fontName, (int)label.pointSize); 
 
     TRACE_EXIT(); 
 }
 
+void manetGLView::renderLabelText(GLdouble x, GLdouble y, GLdouble z, const string &text, const string &font, int pointSize)
+{
+    GLfloat color[4];
+    glGetFloatv(GL_CURRENT_COLOR, color);
+
+    if (conf->cachedLabels && labelAtlas) {
+        unsigned char rgba[4];
+        for (unsigned int i=0; i<sizeof(rgba)/sizeof(rgba[0]); i++)
+            rgba[i]=(unsigned char)(qBound(0.0f, color[i], 1.0f)*255.0+0.5);
+        if (labelAtlas->add(x, y, z, text, font, pointSize, rgba))
+            return;
+    }
+    renderText(x, y, z, QString(text.c_str()), QFont(font.c_str(), pointSize));
+}
+
+void manetGLView::flushLabels()
+{
+    if (labelAtlas)
+        labelAtlas->flush();
+}
+
 void manetGLView::resizeGL(int width, int height)
 {
     TRACE_ENTER();
@@ -2621,7 +3135,6 @@ size_t manetGLView::getNodeIdAtCoords(const int x, const int y)
     size_t retVal=ULONG_MAX;
     unsigned long min_dist = ULONG_MAX; // distance squared to closest
     unsigned r=15;      // Shrug, seems to do the trick
-    unsigned long r2 = r*r;
     size_t found = ULONG_MAX;    // index of closest
     GLdouble modelmatrix[16];
     GLdouble projmatrix[16];
@@ -2633,44 +3146,56 @@ size_t manetGLView::getNodeIdAtCoords(const int x, const int y)
     // convert y-from-top to y-from-bottom
     int convy = viewport[3] - y;
 
-    for (size_t i=0; i<wGraph->numValidNodes; i++) 
+    // Only look at the nodes near the click: ask the graph for the nodes under a 
+    // square around it, growing the square until there are some. If that can't be
+    // worked out, or there are none near, look at them all.
+    vector<size_t> candidates;
+    SpatialBox nodeBox;
+    if (wGraph->spatialIndex.bounds(nodeBox)) {
+        for (GLdouble side=r; side<=2*std::max(viewport[2], viewport[3]) && candidates.empty(); side*=4) {
+            double xMin, yMin, xMax, yMax;
+            if (!nodeAreaInWindowRect(x-side, convy-side, x+side, convy+side, modelmatrix, projmatrix, viewport, 
+                        nodeBox.zMin, nodeBox.zMax, xMin, yMin, xMax, yMax))
+                break;
+            wGraph->spatialIndex.query(xMin, yMin, xMax, yMax, candidates); 
+        }
+    }
+    if (candidates.empty()) 
+        for (size_t i=0; i<wGraph->numValidNodes; i++) 
+            candidates.push_back(i); 
+
+    BOOST_FOREACH(size_t i, candidates)
     {
         if (!wGraph->nodes[i].isActive) 
             continue;
 
-        unsigned int dist;
-
         GLdouble gx=wGraph->nodes[i].x, gy=wGraph->nodes[i].y, gz=wGraph->nodes[i].z;
 
         // Convert from 3d pixels to screen coords
         GLdouble sx, sy, sz;
-        if(gluProject(gx, gy, gz, modelmatrix, projmatrix, viewport, &sx, &sy, &sz) == GL_TRUE)
-        {
-            long dx = x - (long)sx;
-            long dy = convy - (long)sy;
-            dist = (dx*dx) + (dy*dy);
-
-            if (dist<min_dist)
-                min_dist=dist;
-        }
-        else
+        if(gluProject(gx, gy, gz, modelmatrix, projmatrix, viewport, &sx, &sy, &sz) != GL_TRUE)
         {
             LOG_ERROR("getNodeId: Unable to compute screen coords from gl coords."); 
             continue;
         }
 
+        long dx = x - (long)sx;
+        long dy = convy - (long)sy;
+        unsigned long dist = (dx*dx) + (dy*dy);
+
         LOG_DEBUG("getNodeId: gx, gy, gz: " << gx << ", " << gy << ", " << gz); 
         LOG_DEBUG("getNodeId: sx, sy, sz: " << sx << ", " << sy << ", " << sz); 
         LOG_DEBUG("getNodeId: x, convy, y, dist, min_dist: " << x << ", " << convy << ", " << y << ", " << dist << ", " << min_dist); 
 
-        dist=dist>r2 ? dist-r2 : 0; 
-        if (dist < min_dist)
+        if (dist < min_dist) {
+            min_dist=dist;
             found=i;
+        }
     }
     if (min_dist < ULONG_MAX)
         retVal=found;
 
-    if (retVal)
+    if (retVal!=ULONG_MAX)
         LOG_INFO("getNodeId: Found node " << retVal << " at double click location " << x << ", " << y); 
     else
         LOG_INFO("getNodeId: Found no node at double click location " << x << ", " << y); 
@@ -3388,6 +3913,7 @@ void manetGLView::reconnect()
 {
     TRACE_ENTER();
     LOG_INFO("reconnecting to server upon user request");
+    // The stream resumes where it was, so what we have is still good.
     messageStream->clearMessageCache();
     messageStream->reconnect();
     setupStream();
@@ -28,6 +28,9 @@
 #include <QMenu>
 #include <QSlider>
 #include <QTimer>
+#include <algorithm>
+#include <map>
+#include <vector>
 #include <boost/thread/locks.hpp>
 #include "declareLogger.h"
 #include "libwatcher/watcherGraph.h"
@@ -41,6 +44,8 @@ namespace watcher {
     class LayerConfigurationDialog;
     class NodeConfigurationDialog;
     class WatcherGUIConfig;
+    class GraphRenderer;
+    class LabelAtlas;
 }
 
 class manetGLView : public QGLWidget
@@ -163,7 +168,6 @@ signals:
         void connectStream(); // connect to watherd and init the message stream. blocking...
     	void setupStream();
         boost::thread *watcherdConnectionThread;
-        boost::thread *maintainGraphThread;
         boost::thread *checkIOThread;
         boost::mutex graphMutex;
 
@@ -191,6 +195,28 @@ signals:
         void drawBoundingBox(); 
         void drawGroundGrid();
         void drawGraph(watcher::WatcherGraph *&graph); 
+
+        /** The part of the nodes' x, y plane which is on screen, give or take. */
+        struct VisibleArea
+        {
+            bool all;           // cannot tell, draw everything 
+            double xMin, yMin, xMax, yMax;
+            bool contains(double x, double y) const { return all || (x>=xMin && x<=xMax && y>=yMin && y<=yMax); }
+            bool overlaps(double x1, double y1, double x2, double y2) const {
+                return all || !(std::max(x1, x2)<xMin || std::min(x1, x2)>xMax || std::max(y1, y2)<yMin || std::min(y1, y2)>yMax); 
+            }
+        };
+        /** Visible area for the current matrices */
+        VisibleArea visibleArea(); 
+        bool nodeAreaInWindowRect(GLdouble x0, GLdouble y0, GLdouble x1, GLdouble y1, 
+                const GLdouble modelmatrix[16], const GLdouble projmatrix[16], const GLint viewport[4],
+                double zMin, double zMax, double &xMin, double &yMin, double &xMax, double &yMax);
+        /** Indexes of the nodes in area, in order. Only good until the next call. */
+        const std::vector<size_t> &nodesIn(const watcher::WatcherGraph *graph, const VisibleArea &area); 
+        std::vector<size_t> shownNodes;
+        void drawFloatingLabels(watcher::WatcherGraph *graph, size_t layer, const VisibleArea &area); 
+        void drawNodeLabels(watcher::WatcherGraph *graph, size_t layer, const VisibleArea &area); 
+        void drawNodeLabels(watcher::WatcherGraph *graph, size_t layer, size_t node); 
         struct QuadranglePoint
         {
             double x;
@@ -198,7 +224,8 @@ signals:
         };
         void drawText(GLdouble x, GLdouble y, GLdouble z, GLdouble scale, char *text, GLdouble lineWidth=1.0);
         void drawEdge(const watcher::EdgeDisplayInfo &edge, const watcher::NodeDisplayInfo &node1, const watcher::NodeDisplayInfo &node2); 
-        void drawNode(const watcher::NodeDisplayInfo &node, bool physical);
+        void drawEdgeLabel(const watcher::EdgeDisplayInfo &edge, const watcher::NodeDisplayInfo &node1, const watcher::NodeDisplayInfo &node2); 
+        void drawNode(const watcher::NodeDisplayInfo &node, bool physical, bool drawShape=true);
         struct Quadrangle
         {
             QuadranglePoint p[4];
@@ -253,6 +280,10 @@ signals:
         void rotateZ(float deg);
 
         void drawLabel(GLfloat x, GLfloat y, GLfloat z, const watcher::LabelDisplayInfo &label, int labelCount);
+
+        /** renderText() in the current color, through the label atlas if it's enabled. */
+        void renderLabelText(GLdouble x, GLdouble y, GLdouble z, const std::string &text, const std::string &font, int pointSize);
+        void flushLabels();
         void handleSpin(int threeD, const watcher::NodeDisplayInfo &ndi); 
         void handleSize(const watcher::NodeDisplayInfo &ndi); 
         void handleProperties(const watcher::NodeDisplayInfo &ndi); 
@@ -268,10 +299,68 @@ signals:
 
         void changeSpeed(double);
 
-        // updating the graph is a separate function as it's done in it's own thread
-        void maintainGraph();
-
-        unsigned int nodesDrawn, edgesDrawn, labelsDrawn;
+        /** 
+         * What checkIO() has for the GUI. watcherIdle() picks it up once a frame, 
+         * so the widgets are only touched from the GUI thread.
+         */
+        struct StreamState
+        {
+            StreamState() : rangeChanged(false), messagesApplied(0), applyTime(0.0), backlog(0), seeks(0), renderBehind(false) { }
+            bool rangeChanged;              // playbackRangeStart/End have changed
+            std::vector<std::string> newLayers;
+            std::vector<std::pair<unsigned long, std::string> > newStreams;
+            unsigned long messagesApplied;  // since the last frame
+            double applyTime;               // ms spent applying them
+            size_t backlog;                 // messages arrived but not yet applied
+            unsigned long seeks;            // bumped by the GUI when the stream is restarted
+            bool renderBehind;              // the last frame took longer than the frame period
+        };
+        StreamState streamState;
+        boost::mutex streamStateMutex;
+
+        void handleControlMessage(const watcher::event::MessagePtr &message); 
+        void updateFromStream(); 
+        void streamRestarted(); 
+
+        /** Fires watcherIdle() at conf->targetFrameRate */
+        QTimer *frameTimer;
+        double frameTime;                   // ms the last frame took
+        unsigned long messagesPerFrame;     // as of the last frame
+        double applyTimePerFrame; 
+        size_t applyBacklog; 
+
+        /** Draws nodes and edges from vertex buffers. NULL or invalid if the GL can't. */
+        watcher::GraphRenderer *renderer;
+        void drawBatchedGraph(watcher::WatcherGraph *&graph); 
+
+        /** Rendered label text */
+        watcher::LabelAtlas *labelAtlas;
+
+        /** 
+         * Level of detail: when there are lots of nodes, crowds of nodes are 
+         * drawn as one glyph with a count and the edges between two crowds 
+         * as one line. See WatcherGUIConfig::levelOfDetail. 
+         */
+        bool levelOfDetail(const watcher::WatcherGraph *graph) const; 
+        void drawClusteredGraph(watcher::WatcherGraph *graph); 
+        void drawCluster(const watcher::NodeClusters::Summary &cluster, const watcher::NodeDisplayInfo &node, double cellSize); 
+        void drawEdgeBundle(const watcher::EdgeDisplayInfo &edge, const watcher::NodeClusters::Summary &cluster1, 
+                const watcher::NodeClusters::Summary &cluster2, size_t count); 
+        /** World size of a cell conf->clusterPixels across on screen, 0 if that can't be told */
+        double clusterCellSize(const watcher::WatcherGraph *graph); 
+        struct EdgeBundle
+        {
+            size_t count;
+            size_t from, to;        // an edge in the bundle 
+        };
+        typedef std::map<std::pair<size_t, size_t>, EdgeBundle> EdgeBundles;
+        /** Edges of layer l, bundled by the clusters at their ends, per nodeClusters */
+        void bundleEdges(const watcher::WatcherGraph *graph, size_t l, EdgeBundles &bundles);
+        std::vector<watcher::NodeClusters::Summary> clusterSummaries;
+        std::vector<size_t> nodeClusters;       // cluster of each node
+        std::vector<size_t> clusterIndex;       // index in clusterSummaries of each cluster
+
+        unsigned int nodesDrawn, edgesDrawn, labelsDrawn, nodesCulled, clustersDrawn;
         unsigned int framesDrawn, fpsTimeBase;
         double framesPerSec;
 
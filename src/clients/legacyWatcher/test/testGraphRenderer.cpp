@@ -0,0 +1,242 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Draws a fixed WatcherGraph with GraphRenderer into an offscreen EGL
+ * pbuffer, so it runs without a display. "make check" runs it on Mesa's
+ * software rasterizer with the surfaceless EGL platform, so it needs no GPU
+ * either.
+ */
+#define BOOST_TEST_MODULE graph_renderer test
+
+#include <EGL/egl.h>
+#include <GL/gl.h>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <libwatcher/watcherGraph.h>
+#include "../graphRenderer.h"
+#include "../watcherGUIConfig.h"
+
+using namespace std;
+using namespace watcher;
+using namespace watcher::event;
+
+namespace {
+    const int width=256, height=256;
+
+    void *getProcAddress(const char *name)
+    {
+        return reinterpret_cast<void *>(eglGetProcAddress(name));
+    }
+
+    /** An offscreen GL context with the lighting manetGLView sets up. */
+    struct Context {
+        EGLDisplay display;
+        EGLSurface surface;
+        EGLContext context;
+
+        Context() : display(EGL_NO_DISPLAY), surface(EGL_NO_SURFACE), context(EGL_NO_CONTEXT)
+        {
+            display=eglGetDisplay(EGL_DEFAULT_DISPLAY);
+            BOOST_REQUIRE(display!=EGL_NO_DISPLAY);
+            BOOST_REQUIRE(eglInitialize(display, NULL, NULL));
+
+            const EGLint attrs[]={
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+                EGL_DEPTH_SIZE, 16,
+                EGL_NONE
+            };
+            EGLConfig config;
+            EGLint n=0;
+            BOOST_REQUIRE(eglChooseConfig(display, attrs, &config, 1, &n) && n==1);
+
+            const EGLint pbufferAttrs[]={ EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+            surface=eglCreatePbufferSurface(display, config, pbufferAttrs);
+            BOOST_REQUIRE(surface!=EGL_NO_SURFACE);
+            BOOST_REQUIRE(eglBindAPI(EGL_OPENGL_API));
+            context=eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+            BOOST_REQUIRE(context!=EGL_NO_CONTEXT);
+            BOOST_REQUIRE(eglMakeCurrent(display, surface, surface, context));
+            BOOST_TEST_MESSAGE("GL renderer: " << glGetString(GL_RENDERER) << ", version " << glGetString(GL_VERSION));
+
+            glEnable(GL_DEPTH_TEST);
+            glEnable(GL_LIGHTING);
+            glEnable(GL_LIGHT0);
+            GLfloat ambient[]={ 0.25, 0.25, 0.25, 1.0 };
+            GLfloat position[]={ 50.0, 50.0, 0.0, 1.0 };
+            glLightfv(GL_LIGHT0, GL_AMBIENT, ambient);
+            glLightfv(GL_LIGHT0, GL_POSITION, position);
+            glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
+            glEnable(GL_COLOR_MATERIAL);
+            glMatrixMode(GL_PROJECTION);
+            glOrtho(-100, 100, -100, 100, -100, 100);
+            glMatrixMode(GL_MODELVIEW);
+            glLoadIdentity();
+        }
+
+        ~Context()
+        {
+            if (display==EGL_NO_DISPLAY)
+                return;
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (context!=EGL_NO_CONTEXT)
+                eglDestroyContext(display, context);
+            if (surface!=EGL_NO_SURFACE)
+                eglDestroySurface(display, surface);
+            eglTerminate(display);
+        }
+    };
+
+    /**
+     * Four nodes, one of each shape drawn in both views, with two edges on the
+     * physical layer, which is the only active one.
+     */
+    struct Graph {
+        WatcherGraph graph;
+        size_t layer;
+
+        Graph() : graph(16, 4)
+        {
+            const char *addrs[]={ "192.168.1.1", "192.168.1.2", "192.168.1.3", "192.168.1.4" };
+            const NodePropertiesMessage::NodeShape shapes[]={
+                NodePropertiesMessage::CIRCLE, NodePropertiesMessage::SQUARE,
+                NodePropertiesMessage::TRIANGLE, NodePropertiesMessage::TORUS
+            };
+            for (size_t i=0; i<4; i++) {
+                NodeDisplayInfo &node=graph.nodes[graph.nid2Index(NodeIdentifier::from_string(addrs[i]))];
+                node.isActive=true;
+                node.x=-60.0+40.0*i;
+                node.y=(i%2)*30.0;
+                node.z=0.0;
+                node.color=colors::red;
+                node.shape=shapes[i];
+                node.size=2.0;
+            }
+            layer=graph.name2LayerIndex(PHYSICAL_LAYER);
+            for (size_t i=0; i<graph.numValidLayers; i++)
+                graph.layers[i].isActive=false;
+            WatcherLayerData &l=graph.layers[layer];
+            l.isActive=true;
+            l.edges[0][1]=1;
+            l.edges[2][3]=1;
+            l.edgeDisplayInfo.color=colors::blue;
+            l.edgeDisplayInfo.width=3;
+            graph.markChanged();
+        }
+    };
+
+    /** Number of pixels drawn in something other than black. */
+    size_t litPixels()
+    {
+        vector<unsigned char> pixels(width*height*4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+        size_t n=0;
+        for (size_t i=0; i<pixels.size(); i+=4)
+            if (pixels[i] || pixels[i+1] || pixels[i+2])
+                n++;
+        return n;
+    }
+
+    struct Fixture : public Context, public Graph {
+        GraphRenderer renderer;
+        WatcherGUIConfig conf;
+
+        Fixture()
+        {
+            BOOST_REQUIRE(renderer.initialize(boost::bind(getProcAddress, _1)));
+            BOOST_REQUIRE_EQUAL(glGetError(), static_cast<GLenum>(GL_NO_ERROR));
+        }
+        ~Fixture()
+        {
+            renderer.release();
+        }
+    };
+}
+
+/* Every shape is drawn, in 2D and 3D, without a GL error. */
+BOOST_FIXTURE_TEST_CASE( draw_test, Fixture )
+{
+    for (int threeD=0; threeD<2; threeD++) {
+        conf.threeDView=threeD;
+        glClearColor(0.0, 0.0, 0.0, 1.0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        renderer.update(graph, conf);
+        BOOST_CHECK_EQUAL(renderer.numNodes(), 4u);
+        BOOST_CHECK_EQUAL(renderer.edges(layer).size(), 2u);
+
+        renderer.drawNodes();
+        size_t nodePixels=litPixels();
+        renderer.drawEdges(layer);
+        size_t allPixels=litPixels();
+        BOOST_CHECK_EQUAL(glGetError(), static_cast<GLenum>(GL_NO_ERROR));
+
+        BOOST_CHECK_MESSAGE(nodePixels>0, "no nodes drawn, threeD=" << threeD);
+        BOOST_CHECK_MESSAGE(allPixels>nodePixels, "no edges drawn, threeD=" << threeD);
+    }
+}
+
+/* The buffers are only rebuilt when what they were built from changes. */
+BOOST_FIXTURE_TEST_CASE( rebuild_test, Fixture )
+{
+    renderer.update(graph, conf);
+    BOOST_CHECK_EQUAL(renderer.nodeRebuilds, 1u);
+    BOOST_CHECK_EQUAL(renderer.edgeRebuilds, 1u);
+
+    // nothing changed
+    renderer.update(graph, conf);
+    renderer.update(graph, conf);
+    BOOST_CHECK_EQUAL(renderer.nodeRebuilds, 1u);
+    BOOST_CHECK_EQUAL(renderer.edgeRebuilds, 1u);
+
+    // a node moves, which takes its edges with it
+    graph.nodes[0].x+=5.0;
+    renderer.update(graph, conf);
+    BOOST_CHECK_EQUAL(renderer.nodeRebuilds, 2u);
+    BOOST_CHECK_EQUAL(renderer.edgeRebuilds, 2u);
+
+    // an edge goes away
+    graph.layers[layer].edges[2][3]=0;
+    graph.markChanged();
+    renderer.update(graph, conf);
+    BOOST_CHECK_EQUAL(renderer.nodeRebuilds, 2u);
+    BOOST_CHECK_EQUAL(renderer.edgeRebuilds, 3u);
+    BOOST_CHECK_EQUAL(renderer.edges(layer).size(), 1u);
+
+    // the layer's edges change color
+    graph.layers[layer].edgeDisplayInfo.color=colors::green;
+    renderer.update(graph, conf);
+    BOOST_CHECK_EQUAL(renderer.nodeRebuilds, 2u);
+    BOOST_CHECK_EQUAL(renderer.edgeRebuilds, 4u);
+
+    // switching to 3D rebuilds everything
+    conf.threeDView=true;
+    renderer.update(graph, conf);
+    BOOST_CHECK_EQUAL(renderer.nodeRebuilds, 3u);
+    BOOST_CHECK_EQUAL(renderer.edgeRebuilds, 5u);
+
+    renderer.drawNodes();
+    renderer.drawEdges(layer);
+    BOOST_CHECK_EQUAL(glGetError(), static_cast<GLenum>(GL_NO_ERROR));
+}
+
+// vim:sw=4
@@ -27,9 +27,16 @@ WatcherGUIConfig::WatcherGUIConfig() :
     showStreamDescription(true),
     autorewind(false), 
     messageStreamFiltering(false),
+    batchedRendering(true),
+    cachedLabels(true),
+    cullOffscreen(true),
+    levelOfDetail(true),
     maxNodes(0),
     maxLayers(0),
     statusFontPointSize(10),
+    targetFrameRate(25),
+    levelOfDetailNodes(1000),
+    clusterPixels(40),
     statusFontName("Helvetica"),
     hierarchyRingColor(watcher::colors::blue),
     playbackStartTime(event::SeekMessage::eof),  // live mode
@@ -129,7 +136,11 @@ bool WatcherGUIConfig::loadConfiguration()
             { "showPlaybackRange", true, &showPlaybackRangeString },
             { "showDebugInfo", false, &showDebugInfo },
             { "autorewind", true, &autorewind },
-            { "messageStreamFiltering", false, &messageStreamFiltering }
+            { "messageStreamFiltering", false, &messageStreamFiltering },
+            { "batchedRendering", true, &batchedRendering },
+            { "cachedLabels", true, &cachedLabels },
+            { "cullOffscreen", true, &cullOffscreen },
+            { "levelOfDetail", true, &levelOfDetail }
         }; 
         for (size_t i=0; i<sizeof(boolVals)/sizeof(boolVals[0]); i++)
         {
@@ -194,7 +205,10 @@ bool WatcherGUIConfig::loadConfiguration()
             int *val; 
         } intVals[] = 
         {
-            { "statusFontPointSize", 12, &statusFontPointSize }
+            { "statusFontPointSize", 12, &statusFontPointSize },
+            { "targetFrameRate", 25, &targetFrameRate },
+            { "levelOfDetailNodes", 1000, &levelOfDetailNodes },
+            { "clusterPixels", 40, &clusterPixels }
         }; 
         for (size_t i=0; i<sizeof(intVals)/sizeof(intVals[0]); i++)
         {
@@ -369,7 +383,11 @@ bool WatcherGUIConfig::saveConfiguration()
             { "showPlaybackRange", showPlaybackRangeString },
             { "showDebugInfo", showDebugInfo },
             { "autorewind", autorewind },
-            { "messageStreamFiltering", messageStreamFiltering }
+            { "messageStreamFiltering", messageStreamFiltering },
+            { "batchedRendering", batchedRendering },
+            { "cachedLabels", cachedLabels },
+            { "cullOffscreen", cullOffscreen },
+            { "levelOfDetail", levelOfDetail }
         };
 
         for (size_t i = 0; i < sizeof(boolConfigs)/sizeof(boolConfigs[0]); i++) {
@@ -423,6 +441,9 @@ bool WatcherGUIConfig::saveConfiguration()
         } intVals[] = 
         {
             { "statusFontPointSize", &statusFontPointSize },
+            { "targetFrameRate", &targetFrameRate },
+            { "levelOfDetailNodes", &levelOfDetailNodes },
+            { "clusterPixels", &clusterPixels },
             { "maxNodes", (int*)&maxNodes },
             { "maxLayers", (int*)&maxLayers }
         }; 
@@ -66,6 +66,10 @@ namespace watcher
 
             bool autorewind;
             bool messageStreamFiltering;
+            bool batchedRendering;
+            bool cachedLabels;
+            bool cullOffscreen;
+            bool levelOfDetail;     // draw crowds of nodes as one when there are many nodes
 
             float rgbaBGColors[4];
 
@@ -73,6 +77,9 @@ namespace watcher
             size_t maxLayers;
 
             int statusFontPointSize; 
+            int targetFrameRate;    // frames per second the view tries to draw
+            int levelOfDetailNodes; // nodes before levelOfDetail kicks in
+            int clusterPixels;      // size on screen of the cells nodes are grouped by
             std::string statusFontName;
             watcher::Color hierarchyRingColor;
             watcher::Timestamp playbackStartTime;
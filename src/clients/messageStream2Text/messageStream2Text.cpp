@@ -40,6 +40,10 @@
  * @arg <b>-c, --config</b>, the configuration file. If not given messageStream2Text.cfg is assumed. 
  * @arg <b>-s, --speed=FLOAT</b> - specify the event playback speed.
  * @arg <b>-S, --seek=INT</b> - specify the offset in milliseconds to start event playback (default: live playback).
+ * @arg <b>-o, --output=FILE</b> - also write each event to FILE in serialized form, one per line.  The file can be loaded
+ * into an event database with @ref watcherImport.
+ * @arg <b>-t, --trace-report=SECONDS</b> - print the per-hop latencies of trace stamped events every SECONDS.  Feeders
+ * and watcherd stamp events when run with WATCHER_TRACE=1 in their environment (see messageTrace.h).
  * @arg <b>-h, --help</b>, Show help message
  *
  * If a configuration file is not found on startup, a default one will be created, used, and saved on program exit.
@@ -58,6 +62,7 @@
  *
  */
 #include <iostream>
+#include <fstream>
 #include <cstdlib>     // for EXIT_SUCCESS/FAILURE
 #include <unistd.h>
 #include <getopt.h>
@@ -67,6 +72,7 @@
 #include "initConfig.h"
 #include "singletonConfig.h"
 #include "libwatcher/messageStream.h"
+#include "libwatcher/messageTrace.h"
 #include "logger.h"
 
 #ifndef SYSCONFDIR
@@ -90,6 +96,8 @@ option Options[] = {
     { "list-streams", 0, NULL, 'l' },
     { "speed", 1, NULL, 's' },
     { "seek", 1, NULL, 'S' },
+    { "output", 1, NULL, 'o' },
+    { "trace-report", 1, NULL, 't' },
     { 0, 0, NULL, 0 }
 };
 
@@ -104,6 +112,8 @@ void usage(const char *progName, bool exitp)
     cout << "   -l, --list-streams - fetch the list of available streams from the watcher server." << endl;
     cout << "   -s, --speed=FLOAT - specify the event playback speed." << endl;
     cout << "   -S, --seek=INT - specify the offset in milliseconds to start event playback (default: live playback)." << endl;
+    cout << "   -o, --output=FILE - also write the serialized events to FILE, one per line, for use with watcherImport." << endl;
+    cout << "   -t, --trace-report=SECONDS - print the per-hop latencies of trace stamped events every SECONDS." << endl;
     cout << "If a configuration file is not found on startup, a default one will be created, used, and saved on program exit." << endl;
     cout << "Config file settings:" << endl;
     cout << "server - name or ipaddress of the server to connect to." << endl;
@@ -124,8 +134,10 @@ int main(int argc, char **argv)
     bool do_join = false;
     uint32_t stream_uid = -1; // stream to join (default: new stream)
     std::string description(DEFAULT_DESCRIPTION);
+    std::string outputFile;
+    int traceInterval = 0; // seconds between trace reports, 0 for none
 
-    while ((i = getopt_long(argc, argv, "hc:d:j:ls:S:", Options, NULL)) != -1) {
+    while ((i = getopt_long(argc, argv, "hc:d:j:ls:S:o:t:", Options, NULL)) != -1) {
         switch (i) {
             case 'c':
                 //handled below
@@ -146,6 +158,12 @@ int main(int argc, char **argv)
             case 'S':
                 pos = strtoll(optarg, NULL, 10);
                 break;
+            case 'o':
+                outputFile = optarg;
+                break;
+            case 't':
+                traceInterval = atoi(optarg);
+                break;
             default:
                 usage(argv[0], true); 
         }
@@ -209,11 +227,32 @@ int main(int argc, char **argv)
 	ms->startStream(); 
     }
 
+    ofstream output;
+    if (!outputFile.empty()) {
+        output.open(outputFile.c_str());
+        if (!output) {
+            LOG_FATAL("Unable to open " << outputFile << " for writing");
+            TRACE_EXIT_RET(EXIT_FAILURE);
+            return EXIT_FAILURE;
+        }
+    }
+
     LOG_INFO("Waiting for events ");
     unsigned int messageNumber=0;
+    Timestamp nextTraceReport = getCurrentTime() + traceInterval * 1000;
     MessagePtr mp(new Message);
-    while(ms->getNextMessage(mp))
+    while(ms->getNextMessage(mp)) {
         cout << "Message #" << (++messageNumber) << ": " << *mp << endl; 
+        if (output.is_open()) {
+            mp->pack(output);
+            output << endl;  // flush, as we are usually stopped with a signal
+        }
+        if (traceInterval > 0 && getCurrentTime() >= nextTraceReport) {
+            cout << "Trace latencies (usec):" << endl;
+            reportTrace(cout);
+            nextTraceReport = getCurrentTime() + traceInterval * 1000;
+        }
+    }
 
     // Save any configuration changes made during the run.
     LOG_INFO("Saving last known configuration to " << configFilename); 
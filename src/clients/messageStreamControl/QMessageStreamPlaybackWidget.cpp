@@ -18,7 +18,6 @@ namespace watcher {
         isPlaybackPaused(false), 
         streamRate(1.0),
         minTime(0), maxTime(0),
-        timeRangeQueryTimerId(0),
         streamsDialog(NULL)
     {
         setupUi(this); 
@@ -57,13 +56,6 @@ namespace watcher {
             streamsDialog=NULL;
         }
     }
-    void QMessageStreamPlaybackWidget::timerEvent(QTimerEvent *te) {
-        // We request a timerange update every so often to set the slider 
-        // correctly. 
-        if (te->timerId()==timeRangeQueryTimerId) 
-            if (mStream)
-                mStream->getMessageTimeRange();
-    }
     void QMessageStreamPlaybackWidget::playbackTimeUpdated(watcher::Timestamp ts) {
         LOG_DEBUG("Got new message timestamp: epoch: " << ts << ", offset: " << ((ts-minTime)/1000)); 
         if (ts>maxTime) 
@@ -80,13 +72,13 @@ namespace watcher {
         LOG_DEBUG("QMessageStreamPlaybackWidget " << (connected?"":"dis-") << "connected " << 
                 (connected?"to":"from") << " message stream."); 
         if (connected) {
-            timeRangeQueryTimerId=startTimer(1000);  // every second, request the new time range.
-            if (mStream)  
+            // Ask for the range once, watcherd sends updates as it changes.
+            if (mStream) {
+                mStream->getMessageTimeRange();
                 mStream->listStreams();
+            }
         }
         else {
-            killTimer(timeRangeQueryTimerId);          
-            timeRangeQueryTimerId=0;
             descriptionLabel->setText(tr("No Stream")); 
             statusLabel->setText(tr("Lost connection...")); 
             playbackTimeLabel->setNum(-1); 
@@ -99,7 +99,6 @@ namespace watcher
 
         protected:
             DECLARE_LOGGER();
-            void timerEvent(QTimerEvent *); 
 
         private:
             MessageStreamPtr mStream;
@@ -107,9 +106,6 @@ namespace watcher
             float streamRate;
             watcher::Timestamp minTime, maxTime;  /* smallest and greatest timestamps seen - in unix epoch time */
 
-            /** QTimer Ids for our timer callbacks. */
-            int timeRangeQueryTimerId; 
-
             /** dialog for display list of streams */
             watcher::ui::WatcherStreamListDialog *streamsDialog;
     };
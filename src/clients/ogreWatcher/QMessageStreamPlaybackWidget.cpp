@@ -15,8 +15,7 @@ namespace watcher {
         QWidget(parent), 
         isPlaybackPaused(false), 
         streamRate(1.0),
-        minTime(0), maxTime(0),
-        timeRangeQueryTimerId(0)
+        minTime(0), maxTime(0)
     {
         setupUi(this); 
 
@@ -37,13 +36,6 @@ namespace watcher {
     // virtual 
     QMessageStreamPlaybackWidget::~QMessageStreamPlaybackWidget() {
     }
-    void QMessageStreamPlaybackWidget::timerEvent(QTimerEvent *te) {
-        // We request a timerange update every so often to set the slider 
-        // correctly. 
-        if (te->timerId()==timeRangeQueryTimerId) 
-            if (mStream)
-                mStream->getMessageTimeRange();
-    }
     void QMessageStreamPlaybackWidget::playbackTimeUpdated(watcher::Timestamp ts) {
         LOG_DEBUG("Got new message timestamp: epoch: " << ts << ", offset: " << ((ts-minTime)/1000)); 
         if (ts>maxTime) {
@@ -63,12 +55,12 @@ namespace watcher {
         LOG_DEBUG("QMessageStreamPlaybackWidget " << (connected?"":"dis-") << "connected " << 
                 (connected?"to":"from") << " message stream."); 
         if (connected) {
-            timeRangeQueryTimerId=startTimer(10000);  // every five seconds, request the new time range.
+            // Ask for the range once, watcherd sends updates as it changes.
+            if (mStream)
+                mStream->getMessageTimeRange();
             playbackSlider->setEnabled(true); 
         }
         else {
-            killTimer(timeRangeQueryTimerId);          
-            timeRangeQueryTimerId=0;
             descriptionLabel->setText("Not connected"); 
             playbackTimeLabel->setNum(-1); 
             playbackRangeLabel->setText("Unknown Range"); 
@@ -86,7 +86,6 @@ namespace watcher
 
         protected:
             DECLARE_LOGGER();
-            void timerEvent(QTimerEvent *); 
 
         private:
             MessageStreamPtr mStream;
@@ -94,9 +93,6 @@ namespace watcher
             float streamRate;
             watcher::Timestamp minTime, maxTime;  /* smallest and greatest timestamps seen - in unix epoch time */
 
-            /** QTimer Ids for our timer callbacks. */
-            int timeRangeQueryTimerId; 
-
             /** dialog for display list of streams */
             // watcher::WatcherStreamListDialog *streamsDialog;
     };
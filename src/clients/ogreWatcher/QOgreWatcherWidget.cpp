@@ -1,5 +1,8 @@
 #include <QTimerEvent>
+#include <cmath>
 #include <boost/pointer_cast.hpp>       // for dynamic_pointer_cast<>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
 #include <libwatcher/message.h>
 #include <libwatcher/seekWatcherMessage.h>
 #include <libwatcher/edgeMessage.h>
@@ -18,6 +21,13 @@ namespace watcher
 
     static const std::string skyMaterialName("Examples/CloudySky"); 
 
+    static const std::string clusterEntityIdPrefix("cluster_"); 
+    static const std::string clusterSceneNodeIdPrefix("clusternode_"); 
+    static const std::string clusterMeshName("sphere.mesh"); 
+    static const Ogre::Real clusterMeshRadius=100;  // of sphere.mesh
+    static const size_t levelOfDetailNodes=1000;    // nodes before crowds are drawn as one
+    static const Ogre::Real clusterPixels=40;       // size on screen of the cells nodes are grouped by
+
     using namespace event; 
     INIT_LOGGER(QOgreWatcherWidget, "QOgreWidget.QOgreWatcherWidget"); 
 
@@ -25,9 +35,12 @@ namespace watcher
         QOgreWidget(parent),
         lastKnownMessageTime(SeekMessage::eof),
         currentPlaybackTimerId(0),
-        m_physicalLayerSceneNode(NULL) 
+        m_physicalLayerSceneNode(NULL),
+        levelOfDetailTimerId(0),
+        m_levelOfDetail(false)
     { 
         currentPlaybackTimerId=startTimer(1000);  // once a sec.
+        levelOfDetailTimerId=startTimer(200); 
     }
     // virtual
     QOgreWatcherWidget::~QOgreWatcherWidget() {
@@ -44,6 +57,8 @@ namespace watcher
                 emit currentPlaybackTime(lastKnownMessageTime); 
             prevTimeStamp=lastKnownMessageTime;
         }
+        else if (te->timerId()==levelOfDetailTimerId) 
+            updateLevelOfDetail(); 
     }
     bool QOgreWatcherWidget::nodeLocationUpdate(double x, double y, double z, const std::string &nodeId) {
         LOG_DEBUG("Got location update for node " << nodeId << ": " << x << "," << y << "," << z); 
@@ -56,6 +71,13 @@ namespace watcher
             Ogre::SceneNode *sNode=mSceneMgr->getSceneNode(nodeSceneId); 
             sNode->setPosition(ox, oy, oz); 
 
+            {
+                boost::mutex::scoped_lock lock(m_nodesMutex); 
+                std::map<std::string, size_t>::const_iterator i=m_nodeIndexes.find(nodeId); 
+                if (i!=m_nodeIndexes.end())
+                    m_clusters.update(i->second, ox, oz, oy);     // group on the ground
+            }
+
             // first scene node seen's location becomes the center of the playing field.
             static bool firstNode=true;
             if (firstNode)  {
@@ -74,6 +96,85 @@ namespace watcher
         Ogre::SceneNode *sNode = m_physicalLayerSceneNode->createChildSceneNode(sceneNodeIdPrefix + nodeId); 
         sNode->setScale(Ogre::Vector3(0.4, 0.4, 0.4)); 
         sNode->attachObject(ent);
+
+        boost::mutex::scoped_lock lock(m_nodesMutex); 
+        size_t index=m_nodeSceneNodes.size(); 
+        m_nodeIndexes[nodeId]=index; 
+        m_nodeSceneNodes.push_back(sNode); 
+        m_nodeShown.push_back(true); 
+        const Ogre::Vector3 &pos=sNode->getPosition(); 
+        m_clusters.update(index, pos.x, pos.z, pos.y); 
+    }
+    void QOgreWatcherWidget::updateLevelOfDetail() {
+        if (!m_physicalLayerSceneNode) 
+            return;     // no scene yet
+
+        boost::mutex::scoped_lock lock(m_nodesMutex); 
+        if (m_nodeSceneNodes.size()<levelOfDetailNodes) {
+            if (m_levelOfDetail) { 
+                LOG_DEBUG("Fewer than " << levelOfDetailNodes << " nodes, drawing each of them"); 
+                for (size_t n=0; n<m_nodeSceneNodes.size(); n++) 
+                    if (!m_nodeShown[n]) {
+                        m_nodeSceneNodes[n]->setVisible(true); 
+                        m_nodeShown[n]=true;
+                    }
+                for (size_t c=0; c<m_clusterSceneNodes.size(); c++) 
+                    if (m_clusterSceneNodes[c]) 
+                        m_clusterSceneNodes[c]->setVisible(false); 
+                m_levelOfDetail=false;
+            }
+            return;
+        }
+        m_levelOfDetail=true;
+
+        // A cell is clusterPixels on screen, at the distance of the middle of the playing field. 
+        Ogre::Real distance=mCamera->getDerivedPosition().distance(m_mainNode->_getDerivedPosition()); 
+        Ogre::Real viewHeight=2*distance*Ogre::Math::Tan(mCamera->getFOVy()/2); 
+        if (height()>0)
+            m_clusters.setCellSize(viewHeight*clusterPixels/height()); 
+        Ogre::Real cellSize=m_clusters.cellSize(); 
+
+        std::vector<NodeClusters::Summary> clusters; 
+        m_clusters.clusters(clusters); 
+        std::vector<size_t> membership; 
+        m_clusters.membership(membership); 
+
+        // Show the crowds, hide the nodes in them. 
+        std::vector<bool> crowd;
+        BOOST_FOREACH(const NodeClusters::Summary &c, clusters) {
+            if (c.id>=crowd.size())
+                crowd.resize(c.id+1, false); 
+            if (c.count<2) 
+                continue;
+            crowd[c.id]=true;
+
+            if (c.id>=m_clusterSceneNodes.size())
+                m_clusterSceneNodes.resize(c.id+1, NULL); 
+            Ogre::SceneNode *&sNode=m_clusterSceneNodes[c.id]; 
+            if (!sNode) {
+                std::string id(boost::lexical_cast<std::string>(c.id)); 
+                Ogre::Entity *ent=mSceneMgr->createEntity(clusterEntityIdPrefix + id, clusterMeshName); 
+                ent->setCastShadows(true); 
+                sNode=m_physicalLayerSceneNode->createChildSceneNode(clusterSceneNodeIdPrefix + id); 
+                sNode->attachObject(ent); 
+            }
+            // Bigger crowds get bigger spheres, but a sphere stays inside its cell. 
+            Ogre::Real radius=cellSize*std::min(0.5, 0.1+0.04*log((double)c.count)/M_LN2); 
+            sNode->setScale(Ogre::Vector3(radius/clusterMeshRadius)); 
+            sNode->setPosition(c.x, c.z, c.y); 
+            sNode->setVisible(true); 
+        }
+        for (size_t c=0; c<m_clusterSceneNodes.size(); c++) 
+            if (m_clusterSceneNodes[c] && (c>=crowd.size() || !crowd[c])) 
+                m_clusterSceneNodes[c]->setVisible(false); 
+
+        for (size_t n=0; n<m_nodeSceneNodes.size() && n<membership.size(); n++) {
+            bool show=membership[n]>=crowd.size() || !crowd[membership[n]]; 
+            if (show!=m_nodeShown[n]) {
+                m_nodeSceneNodes[n]->setVisible(show); 
+                m_nodeShown[n]=show;
+            }
+        }
     }
     void QOgreWatcherWidget::newLayerSeen(watcher::event::MessagePtr m) {
         std::string layer;
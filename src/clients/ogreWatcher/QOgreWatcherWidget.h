@@ -1,8 +1,13 @@
 #ifndef QOGRE_WATCHER_WIDGET_H
 #define QOGRE_WATCHER_WIDGET_H
 
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
 #include <libwatcher/message_fwd.h>
 #include <libwatcher/watcherTypes.h>
+#include <libwatcher/nodeClusters.h>
 #include "QOgreWidget.h"
 #include "declareLogger.h"
 
@@ -100,6 +105,24 @@ namespace watcher
             int currentPlaybackTimerId; 
         
             Ogre::SceneNode *m_physicalLayerSceneNode; 
+
+            /** 
+             * Level of detail: once there are lots of nodes, a crowd of nodes 
+             * which would be drawn close together is drawn as one sphere, sized 
+             * by the number of nodes in it. The nodes are grouped as they move, 
+             * the groups are shown every levelOfDetailTimerId tick. 
+             */
+            void updateLevelOfDetail(); 
+            int levelOfDetailTimerId; 
+            bool m_levelOfDetail;       // crowds are being drawn
+            watcher::NodeClusters m_clusters; 
+            /** Each node's number in m_clusters, and its scene node */
+            std::map<std::string, size_t> m_nodeIndexes;
+            std::vector<Ogre::SceneNode*> m_nodeSceneNodes; 
+            std::vector<bool> m_nodeShown; 
+            boost::mutex m_nodesMutex;  // nodes are added from the message stream's thread
+            /** Scene node of each cluster, by its number in m_clusters */
+            std::vector<Ogre::SceneNode*> m_clusterSceneNodes; 
     };
 } // namespace
 #endif
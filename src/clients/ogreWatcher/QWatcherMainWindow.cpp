@@ -103,15 +103,21 @@ void QWatcherMainWindow::initMessageStream()
         delete messageStreamReactor; 
         messageStreamReactor=NULL;
     }
-    messageStreamReactor=new MessageStreamReactor(messageStream); 
+    // A pool of one thread, so the scene is updated in order, by one thread at a time. 
+    messageStreamReactor=new MessageStreamReactor(messageStream, 1); 
 
     // GUI window wants GPS updates, new layers, new nodes, and all data messages on all layers.
+    // Updating the scene is slow, so it's done off the reactor thread, leaving it 
+    // free to keep up with the stream and the playback widget. 
     messageStreamReactor->addNodeLocationUpdateFunction(
-            boost::bind(&watcher::QOgreWatcherWidget::nodeLocationUpdate, ui.ogreWidget, _1, _2, _3, _4)); 
+            boost::bind(&watcher::QOgreWatcherWidget::nodeLocationUpdate, ui.ogreWidget, _1, _2, _3, _4), 
+            MessageStreamReactor::DISPATCH_POOL); 
     messageStreamReactor->addNewNodeSeenCallback(
-            boost::bind(&watcher::QOgreWatcherWidget::newNodeSeen, ui.ogreWidget, _1)); 
+            boost::bind(&watcher::QOgreWatcherWidget::newNodeSeen, ui.ogreWidget, _1), 
+            MessageStreamReactor::DISPATCH_POOL); 
     messageStreamReactor->addNewLayerSeenCallback(
-            boost::bind(&watcher::QOgreWatcherWidget::newLayerSeen, ui.ogreWidget, _1));
+            boost::bind(&watcher::QOgreWatcherWidget::newLayerSeen, ui.ogreWidget, _1), 
+            MessageStreamReactor::DISPATCH_POOL);
     messageStreamReactor->addFeederMessageCallback(
             boost::bind(&watcher::QOgreWatcherWidget::handleFeederMessage, ui.ogreWidget, _1));
     messageStreamReactor->addMessageTypeCallback(
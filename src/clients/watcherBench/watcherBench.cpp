@@ -0,0 +1,679 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file watcherBench.cpp
+ * @date 2010-06-15
+ */
+/**
+ * @page watcherBench
+ *
+ * watcherBench measures the throughput of the whole watcher pipeline.  It runs a watcherd in
+ * process, listening on the loopback interface and writing to a temporary database, and drives
+ * it with synthetic feeders and MessageStream subscribers:
+ *
+ * -# the live subscribers connect and start playback;
+ * -# the feeders send their events, with a configurable mix of event types;
+ * -# once every event is stored, and the live subscribers have received them all, the replay
+ *    subscribers play the database back from the beginning.
+ *
+ * The events are generated from a seeded random number generator, so runs with the same
+ * arguments send the same events.  It reports the ingest rate, the rate events are delivered to
+ * the live and replay subscribers, the latency from an event's timestamp to its delivery to a
+ * live subscriber, and the resident set size of the process.  The report can also be written to
+ * a file as YAML for tracking regressions.
+ *
+ * Usage:
+ * @{
+ * <b>watcherBench [optional args]</b>
+ * @}
+ * Optional args:
+ * @arg <b>-f, --feeders=INT</b>, the number of feeders (default: 4).
+ * @arg <b>-e, --events=INT</b>, the number of events sent by each feeder (default: 10000).
+ * @arg <b>-r, --rate=INT</b>, events per second sent by each feeder, 0 for as fast as possible (default: 0).
+ * @arg <b>-b, --batch=INT</b>, events per message sent by a feeder (default: 10).
+ * @arg <b>-m, --mix=LIST</b>, the relative frequency of each event type
+ * (default: gps=40,connectivity=20,edge=20,label=10,data=10).
+ * @arg <b>-n, --nodes=INT</b>, the number of simulated nodes (default: 50).
+ * @arg <b>-l, --live=INT</b>, the number of live subscribers (default: 4).
+ * @arg <b>-R, --replay=INT</b>, the number of replay subscribers (default: 4).
+ * @arg <b>-x, --replay-speed=FLOAT</b>, the replay playback speed (default: 100).
+ * @arg <b>-s, --seed=INT</b>, the random number seed (default: 1).
+ * @arg <b>-j, --threads=INT</b>, the number of watcherd connection threads (default: 8).
+ * @arg <b>-p, --port=PORT</b>, the loopback port watcherd listens on (default: 18095).
+ * @arg <b>-t, --timeout=SECONDS</b>, how long to wait for each phase to finish (default: 120).
+ * @arg <b>-o, --output=FILE</b>, also write the report to FILE as YAML.
+ * @arg <b>-k, --keep=FILE</b>, write the event database to FILE and keep it.
+ * @arg <b>-L, --logProperties=FILE</b>, the log.properties file (default: logging disabled).
+ * @arg <b>-h, --help</b>, Show help message
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cstdlib>     // for EXIT_SUCCESS/FAILURE
+#include <cstdio>
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <yaml-cpp/yaml.h>
+
+#include "libwatcher/client.h"
+#include "libwatcher/messageHandler.h"
+#include "libwatcher/messageStream.h"
+#include "libwatcher/metrics.h"
+#include "libwatcher/gpsMessage.h"
+#include "libwatcher/connectivityMessage.h"
+#include "libwatcher/edgeMessage.h"
+#include "libwatcher/labelMessage.h"
+#include "libwatcher/dataPointMessage.h"
+#include "singletonConfig.h"
+#include "watcherd.h"
+#include "logger.h"
+
+DECLARE_GLOBAL_LOGGER("watcherBench");
+
+using namespace std;
+using namespace watcher;
+using namespace watcher::event;
+
+namespace {
+
+    option Options[] = {
+        { "help", 0, NULL, 'h' },
+        { "feeders", 1, NULL, 'f' },
+        { "events", 1, NULL, 'e' },
+        { "rate", 1, NULL, 'r' },
+        { "batch", 1, NULL, 'b' },
+        { "mix", 1, NULL, 'm' },
+        { "nodes", 1, NULL, 'n' },
+        { "live", 1, NULL, 'l' },
+        { "replay", 1, NULL, 'R' },
+        { "replay-speed", 1, NULL, 'x' },
+        { "seed", 1, NULL, 's' },
+        { "threads", 1, NULL, 'j' },
+        { "port", 1, NULL, 'p' },
+        { "timeout", 1, NULL, 't' },
+        { "output", 1, NULL, 'o' },
+        { "keep", 1, NULL, 'k' },
+        { "logProperties", 1, NULL, 'L' },
+        { 0, 0, NULL, 0 }
+    };
+
+    void usage(const char *progName, bool exitp)
+    {
+        cout << "Usage: " << basename(progName) << " [optional args]" << endl;
+        cout << "Args: " << endl;
+        cout << "   -h, show this messsage and exit." << endl;
+        cout << "   -f, --feeders=INT - the number of feeders (default: 4)." << endl;
+        cout << "   -e, --events=INT - the number of events sent by each feeder (default: 10000)." << endl;
+        cout << "   -r, --rate=INT - events per second sent by each feeder, 0 for as fast as possible (default: 0)." << endl;
+        cout << "   -b, --batch=INT - events per message sent by a feeder (default: 10)." << endl;
+        cout << "   -m, --mix=LIST - relative frequency of each event type (default: gps=40,connectivity=20,edge=20,label=10,data=10)." << endl;
+        cout << "   -n, --nodes=INT - the number of simulated nodes (default: 50)." << endl;
+        cout << "   -l, --live=INT - the number of live subscribers (default: 4)." << endl;
+        cout << "   -R, --replay=INT - the number of replay subscribers (default: 4)." << endl;
+        cout << "   -x, --replay-speed=FLOAT - the replay playback speed (default: 100)." << endl;
+        cout << "   -s, --seed=INT - the random number seed (default: 1)." << endl;
+        cout << "   -j, --threads=INT - the number of watcherd connection threads (default: 8)." << endl;
+        cout << "   -p, --port=PORT - the loopback port watcherd listens on (default: 18095)." << endl;
+        cout << "   -t, --timeout=SECONDS - how long to wait for each phase to finish (default: 120)." << endl;
+        cout << "   -o, --output=FILE - also write the report to FILE as YAML." << endl;
+        cout << "   -k, --keep=FILE - write the event database to FILE and keep it." << endl;
+        cout << "   -L, --logProperties=FILE - the log.properties file (default: logging disabled)." << endl;
+
+        if(exitp)
+            exit(EXIT_FAILURE);
+    }
+
+    const char *loopback = "127.0.0.1";
+
+    long long now_usec()
+    {
+        timeval tv;
+        gettimeofday(&tv, 0);
+        return tv.tv_sec * 1000000LL + tv.tv_usec;
+    }
+
+    /* The event types a feeder sends. */
+    enum EventKind { GPS, CONNECTIVITY, EDGE, LABEL, DATA_POINT, KIND_COUNT };
+    const char *kindNames[KIND_COUNT] = { "gps", "connectivity", "edge", "label", "data" };
+
+    /* Parse a list of the form "gps=40,edge=10" into weights.  Types which
+     * are not listed get a weight of zero. */
+    bool parse_mix(const string& s, unsigned int weights[KIND_COUNT])
+    {
+        for (int k = 0; k < KIND_COUNT; ++k)
+            weights[k] = 0;
+        unsigned int total = 0;
+        istringstream is(s);
+        string item;
+        while (getline(is, item, ',')) {
+            string::size_type eq = item.find('=');
+            if (eq == string::npos)
+                return false;
+            string name(item.substr(0, eq));
+            int k = 0;
+            while (k < KIND_COUNT && name != kindNames[k])
+                ++k;
+            if (k == KIND_COUNT)
+                return false;
+            try {
+                weights[k] = boost::lexical_cast<unsigned int>(item.substr(eq + 1));
+            } catch (boost::bad_lexical_cast&) {
+                return false;
+            }
+            total += weights[k];
+        }
+        return total > 0;
+    }
+
+    NodeIdentifier node_address(unsigned int n)
+    {
+        return boost::asio::ip::address_v4(0x0a000001 + n); // 10.0.0.1 ...
+    }
+
+    /* Counts the events a Client has finished writing to the socket, so a
+     * feeder can keep a single write outstanding on its connection. */
+    class SentCounter : public MessageHandler {
+        public:
+            SentCounter() : sent_(0) { }
+
+            bool handleMessagesSent(const std::vector<MessagePtr>& messages)
+            {
+                boost::mutex::scoped_lock lock(lock_);
+                sent_ += messages.size();
+                cond_.notify_all();
+                return false;   // keep the connection open
+            }
+
+            void waitFor(unsigned long n)
+            {
+                boost::mutex::scoped_lock lock(lock_);
+                while (sent_ < n)
+                    cond_.wait(lock);
+            }
+
+        private:
+            boost::mutex lock_;
+            boost::condition_variable cond_;
+            unsigned long sent_;
+    };
+
+    /* A simulated test node daemon sending a fixed number of events. */
+    class Feeder : private boost::noncopyable {
+        public:
+            Feeder(unsigned int id, const string& port, unsigned int events, unsigned int rate, unsigned int batch,
+                   unsigned int nodes, unsigned int seed, const unsigned int weights[KIND_COUNT]) :
+                id_(id), events_(events), rate_(rate), batch_(batch), nodes_(nodes),
+                gen_(seed * 7919 + id), sent_(new SentCounter), client_(new Client(loopback, port))
+            {
+                for (int k = 0; k < KIND_COUNT; ++k)
+                    weights_[k] = weights[k];
+                weightTotal_ = 0;
+                for (int k = 0; k < KIND_COUNT; ++k)
+                    weightTotal_ += weights_[k];
+                client_->addMessageHandler(sent_);
+            }
+
+            void start() { thread_ = boost::thread(boost::bind(&Feeder::run, this)); }
+            void join() { thread_.join(); }
+
+            /* Close the connection.  Call once the events have been stored. */
+            void close() { client_->close(); client_.reset(); }
+
+        private:
+            void run()
+            {
+                vector<MessagePtr> batch;
+                long long start = now_usec();
+                for (unsigned int i = 0; i < events_; ++i) {
+                    batch.push_back(makeEvent());
+                    if (batch.size() == batch_ || i + 1 == events_) {
+                        sent_->waitFor(i + 1 - batch.size());
+                        if (!client_->sendMessages(batch)) {
+                            LOG_ERROR("feeder " << id_ << " failed to send");
+                            return;
+                        }
+                        batch.clear();
+                    }
+                    if (rate_) {
+                        long long due = start + (i + 1) * 1000000LL / rate_;
+                        long long wait = due - now_usec();
+                        if (wait > 0)
+                            boost::this_thread::sleep(boost::posix_time::microseconds(wait));
+                    }
+                }
+                sent_->waitFor(events_);
+            }
+
+            NodeIdentifier randomNode() { return node_address(gen_() % nodes_); }
+
+            MessagePtr makeEvent()
+            {
+                unsigned int w = gen_() % weightTotal_;
+                int kind = 0;
+                while (w >= weights_[kind])
+                    w -= weights_[kind++];
+
+                MessagePtr m;
+                switch (kind) {
+                    case GPS:
+                        m.reset(new GPSMessage(-77.0 + (gen_() % 10000) / 100000.0, 38.0 + (gen_() % 10000) / 100000.0, 10));
+                        break;
+                    case CONNECTIVITY: {
+                        ConnectivityMessagePtr c(new ConnectivityMessage);
+                        for (int n = 0; n < 3; ++n)
+                            c->neighbors.push_back(randomNode());
+                        m = c;
+                        break;
+                    }
+                    case EDGE:
+                        m.reset(new EdgeMessage(randomNode(), randomNode(), PHYSICAL_LAYER));
+                        break;
+                    case LABEL:
+                        m.reset(new LabelMessage("node " + boost::lexical_cast<string>(gen_() % 1000)));
+                        break;
+                    default: {
+                        DataPointMessage::DataPointList values;
+                        values.push_back(gen_() % 1000);
+                        m.reset(new DataPointMessage("load", values));
+                        break;
+                    }
+                }
+                m->fromNodeID = randomNode();
+                return m;
+            }
+
+            unsigned int id_;
+            unsigned int events_;
+            unsigned int rate_;
+            size_t batch_;
+            unsigned int nodes_;
+            unsigned int weights_[KIND_COUNT];
+            unsigned int weightTotal_;
+            boost::mt19937 gen_;
+            boost::shared_ptr<SentCounter> sent_;
+            boost::scoped_ptr<Client> client_;
+            boost::thread thread_;
+    };
+
+    const char *liveLatencyName = "bench.live_latency_usec";
+    metrics::Histogram liveLatency(liveLatencyName);
+
+    /* A GUI client counting the events it is sent. */
+    class Subscriber : private boost::noncopyable {
+        public:
+            Subscriber(const string& port, bool live, float speed) :
+                live_(live), received_(0), first_(0), last_(0)
+            {
+                stream_ = MessageStream::createNewMessageStream(loopback, port, live ? -1 : 0, live ? 1.0 : speed);
+            }
+
+            void start()
+            {
+                stream_->startStream();
+                thread_ = boost::thread(boost::bind(&Subscriber::run, this));
+            }
+
+            void stop()
+            {
+                thread_.interrupt();
+                thread_.join();
+            }
+
+            unsigned long received() const { boost::mutex::scoped_lock lock(lock_); return received_; }
+            long long first() const { boost::mutex::scoped_lock lock(lock_); return first_; }
+            long long last() const { boost::mutex::scoped_lock lock(lock_); return last_; }
+
+        private:
+            void run()
+            {
+                MessagePtr m;
+                try {
+                    while (stream_->getNextMessage(m)) {
+                        if (!isFeederEvent(m->type))
+                            continue;
+                        long long now = now_usec();
+                        if (live_) {
+                            long long latency = now - m->timestamp * 1000;
+                            liveLatency.record(latency > 0 ? latency : 0);
+                        }
+                        boost::mutex::scoped_lock lock(lock_);
+                        if (!received_)
+                            first_ = now;
+                        ++received_;
+                        last_ = now;
+                    }
+                } catch (boost::thread_interrupted&) {
+                }
+            }
+
+            bool live_;
+            MessageStreamPtr stream_;
+            boost::thread thread_;
+            mutable boost::mutex lock_;
+            unsigned long received_;
+            long long first_;
+            long long last_;
+    };
+
+    typedef boost::shared_ptr<Subscriber> SubscriberPtr;
+
+    /* Wait until f() returns true or the timeout expires, returning the last value of f(). */
+    template <typename F> bool wait_until(F f, int timeout)
+    {
+        long long deadline = now_usec() + timeout * 1000000LL;
+        while (!f()) {
+            if (now_usec() > deadline)
+                return false;
+            boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+        }
+        return true;
+    }
+
+    int64_t counter_value(const string& name)
+    {
+        metrics::Snapshot snap;
+        metrics::snapshot(snap);
+        for (size_t i = 0; i < snap.counters.size(); ++i)
+            if (snap.counters[i].first == name)
+                return snap.counters[i].second;
+        return 0;
+    }
+
+    bool all_stored(int64_t expected) { return counter_value("db.events_stored") >= expected; }
+
+    bool all_received(const vector<SubscriberPtr>& subs, unsigned long expected)
+    {
+        BOOST_FOREACH(const SubscriberPtr& s, subs)
+            if (s->received() < expected)
+                return false;
+        return true;
+    }
+
+    /* Events per second delivered to a set of subscribers since start. */
+    double delivery_rate(const vector<SubscriberPtr>& subs, long long start, unsigned long& delivered)
+    {
+        long long end = start;
+        delivered = 0;
+        BOOST_FOREACH(const SubscriberPtr& s, subs) {
+            delivered += s->received();
+            if (s->last() > end)
+                end = s->last();
+        }
+        return end > start ? delivered * 1e6 / (end - start) : 0;
+    }
+
+    /* The resident set size and its peak, in kB. */
+    void memory_usage(long& rss, long& peak)
+    {
+        rss = peak = 0;
+        ifstream status("/proc/self/status");
+        string line;
+        while (getline(status, line)) {
+            if (line.compare(0, 6, "VmRSS:") == 0)
+                rss = atol(line.c_str() + 6);
+            else if (line.compare(0, 6, "VmHWM:") == 0)
+                peak = atol(line.c_str() + 6);
+        }
+    }
+
+    bool connectable(const string& port)
+    {
+        boost::asio::io_service ios;
+        boost::asio::ip::tcp::socket sock(ios);
+        boost::system::error_code ec;
+        sock.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(loopback),
+                                                    boost::lexical_cast<unsigned short>(port)), ec);
+        return !ec;
+    }
+
+    /** Removes a temporary directory, if one was made, however main() returns. */
+    class TempDir : private boost::noncopyable {
+        public:
+            ~TempDir()
+            {
+                if (path.empty())
+                    return;
+                try {
+                    boost::filesystem::remove_all(path);
+                } catch (const boost::filesystem::filesystem_error& e) {
+                    cerr << "unable to remove " << path << ": " << e.what() << endl;
+                }
+            }
+            string path;
+    };
+}
+
+int main(int argc, char **argv)
+{
+    TRACE_ENTER();
+
+    unsigned int feeders = 4, events = 10000, rate = 0, batch = 10, nodes = 50, seed = 1;
+    unsigned int liveSubs = 4, replaySubs = 4;
+    float replaySpeed = 100;
+    int threads = 8, timeout = 120;
+    string port("18095"), outputFile, keepFile, logProps;
+    string mix("gps=40,connectivity=20,edge=20,label=10,data=10");
+    unsigned int weights[KIND_COUNT];
+
+    int i;
+    while ((i = getopt_long(argc, argv, "hf:e:r:b:m:n:l:R:x:s:j:p:t:o:k:L:", Options, NULL)) != -1) {
+        try {
+            switch (i) {
+                case 'f': feeders = boost::lexical_cast<unsigned int>(optarg); break;
+                case 'e': events = boost::lexical_cast<unsigned int>(optarg); break;
+                case 'r': rate = boost::lexical_cast<unsigned int>(optarg); break;
+                case 'b': batch = boost::lexical_cast<unsigned int>(optarg); break;
+                case 'm': mix = optarg; break;
+                case 'n': nodes = boost::lexical_cast<unsigned int>(optarg); break;
+                case 'l': liveSubs = boost::lexical_cast<unsigned int>(optarg); break;
+                case 'R': replaySubs = boost::lexical_cast<unsigned int>(optarg); break;
+                case 'x': replaySpeed = boost::lexical_cast<float>(optarg); break;
+                case 's': seed = boost::lexical_cast<unsigned int>(optarg); break;
+                case 'j': threads = boost::lexical_cast<int>(optarg); break;
+                case 'p': port = optarg; break;
+                case 't': timeout = boost::lexical_cast<int>(optarg); break;
+                case 'o': outputFile = optarg; break;
+                case 'k': keepFile = optarg; break;
+                case 'L': logProps = optarg; break;
+                default: usage(argv[0], true);
+            }
+        } catch (boost::bad_lexical_cast&) {
+            cerr << "invalid argument to -" << static_cast<char>(i) << ": " << optarg << endl;
+            usage(argv[0], true);
+        }
+    }
+    if (!parse_mix(mix, weights)) {
+        cerr << "invalid event mix: " << mix << endl;
+        usage(argv[0], true);
+    }
+    if (!feeders || !events || !batch || !nodes || replaySpeed <= 0) {
+        cerr << "feeders, events, batch, nodes and replay speed must be positive" << endl;
+        usage(argv[0], true);
+    }
+
+    if (logProps.empty())
+        Logger::getRootLogger()->setLevel(Level::getOff());
+    else
+        LOAD_LOG_PROPS(logProps);
+
+    TempDir tmpdir;
+    string dbFile(keepFile);
+    if (dbFile.empty()) {
+        char tmpl[] = "/tmp/watcherBench.XXXXXX";
+        if (!mkdtemp(tmpl)) {
+            perror("mkdtemp");
+            return EXIT_FAILURE;
+        }
+        tmpdir.path = tmpl;
+        dbFile = tmpdir.path + "/event.db";
+    } else if (boost::filesystem::exists(dbFile)) {
+        cerr << dbFile << " already exists" << endl;
+        return EXIT_FAILURE;
+    }
+
+    libconfig::Config& config = SingletonConfig::instance();
+    config.getRoot().add("databasePath", libconfig::Setting::TypeString) = dbFile;
+    config.getRoot().add("metricsInterval", libconfig::Setting::TypeInt) = 0;
+
+    /* The in-process watcherd shuts down when it receives one of these
+     * signals.  Block them before any thread is started, so that only its
+     * sigwait() sees them. */
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGQUIT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, 0);
+
+    WatcherdPtr watcherd(new Watcherd(false));
+    boost::thread watcherdThread(boost::bind(&Watcherd::run, watcherd, string(loopback), port, threads));
+    if (!wait_until(boost::bind(connectable, port), 10)) {
+        cerr << "watcherd did not start listening on port " << port << endl;
+        return EXIT_FAILURE;
+    }
+
+    const unsigned long total = static_cast<unsigned long>(feeders) * events;
+    cout << "watcherBench: " << feeders << " feeders x " << events << " events (" << mix << "), " <<
+        liveSubs << " live and " << replaySubs << " replay subscribers" << endl;
+
+    // live subscribers must be watching before the first event arrives
+    vector<SubscriberPtr> live;
+    for (unsigned int n = 0; n < liveSubs; ++n) {
+        live.push_back(SubscriberPtr(new Subscriber(port, true, 1.0)));
+        live.back()->start();
+    }
+
+    vector<boost::shared_ptr<Feeder> > feederList;
+    for (unsigned int n = 0; n < feeders; ++n)
+        feederList.push_back(boost::shared_ptr<Feeder>(new Feeder(n, port, events, rate, batch, nodes, seed, weights)));
+
+    long long ingestStart = now_usec();
+    BOOST_FOREACH(boost::shared_ptr<Feeder>& f, feederList)
+        f->start();
+    BOOST_FOREACH(boost::shared_ptr<Feeder>& f, feederList)
+        f->join();
+    bool ingestDone = wait_until(boost::bind(all_stored, static_cast<int64_t>(total)), timeout);
+    long long ingestEnd = now_usec();
+    int64_t stored = counter_value("db.events_stored");
+    double ingestRate = stored * 1e6 / (ingestEnd - ingestStart);
+    BOOST_FOREACH(boost::shared_ptr<Feeder>& f, feederList)
+        f->close();
+    cout << "ingest: " << stored << " events in " << (ingestEnd - ingestStart) / 1e6 << "s, " << ingestRate << " events/s" <<
+        (ingestDone ? "" : " (timed out)") << endl;
+
+    bool liveDone = wait_until(boost::bind(all_received, boost::cref(live), total), timeout);
+    unsigned long liveDelivered;
+    double liveRate = delivery_rate(live, ingestStart, liveDelivered);
+    BOOST_FOREACH(SubscriberPtr& s, live)
+        s->stop();
+    cout << "live: " << liveDelivered << " events delivered, " << liveRate << " events/s" << (liveDone ? "" : " (timed out)") << endl;
+
+    vector<SubscriberPtr> replay;
+    long long replayStart = now_usec();
+    for (unsigned int n = 0; n < replaySubs; ++n) {
+        replay.push_back(SubscriberPtr(new Subscriber(port, false, replaySpeed)));
+        replay.back()->start();
+    }
+    bool replayDone = wait_until(boost::bind(all_received, boost::cref(replay), static_cast<unsigned long>(stored)), timeout);
+    unsigned long replayDelivered;
+    double replayRate = delivery_rate(replay, replayStart, replayDelivered);
+    BOOST_FOREACH(SubscriberPtr& s, replay)
+        s->stop();
+    if (replaySubs)
+        cout << "replay: " << replayDelivered << " events delivered, " << replayRate << " events/s" <<
+            (replayDone ? "" : " (timed out)") << endl;
+
+    metrics::Snapshot snap;
+    metrics::snapshot(snap);
+    metrics::HistogramSummary latency;
+    BOOST_FOREACH(const metrics::HistogramSummary& h, snap.histograms)
+        if (h.name == liveLatencyName)
+            latency = h;
+    long rss, peakRss;
+    memory_usage(rss, peakRss);
+    cout << "live latency (usec): p50=" << latency.p50 << " p99=" << latency.p99 << " max=" << latency.max << endl;
+    cout << "rss: " << rss << " kB (peak " << peakRss << " kB)" << endl;
+
+    // shut down watcherd; the subscribers are closed by the server
+    kill(getpid(), SIGTERM);
+    watcherdThread.join();
+    live.clear();
+    replay.clear();
+
+    if (!outputFile.empty()) {
+        YAML::Emitter e;
+        e << YAML::BeginMap;
+        e << YAML::Key << "feeders" << YAML::Value << feeders;
+        e << YAML::Key << "events_per_feeder" << YAML::Value << events;
+        e << YAML::Key << "rate" << YAML::Value << rate;
+        e << YAML::Key << "batch" << YAML::Value << batch;
+        e << YAML::Key << "mix" << YAML::Value << mix;
+        e << YAML::Key << "nodes" << YAML::Value << nodes;
+        e << YAML::Key << "seed" << YAML::Value << seed;
+        e << YAML::Key << "live_subscribers" << YAML::Value << liveSubs;
+        e << YAML::Key << "replay_subscribers" << YAML::Value << replaySubs;
+        e << YAML::Key << "replay_speed" << YAML::Value << replaySpeed;
+        e << YAML::Key << "complete" << YAML::Value << (ingestDone && liveDone && replayDone);
+        e << YAML::Key << "events_stored" << YAML::Value << static_cast<long long>(stored);
+        e << YAML::Key << "ingest_events_per_sec" << YAML::Value << ingestRate;
+        e << YAML::Key << "live_events_delivered" << YAML::Value << liveDelivered;
+        e << YAML::Key << "live_events_per_sec" << YAML::Value << liveRate;
+        e << YAML::Key << "live_latency_p50_usec" << YAML::Value << static_cast<unsigned long long>(latency.p50);
+        e << YAML::Key << "live_latency_p99_usec" << YAML::Value << static_cast<unsigned long long>(latency.p99);
+        e << YAML::Key << "replay_events_delivered" << YAML::Value << replayDelivered;
+        e << YAML::Key << "replay_events_per_sec" << YAML::Value << replayRate;
+        e << YAML::Key << "rss_kb" << YAML::Value << rss;
+        e << YAML::Key << "peak_rss_kb" << YAML::Value << peakRss;
+        e << YAML::Key << "histograms" << YAML::Value << YAML::BeginMap;
+        BOOST_FOREACH(const metrics::HistogramSummary& h, snap.histograms) {
+            e << YAML::Key << h.name << YAML::Value << YAML::Flow << YAML::BeginMap;
+            e << YAML::Key << "count" << YAML::Value << static_cast<unsigned long long>(h.count);
+            e << YAML::Key << "p50" << YAML::Value << static_cast<unsigned long long>(h.p50);
+            e << YAML::Key << "p99" << YAML::Value << static_cast<unsigned long long>(h.p99);
+            e << YAML::Key << "max" << YAML::Value << static_cast<unsigned long long>(h.max);
+            e << YAML::EndMap;
+        }
+        e << YAML::EndMap;
+        e << YAML::EndMap;
+
+        ofstream out(outputFile.c_str());
+        out << e.c_str() << endl;
+        if (!out) {
+            cerr << "unable to write " << outputFile << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    TRACE_EXIT();
+    return ingestDone && liveDone && replayDone ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -2,7 +2,7 @@
 #define ALERT_HANDLER_H_WE_EAT_WELL_HERE_IN_CAMELOT_WE_EAT_HAM_AND_JAM_AND_SPAMALOT
 
 #include <libwatcher/client.h>
-#include <libxml/tree.h>
+#include "IDMEFAlert.h"
 #include "idsCommunications.h"
 #include <string>
 
@@ -16,8 +16,9 @@ namespace  HierarchyAPI
 			AlertHandler();
 			virtual ~AlertHandler(); 
 
-			// do actual work
-			virtual bool handleAlert(const xmlDoc* alertMessage, watcher::ClientPtr client) = 0; 
+			// do actual work. Handlers which need more than the fields in 
+			// IDMEFAlert can get at the whole document with alert.doc().
+			virtual bool handleAlert(const IDMEFAlert &alert, watcher::ClientPtr client) = 0; 
 		
 			void setGUIAlertTimeout(const int &timeout);
 
@@ -1,5 +1,4 @@
 #include "AlertHandlerDefault.h"
-#include "XPathExtractor.h"
 #include <boost/exception/diagnostic_information.hpp>
 #include <string.h>
 #include <libwatcher/labelMessage.h>
@@ -7,7 +6,6 @@
 #include <libwatcher/colors.h>
 
 using namespace HierarchyAPI;
-using SpartaIssoSrdXmlAPI::XPathExtractor;
 using namespace std; 
 using namespace watcher;
 using namespace watcher::event;
@@ -29,23 +27,20 @@ AlertHandlerDefault::~AlertHandlerDefault()
 // Default "handling" is too assume one victim and one attacker and 
 // label thoses nodes in the watcher. 
 //
-bool AlertHandlerDefault::handleAlert(const xmlDoc* alertMessage, watcher::ClientPtr client)
+bool AlertHandlerDefault::handleAlert(const IDMEFAlert &alert, watcher::ClientPtr client)
 {
     TRACE_ENTER(); 
 
     try {
-        string* detectorAddrStr = XPathExtractor::extractFromDocUsing(alertMessage, 
-                "/IDMEF-Message/Alert/Analyzer/Node/Address[@category='ipv4-addr']/address");
-        string* attackerAddrStr = XPathExtractor::extractFromDocUsing(alertMessage, 
-                "/IDMEF-Message/Alert/Source/Node/Address[@category='ipv4-addr']/address");
-        string* victimAddrStr = XPathExtractor::extractFromDocUsing(alertMessage, 
-                "/IDMEF-Message/Alert/Target/Node/Address[@category='ipv4-addr']/address");
-        string *classificationString = XPathExtractor::extractFromDocUsing(alertMessage, "/IDMEF-Message/Alert/Classification[@text]");
+        const string *detectorAddrStr = alert.analyzer.empty() ? NULL : &alert.analyzer; 
+        const string *attackerAddrStr = IDMEFAlert::firstAddress(alert.sources); 
+        const string *victimAddrStr = IDMEFAlert::firstAddress(alert.targets); 
+        const string *classificationString = alert.classification.empty() ? NULL : &alert.classification; 
 
-        LOG_DEBUG("detectorAddrStr: " << *detectorAddrStr); 
-        LOG_DEBUG("attackerAddrStr: " << *attackerAddrStr); 
-        LOG_DEBUG("victimAddrStr: " << *victimAddrStr); 
-        LOG_DEBUG("classificationString: " << *classificationString); 
+        LOG_DEBUG("detectorAddrStr: " << alert.analyzer); 
+        LOG_DEBUG("attackerAddrStr: " << (attackerAddrStr ? *attackerAddrStr : string())); 
+        LOG_DEBUG("victimAddrStr: " << (victimAddrStr ? *victimAddrStr : string())); 
+        LOG_DEBUG("classificationString: " << alert.classification); 
 
         std::vector<MessagePtr> messages;
 
@@ -103,7 +98,6 @@ bool AlertHandlerDefault::handleAlert(const xmlDoc* alertMessage, watcher::Clien
                 lm->background=watcher::colors::black;
                 lm->foreground=watcher::colors::white;
                 lm->expiration=m_alertLabelTimeout*1000;
-                delete classificationString; 
             }
         }
 
@@ -118,13 +112,6 @@ bool AlertHandlerDefault::handleAlert(const xmlDoc* alertMessage, watcher::Clien
         else
             LOG_DEBUG("Alert does not contain enough information to generate any display information"); 
 
-        if(victimAddrStr)   
-            delete victimAddrStr; 
-        if(attackerAddrStr) 
-            delete attackerAddrStr; 
-        if(detectorAddrStr) 
-            delete detectorAddrStr; 
-
     }
     catch (boost::exception &e) {
         LOG_ERROR("Caught boost exception when sending watcher messasge(s): " << diagnostic_information(e));
@@ -15,7 +15,7 @@ AlertHandlerFictitiousNeighbor::~AlertHandlerFictitiousNeighbor()
 	// noop 
 }
 
-bool AlertHandlerFictitiousNeighbor::handleAlert(const xmlDoc* alertMessage, watcher::ClientPtr client)
+bool AlertHandlerFictitiousNeighbor::handleAlert(const IDMEFAlert &alert, watcher::ClientPtr client)
 {
 	return false; // let the default handle it. 
 }
@@ -15,7 +15,7 @@ AlertHandlerOmittedNeighbor::~AlertHandlerOmittedNeighbor()
 	// noop 
 }
 
-bool AlertHandlerOmittedNeighbor::handleAlert(const xmlDoc* alertMessage, watcher::ClientPtr client)
+bool AlertHandlerOmittedNeighbor::handleAlert(const IDMEFAlert &alert, watcher::ClientPtr client)
 {
 	return false; // let the default handle it. 
 }
@@ -1,11 +1,10 @@
 #include "AlertHandlerWormhole.h"
-#include "XPathExtractor.h"
 #include <string.h>
 #include <libwatcher/labelMessage.h>
 #include <libwatcher/edgeMessage.h>
 
 using namespace HierarchyAPI; 
-using namespace SpartaIssoSrdXmlAPI; 
+using namespace std; 
 using namespace watcher;
 using namespace watcher::event;
 
@@ -22,14 +21,13 @@ AlertHandlerWormhole::~AlertHandlerWormhole()
 	// noop 
 }
 
-bool AlertHandlerWormhole::handleAlert(const xmlDoc* alertMessage, watcher::ClientPtr client)
+bool AlertHandlerWormhole::handleAlert(const IDMEFAlert &alert, watcher::ClientPtr client)
 {
 	TRACE_ENTER();
 
-	string* attacker1AddrStr=XPathExtractor::extractFromDocUsing(alertMessage, "/IDMEF-Message/Alert/Source[1]/Node/Address[@category='ipv4-addr']/address");
-	string* attacker2AddrStr=XPathExtractor::extractFromDocUsing(alertMessage, "/IDMEF-Message/Alert/Source[2]/Node/Address[@category='ipv4-addr']/address");
+	const string *attacker1AddrStr=alert.sources.size() > 0 && !alert.sources[0].empty() ? &alert.sources[0] : NULL; 
+	const string *attacker2AddrStr=alert.sources.size() > 1 && !alert.sources[1].empty() ? &alert.sources[1] : NULL; 
 
-	
 	if(attacker1AddrStr && attacker2AddrStr)
 	{
 	    LOG_DEBUG("Marking " << *attacker1AddrStr << " and " << *attacker2AddrStr << " as ends of the wormhole"); 
@@ -51,11 +49,6 @@ bool AlertHandlerWormhole::handleAlert(const xmlDoc* alertMessage, watcher::Clie
             LOG_WARN("Error sending wormhole alert messages to the watcher"); 
 	}
 
-	if(attacker1AddrStr) 
-        delete attacker1AddrStr; 
-	if(attacker2AddrStr) 
-        delete attacker2AddrStr; 
-
 	TRACE_EXIT();
 	return true; 
 }
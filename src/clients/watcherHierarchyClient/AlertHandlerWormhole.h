@@ -13,7 +13,7 @@ namespace  HierarchyAPI
 			AlertHandlerWormhole();
 			virtual ~AlertHandlerWormhole(); 
 
-			bool handleAlert(const xmlDoc* alertMessage, watcher::ClientPtr client); 
+			bool handleAlert(const IDMEFAlert &alert, watcher::ClientPtr client); 
 		
 		protected:
 
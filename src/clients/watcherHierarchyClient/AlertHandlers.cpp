@@ -1,6 +1,5 @@
 #include "AlertHandlers.h"
 #include "alertClassifications.h" 	// all known alert types
-#include "XPathExtractor.h"
 
 // known handlers
 #include "AlertHandlerWormhole.h"
@@ -8,7 +7,6 @@
 #include "AlertHandlerOmittedNeighbor.h"
 
 using namespace HierarchyAPI; 
-using namespace SpartaIssoSrdXmlAPI; 
 using namespace std; 
 using namespace watcher;
 using namespace watcher::event;
@@ -22,22 +20,18 @@ AlertHandlers *AlertHandlers::getAlertHandlers()
 	return &theOneAndOnlyAlertHandlersInstance; 
 }
 
-bool AlertHandlers::handleAlert(const xmlDoc* alertMessage, ClientPtr client)
+bool AlertHandlers::handleAlert(const IDMEFAlert &alert, ClientPtr client)
 {
-	string *classificationString = XPathExtractor::extractFromDocUsing(alertMessage, "/IDMEF-Message/Alert/Classification/@text");
-	if(!classificationString->empty()) {
-		std::map<std::string, AlertHandler *>::iterator handler = m_alertHandlers.find(*classificationString); 
+	if(!alert.classification.empty()) {
+		std::map<std::string, AlertHandler *>::iterator handler = m_alertHandlers.find(alert.classification); 
 		if(handler != m_alertHandlers.end()) {
-			if(handler->second->handleAlert(alertMessage, client)) {
-				delete classificationString; 
+			if(handler->second->handleAlert(alert, client))
 				return true; 
-			}
 			// else let the default handler get it. 
 		}
-		delete classificationString; // annoying. 
 	}
 
-	return m_defaultHandler.handleAlert(alertMessage, client); 
+	return m_defaultHandler.handleAlert(alert, client); 
 }
 
 AlertHandlers::AlertHandlers() : m_defaultHandler()
@@ -23,7 +23,7 @@ namespace HierarchyAPI
 			//
 			// react somehow if this alert is known
 			// 
-			bool handleAlert(const xmlDoc* alertMessage, watcher::ClientPtr client); 
+			bool handleAlert(const IDMEFAlert &alert, watcher::ClientPtr client); 
 
 			//
 			// Set GUI alert timeout. (Breaks encapsulation)
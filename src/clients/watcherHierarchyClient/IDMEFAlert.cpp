@@ -0,0 +1,168 @@
+#include "IDMEFAlert.h"
+
+using namespace HierarchyAPI; 
+using namespace std; 
+
+namespace {
+	const int readerOptions = XML_PARSE_NOBLANKS | XML_PARSE_NONET | XML_PARSE_NOERROR | XML_PARSE_NOWARNING; 
+
+	bool nameIs(xmlTextReaderPtr reader, const char *name)
+	{
+		return xmlStrEqual(xmlTextReaderConstLocalName(reader), BAD_CAST name); 
+	}
+
+	bool attributeIs(xmlTextReaderPtr reader, const char *attr, const char *value)
+	{
+		xmlChar *v = xmlTextReaderGetAttribute(reader, BAD_CAST attr); 
+		bool ret = v && xmlStrEqual(v, BAD_CAST value); 
+		xmlFree(v); 
+		return ret; 
+	}
+
+	// Put the attribute value in s. Returns false if there is no such attribute.
+	bool getAttribute(xmlTextReaderPtr reader, const char *attr, string &s)
+	{
+		xmlChar *v = xmlTextReaderGetAttribute(reader, BAD_CAST attr); 
+		if (!v)
+			return false; 
+		s = reinterpret_cast<const char *>(v); 
+		xmlFree(v); 
+		return true; 
+	}
+
+	// Put the text content of the current element in s.
+	void getContent(xmlTextReaderPtr reader, string &s)
+	{
+		xmlChar *v = xmlTextReaderReadString(reader); 
+		if (v) {
+			s = reinterpret_cast<const char *>(v); 
+			xmlFree(v); 
+		}
+	}
+}
+
+IDMEFAlert::IDMEFAlert(const char *xml, size_t len) : 
+	m_xml(xml), m_len(len), m_valid(false), m_doc(NULL), m_ownDoc(false)
+{
+	xmlTextReaderPtr reader = xmlReaderForMemory(xml, static_cast<int>(len), NULL, NULL, readerOptions); 
+	if (reader) {
+		read(reader); 
+		xmlFreeTextReader(reader); 
+	}
+}
+
+IDMEFAlert::IDMEFAlert(const xmlDoc *doc) : 
+	m_xml(NULL), m_len(0), m_valid(false), m_doc(const_cast<xmlDocPtr>(doc)), m_ownDoc(false)
+{
+	xmlTextReaderPtr reader = doc ? xmlReaderWalker(m_doc) : NULL; 
+	if (reader) {
+		read(reader); 
+		xmlFreeTextReader(reader); 
+	}
+}
+
+IDMEFAlert::~IDMEFAlert()
+{
+	if (m_ownDoc && m_doc)
+		xmlFreeDoc(m_doc); 
+}
+
+//
+// The fields are at fixed depths below the root:
+//
+//   0 IDMEF-Message
+//   1   Alert
+//   2     Classification text=... | Analyzer | Source | Target
+//   3       Node
+//   4         Address category="ipv4-addr"
+//   5           address
+//
+// so it is enough to remember which element is open at each of 
+// depths 2 to 4.
+//
+void IDMEFAlert::read(xmlTextReaderPtr reader)
+{
+	enum { Other, Analyzer, Source, Target } section = Other; 
+	bool inAlert = false, alertSeen = false, classified = false; 
+	bool inNode = false, inAddress = false, finished = false; 
+
+	int ret = 0; 
+	while (!finished && (ret = xmlTextReaderRead(reader)) == 1) {
+		int type = xmlTextReaderNodeType(reader); 
+		int depth = xmlTextReaderDepth(reader); 
+
+		if (type == XML_READER_TYPE_END_ELEMENT) {
+			if (depth == 1 && inAlert)
+				finished = true;  // only the first alert is wanted 
+			continue; 
+		}
+		if (type != XML_READER_TYPE_ELEMENT)
+			continue; 
+
+		switch (depth) {
+			case 1: 
+				if (nameIs(reader, "Alert")) {
+					if (alertSeen) {
+						finished = true; 
+						break; 
+					}
+					inAlert = alertSeen = true; 
+				}
+				else
+					inAlert = false; 
+				break; 
+			case 2: 
+				section = Other; 
+				if (!inAlert)
+					break; 
+				if (nameIs(reader, "Classification")) {
+					if (!classified)
+						classified = getAttribute(reader, "text", classification); 
+				}
+				else if (nameIs(reader, "Analyzer"))
+					section = Analyzer; 
+				else if (nameIs(reader, "Source")) {
+					section = Source; 
+					sources.push_back(string()); 
+				}
+				else if (nameIs(reader, "Target")) {
+					section = Target; 
+					targets.push_back(string()); 
+				}
+				break; 
+			case 3: 
+				inNode = section != Other && nameIs(reader, "Node"); 
+				break; 
+			case 4: 
+				inAddress = inNode && nameIs(reader, "Address") && attributeIs(reader, "category", "ipv4-addr"); 
+				break; 
+			case 5: 
+				if (inAddress && nameIs(reader, "address")) {
+					string &addr = section == Analyzer ? analyzer : 
+						section == Source ? sources.back() : targets.back(); 
+					if (addr.empty())
+						getContent(reader, addr); 
+				}
+				break; 
+		}
+	}
+	m_valid = ret != -1; 
+}
+
+// static
+const string *IDMEFAlert::firstAddress(const vector<string> &addrs)
+{
+	for (vector<string>::const_iterator i = addrs.begin(); i != addrs.end(); ++i)
+		if (!i->empty())
+			return &*i; 
+	return NULL; 
+}
+
+const xmlDoc *IDMEFAlert::doc() const
+{
+	if (!m_doc && m_xml) {
+		m_doc = xmlReadMemory(m_xml, static_cast<int>(m_len), NULL, NULL, XML_PARSE_NOBLANKS | XML_PARSE_NONET); 
+		m_ownDoc = true; 
+	}
+	return m_doc; 
+}
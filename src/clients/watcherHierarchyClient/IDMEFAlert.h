@@ -0,0 +1,71 @@
+#ifndef IDMEF_ALERT_H_WE_ARE_THE_KNIGHTS_WHO_SAY_NI
+#define IDMEF_ALERT_H_WE_ARE_THE_KNIGHTS_WHO_SAY_NI
+
+#include <string>
+#include <vector>
+#include <libxml/tree.h>
+#include <libxml/xmlreader.h>
+
+namespace HierarchyAPI
+{
+	//
+	// The fields of an IDMEF alert that the alert handlers use.
+	//
+	// The fields are pulled out with a single pass of libxml's 
+	// xmlTextReader, which stops at the end of the first Alert, 
+	// rather than by building the whole document and running an 
+	// xpath query over it for each field. Handlers which need 
+	// anything else can ask for the document with doc(), which is 
+	// only built when it is asked for.
+	//
+	class IDMEFAlert
+	{
+		public:
+			// Read the alert from its XML text. The text must outlive
+			// the IDMEFAlert.
+			IDMEFAlert(const char *xml, size_t len); 
+
+			// Read the alert from an existing document, which must 
+			// outlive the IDMEFAlert.
+			explicit IDMEFAlert(const xmlDoc *doc); 
+
+			~IDMEFAlert(); 
+
+			// false if the XML could not be read. 
+			bool valid() const { return m_valid; }
+
+			// /IDMEF-Message/Alert/Classification/@text
+			std::string classification; 
+
+			// /IDMEF-Message/Alert/Analyzer/Node/Address[@category='ipv4-addr']/address
+			std::string analyzer; 
+
+			// The first ipv4-addr address of each Source and each 
+			// Target, in document order. The string is empty for a 
+			// Source or Target which has none.
+			std::vector<std::string> sources; 
+			std::vector<std::string> targets; 
+
+			// The first non-empty address in sources or targets, or 
+			// NULL if there is none. 
+			static const std::string *firstAddress(const std::vector<std::string> &addrs); 
+
+			// The alert as a document, or NULL if it cannot be parsed. 
+			const xmlDoc *doc() const; 
+
+		private:
+			void read(xmlTextReaderPtr reader); 
+
+			const char *m_xml; 
+			size_t m_len; 
+			bool m_valid; 
+			mutable xmlDocPtr m_doc; 
+			mutable bool m_ownDoc; 
+
+			// no copying or assignment
+			IDMEFAlert(const IDMEFAlert &noCopies); 
+			IDMEFAlert& operator=(const IDMEFAlert &other); 
+	}; 
+}
+
+#endif // IDMEF_ALERT_H_WE_ARE_THE_KNIGHTS_WHO_SAY_NI
@@ -23,7 +23,7 @@
  *
  * The only thing at all special needed to compile is libxml2.
  * This will often do the trick:
- *   cc -D GEN_MAIN -I /usr/include/libxml2 -I /usr/include/c++/3.4.2 -lxml2 -lstdc++ XPathExtractor.cpp
+ *   cc -D GEN_MAIN -I /usr/include/libxml2 -I /usr/include/c++/3.4.2 -lxml2 -lstdc++ -lboost_thread XPathExtractor.cpp
  *
  */
 
@@ -31,6 +31,9 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <map>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
 
 #if !defined(LIBXML_XPATH_ENABLED) 
 #error("NO XPATH SUPPORT!");
@@ -41,6 +44,40 @@ namespace SpartaIssoSrdXmlAPI
 
 using namespace std;
 
+namespace {
+    //
+    // The xpath context of the calling thread.  Creating a context
+    // costs more than evaluating a compiled expression does, so each
+    // thread creates one and points it at each document in turn.
+    //
+    boost::thread_specific_ptr<xmlXPathContext> threadContext(xmlXPathFreeContext);
+
+    xmlXPathContextPtr contextFor(const xmlDoc* doc)
+    {
+        xmlXPathContextPtr context = threadContext.get();
+        if (context == NULL) {
+            context = xmlXPathNewContext(NULL);
+            if (context == NULL)
+                return NULL;
+            threadContext.reset(context);
+        }
+        context->doc = const_cast<xmlDocPtr>(doc);
+        context->node = NULL;
+        context->contextSize = -1;
+        context->proximityPosition = -1;
+        return context;
+    }
+
+    // Extractors used by the static functions, by xpath.
+    typedef map<string, shared_ptr<XPathExtractor> > ExtractorCache;
+    ExtractorCache extractorCache;
+    boost::mutex extractorCacheLock;
+
+    // Callers are expected to use a fixed set of xpaths; if they do 
+    // not, start again rather than grow without bound.
+    const size_t maxCachedExtractors = 256;
+}
+
 //
 // extractSpecification: Multiple xpaths separated by
 // "specSeparator".
@@ -71,6 +108,14 @@ XPathExtractor::XPathExtractor(
     extrSep(extractionSeparator),
     nodeValSep(nodeValueSeparator) 
 {
+    string::size_type pos, beg, sz;
+
+    for (pos = beg = 0; beg < extractSpec.size() && pos != string::npos; beg += sz + specSep.size()) {
+        pos = extractSpec.find(specSep, beg);
+        sz = (pos == string::npos) ? extractSpec.size() : pos - beg;
+        xmlXPathCompExprPtr comp = xmlXPathCompile((const xmlChar *)extractSpec.substr(beg, sz).c_str());
+        compiledPaths.push_back(comp ? CompiledPath(comp, xmlXPathFreeCompExpr) : CompiledPath());
+    }
 }
 
 // Destructor
@@ -83,13 +128,15 @@ XPathExtractor::~XPathExtractor()
 //
 // Evaluate the given xpath on the given document.
 //
-xmlXPathObjectPtr XPathExtractor::followPath(const xmlDoc* doc, const xmlChar *xpath) {
+xmlXPathObjectPtr XPathExtractor::followPath(const xmlDoc* doc, const CompiledPath &xpath) {
     xmlXPathObjectPtr answer = NULL;
-    xmlXPathContextPtr context = xmlXPathNewContext(const_cast<xmlDocPtr>(doc));
+    if (!xpath || doc == NULL)
+        return NULL;
 
+    xmlXPathContextPtr context = contextFor(doc);
     if (context != NULL) {
-        answer = xmlXPathEvalExpression(xpath, context);
-        xmlXPathFreeContext(context);
+        answer = xmlXPathCompiledEval(xpath.get(), context);
+        context->doc = NULL;
         if (answer != NULL) {
             if(xmlXPathNodeSetIsEmpty(answer->nodesetval)){
                 xmlXPathFreeObject(answer);
@@ -107,7 +154,7 @@ xmlXPathObjectPtr XPathExtractor::followPath(const xmlDoc* doc, const xmlChar *x
 // xpath.
 //
 string* XPathExtractor::extractMatchingNodesFromDoc(
-        const string& xpath, const xmlDoc* doc)
+        const CompiledPath &xpath, const xmlDoc* doc)
 {
     xmlChar *contentStr;
     bool foundSomething = false;
@@ -115,7 +162,7 @@ string* XPathExtractor::extractMatchingNodesFromDoc(
     string* answer = new string();
     if (answer == NULL)
         return NULL;
-    xmlXPathObjectPtr pObj = followPath(doc, (const xmlChar *)xpath.c_str());
+    xmlXPathObjectPtr pObj = followPath(doc, xpath);
     if (pObj == NULL) {
         delete answer;
         return NULL;
@@ -146,12 +193,12 @@ string* XPathExtractor::extractMatchingNodesFromDoc(
 // matching the given xpath.
 //
 vector<shared_ptr<string> > XPathExtractor::extractMatchingNodesVectorFromDoc(
-        const string& xpath, const xmlDoc* doc)
+        const CompiledPath &xpath, const xmlDoc* doc)
 {
     vector<shared_ptr<string> > ret;
     xmlChar *contentStr;
 
-    xmlXPathObjectPtr pObj = followPath(doc, (const xmlChar *)xpath.c_str());
+    xmlXPathObjectPtr pObj = followPath(doc, xpath);
     if(pObj)
     {
         xmlNodeSetPtr nodes = pObj->nodesetval;
@@ -197,15 +244,9 @@ bool XPathExtractor::extractFromDoc(const xmlDoc* doc, string &theString)
 vector<vector<shared_ptr<string> > > XPathExtractor::extractVectorFromDoc(const xmlDoc* doc)
 {
     vector<vector<shared_ptr<string> > > ret;
-    string::size_type pos, beg, sz;
 
-    for (pos = beg = 0; beg < extractSpec.size() && pos != string::npos; beg += sz + specSep.size())
-    {
-        pos = extractSpec.find(specSep, beg);
-        sz = (pos == string::npos) ? extractSpec.size() : pos - beg;
-        ret.push_back(
-            extractMatchingNodesVectorFromDoc(extractSpec.substr(beg, sz), doc));
-    }
+    for (vector<CompiledPath>::const_iterator i = compiledPaths.begin(); i != compiledPaths.end(); ++i)
+        ret.push_back(extractMatchingNodesVectorFromDoc(*i, doc));
     return ret;
 }
 
@@ -222,16 +263,13 @@ vector<vector<shared_ptr<string> > > XPathExtractor::extractVectorFromDoc(const
 //
 string* XPathExtractor::extractFromDoc(const xmlDoc* doc)
 {
-    string::size_type pos, beg, sz;
     string *answer, *extract;
 
     answer = new string();
 
-    for (pos = beg = 0; beg < extractSpec.size() && pos != string::npos; beg += sz + specSep.size()) {
-        pos = extractSpec.find(specSep, beg);
-        sz = (pos == string::npos) ? extractSpec.size() : pos - beg;
-        extract = extractMatchingNodesFromDoc(extractSpec.substr(beg, sz), doc);
-        if (beg > 0) 
+    for (vector<CompiledPath>::size_type i = 0; i < compiledPaths.size(); ++i) {
+        extract = extractMatchingNodesFromDoc(compiledPaths[i], doc);
+        if (i > 0) 
             answer->append(extrSep);
         if (extract) {
             answer->append(*extract);
@@ -252,17 +290,38 @@ string* XPathExtractor::extractFromFile (const char *fname)
     docIn = xmlReadFile(fname, NULL, XML_PARSE_NOBLANKS /* | XML_PARSE_NOERROR | XML_PARSE_NOWARNING */ );
     if (!docIn)
         return NULL;
-    else
-        return (extractFromDoc(docIn));
+
+    string *answer = extractFromDoc(docIn);
+    xmlFreeDoc(docIn);
+    return answer;
 };
 
+//
+// Return the extractor for xpath, compiling it if this is the 
+// first time it has been asked for.
+//
+// class static
+shared_ptr<XPathExtractor> XPathExtractor::cachedExtractor(const char *xpath)
+{
+    boost::mutex::scoped_lock lock(extractorCacheLock);
+    ExtractorCache::iterator i = extractorCache.find(xpath);
+    if (i != extractorCache.end())
+        return i->second;
+
+    if (extractorCache.size() >= maxCachedExtractors)
+        extractorCache.clear();
+    shared_ptr<XPathExtractor> extractor(new XPathExtractor(xpath));
+    extractorCache[xpath] = extractor;
+    return extractor;
+}
+
 //
 // XPathExtractor(xpath).extractFromDoc(doc, theString);
 //
 // class static 
 bool XPathExtractor::extractFromDocUsing(const xmlDoc* doc, const char* xpath, string &theString)
 {
-    return XPathExtractor(xpath).extractFromDoc(doc, theString);
+    return cachedExtractor(xpath)->extractFromDoc(doc, theString);
 }
 
 //
@@ -272,7 +331,7 @@ bool XPathExtractor::extractFromDocUsing(const xmlDoc* doc, const char* xpath, s
 // class static 
 string* XPathExtractor::extractFromDocUsing(const xmlDoc* doc, const char* xpath)
 {
-    return XPathExtractor(xpath).extractFromDoc(doc);
+    return cachedExtractor(xpath)->extractFromDoc(doc);
 }
 
 //
@@ -282,7 +341,7 @@ string* XPathExtractor::extractFromDocUsing(const xmlDoc* doc, const char* xpath
 // class static
 string* XPathExtractor::extractFromFileUsing (const char *fname, const char* xpath)
 {
-    return XPathExtractor(xpath).extractFromFile(fname);
+    return cachedExtractor(xpath)->extractFromFile(fname);
 }
 
 
@@ -23,6 +23,13 @@ namespace SpartaIssoSrdXmlAPI
     using namespace std;
     using namespace boost;
 
+    //
+    // Each xpath in the extraction specification is compiled once, when
+    // the extractor is constructed, and evaluated against each document
+    // with a context that is kept per thread, so an extractor can be
+    // built once and used for every alert.  An extractor is not changed
+    // by extraction and may be shared between threads.
+    //
     class XPathExtractor
     {
     public:
@@ -90,6 +97,8 @@ namespace SpartaIssoSrdXmlAPI
 
         //
         // XPathExtractor(xpath).extractFromDoc(doc, theString);
+        // The extractor for each xpath is compiled on first use and 
+        // kept for later calls.
         //
 	    static bool extractFromDocUsing(const xmlDoc* doc, const char* xpath, string &theString);
 
@@ -108,9 +117,14 @@ namespace SpartaIssoSrdXmlAPI
     protected:
     
     private:
-	    xmlXPathObjectPtr followPath(const xmlDoc* doc, const xmlChar *xpath);
-	    string* extractMatchingNodesFromDoc(const string& xpath, const xmlDoc* doc);
-        vector<shared_ptr<string> > extractMatchingNodesVectorFromDoc(const string& xpath, const xmlDoc* doc);
+        typedef shared_ptr<xmlXPathCompExpr> CompiledPath;
+
+	    xmlXPathObjectPtr followPath(const xmlDoc* doc, const CompiledPath &xpath);
+	    string* extractMatchingNodesFromDoc(const CompiledPath &xpath, const xmlDoc* doc);
+        vector<shared_ptr<string> > extractMatchingNodesVectorFromDoc(const CompiledPath &xpath, const xmlDoc* doc);
+
+        // The shared extractor for xpath used by the static functions.
+        static shared_ptr<XPathExtractor> cachedExtractor(const char *xpath);
 
         // contains a series of xpaths separated by 
         // delimiting strings that will be used to
@@ -129,6 +143,10 @@ namespace SpartaIssoSrdXmlAPI
 		// when the xpath indicates more than one node.
     	string nodeValSep;
 
+        // the xpaths in extractSpec, compiled.  Null if 
+        // the xpath did not compile.
+        vector<CompiledPath> compiledPaths;
+
     }; // end of class.
 
 }  // end of namespace;
@@ -0,0 +1,221 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file alertBench.cpp
+ * Measures how fast the fields the alert handlers use can be pulled out of
+ * recorded IDMEF alerts, three ways:
+ *
+ *  - perCall: parse the document, then create an xpath context and evaluate
+ *    each expression from its text, which is what the handlers used to do
+ *    for every alert.
+ *  - compiled: parse the document, then evaluate XPathExtractors which were
+ *    compiled once, with the per-thread context.
+ *  - pull: one pass of the xmlTextReader with IDMEFAlert, without building a
+ *    document.
+ *
+ * The alerts are read from the files given on the command line; there are
+ * some recorded alerts in alerts/.  Each method is run over all of them for
+ * at least the given number of seconds in each thread.
+ *
+ * Usage: alertBench [-t threads] [-s seconds] alert.xml...
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/time.h>
+#include <unistd.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <libxml/parser.h>
+#include <libxml/xpath.h>
+
+#include "XPathExtractor.h"
+#include "IDMEFAlert.h"
+
+using namespace std;
+using namespace HierarchyAPI;
+using SpartaIssoSrdXmlAPI::XPathExtractor;
+
+namespace {
+
+    double now()
+    {
+        struct timeval tv;
+        gettimeofday(&tv, 0);
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+    // The fields the default handler uses.
+    const char *paths[] = {
+        "/IDMEF-Message/Alert/Classification/@text",
+        "/IDMEF-Message/Alert/Analyzer/Node/Address[@category='ipv4-addr']/address",
+        "/IDMEF-Message/Alert/Source/Node/Address[@category='ipv4-addr']/address",
+        "/IDMEF-Message/Alert/Target/Node/Address[@category='ipv4-addr']/address"
+    };
+    const size_t numPaths = sizeof(paths) / sizeof(paths[0]);
+
+    struct Fields {
+        string value[numPaths];
+    };
+
+    // The first match of xpath, the old way.
+    string evalOnce(xmlDocPtr doc, const char *xpath)
+    {
+        string ret;
+        xmlXPathContextPtr context = xmlXPathNewContext(doc);
+        xmlXPathObjectPtr obj = xmlXPathEvalExpression(BAD_CAST xpath, context);
+        xmlXPathFreeContext(context);
+        if (obj) {
+            if (!xmlXPathNodeSetIsEmpty(obj->nodesetval)) {
+                xmlChar *content = xmlNodeGetContent(obj->nodesetval->nodeTab[0]);
+                if (content) {
+                    ret = reinterpret_cast<const char *>(content);
+                    xmlFree(content);
+                }
+            }
+            xmlXPathFreeObject(obj);
+        }
+        return ret;
+    }
+
+    void perCall(const string &xml, Fields &f)
+    {
+        xmlDocPtr doc = xmlReadMemory(xml.data(), xml.size(), NULL, NULL, XML_PARSE_NOBLANKS);
+        for (size_t i = 0; i < numPaths; ++i)
+            f.value[i] = evalOnce(doc, paths[i]);
+        xmlFreeDoc(doc);
+    }
+
+    void compiled(const string &xml, Fields &f)
+    {
+        static XPathExtractor classification(paths[0]), analyzer(paths[1]), source(paths[2]), target(paths[3]);
+        static XPathExtractor *extractors[] = { &classification, &analyzer, &source, &target };
+
+        xmlDocPtr doc = xmlReadMemory(xml.data(), xml.size(), NULL, NULL, XML_PARSE_NOBLANKS);
+        for (size_t i = 0; i < numPaths; ++i) {
+            vector<vector<boost::shared_ptr<string> > > v = extractors[i]->extractVectorFromDoc(doc);
+            f.value[i] = v.empty() || v[0].empty() ? string() : *v[0][0];
+        }
+        xmlFreeDoc(doc);
+    }
+
+    void pull(const string &xml, Fields &f)
+    {
+        IDMEFAlert alert(xml.data(), xml.size());
+        const string *source = IDMEFAlert::firstAddress(alert.sources);
+        const string *target = IDMEFAlert::firstAddress(alert.targets);
+        f.value[0] = alert.classification;
+        f.value[1] = alert.analyzer;
+        f.value[2] = source ? *source : string();
+        f.value[3] = target ? *target : string();
+    }
+
+    typedef void (*Method)(const string &, Fields &);
+
+    // Run method over the alerts until minTime has passed; returns alerts/s.
+    void run(Method method, const vector<string> *alerts, double minTime, double *rate)
+    {
+        Fields f;
+        unsigned long count = 0;
+        double start = now(), elapsed;
+        do {
+            for (size_t i = 0; i < alerts->size(); ++i)
+                method((*alerts)[i], f);
+            count += alerts->size();
+        } while ((elapsed = now() - start) < minTime);
+        *rate = count / elapsed;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned threads = 1;
+    double minTime = 1.0;
+    int c;
+    while ((c = getopt(argc, argv, "t:s:")) != -1) {
+        switch (c) {
+            case 't': threads = strtoul(optarg, NULL, 10); break;
+            case 's': minTime = strtod(optarg, NULL); break;
+            default:
+                cerr << "Usage: " << argv[0] << " [-t threads] [-s seconds] alert.xml..." << endl;
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind == argc || threads == 0) {
+        cerr << "Usage: " << argv[0] << " [-t threads] [-s seconds] alert.xml..." << endl;
+        return EXIT_FAILURE;
+    }
+
+    vector<string> alerts;
+    for (int i = optind; i < argc; ++i) {
+        ifstream in(argv[i]);
+        if (!in) {
+            cerr << "Unable to read " << argv[i] << endl;
+            return EXIT_FAILURE;
+        }
+        ostringstream os;
+        os << in.rdbuf();
+        alerts.push_back(os.str());
+    }
+
+    xmlInitParser();
+
+    const char *names[] = { "perCall", "compiled", "pull" };
+    Method methods[] = { perCall, compiled, pull };
+    const size_t numMethods = sizeof(methods) / sizeof(methods[0]);
+
+    // All three must find the same thing.
+    bool agree = true;
+    for (size_t a = 0; a < alerts.size(); ++a) {
+        Fields f[numMethods];
+        for (size_t m = 0; m < numMethods; ++m)
+            methods[m](alerts[a], f[m]);
+        cout << argv[optind + a] << ":";
+        for (size_t i = 0; i < numPaths; ++i) {
+            cout << " \"" << f[0].value[i] << "\"";
+            for (size_t m = 1; m < numMethods; ++m)
+                if (f[m].value[i] != f[0].value[i]) {
+                    cout << " (" << names[m] << ": \"" << f[m].value[i] << "\")";
+                    agree = false;
+                }
+        }
+        cout << endl;
+    }
+
+    cout << left << setw(12) << "Method" << right << setw(16) << "alerts/s" << setw(12) << "us/alert" << endl;
+    for (size_t m = 0; m < numMethods; ++m) {
+        vector<double> rates(threads);
+        boost::thread_group group;
+        for (unsigned t = 0; t < threads; ++t)
+            group.create_thread(boost::bind(run, methods[m], &alerts, minTime, &rates[t]));
+        group.join_all();
+
+        double total = 0;
+        for (unsigned t = 0; t < threads; ++t)
+            total += rates[t];
+        cout << left << setw(12) << names[m] << right << fixed << setprecision(0) << setw(16) << total
+             << setprecision(2) << setw(12) << threads * 1e6 / total << endl;
+    }
+
+    xmlCleanupParser();
+    return agree ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -287,20 +287,37 @@ void sendIDMEFAlert(void *messageHandlerData, const struct MessageInfo *mi)
 
     // GTL - put check for root in here. If we're the root issue alert,
     // otherwise do not.
-    xmlDocPtr payload=messageInfoPayloadGet(mi);
+    //
+    // The handlers only need a few fields, so read them straight from 
+    // the XML text rather than building a document. Fall back to the 
+    // document if the raw payload is not readable as XML.
+    const char *raw = static_cast<const char *>(messageInfoRawPayloadGet(mi)); 
+    size_t rawLen = messageInfoRawPayloadLenGet(mi); 
     AlertHandlers *handlers = AlertHandlers::getAlertHandlers();
-    if(handlers)
-        handlers->handleAlert(payload, st->client); 
 
-    {   // Dump the alert to the log.
-        xmlChar* dump;
-        int dumpSz;
-        xmlDocDumpFormatMemory(payload, &dump, &dumpSz, 1); 
+    IDMEFAlert rawAlert(raw, rawLen); 
+    if (raw && rawAlert.valid()) {
+        if(handlers)
+            handlers->handleAlert(rawAlert, st->client); 
         LOG_INFO("Recv'd IDMEF alert:"); 
-        LOG_INFO(dump); 
-        xmlFree(dump);
+        LOG_INFO(string(raw, rawLen)); 
+    }
+    else {
+        xmlDocPtr payload=messageInfoPayloadGet(mi);
+        IDMEFAlert alert(payload); 
+        if(handlers)
+            handlers->handleAlert(alert, st->client); 
+
+        {   // Dump the alert to the log.
+            xmlChar* dump;
+            int dumpSz;
+            xmlDocDumpFormatMemory(payload, &dump, &dumpSz, 1); 
+            LOG_INFO("Recv'd IDMEF alert:"); 
+            LOG_INFO(dump); 
+            xmlFree(dump);
+        }
+        xmlFreeDoc(payload);
     }
-    xmlFreeDoc(payload);
 
     TRACE_EXIT();
 }
@@ -0,0 +1,477 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file watcherImport.cpp
+ * @date 2010-06-01
+ */
+/**
+ * @page watcherImport
+ *
+ * watcherImport is a command line program which loads recorded events into a watcher event database.
+ * The input files hold one serialized event per line, as written by <b>messageStream2Text --output</b>.
+ *
+ * Each input file is parsed on its own thread and the files are merged by timestamp, so every file
+ * should be in timestamp order (events which are not are still stored, just not merged in order).
+ * The merged events are serialized for storage on a pool of threads and written in large
+ * transactions, with the indices of new partitions built once at the end of the load.
+ *
+ * Usage:
+ * @{
+ * <b>watcherImport -d database [optional args] file...</b>
+ * @}
+ * Optional args:
+ * @arg <b>-d, --database=FILE</b>, the event database to load (default: event.db).
+ * @arg <b>-j, --threads=INT</b>, the number of threads serializing events (default: number of CPUs).
+ * @arg <b>-b, --batch=INT</b>, the number of events stored per transaction (default: 10000).
+ * @arg <b>-p, --partition=MINUTES</b>, the length of the time window held in each new partition (default: 60).
+ * @arg <b>-q, --quiet</b>, do not print progress reports.
+ * @arg <b>-l, --logProps=FILE</b>, log.properties file, which controls logging for this program (default: SYSCONFDIR/watcher.log.props).
+ * @arg <b>-h, --help</b>, Show help message
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <deque>
+#include <map>
+#include <queue>
+#include <vector>
+#include <cstdlib>     // for EXIT_SUCCESS/FAILURE
+#include <getopt.h>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "libwatcher/message.h"
+#include "logger.h"
+#include "database.h"
+
+using namespace std;
+using namespace watcher;
+using namespace watcher::event;
+
+namespace {
+
+    option Options[] = {
+        { "help", 0, NULL, 'h' },
+        { "database", 1, NULL, 'd' },
+        { "threads", 1, NULL, 'j' },
+        { "batch", 1, NULL, 'b' },
+        { "partition", 1, NULL, 'p' },
+        { "quiet", 0, NULL, 'q' },
+        { "logProps", 1, NULL, 'l' },
+        { 0, 0, NULL, 0 }
+    };
+
+    void usage(const char *progName, bool exitp)
+    {
+        cout << "Usage: " << basename(progName) << " [-d database] [-j threads] [-b batch] [-p minutes] [-q] [-l logProps] file..." << endl;
+        cout << "Args: " << endl;
+        cout << "   -h, show this messsage and exit." << endl;
+        cout << "   -d, --database=FILE - the event database to load (default: event.db)." << endl;
+        cout << "   -j, --threads=INT - the number of threads serializing events (default: number of CPUs)." << endl;
+        cout << "   -b, --batch=INT - the number of events stored per transaction (default: 10000)." << endl;
+        cout << "   -p, --partition=MINUTES - the length of the time window held in each new partition (default: 60)." << endl;
+        cout << "   -q, --quiet - do not print progress reports." << endl;
+        cout << "   -l, --logProps=FILE - log.properties file, which controls logging for this program (default: " SYSCONFDIR "/watcher.log.props)." << endl;
+        cout << "Each file holds one serialized event per line, as written by messageStream2Text --output," << endl;
+        cout << "and should be in timestamp order." << endl;
+
+        if(exitp)
+            exit(EXIT_FAILURE);
+    }
+
+    /** A FIFO of bounded size connecting two stages of the import.  A full
+     * queue blocks the producer so that a slow stage limits how much is
+     * held in memory.  close() releases everyone waiting on the queue;
+     * afterwards push() fails, and pop() fails once the queue is drained.
+     */
+    template <typename T> class BoundedQueue : private boost::noncopyable {
+        public:
+            BoundedQueue(size_t limit) : limit_(limit), closed_(false) { }
+
+            bool push(const T& val)
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                while (q_.size() >= limit_ && !closed_)
+                    notFull_.wait(lock);
+                if (closed_)
+                    return false;
+                q_.push_back(val);
+                notEmpty_.notify_one();
+                return true;
+            }
+
+            bool pop(T& val)
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                while (q_.empty() && !closed_)
+                    notEmpty_.wait(lock);
+                if (q_.empty())
+                    return false;
+                val = q_.front();
+                q_.pop_front();
+                notFull_.notify_one();
+                return true;
+            }
+
+            void close()
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                closed_ = true;
+                notEmpty_.notify_all();
+                notFull_.notify_all();
+            }
+
+        private:
+            size_t limit_;
+            bool closed_;
+            std::deque<T> q_;
+            boost::mutex mutex_;
+            boost::condition_variable notEmpty_;
+            boost::condition_variable notFull_;
+    };
+
+    typedef std::vector<MessagePtr> MessageList;
+    typedef boost::shared_ptr<MessageList> MessageListPtr;
+
+    /** Number of events parsed from a file before handing them to the merge. */
+    const size_t chunkSize = 1024;
+
+    /** Parses one input file on its own thread. */
+    class FileReader : private boost::noncopyable {
+        public:
+            FileReader(const string& path) : path_(path), queue_(4), pos_(0), parsed_(0), skipped_(0), failed_(false) { }
+
+            void run()
+            {
+                ifstream in(path_.c_str());
+                if (!in) {
+                    cerr << "Unable to open " << path_ << " for reading." << endl;
+                    failed_ = true;
+                    queue_.close();
+                    return;
+                }
+
+                MessageListPtr chunk(new MessageList);
+                chunk->reserve(chunkSize);
+                string line;
+                for (unsigned int lineno = 1; getline(in, line); ++lineno) {
+                    if (line.empty())
+                        continue;
+                    istringstream is(line);
+                    MessagePtr m(Message::unpack(is));
+                    if (!m) {
+                        cerr << path_ << ":" << lineno << ": unable to parse event, skipping it." << endl;
+                        ++skipped_;
+                        continue;
+                    }
+                    chunk->push_back(m);
+                    ++parsed_;
+                    if (chunk->size() == chunkSize) {
+                        if (!queue_.push(chunk))
+                            return;    // import aborted
+                        chunk.reset(new MessageList);
+                        chunk->reserve(chunkSize);
+                    }
+                }
+                if (!chunk->empty())
+                    queue_.push(chunk);
+                queue_.close();
+            }
+
+            /** Advance to the next event, returning false at the end of the file. */
+            bool next()
+            {
+                if (chunk_ && ++pos_ < chunk_->size())
+                    return true;
+                pos_ = 0;
+                return queue_.pop(chunk_);
+            }
+
+            const MessagePtr& current() const { return (*chunk_)[pos_]; }
+
+            void abort() { queue_.close(); }
+
+            string path_;
+            BoundedQueue<MessageListPtr> queue_;
+            MessageListPtr chunk_;
+            size_t pos_;
+            unsigned long parsed_;
+            unsigned long skipped_;
+            bool failed_;
+    };
+    typedef boost::shared_ptr<FileReader> FileReaderPtr;
+
+    /** Orders the merge heap so that the reader with the earliest event is on top. */
+    struct LaterEvent {
+        bool operator() (const FileReader *a, const FileReader *b) const
+        {
+            return a->current()->timestamp > b->current()->timestamp;
+        }
+    };
+
+    /** A batch of events on its way to the database.  seq records the
+     * merge order so the writer can store the batches in sequence even
+     * though they are encoded concurrently.
+     */
+    struct Batch {
+        unsigned long seq;
+        MessageListPtr events;
+        boost::shared_ptr<EncodedEventList> encoded;
+    };
+
+    /** Serializes batches for storage on a pool of threads and hands them
+     * to the writer in their original order. */
+    class Encoder : private boost::noncopyable {
+        public:
+            Encoder(size_t nthreads) : input_(nthreads * 2), window_(nthreads * 2), running_(nthreads), next_(0) { }
+
+            void run()
+            {
+                Batch b;
+                while (input_.pop(b)) {
+                    b.encoded.reset(new EncodedEventList(b.events->size()));
+                    for (size_t i = 0; i < b.events->size(); ++i)
+                        encode_event((*b.events)[i], (*b.encoded)[i]);
+                    b.events.reset();
+
+                    /* Hold on to batches too far ahead of the writer, so
+                     * a slow database bounds memory use.  The batch the
+                     * writer is waiting for is always accepted. */
+                    boost::mutex::scoped_lock lock(mutex_);
+                    while (b.seq >= next_ + window_)
+                        ready_.wait(lock);
+                    done_[b.seq] = b;
+                    ready_.notify_all();
+                }
+
+                boost::mutex::scoped_lock lock(mutex_);
+                --running_;
+                ready_.notify_all();
+            }
+
+            /** Wait for the next batch in sequence, returning false once all have been taken. */
+            bool next(Batch& b)
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                for (;;) {
+                    std::map<unsigned long, Batch>::iterator it = done_.find(next_);
+                    if (it != done_.end()) {
+                        b = it->second;
+                        done_.erase(it);
+                        ++next_;
+                        ready_.notify_all();
+                        return true;
+                    }
+                    if (!running_)
+                        return false;
+                    ready_.wait(lock);
+                }
+            }
+
+            BoundedQueue<Batch> input_;
+
+        private:
+            unsigned long window_;
+            size_t running_;
+            unsigned long next_;
+            std::map<unsigned long, Batch> done_;
+            boost::mutex mutex_;
+            boost::condition_variable ready_;
+    };
+
+    /** Stores the encoded batches, reporting progress once a second. */
+    class Writer : private boost::noncopyable {
+        public:
+            Writer(Database& db, Encoder& enc, bool quiet) : db_(db), enc_(enc), quiet_(quiet), stored_(0), failed_(false) { }
+
+            void run()
+            {
+                using namespace boost::posix_time;
+                ptime start = microsec_clock::universal_time();
+                ptime lastReport = start;
+                unsigned long lastStored = 0;
+
+                Batch b;
+                while (enc_.next(b)) {
+                    try {
+                        db_.storeEvents(*b.encoded);
+                    } catch (std::exception& e) {
+                        cerr << "Unable to store events: " << e.what() << endl;
+                        failed_ = true;
+                        enc_.input_.close();
+                        while (enc_.next(b))
+                            ;   // let the encoders drain
+                        return;
+                    }
+                    stored_ += b.encoded->size();
+
+                    ptime now = microsec_clock::universal_time();
+                    if (!quiet_ && now - lastReport >= seconds(1)) {
+                        double secs = (now - lastReport).total_microseconds() / 1e6;
+                        cerr << stored_ << " events stored, " << static_cast<unsigned long>((stored_ - lastStored) / secs) << " events/sec" << endl;
+                        lastReport = now;
+                        lastStored = stored_;
+                    }
+                }
+            }
+
+            Database& db_;
+            Encoder& enc_;
+            bool quiet_;
+            unsigned long stored_;
+            bool failed_;
+    };
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+    string dbName("event.db");
+    size_t nthreads = boost::thread::hardware_concurrency();
+    size_t batchSize = 10000;
+    int partitionMinutes = defaultPartitionLength / (60 * 1000);
+    bool quiet = false;
+    string logProps(SYSCONFDIR "/watcher.log.props");
+
+    while ((i = getopt_long(argc, argv, "hd:j:b:p:ql:", Options, NULL)) != -1) {
+        switch (i) {
+            case 'd':
+                dbName = optarg;
+                break;
+            case 'j':
+                nthreads = boost::lexical_cast<size_t>(optarg);
+                break;
+            case 'b':
+                batchSize = boost::lexical_cast<size_t>(optarg);
+                break;
+            case 'p':
+                partitionMinutes = boost::lexical_cast<int>(optarg);
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            case 'l':
+                logProps = optarg;
+                break;
+            default:
+                usage(argv[0], true);
+        }
+    }
+    if (optind >= argc)
+        usage(argv[0], true);
+    if (!nthreads)
+        nthreads = 1;
+    if (!batchSize)
+        batchSize = 1;
+
+    LOAD_LOG_PROPS(logProps);
+
+    boost::scoped_ptr<Database> db;
+    try {
+        db.reset(Database::connect(dbName, static_cast<Timestamp>(partitionMinutes) * 60 * 1000));
+    } catch (std::exception& e) {
+        cerr << "Unable to open database " << dbName << ": " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    db->beginBulkLoad();
+
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+    // Start every stage before feeding the pipeline.
+    boost::thread_group threads;
+    vector<FileReaderPtr> readers;
+    for (int arg = optind; arg < argc; ++arg) {
+        FileReaderPtr r(new FileReader(argv[arg]));
+        readers.push_back(r);
+        threads.create_thread(boost::bind(&FileReader::run, r.get()));
+    }
+    Encoder encoder(nthreads);
+    for (size_t n = 0; n < nthreads; ++n)
+        threads.create_thread(boost::bind(&Encoder::run, &encoder));
+    Writer writer(*db, encoder, quiet);
+    boost::thread writerThread(boost::bind(&Writer::run, &writer));
+
+    // k-way merge of the input files by timestamp
+    priority_queue<FileReader*, vector<FileReader*>, LaterEvent> heap;
+    BOOST_FOREACH(FileReaderPtr& r, readers)
+        if (r->next())
+            heap.push(r.get());
+
+    Batch b;
+    b.seq = 0;
+    b.events.reset(new MessageList);
+    b.events->reserve(batchSize);
+    bool aborted = false;
+    while (!heap.empty() && !aborted) {
+        FileReader *r = heap.top();
+        heap.pop();
+        b.events->push_back(r->current());
+        if (r->next())
+            heap.push(r);
+
+        if (b.events->size() == batchSize) {
+            aborted = !encoder.input_.push(b);
+            ++b.seq;
+            b.events.reset(new MessageList);
+            b.events->reserve(batchSize);
+        }
+    }
+    if (!b.events->empty() && !aborted)
+        encoder.input_.push(b);
+    encoder.input_.close();
+
+    if (aborted)
+        BOOST_FOREACH(FileReaderPtr& r, readers)
+            r->abort();
+    threads.join_all();
+    writerThread.join();
+
+    bool ok = !writer.failed_;
+    unsigned long skipped = 0;
+    BOOST_FOREACH(FileReaderPtr& r, readers) {
+        skipped += r->skipped_;
+        if (r->failed_)
+            ok = false;
+    }
+
+    if (!quiet)
+        cerr << "Building indices" << endl;
+    try {
+        db->endBulkLoad();
+    } catch (std::exception& e) {
+        cerr << "Unable to build indices: " << e.what() << endl;
+        ok = false;
+    }
+
+    double secs = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+    cout << "Imported " << writer.stored_ << " events from " << readers.size() << " files in " << secs << " seconds";
+    if (secs > 0)
+        cout << " (" << static_cast<unsigned long>(writer.stored_ / secs) << " events/sec)";
+    cout << endl;
+    if (skipped)
+        cout << skipped << " lines could not be parsed and were skipped" << endl;
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
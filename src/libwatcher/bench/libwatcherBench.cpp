@@ -0,0 +1,563 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file libwatcherBench.cpp
+ * Microbenchmarks for the libwatcher paths which run once per message:
+ * createMessage() and Message::pack()/unpack() for each feeder message type,
+ * DataMarshaller::marshalPayload()/unmarshalPayload() at batch sizes from 1
+ * to 1000, WatcherGraph::updateGraph() and doMaintanence() at 100, 1000 and
+ * 5000 nodes, and MessageStreamFilter::passFilter() with the filters the
+ * GUIs typically set.
+ *
+ * Each benchmark is run with an increasing number of iterations until one
+ * run takes at least the minimum time, and the time per iteration of that
+ * run is reported, with the number of heap allocations made per million
+ * messages.  Setup done before the timed loop is not counted.
+ *
+ * The 5000 node graph needs several gigabytes (WatcherLayerData keeps an
+ * n x n matrix of locks), so those cases only run when the filter names
+ * them, e.g. "libwatcherBench graph/updateGraph/5000".
+ *
+ * Usage: libwatcherBench [filter] [minimum seconds per benchmark]
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <new>
+#include <sstream>
+#include <sys/time.h>
+#include <boost/foreach.hpp>
+
+#include "logger.h"
+#include "../messageTypesAndVersions.h"
+#include "../dataMarshaller.h"
+#include "../messageFactory.h"
+#include "../messageStreamFilter.h"
+#include "../watcherGraph.h"
+#include "../gpsMessage.h"
+#include "../labelMessage.h"
+#include "../edgeMessage.h"
+#include "../colorMessage.h"
+#include "../connectivityMessage.h"
+#include "../nodeStatusMessage.h"
+#include "../dataPointMessage.h"
+#include "../nodePropertiesMessage.h"
+
+DECLARE_GLOBAL_LOGGER("LibwatcherBench");
+
+// Every heap allocation, counted so the benchmarks can report them.  The
+// benchmarks run in one thread.
+static unsigned long long allocations = 0;
+
+// Dynamic exception specifications are an error from C++17 on, and g++ now
+// defaults to it.
+#if __cplusplus >= 201103L
+#define THROWS_BAD_ALLOC
+#define NO_THROW noexcept
+#else
+#define THROWS_BAD_ALLOC throw(std::bad_alloc)
+#define NO_THROW throw()
+#endif
+
+void *operator new(size_t size) THROWS_BAD_ALLOC
+{
+    ++allocations;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) THROWS_BAD_ALLOC
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) NO_THROW
+{
+    free(p);
+}
+
+void operator delete[](void *p) NO_THROW
+{
+    free(p);
+}
+
+// C++14 calls these when it knows the size.
+void operator delete(void *p, size_t) NO_THROW
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) NO_THROW
+{
+    free(p);
+}
+
+using namespace std;
+using namespace watcher;
+using namespace watcher::event;
+
+namespace {
+
+    double now()
+    {
+        struct timeval tv;
+        gettimeofday(&tv, 0);
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+    /** Passed to each benchmark, which does its setup and then runs
+     * "while (state.keepRunning()) { ... }".  The clock starts on the first
+     * call to keepRunning().
+     */
+    class State {
+        public:
+            State(size_t arg_, unsigned long iterations) :
+                arg(arg_), itemsPerIteration(1), bytesPerIteration(0),
+                maxIterations(iterations), done(0), start(0), stop(0),
+                allocationsAtStart(0), allocationsAtStop(0) { }
+
+            bool keepRunning()
+            {
+                if (done == 0) {
+                    allocationsAtStart = allocations;
+                    start = now();
+                }
+                if (done == maxIterations) {
+                    stop = now();
+                    allocationsAtStop = allocations;
+                    return false;
+                }
+                ++done;
+                return true;
+            }
+
+            double elapsed() const { return stop - start; }
+            unsigned long long allocated() const { return allocationsAtStop - allocationsAtStart; }
+
+            /** the benchmark's parameter (node count, batch size, ...) */
+            size_t arg;
+            /** messages handled by one iteration, for the messages/s column */
+            size_t itemsPerIteration;
+            /** bytes handled by one iteration, for the MB/s column */
+            size_t bytesPerIteration;
+
+        private:
+            unsigned long maxIterations;
+            unsigned long done;
+            double start;
+            double stop;
+            unsigned long long allocationsAtStart;
+            unsigned long long allocationsAtStop;
+    };
+
+    typedef void (*BenchFunction)(State &);
+
+    struct Benchmark {
+        const char *name;
+        BenchFunction fn;
+        size_t arg;
+        const char *argName;
+        bool large;     ///< only run when the filter asks for it
+    };
+
+    const NodeIdentifier nodeAddress(size_t i)
+    {
+        return NodeIdentifier(boost::asio::ip::address_v4(0x0a000000 + 1 + i));
+    }
+
+    /** The feeder message types, in the order the pack/unpack benchmarks use them. */
+    const MessageType feederTypes[] = {
+        GPS_MESSAGE_TYPE, LABEL_MESSAGE_TYPE, EDGE_MESSAGE_TYPE, COLOR_MESSAGE_TYPE,
+        CONNECTIVITY_MESSAGE_TYPE, NODE_STATUS_MESSAGE_TYPE, DATA_POINT_MESSAGE_TYPE,
+        NODE_PROPERTIES_MESSAGE_TYPE
+    };
+    const char *feederTypeNames[] = {
+        "gps", "label", "edge", "color", "connectivity", "nodeStatus", "dataPoint", "nodeProperties"
+    };
+
+    /** A message of the given type, filled in the way a test node's feeder would. */
+    MessagePtr makeMessage(MessageType type, size_t node, size_t numNodes)
+    {
+        MessagePtr m;
+        switch (type) {
+            case GPS_MESSAGE_TYPE: {
+                GPSMessagePtr g(new GPSMessage(-77.0 + node * 0.001, 38.0 + node * 0.001, 20.0));
+                m = g;
+                break;
+            }
+            case LABEL_MESSAGE_TYPE: {
+                LabelMessagePtr l(new LabelMessage("routing: 12 routes", nodeAddress(node)));
+                l->layer = "Routing";
+                l->expiration = 5000;
+                m = l;
+                break;
+            }
+            case EDGE_MESSAGE_TYPE: {
+                EdgeMessagePtr e(new EdgeMessage(nodeAddress(node), nodeAddress((node + 1) % numNodes),
+                            "Routing", colors::green, 2.0, false, 5000));
+                m = e;
+                break;
+            }
+            case COLOR_MESSAGE_TYPE: {
+                ColorMessagePtr c(new ColorMessage(colors::red, nodeAddress(node), 2000));
+                m = c;
+                break;
+            }
+            case CONNECTIVITY_MESSAGE_TYPE: {
+                ConnectivityMessagePtr c(new ConnectivityMessage);
+                for (size_t i = 1; i <= 8 && i < numNodes; ++i)
+                    c->neighbors.push_back(nodeAddress((node + i) % numNodes));
+                m = c;
+                break;
+            }
+            case NODE_STATUS_MESSAGE_TYPE:
+                m.reset(new NodeStatusMessage);
+                break;
+            case DATA_POINT_MESSAGE_TYPE: {
+                DataPointMessage::DataPointList points;
+                for (size_t i = 0; i < 4; ++i)
+                    points.push_back(node * 0.5 + i);
+                m.reset(new DataPointMessage("bandwidth", points));
+                break;
+            }
+            case NODE_PROPERTIES_MESSAGE_TYPE: {
+                NodePropertiesMessagePtr p(new NodePropertiesMessage);
+                p->useColor = true;
+                p->color = colors::blue;
+                m = p;
+                break;
+            }
+            default:
+                break;
+        }
+        m->fromNodeID = nodeAddress(node);
+        m->timestamp = 1262304000000LL + node;
+        return m;
+    }
+
+    /** A mix of messages in roughly the proportions a testbed sends them. */
+    void makeMix(vector<MessagePtr> &out, size_t count, size_t numNodes)
+    {
+        static const MessageType mix[] = {
+            GPS_MESSAGE_TYPE, GPS_MESSAGE_TYPE, GPS_MESSAGE_TYPE, GPS_MESSAGE_TYPE,
+            CONNECTIVITY_MESSAGE_TYPE, CONNECTIVITY_MESSAGE_TYPE, EDGE_MESSAGE_TYPE,
+            LABEL_MESSAGE_TYPE, COLOR_MESSAGE_TYPE, DATA_POINT_MESSAGE_TYPE
+        };
+        const size_t mixSize = sizeof(mix) / sizeof(mix[0]);
+        out.clear();
+        for (size_t i = 0; i < count; ++i)
+            out.push_back(makeMessage(mix[i % mixSize], (i * 7) % numNodes, numNodes));
+    }
+
+    //
+    // createMessage(), Message::pack() / unpack()
+    //
+
+    void createMessages(State &state)
+    {
+        const MessageType type = feederTypes[state.arg];
+        while (state.keepRunning()) {
+            MessagePtr m = createMessage(type);
+        }
+    }
+
+    void packMessage(State &state)
+    {
+        MessagePtr m = makeMessage(feederTypes[state.arg], 1, 100);
+        ostringstream probe;
+        m->pack(probe);
+        state.bytesPerIteration = probe.str().size();
+
+        while (state.keepRunning()) {
+            ostringstream out;
+            m->pack(out);
+        }
+    }
+
+    void unpackMessage(State &state)
+    {
+        ostringstream packed;
+        makeMessage(feederTypes[state.arg], 1, 100)->pack(packed);
+        const string data(packed.str());
+        state.bytesPerIteration = data.size();
+
+        while (state.keepRunning()) {
+            istringstream in(data);
+            if (!Message::unpack(in)) {
+                LOG_ERROR("unable to unpack a " << feederTypeNames[state.arg] << " message");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    //
+    // DataMarshaller
+    //
+
+    void marshal(State &state)
+    {
+        vector<MessagePtr> messages;
+        makeMix(messages, state.arg, 100);
+        state.itemsPerIteration = state.arg;
+
+        while (state.keepRunning()) {
+            DataMarshaller::NetworkMarshalBuffers buffers;
+            DataMarshaller::marshalPayload(messages, buffers);
+        }
+    }
+
+    void unmarshal(State &state)
+    {
+        vector<MessagePtr> messages;
+        makeMix(messages, state.arg, 100);
+        DataMarshaller::NetworkMarshalBuffers buffers;
+        DataMarshaller::marshalPayload(messages, buffers);
+
+        // The server reads the payload following the header in one piece.
+        string payload;
+        for (DataMarshaller::NetworkMarshalBuffers::const_iterator b = ++buffers.begin(); b != buffers.end(); ++b)
+            payload.append(boost::asio::buffer_cast<const char*>(*b), boost::asio::buffer_size(*b));
+        state.itemsPerIteration = state.arg;
+        state.bytesPerIteration = payload.size();
+
+        while (state.keepRunning()) {
+            vector<MessagePtr> out;
+            unsigned short num = messages.size();
+            if (!DataMarshaller::unmarshalPayload(out, num, payload.data(), payload.size())) {
+                LOG_ERROR("unable to unmarshal a batch of " << state.arg << " messages");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    //
+    // WatcherGraph
+    //
+
+    /** Graphs are expensive to build, so one is kept for each size and every
+     * node in it has a location, neighbors and a label. */
+    WatcherGraph &graphOfSize(size_t numNodes)
+    {
+        static map<size_t, WatcherGraph*> graphs;
+        WatcherGraph *&g = graphs[numNodes];
+        if (!g) {
+            g = new WatcherGraph(numNodes, 4);
+            for (size_t i = 0; i < numNodes; ++i) {
+                g->updateGraph(makeMessage(GPS_MESSAGE_TYPE, i, numNodes));
+                g->updateGraph(makeMessage(CONNECTIVITY_MESSAGE_TYPE, i, numNodes));
+                g->updateGraph(makeMessage(LABEL_MESSAGE_TYPE, i, numNodes));
+            }
+        }
+        return *g;
+    }
+
+    void updateGraph(State &state)
+    {
+        WatcherGraph &graph = graphOfSize(state.arg);
+        vector<MessagePtr> messages;
+        makeMix(messages, 10000, state.arg);
+        // remove each label again so the label lists do not grow without bound
+        for (size_t i = 0; i < messages.size(); ++i)
+            if (messages[i]->type == LABEL_MESSAGE_TYPE && (i / 10) % 2)
+                boost::dynamic_pointer_cast<LabelMessage>(messages[i])->addLabel = false;
+
+        size_t i = 0;
+        while (state.keepRunning()) {
+            graph.updateGraph(messages[i]);
+            if (++i == messages.size())
+                i = 0;
+        }
+    }
+
+    void graphMaintenance(State &state)
+    {
+        WatcherGraph &graph = graphOfSize(state.arg);
+        // Before any of the edges and labels expire.
+        const Timestamp ts = 1262304000000LL;
+
+        while (state.keepRunning())
+            graph.doMaintanence(ts);
+    }
+
+    //
+    // MessageStreamFilter
+    //
+
+    /** The filters a GUI sets: none, one layer, the layers shown by default,
+     * the message types a graph view draws, and a layer and type together. */
+    MessageStreamFilter makeFilter(size_t which)
+    {
+        const char *layers[] = { "Physical", "Routing", "Hierarchy", "Bandwidth", "Neighbors", "Undefined", "Floating", "Antenna" };
+        switch (which) {
+            case 0:
+                return MessageStreamFilter();
+            case 1: {
+                MessageStreamFilter f;
+                f.addLayer("Routing");
+                return f;
+            }
+            case 2: {
+                MessageStreamFilter f;
+                BOOST_FOREACH(const char *l, layers)
+                    f.addLayer(l);
+                return f;
+            }
+            case 3: {
+                MessageStreamFilter f;
+                f.addMessageType(GPS_MESSAGE_TYPE);
+                f.addMessageType(EDGE_MESSAGE_TYPE);
+                f.addMessageType(CONNECTIVITY_MESSAGE_TYPE);
+                f.addMessageType(COLOR_MESSAGE_TYPE);
+                return f;
+            }
+            default: {
+                MessageStreamFilter f(true);
+                f.addMessageType(EDGE_MESSAGE_TYPE);
+                f.addLayer("Routing");
+                return f;
+            }
+        }
+    }
+
+    void passFilter(State &state)
+    {
+        MessageStreamFilter filter(makeFilter(state.arg));
+        vector<MessagePtr> messages;
+        makeMix(messages, 1000, 100);
+
+        size_t i = 0, passed = 0;
+        while (state.keepRunning()) {
+            passed += filter.passFilter(messages[i]);
+            if (++i == messages.size())
+                i = 0;
+        }
+        LOG_DEBUG(passed << " messages passed");
+    }
+
+    const Benchmark benchmarks[] = {
+        { "createMessage", createMessages, 0, "gps", false },
+        { "createMessage", createMessages, 1, "label", false },
+        { "createMessage", createMessages, 2, "edge", false },
+        { "createMessage", createMessages, 3, "color", false },
+        { "createMessage", createMessages, 4, "connectivity", false },
+        { "createMessage", createMessages, 5, "nodeStatus", false },
+        { "createMessage", createMessages, 6, "dataPoint", false },
+        { "createMessage", createMessages, 7, "nodeProperties", false },
+        { "pack", packMessage, 0, "gps", false },
+        { "pack", packMessage, 1, "label", false },
+        { "pack", packMessage, 2, "edge", false },
+        { "pack", packMessage, 3, "color", false },
+        { "pack", packMessage, 4, "connectivity", false },
+        { "pack", packMessage, 5, "nodeStatus", false },
+        { "pack", packMessage, 6, "dataPoint", false },
+        { "pack", packMessage, 7, "nodeProperties", false },
+        { "unpack", unpackMessage, 0, "gps", false },
+        { "unpack", unpackMessage, 1, "label", false },
+        { "unpack", unpackMessage, 2, "edge", false },
+        { "unpack", unpackMessage, 3, "color", false },
+        { "unpack", unpackMessage, 4, "connectivity", false },
+        { "unpack", unpackMessage, 5, "nodeStatus", false },
+        { "unpack", unpackMessage, 6, "dataPoint", false },
+        { "unpack", unpackMessage, 7, "nodeProperties", false },
+        { "marshalPayload", marshal, 1, "1", false },
+        { "marshalPayload", marshal, 10, "10", false },
+        { "marshalPayload", marshal, 100, "100", false },
+        { "marshalPayload", marshal, 1000, "1000", false },
+        { "unmarshalPayload", unmarshal, 1, "1", false },
+        { "unmarshalPayload", unmarshal, 10, "10", false },
+        { "unmarshalPayload", unmarshal, 100, "100", false },
+        { "unmarshalPayload", unmarshal, 1000, "1000", false },
+        { "graph/updateGraph", updateGraph, 100, "100", false },
+        { "graph/updateGraph", updateGraph, 1000, "1000", false },
+        { "graph/updateGraph", updateGraph, 5000, "5000", true },
+        { "graph/doMaintanence", graphMaintenance, 100, "100", false },
+        { "graph/doMaintanence", graphMaintenance, 1000, "1000", false },
+        { "graph/doMaintanence", graphMaintenance, 5000, "5000", true },
+        { "passFilter", passFilter, 0, "none", false },
+        { "passFilter", passFilter, 1, "oneLayer", false },
+        { "passFilter", passFilter, 2, "eightLayers", false },
+        { "passFilter", passFilter, 3, "graphTypes", false },
+        { "passFilter", passFilter, 4, "typeAndLayer", false }
+    };
+
+    /** Run a benchmark, growing the iteration count until a run takes at least minTime. */
+    void run(const Benchmark &b, const string &fullName, double minTime)
+    {
+        unsigned long iterations = 1;
+        double elapsed = 0;
+        size_t items = 1, bytes = 0;
+        unsigned long long allocated = 0;
+        while (true) {
+            State state(b.arg, iterations);
+            b.fn(state);
+            elapsed = state.elapsed();
+            items = state.itemsPerIteration;
+            bytes = state.bytesPerIteration;
+            allocated = state.allocated();
+            if (elapsed >= minTime || iterations >= 1000000000UL)
+                break;
+            // Aim a little past minTime, but grow by at most 10x per run
+            // so a bad first estimate does not take forever.
+            double scale = elapsed > 0 ? minTime * 1.4 / elapsed : 10;
+            if (scale > 10)
+                scale = 10;
+            unsigned long next = static_cast<unsigned long>(iterations * scale);
+            iterations = next > iterations ? next : iterations + 1;
+        }
+
+        double perIteration = elapsed / iterations;
+        cout << left << setw(36) << fullName << right
+            << setw(14) << fixed << setprecision(0) << perIteration * 1e9 << " ns"
+            << setw(12) << iterations
+            << setw(14) << setprecision(0) << allocated * 1e6 / (static_cast<double>(iterations) * items);
+        if (items > 1 || bytes == 0)
+            cout << setw(14) << setprecision(0) << items / perIteration << " msg/s";
+        if (bytes)
+            cout << setw(12) << setprecision(1) << bytes / perIteration / (1024 * 1024) << " MB/s";
+        cout << endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const string filter(argc > 1 ? argv[1] : "");
+    double minTime = argc > 2 ? strtod(argv[2], NULL) : 0.5;
+
+    BasicConfigurator::configure();
+    Logger::getRootLogger()->setLevel(Level::getError());
+
+    cout << left << setw(36) << "Benchmark" << right << setw(17) << "Time" << setw(12) << "Iterations"
+        << setw(14) << "Allocs/1M msg" << endl;
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i) {
+        const Benchmark &b = benchmarks[i];
+        const string fullName = string(b.name) + "/" + b.argName;
+        if (fullName.find(filter) == string::npos)
+            continue;
+        if (b.large && filter.find(b.argName) == string::npos)
+            continue;
+        run(b, fullName, minTime);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// vim:sw=4 ts=8
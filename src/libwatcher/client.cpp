@@ -48,6 +48,9 @@ Client::~Client()
     TRACE_ENTER();
     if(work)
     {
+        // Stop trying to connect, or the work thread would never finish.
+        if (!clientConnection->isConnected())
+            clientConnection->close();
         delete work;
         work=NULL; 
         workThread->join();
@@ -110,6 +113,13 @@ bool Client::connect(bool async)
     return rv;
 }
 
+void Client::setReconnect(bool reconnect)
+{
+    TRACE_ENTER();
+    clientConnection->setReconnect(reconnect);
+    TRACE_EXIT();
+}
+
 bool Client::connected() const
 {
     return clientConnection->isConnected();
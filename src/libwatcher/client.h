@@ -60,7 +60,8 @@ namespace watcher
             virtual ~Client();
 
             /**
-             * Send a messsage to the server.
+             * Send a messsage to the server. Does not wait to connect: if not connected,
+             * the message is queued until the connection is made.
              * 
              * @param message the message to be sent. 
              * @return boolean true on success, false otherwise
@@ -93,12 +94,20 @@ namespace watcher
             void wait();
 
             /**
-             * Perform a synchronous connection attempt to the server.
+             * Connect to the server, and wait.
+             * @param async if true, wait for the outcome of one connection attempt only,
+             *        otherwise wait until connected.
              * @retval true connection succeeded
              * @retval false connection failed
              */
             bool connect(bool async=false);
 
+            /**
+             * Reconnect, with backoff, whenever the connection is lost. Off by default,
+             * but a connection is always made to send messages.
+             */
+            void setReconnect(bool reconnect);
+
             /**
              * @return true if connected, false otherwise.
              */
@@ -26,6 +26,7 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include "libwatcher/message.h"
+#include "libwatcher/messageTrace.h"
 #include "messageHandler.h"
 #include "logger.h"
 
@@ -37,15 +38,38 @@ using namespace boost::asio::ip;
 
 INIT_LOGGER(ClientConnection, "Connection.ClientConnection");
 
+namespace {
+    // Messages kept while disconnected. A GUI's controls are a handful; this is for feeders.
+    const size_t maxQueuedMessages = 10000;
+
+    // A write carries at most this many messages, well inside the header's count of them.
+    const size_t maxMessagesPerWrite = 1000;
+
+    const posix_time::time_duration firstBackoff = posix_time::milliseconds(250);
+    const posix_time::time_duration maxBackoff = posix_time::seconds(8);
+    const posix_time::time_duration connectTimeout = posix_time::seconds(10);
+}
+
 ClientConnection::ClientConnection(
         boost::asio::io_service& io_service, 
         const std::string &server_, 
         const std::string &service_) :
     Connection(io_service),
-    connected(false),
+    state(DISCONNECTED),
+    reconnect(false),
+    closing(false),
+    writing(false),
+    failures(0),
+    backoff(firstBackoff),
+    queuedMessages(0),
+    numDropped(0),
+    handlerBatches(0),
     ioService(io_service),
     theStrand(io_service),
     writeStrand(io_service),
+    connectStrand(io_service),
+    resolver(io_service),
+    timer(io_service),
     incomingBuffer(DataMarshaller::header_length),
     server(server_),
     service(service_)
@@ -65,105 +89,255 @@ void ClientConnection::doClose()
 {
     TRACE_ENTER();
     LOG_DEBUG("Closing the socket"); 
-    getSocket().close();
-    connected = false;
+    mutex::scoped_lock lock(stateMutex);
+    disconnected("closed");
     TRACE_EXIT();
 }
 
 void ClientConnection::close()
 {
     TRACE_ENTER();
-    if (connected) {
-	LOG_DEBUG("posting call to doClose()");
-	ioService.post(boost::bind(&ClientConnection::doClose, this));
+    {
+        mutex::scoped_lock lock(stateMutex);
+        closing=true;
+        queued.clear();
+        queuedMessages=0;
+        handlerBatches=0;
+        stateCond.notify_all();
     }
+    LOG_DEBUG("posting call to doClose()");
+    connectStrand.post(boost::bind(&ClientConnection::doClose, shared_from_this()));
     TRACE_EXIT();
 }
 
+bool ClientConnection::isConnected() const
+{
+    mutex::scoped_lock lock(stateMutex);
+    return state==CONNECTED;
+}
+
+void ClientConnection::setReconnect(bool reconnect_)
+{
+    mutex::scoped_lock lock(stateMutex);
+    reconnect=reconnect_;
+}
+
+unsigned long ClientConnection::droppedMessages() const
+{
+    mutex::scoped_lock lock(stateMutex);
+    return numDropped;
+}
+
 bool ClientConnection::connect(bool async)
 {
     TRACE_ENTER();
 
-    if (!connected) {
-	if (async) {
-	    bool rv = tryConnect();
-	    TRACE_EXIT_RET(rv);
-	    return rv;
-	}
+    unique_lock<mutex> lock(stateMutex);
+    closing=false;
+    unsigned int failed=failures;
+    startConnect();
+    while (state!=CONNECTED && !closing && (!async || failures==failed))
+        stateCond.wait(lock);
 
-	// Don't exit this function until we're connected. connect(false) is synchronous
-	while (! tryConnect()) {
-	    LOG_WARN("Unable to connect to server, trying again in 2 seconds.");
-	    sleep(2);
-	}
-    }
-    TRACE_EXIT_RET(true);
-    return true;
+    bool rv=state==CONNECTED;
+    TRACE_EXIT_RET_BOOL(rv);
+    return rv;
 }
 
-bool ClientConnection::tryConnect()
+void ClientConnection::startConnect()
 {
-    TRACE_ENTER();
+    if (closing || (state!=DISCONNECTED && state!=BACKING_OFF))
+        return;
 
-    LOG_DEBUG("Starting connection sequence to " << server); 
+    if (state==BACKING_OFF) {
+        boost::system::error_code ignored;
+        timer.cancel(ignored);   // somebody wants it now
+    }
 
-    boost::system::error_code error;
-    tcp::resolver resolver(ioService); 
+    LOG_DEBUG("Starting connection sequence to " << server << ", service/port " << service); 
+    state=RESOLVING;
     tcp::resolver::query query(server, service);
-    LOG_DEBUG("Connecting to service/port " << service);
-    tcp::resolver::iterator endpoint_iterator = resolver.resolve(query, error);
-    tcp::resolver::iterator end;
+    resolver.async_resolve(query,
+                           connectStrand.wrap(bind(&ClientConnection::handle_resolve,
+                                                   shared_from_this(),
+                                                   asio::placeholders::error,
+                                                   asio::placeholders::iterator)));
+}
 
-    if (error)
-    {
-        connected=false;
-        if (error==boost::asio::error::service_not_found)
-        {
+void ClientConnection::handle_resolve(const boost::system::error_code &e, tcp::resolver::iterator endpoints)
+{
+    TRACE_ENTER();
+
+    mutex::scoped_lock lock(stateMutex);
+    if (closing || state!=RESOLVING) {
+        TRACE_EXIT();
+        return;
+    }
+
+    if (e) {
+        if (e==boost::asio::error::service_not_found) {
             LOG_FATAL("watcherd service not found. Please add \"watcherd    8095/tcp\" to your /etc/services file.");
-        }
-        else if(error==boost::asio::error::host_not_found)
-        {
+        } else if (e==boost::asio::error::host_not_found) {
             LOG_FATAL("Unable to resolve hostname of server \"" << server << "\". Please resolve connectivity issues and try again.");
+        } else if (e==boost::asio::error::host_not_found_try_again) {
+            LOG_ERROR("Unable to resolve hostname of server \"" << server << "\" for now.");
+            attemptFailed();
+            TRACE_EXIT();
+            return;
+        } else {
+            LOG_FATAL("Resolution error: " << e.message());
         }
-        else
-            LOG_FATAL("Resolution error: " << error);
 
-        throw(error);
+        // Trying again won't help. Give up until asked to connect again.
+        closing=true;
+        attemptFailed();
+        TRACE_EXIT();
+        return;
+    }
+
+    LOG_DEBUG("Resolved connection query to " << server);
+    startAttempt(endpoints);
+
+    TRACE_EXIT();
+}
+
+void ClientConnection::startAttempt(tcp::resolver::iterator endpoint)
+{
+    LOG_DEBUG("Attempting connect."); 
+    state=CONNECTING;
+    boost::system::error_code ignored;
+    theSocket.close(ignored);
+    theSocket.async_connect(*endpoint,
+                            connectStrand.wrap(bind(&ClientConnection::handle_connect,
+                                                    shared_from_this(),
+                                                    asio::placeholders::error,
+                                                    endpoint)));
+    timer.expires_from_now(connectTimeout);
+    timer.async_wait(connectStrand.wrap(bind(&ClientConnection::handle_timer, shared_from_this(), asio::placeholders::error)));
+}
+
+void ClientConnection::handle_connect(const boost::system::error_code &e, tcp::resolver::iterator endpoint)
+{
+    TRACE_ENTER();
+
+    unique_lock<mutex> lock(stateMutex);
+    if (closing || state!=CONNECTING) {
+        TRACE_EXIT();
+        return;
     }
-    else
-    {
-        LOG_DEBUG("Resolved connection query to " << server);
 
+    boost::system::error_code error=e;
+    tcp::endpoint ep;
+    if (!error) 
+        ep=theSocket.remote_endpoint(error);    // fails if the attempt timed out just now
+
+    if (error) {
+        LOG_ERROR("Connection error: " << error.message());
         // Try each endpoint until we successfully establish a connection.
-        do 
-        {
-            theSocket.close();
-            LOG_DEBUG("Attempting connect."); 
-            theSocket.connect(*endpoint_iterator++, error);
-
-            if (!error)
-            {
-                /* Store connection information for use by Connection::getPeerAddr() */
-                boost::asio::ip::tcp::endpoint ep = theSocket.remote_endpoint();
-                endpoint_addr_ = ep.address().to_string();
-                endpoint_port_ = ep.port();
-
-                connected=true;
-                break;
-            }
-            else
-            {
-                connected=false;
-                LOG_ERROR("Connection error: " << error);
-            }
-        } while (endpoint_iterator != end);
+        if (++endpoint!=tcp::resolver::iterator()) 
+            startAttempt(endpoint);
+        else
+            attemptFailed();
+        TRACE_EXIT();
+        return;
+    }
+
+    boost::system::error_code ignored;
+    timer.cancel(ignored);
+
+    /* Store connection information for use by Connection::getPeerAddr() */
+    endpoint_addr_ = ep.address().to_string();
+    endpoint_port_ = ep.port();
+
+    // Let the handlers say what they need before anything that was waiting
+    // goes out. Anybody else's messages still wait, as we're not connected yet.
+    MessageHandlerList handlers(messageHandlers);
+    handlerThread=this_thread::get_id();
+    handlerBatches=0;
+    lock.unlock();
+    BOOST_FOREACH(MessageHandlerPtr& mh, handlers) 
+        mh->handleConnect(shared_from_this());
+    lock.lock();
+    handlerThread=thread::id();
+
+    if (closing || state!=CONNECTING) {
+        TRACE_EXIT();
+        return;
+    }
+
+    LOG_INFO("Connected to " << endpoint_addr_ << ":" << endpoint_port_ << ", " << queuedMessages << " messages waiting to be sent");
+    state=CONNECTED;
+    failures=0;
+    backoff=firstBackoff;
+    stateCond.notify_all();
+
+    run(); // start message reader strand
+    writeQueued();
+
+    TRACE_EXIT();
+}
+
+void ClientConnection::handle_timer(const boost::system::error_code &e)
+{
+    TRACE_ENTER();
+
+    if (e==boost::asio::error::operation_aborted) {
+        TRACE_EXIT();
+        return;
+    }
+
+    mutex::scoped_lock lock(stateMutex);
+    if (state==BACKING_OFF) {
+        state=DISCONNECTED;
+        startConnect();
+    } else if (state==CONNECTING) {
+        LOG_WARN("Timed out connecting to server.");
+        boost::system::error_code ignored;
+        theSocket.close(ignored);  // handle_connect() tries the next address
+    }
+
+    TRACE_EXIT();
+}
+
+void ClientConnection::attemptFailed()
+{
+    ++failures;
+    stateCond.notify_all();
+
+    if (closing) {
+        state=DISCONNECTED;
+        return;
     }
 
-    if (connected)
-        run(); // start message reader strand
+    LOG_WARN("Unable to connect to server, trying again in " << backoff);
+    backOff();
+}
 
-    TRACE_EXIT_RET((connected==true?"true":"false"));
-    return connected;
+void ClientConnection::backOff()
+{
+    state=BACKING_OFF;
+    timer.expires_from_now(backoff);
+    timer.async_wait(connectStrand.wrap(bind(&ClientConnection::handle_timer, shared_from_this(), asio::placeholders::error)));
+    backoff=std::min(backoff*2, maxBackoff);
+}
+
+void ClientConnection::disconnected(const string &why)
+{
+    boost::system::error_code ignored;
+    timer.cancel(ignored);
+    resolver.cancel();
+    theSocket.close(ignored);
+
+    if (state==CONNECTED) 
+        LOG_INFO("Connection to server " << why);
+    state=DISCONNECTED;
+    writing=false;
+    stateCond.notify_all();
+
+    if (!closing && (reconnect || !queued.empty())) {
+        LOG_INFO("Reconnecting in " << backoff);
+        backOff();
+    }
 }
 
 bool ClientConnection::sendMessage(const MessagePtr message)
@@ -183,34 +357,97 @@ bool ClientConnection::sendMessages(const vector<event::MessagePtr> &messages)
 {
     TRACE_ENTER();
 
-    if (!connected)
-        connect();
+    if (tracingEnabled()) {
+        BOOST_FOREACH(const MessagePtr& m, messages) {
+            if (isFeederEvent(m->type)) {
+                m->trace.clear();   // in case the message is being resent
+                traceStamp(*m, TRACE_FEEDER_SEND);
+            }
+        }
+    }
 
     LOG_DEBUG("Marshaling outbound message"); 
-    DataMarshaller::NetworkMarshalBuffers outBuffers;
-    if (!DataMarshaller::marshalPayload(messages, outBuffers)) {
+    Batch batch;
+    if (!DataMarshaller::marshalPayload(messages, batch.buffers)) {
         LOG_WARN("Error marshaling message, not sending"); 
         TRACE_EXIT_RET("false"); 
         return false;
     }
+    batch.messages=messages;
+
+    mutex::scoped_lock lock(stateMutex);
+    if (handlerThread==this_thread::get_id()) {
+        enqueue(batch, true);
+    } else {
+        closing=false;  // whoever closed us wants these sent
+        enqueue(batch);
+        if (state==CONNECTED) {
+            LOG_INFO("Sending message: " << *(messages.front()) << " (" << messages.front() << ")");
+            writeQueued();
+        } else {
+            LOG_DEBUG("Not connected, queued message: " << *(messages.front()));
+            startConnect();
+        }
+    }
+
+    TRACE_EXIT_RET("true"); 
+
+    return true;
+}
+
+void ClientConnection::enqueue(const Batch &batch, bool atFront)
+{
+    if (atFront) 
+        queued.insert(queued.begin()+handlerBatches++, batch);
+    else
+        queued.push_back(batch);
+    queuedMessages+=batch.messages.size();
+
+    while (queuedMessages>maxQueuedMessages && queued.size()>1) {
+        if (numDropped%1000==0)
+            LOG_WARN("Too many messages waiting to be sent, dropping the oldest (" << numDropped << " so far)");
+        queuedMessages-=queued.front().messages.size();
+        numDropped+=queued.front().messages.size();
+        queued.pop_front();
+        if (handlerBatches) 
+            --handlerBatches;
+    }
+}
+
+void ClientConnection::writeQueued()
+{
+    if (writing || state!=CONNECTED || queued.empty())
+        return;
 
-    LOG_INFO("Sending message: " << *(messages.front()) << " (" << messages.front() << ")");
+    // Write as many batches as fit in one go, and only one write at a time.
+    BatchQueuePtr batches(new BatchQueue);
+    DataMarshaller::NetworkMarshalBuffers outBuffers;
+    size_t n=0;
+    do {
+        n+=queued.front().messages.size();
+        queuedMessages-=queued.front().messages.size();
+        outBuffers.insert(outBuffers.end(), queued.front().buffers.begin(), queued.front().buffers.end());
+        batches->push_back(queued.front());
+        queued.pop_front();
+    } while (!queued.empty() && n+queued.front().messages.size()<=maxMessagesPerWrite);
+
+    writing=true;
     async_write(theSocket, 
                 outBuffers, 
                 writeStrand.wrap(bind(&ClientConnection::handle_write_message, 
-                                      this, 
+                                      shared_from_this(), 
                                       asio::placeholders::error, 
-                                      messages)));
-
-    TRACE_EXIT_RET("true"); 
-
-    return true;
+                                      batches)));
 }
 
-void ClientConnection::handle_write_message(const boost::system::error_code &e, vector<MessagePtr> messages)
+void ClientConnection::handle_write_message(const boost::system::error_code &e, BatchQueuePtr batches)
 {
     TRACE_ENTER();
 
+    vector<MessagePtr> messages;
+    BOOST_FOREACH(const Batch& b, *batches) 
+        messages.insert(messages.end(), b.messages.begin(), b.messages.end());
+
     if (!e) {
         LOG_DEBUG("Sucessfully sent message " << messages.front()); 
 
@@ -218,16 +455,29 @@ void ClientConnection::handle_write_message(const boost::system::error_code &e,
         BOOST_FOREACH(MessageHandlerPtr& mh, messageHandlers) {
             rv |= mh->handleMessagesSent(messages);
         }
+
+        mutex::scoped_lock lock(stateMutex);
+        writing=false;
         if (rv) {
             LOG_DEBUG("Handler requested shutdown of connection");
-            getSocket().shutdown(boost::asio::ip::tcp::socket::shutdown_send);
-        }
-
+            closing=true;
+            boost::system::error_code ignored;
+            getSocket().shutdown(boost::asio::ip::tcp::socket::shutdown_send, ignored);
+        } else
+            writeQueued();
     }
     else
     {
         LOG_WARN("Error '" << e.message() << "' while writing message: " << messages.front());
-        doClose(); 
+
+        // Send them again once reconnected; better twice than never.
+        mutex::scoped_lock lock(stateMutex);
+        if (!closing) {
+            queued.insert(queued.begin(), batches->begin(), batches->end());
+            queuedMessages+=messages.size();
+        }
+        if (e!=boost::asio::error::operation_aborted)     // else we closed it already
+            disconnected("lost while writing");
     }
 
     TRACE_EXIT();
@@ -305,7 +555,10 @@ void ClientConnection::handle_read_header(const boost::system::error_code &e, st
 	else
 	{
 		LOG_DEBUG("Error reading inbound message header: " << e.message()); 
-		doClose();
+		if (e!=boost::asio::error::operation_aborted) {	// we closed it already
+			mutex::scoped_lock lock(stateMutex);
+			disconnected("lost: " + e.message());
+		}
 	}
 
 	TRACE_EXIT(); 
@@ -24,8 +24,13 @@
 #ifndef WATCHERD_CLIENT_CONECTION_HPP
 #define WATCHERD_CLIENT_CONECTION_HPP
 
+#include <deque>
 #include <list>
 #include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
@@ -37,7 +42,20 @@
 
 namespace watcher 
 {
-    /// Represents a single connection from a client.
+    /** Represents a single connection from a client.
+     *
+     * Connecting never blocks the thread that sends: a connection is made
+     * asynchronously on the io_service, and a failed attempt is retried after
+     * a backoff delay which doubles each time, up to a limit.  Messages sent
+     * while there is no connection are kept in a bounded queue, dropping the
+     * oldest when it is full, and go out in order once connected.  All writes
+     * go through one queue, so only one is in progress on the socket at a time.
+     *
+     * A connection which is lost is reconnected if reconnection has been
+     * turned on with setReconnect(), or if there are messages waiting to be
+     * sent, but not after close() or after a message handler has asked for
+     * the connection to be shut down.
+     */
     class ClientConnection : 
         public Connection,
         public boost::enable_shared_from_this<ClientConnection>
@@ -47,7 +65,6 @@ namespace watcher
              * @param io_service io_service for the application
              * @param server DNS name or IP address of server
              * @param service port or service name
-             * @param reconnect attempt to reconnect if the connection terminates
              */
             ClientConnection(
                     boost::asio::io_service& io_service, 
@@ -60,30 +77,43 @@ namespace watcher
              * send a packet to the server which contains the message. 
              *
              * @param message The message to send.
-             * @return a bool currently ignored. 
+             * @return false if the message could not be marshaled, true otherwise.
              */
             bool sendMessage(const event::MessagePtr message);
 
             /**
-             * send a packet to the server which contains messages. 
+             * send a packet to the server which contains messages. If not connected, the messages
+             * are queued and a connection is started. Does not block.
              * @param message The messages to send.
-             * @return a bool currently ignored. 
+             * @return false if the messages could not be marshaled, true otherwise.
              */
             bool sendMessages(const std::vector<event::MessagePtr> &message);
 
             /**
-             * Perform a synchronous connection attempt to the server.
-             * @param async, If true, connect() will attempt to connect once, and return true/false on success/failure.
-             *          If false, connect() will not return until connected, retrying every 2 seconds. Returns true.
-             * @retval true connection succeeded
-             * @retval false connection failed
+             * Start connecting to the server, if not connected or connecting already, and wait.
+             * Must not be called from a message handler, as the connection is made on the io_service.
+             * @param async, If true, connect() waits for the outcome of the next connection attempt only.
+             *          If false, connect() will not return until connected, retrying with backoff.
+             * @retval true connected
+             * @retval false connection attempt failed, or the connection was closed
              */
             bool connect(bool async=false); 
 
-            bool isConnected() const { return connected; }
+            bool isConnected() const;
 
             /**
-             * close the connection to the server.
+             * Turn reconnecting after the connection is lost on or off. Off by default.
+             */
+            void setReconnect(bool reconnect);
+
+            /**
+             * @return number of queued messages dropped because the queue was full.
+             */
+            unsigned long droppedMessages() const;
+
+            /**
+             * close the connection to the server, and stop any connection attempt in progress.
+             * Queued messages are not sent.
              */
             void close(); 
 
@@ -91,25 +121,73 @@ namespace watcher
 
             DECLARE_LOGGER();
 
-            void doClose();
+            enum State { 
+                DISCONNECTED,   // not trying to connect
+                RESOLVING,      // looking up the server's address
+                CONNECTING,     // trying each of the server's addresses in turn
+                BACKING_OFF,    // waiting to try again
+                CONNECTED
+            };
 
-            /**
-             * Attempt connection to server. Will set 'connected' to true, if successful. Will
-             * also return true on success.
-             * @return true on success, false otherwise.
-             */
-            bool tryConnect(); 
+            void doClose();
 
-            bool connected; 
+            /** Lost or failed connection: shut the socket, and try again later if there is reason to. */
+            void disconnected(const std::string &why);
+
+            /** Start connecting if not doing so already. */
+            void startConnect();
+
+            /** Try connecting to the address endpoint, or time out. */
+            void startAttempt(boost::asio::ip::tcp::resolver::iterator endpoint);
+
+            /** A connection attempt failed. Try again after a while, unless closing. */
+            void attemptFailed();
+            void backOff();
+
+            void handle_resolve(const boost::system::error_code& e, boost::asio::ip::tcp::resolver::iterator endpoints);
+            void handle_connect(const boost::system::error_code& e, boost::asio::ip::tcp::resolver::iterator endpoint);
+            void handle_timer(const boost::system::error_code& e);
+
+            /** Messages as passed to sendMessages(), and marshaled. */
+            struct Batch {
+                std::vector<event::MessagePtr> messages;
+                DataMarshaller::NetworkMarshalBuffers buffers;
+            };
+            typedef std::deque<Batch> BatchQueue;
+            typedef boost::shared_ptr<BatchQueue> BatchQueuePtr;
+
+            /** Queue a batch to be sent, dropping the oldest if there are too many. */
+            void enqueue(const Batch &batch, bool atFront=false);
+
+            /** Start writing the queued messages, if connected and not writing already. */
+            void writeQueued();
+
+            // All of these are protected by stateMutex, which disconnected() through writeQueued() expect to be held.
+            mutable boost::mutex stateMutex;
+            boost::condition_variable stateCond;
+            State state; 
+            bool reconnect;     // reconnect when the connection is lost?
+            bool closing;       // no more connection attempts
+            bool writing;       // is a write in progress?
+            unsigned int failures;  // connection attempts that failed since last connected
+            boost::posix_time::time_duration backoff;     // before the next attempt
+            BatchQueue queued;  // waiting to be written
+            size_t queuedMessages;
+            unsigned long numDropped;
+            boost::thread::id handlerThread; // calling handleConnect()
+            size_t handlerBatches;  // queued by handleConnect(), at the front
 
             boost::asio::io_service &ioService;
             boost::asio::io_service::strand theStrand; // for reading
             boost::asio::io_service::strand writeStrand;
+            boost::asio::io_service::strand connectStrand;
+            boost::asio::ip::tcp::resolver resolver;
+            boost::asio::deadline_timer timer; // backoff, or connection attempt timeout
 
             typedef std::vector<char> IncomingBuffer;
             IncomingBuffer incomingBuffer;
 
-            void handle_write_message(const boost::system::error_code& e, std::vector<event::MessagePtr> messages);
+            void handle_write_message(const boost::system::error_code& e, BatchQueuePtr batches);
             void handle_read_header(const boost::system::error_code& e, std::size_t bytes_transferred);
             void handle_read_payload(const boost::system::error_code& e, std::size_t bytes_transferred);
             void run();
@@ -63,7 +63,7 @@ void Connection::removeMessageHandler(MessageHandlerPtr messageHandler)
     LOG_DEBUG("Removing messageHandler from connection."); 
     MessageHandlerList::iterator removeMe;
 
-    removeMe=find(messageHandlers.end(), messageHandlers.begin(), messageHandler);
+    removeMe=find(messageHandlers.begin(), messageHandlers.end(), messageHandler);
 
     if (removeMe!=messageHandlers.end())
         messageHandlers.erase(removeMe);
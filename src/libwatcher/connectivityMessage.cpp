@@ -53,7 +53,7 @@ namespace watcher
         ConnectivityMessage::ConnectivityMessage(const ConnectivityMessage &other) :
             Message(other.type, other.version), 
             neighbors(other.neighbors),
-            layer(PHYSICAL_LAYER)
+            layer(other.layer)
         {
             TRACE_ENTER();
             TRACE_EXIT();
@@ -92,7 +92,7 @@ namespace watcher
             Message::toStream(out);
             out << " layer: " << layer;
             out << " neighbors:[";
-            for (vector<NodeIdentifier>::const_iterator i=neighbors.begin(); i != neighbors.end(); ++i)
+            for (NeighborList::const_iterator i=neighbors.begin(); i != neighbors.end(); ++i)
                 out << *i << ",";
             out << "] ";
 
@@ -115,7 +115,7 @@ namespace watcher
 			e << YAML::Key << "layer" << YAML::Value << layer;		
 			e << YAML::Key << "neighbors" << YAML::Value;		
 				e << YAML::Flow << YAML::BeginSeq; 
-				BOOST_FOREACH(const NodeIdentifier &n, neighbors) 
+				BOOST_FOREACH(NodeIdentifier n, neighbors) 
 					e << n.to_string(); 
 				e << YAML::EndSeq; 
 			e << YAML::EndMap; 
@@ -23,9 +23,8 @@
 #ifndef CONNNECTIVITY_MESSAGE_DATA_H
 #define CONNNECTIVITY_MESSAGE_DATA_H
 
-#include <vector>
-
 #include "message.h"
+#include "nodeIdList.h"
 #include "watcherTypes.h"
 
 namespace watcher 
@@ -49,8 +48,10 @@ namespace watcher
                 
                 /**
                  * List of neighbors at the time the message is sent.
+                 * IPv4 neighbors take 4 bytes each, and the first few
+                 * don't need the heap.
                  */
-                typedef std::vector<watcher::NodeIdentifier> NeighborList;
+                typedef watcher::NodeIdList NeighborList;
                 NeighborList neighbors;
 
                 /**
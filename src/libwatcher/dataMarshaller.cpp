@@ -49,6 +49,52 @@ using namespace watcher::event;
 
 #define UNMARSHALINT32(a,b)  {b = (*(a+0)<<24) | (*(a+1)<<16) | (*(a+2)<<8) | *(a+3); a+=4;}
 
+namespace {
+	/* Trace stamps are not part of a packed message, so a message which
+	 * carries some is sent after a document holding only its stamps:
+	 * {trace: [[hop, usec], ...]}. Message documents never have a trace key. */
+	void packTrace(ostream &out, const TraceStamps &trace)
+	{
+		YAML::Emitter e; 
+		e << YAML::Flow << YAML::BeginMap;
+		e << YAML::Key << "trace" << YAML::Value << YAML::Flow << YAML::BeginSeq;
+		for (TraceStamps::const_iterator t=trace.begin(); t!=trace.end(); ++t)
+			e << YAML::Flow << YAML::BeginSeq << static_cast<int>(t->hop) << t->usec << YAML::EndSeq;
+		e << YAML::EndSeq << YAML::EndMap; 
+		out.write(e.c_str(), e.size()); 
+	}
+
+	/* Read the next message, and the stamps sent ahead of it if there are any. */
+	MessagePtr unpackMessage(YAML::Parser &parser)
+	{
+		YAML::Node node; 
+		parser.GetNextDocument(node); 
+		TraceStamps trace; 
+		if (const YAML::Node *t=node.FindValue("trace")) {
+			try {
+				for (unsigned i=0; i<t->size(); i++) {
+					int hop;
+					long long usec;
+					(*t)[i][0] >> hop;
+					(*t)[i][1] >> usec;
+					if (hop>=0 && hop<TRACE_HOP_COUNT) {
+						TraceStamp stamp = { static_cast<TraceHop>(hop), usec };
+						trace.push_back(stamp);
+					}
+				}
+			}
+			catch (YAML::Exception &e) {
+				return MessagePtr(); 
+			}
+			parser.GetNextDocument(node); 
+		}
+		MessagePtr message=Message::unpack(node); 
+		if (message) 
+			message->trace.swap(trace); 
+		return message; 
+	}
+}
+
 // static 
 bool DataMarshaller::unmarshalHeader(const char *buffer, const size_t &bufferSize, size_t &payloadSize, unsigned short &messageNum)
 {
@@ -86,7 +132,8 @@ bool DataMarshaller::unmarshalPayload(MessagePtr &message, const char *buffer, c
 	string data(buffer, bufferSize); 
 	istringstream dataStream(data); 
     LOG_DEBUG("Unmarshalling payload data(size=" << bufferSize << "): " << data); 
-	message=Message::unpack(dataStream); 
+	YAML::Parser parser(dataStream); 
+	message=unpackMessage(parser); 
 	if (!message) {
 		LOG_WARN("Error: failed to unmarshal message."); 
 		TRACE_EXIT_RET("false"); 
@@ -105,10 +152,8 @@ bool DataMarshaller::unmarshalPayload(std::vector<MessagePtr> &messages, unsigne
 	string str(buffer, bufferSize); 
 	istringstream ss(str); 
 	YAML::Parser parser(ss); 
-	YAML::Node node; 
     for(i=0; i<numOfMessages; i++) {
-		parser.GetNextDocument(node); 
-		MessagePtr message=Message::unpack(node); 
+		MessagePtr message=unpackMessage(parser); 
 		if (message.get()==0) { 
 			numOfMessages=i; 
 			TRACE_EXIT_RET("false"); 
@@ -150,6 +195,8 @@ bool DataMarshaller::marshalPayload(const vector<MessagePtr> &messages, NetworkM
 	for(vector<MessagePtr>::const_iterator m=messages.begin(); m!=messages.end(); ++m) {
 		// first pack the message so we know how big it is.
 		ostringstream out; 
+		if (!m->get()->trace.empty())
+			packTrace(out, m->get()->trace); 
 		m->get()->pack(out); 
 		uint32_t size=static_cast<uint32_t>(out.str().size());
 		payloadSize += size; 
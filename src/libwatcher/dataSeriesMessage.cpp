@@ -0,0 +1,110 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file dataSeriesMessage.cpp
+ */
+#include "dataSeriesMessage.h"
+#include "logger.h"
+#include <boost/foreach.hpp>
+
+namespace watcher {
+namespace event {
+
+INIT_LOGGER(DataSeriesMessage, "Message.DataSeriesMessage");
+
+DataSeriesMessage::DataSeriesMessage(const NodeIdentifier& node_, const std::string& dataName_,
+	Timestamp begin_, Timestamp end_, Timestamp resolution_) :
+    Message(DATA_SERIES_MESSAGE_TYPE, DATA_SERIES_MESSAGE_VERSION),
+    node(node_), dataName(dataName_), begin(begin_), end(end_), resolution(resolution_)
+{
+    TRACE_ENTER();
+    TRACE_EXIT();
+}
+
+std::ostream& operator<< (std::ostream& os, const DataSeriesMessage& p)
+{
+    return os << "[DataSeriesMessage node=" << p.node << " dataName=\"" << p.dataName << "\" begin=" << p.begin <<
+	" end=" << p.end << " resolution=" << p.resolution << " buckets=" << p.buckets.size() << "]";
+}
+
+bool operator== (const DataSeriesMessage::Bucket& lhs, const DataSeriesMessage::Bucket& rhs)
+{
+    return lhs.time == rhs.time && lhs.count == rhs.count && lhs.min == rhs.min &&
+	lhs.max == rhs.max && lhs.mean == rhs.mean && lhs.last == rhs.last;
+}
+
+bool operator== (const DataSeriesMessage& lhs, const DataSeriesMessage& rhs)
+{
+    return lhs.node == rhs.node && lhs.dataName == rhs.dataName && lhs.begin == rhs.begin &&
+	lhs.end == rhs.end && lhs.resolution == rhs.resolution && lhs.buckets == rhs.buckets;
+}
+
+// virtual
+std::ostream& DataSeriesMessage::toStream(std::ostream& os) const
+{
+    return Message::toStream(os) << *this;
+}
+
+YAML::Emitter &DataSeriesMessage::serialize(YAML::Emitter &e) const {
+	e << YAML::Flow << YAML::BeginMap;
+	Message::serialize(e);
+	e << YAML::Key << "node" << YAML::Value << node.to_string();
+	e << YAML::Key << "dataName" << YAML::Value << dataName;
+	e << YAML::Key << "begin" << YAML::Value << begin;
+	e << YAML::Key << "end" << YAML::Value << end;
+	e << YAML::Key << "resolution" << YAML::Value << resolution;
+	// each bucket is [time, count, min, max, mean, last]
+	e << YAML::Key << "buckets" << YAML::Value;
+		e << YAML::Flow << YAML::BeginSeq;
+		BOOST_FOREACH(const Bucket& b, buckets) {
+			e << YAML::Flow << YAML::BeginSeq;
+			e << b.time << b.count << b.min << b.max << b.mean << b.last;
+			e << YAML::EndSeq;
+		}
+		e << YAML::EndSeq;
+	e << YAML::EndMap;
+	return e;
+}
+
+YAML::Node &DataSeriesMessage::serialize(YAML::Node &n) {
+	// Do not serialize base data GTL - Message::serialize(node);
+	std::string str;
+	n["node"] >> str;
+	node=NodeIdentifier::from_string(str);
+	n["dataName"] >> dataName;
+	n["begin"] >> begin;
+	n["end"] >> end;
+	n["resolution"] >> resolution;
+	buckets.clear();
+	const YAML::Node &seq=n["buckets"];
+	for (unsigned i=0;i<seq.size();i++) {
+		Bucket b;
+		seq[i][0] >> b.time;
+		seq[i][1] >> b.count;
+		seq[i][2] >> b.min;
+		seq[i][3] >> b.max;
+		seq[i][4] >> b.mean;
+		seq[i][5] >> b.last;
+		buckets.push_back(b);
+	}
+	return n;
+}
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,90 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file dataSeriesMessage.h
+ */
+#ifndef DATA_SERIES_MESSAGE_H
+#define DATA_SERIES_MESSAGE_H
+
+#include <vector>
+#include <yaml-cpp/yaml.h>
+#include "message.h"
+
+namespace watcher {
+	namespace event {
+		/**
+		 * Request a downsampled DataPointMessage series from watcherd.
+		 *
+		 * watcherd keeps the values of each node's data series (the first
+		 * value of each DataPointMessage) summarized into buckets at several
+		 * resolutions.  A client asks for one series over a time range at
+		 * the resolution it can display, e.g. the range divided by the plot
+		 * width in pixels, and watcherd replies with a copy of the request
+		 * with @ref buckets filled in.  The reply's @ref resolution may be
+		 * coarser than requested when the finer summaries no longer cover
+		 * the start of the range.
+		 */
+		class DataSeriesMessage : public Message {
+			public:
+				/** The values which fell within one bucket of time. */
+				struct Bucket {
+					Timestamp time;		//< start of the bucket
+					uint32_t count;		//< number of values
+					double min;
+					double max;
+					double mean;
+					double last;		//< the value with the latest timestamp
+
+					Bucket() : time(0), count(0), min(0), max(0), mean(0), last(0) { }
+				};
+				typedef std::vector<Bucket> BucketList;
+
+				DataSeriesMessage(const NodeIdentifier& node = NodeIdentifier(), const std::string& dataName = std::string(),
+						Timestamp begin = 0, Timestamp end = Infinity, Timestamp resolution = 1000);
+				/*virtual*/ std::ostream& toStream(std::ostream&) const;
+
+				NodeIdentifier node;		//< the node the series is from
+				std::string dataName;		//< DataPointMessage::dataName of the series
+				Timestamp begin;		//< first timestamp to return (inclusive)
+				Timestamp end;			//< last timestamp to return (inclusive), Infinity for no bound
+				Timestamp resolution;		//< bucket width (milliseconds)
+				BucketList buckets;		//< filled in by watcherd in the reply, in time order
+
+				/** Serialize this message using a YAML::Emitter
+				 * @param e the emitter to serialize to
+				 * @return the emitter emitted to.
+				 */
+				virtual YAML::Emitter &serialize(YAML::Emitter &e) const;
+
+				/** Serialize from a YAML::Parser.
+				 * @param p the Parser to read from
+				 * @return the parser read from.
+				 */
+				virtual YAML::Node &serialize(YAML::Node &n);
+			private:
+				DECLARE_LOGGER();
+		};
+
+		typedef boost::shared_ptr<DataSeriesMessage> DataSeriesMessagePtr;
+
+		std::ostream& operator<< (std::ostream& os, const DataSeriesMessage& p);
+		bool operator== (const DataSeriesMessage& lhs, const DataSeriesMessage& rhs);
+		bool operator== (const DataSeriesMessage::Bucket& lhs, const DataSeriesMessage::Bucket& rhs);
+	}
+}
+#endif
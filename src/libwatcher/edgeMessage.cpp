@@ -25,6 +25,7 @@
 
 #include "marshalYAML.h"
 #include "edgeMessage.h"
+#include "messageFactory.h"
 #include "messageTypesAndVersions.h"
 #include "watcherGlobalFunctions.h"         // for address serialize(). 
 #include "colors.h"
@@ -239,15 +240,15 @@ namespace watcher {
 			node["addEdge"] >> addEdge;
 			const YAML::Node *subNode;
 			if (NULL!=(subNode=node.FindValue("node1Label"))) {
-				node1Label=LabelMessagePtr(new LabelMessage); 
+				node1Label=newPooledMessage<LabelMessage>(); 
 				node1Label->serialize(*(const_cast<YAML::Node*>(subNode))); 
 			}
 			if (NULL!=(subNode=node.FindValue("middleLabel"))) {
-				middleLabel=LabelMessagePtr(new LabelMessage);
+				middleLabel=newPooledMessage<LabelMessage>();
 				middleLabel->serialize(*(const_cast<YAML::Node*>(subNode))); 
 			}
 			if (NULL!=(subNode=node.FindValue("node2Label"))) {
-				node2Label=LabelMessagePtr(new LabelMessage);
+				node2Label=newPooledMessage<LabelMessage>();
 				node2Label->serialize(*(const_cast<YAML::Node*>(subNode))); 
 			}
 			node["bidirectional"] >> bidirectional;
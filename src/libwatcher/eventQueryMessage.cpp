@@ -0,0 +1,123 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file eventQueryMessage.cpp
+ */
+#include "eventQueryMessage.h"
+#include "logger.h"
+#include <boost/foreach.hpp>
+
+namespace watcher {
+namespace event {
+
+INIT_LOGGER(EventQueryMessage, "Message.EventQueryMessage");
+
+EventQueryMessage::EventQueryMessage(Timestamp begin_, Timestamp end_) :
+    Message(EVENT_QUERY_MESSAGE_TYPE, EVENT_QUERY_MESSAGE_VERSION),
+    begin(begin_), end(end_), limit(0), count(0), next(Infinity)
+{
+    TRACE_ENTER();
+    TRACE_EXIT();
+}
+
+std::ostream& operator<< (std::ostream& os, const EventQueryMessage& p)
+{
+    os << "[EventQueryMessage begin=" << p.begin << " end=" << p.end << " limit=" << p.limit << " count=" << p.count << " next=" << p.next;
+    os << " nodes=(";
+    BOOST_FOREACH(const NodeIdentifier& n, p.nodes)
+	os << ' ' << n;
+    os << " ) types=(";
+    BOOST_FOREACH(const MessageType& t, p.types)
+	os << ' ' << t;
+    os << " ) layers=(";
+    BOOST_FOREACH(const GUILayer& l, p.layers)
+	os << ' ' << l;
+    return os << " )]";
+}
+
+bool operator== (const EventQueryMessage& lhs, const EventQueryMessage& rhs)
+{
+    return lhs.begin == rhs.begin && lhs.end == rhs.end &&
+	lhs.limit == rhs.limit && lhs.count == rhs.count && lhs.next == rhs.next &&
+	lhs.nodes == rhs.nodes && lhs.types == rhs.types && lhs.layers == rhs.layers;
+}
+
+// virtual
+std::ostream& EventQueryMessage::toStream(std::ostream& os) const
+{
+    return Message::toStream(os) << *this;
+}
+
+YAML::Emitter &EventQueryMessage::serialize(YAML::Emitter &e) const {
+	e << YAML::Flow << YAML::BeginMap;
+	Message::serialize(e);
+	e << YAML::Key << "begin" << YAML::Value << begin;
+	e << YAML::Key << "end" << YAML::Value << end;
+	e << YAML::Key << "limit" << YAML::Value << limit;
+	e << YAML::Key << "count" << YAML::Value << count;
+	e << YAML::Key << "next" << YAML::Value << next;
+	e << YAML::Key << "nodes" << YAML::Value;
+		e << YAML::Flow << YAML::BeginSeq;
+		BOOST_FOREACH(const NodeIdentifier& n, nodes)
+			e << n.to_string();
+		e << YAML::EndSeq;
+	e << YAML::Key << "types" << YAML::Value;
+		e << YAML::Flow << YAML::BeginSeq;
+		BOOST_FOREACH(const MessageType& t, types)
+			e << (const unsigned int&)t;
+		e << YAML::EndSeq;
+	e << YAML::Key << "layers" << YAML::Value;
+		e << YAML::Flow << YAML::BeginSeq;
+		BOOST_FOREACH(const GUILayer& l, layers)
+			e << l;
+		e << YAML::EndSeq;
+	e << YAML::EndMap;
+	return e;
+}
+
+YAML::Node &EventQueryMessage::serialize(YAML::Node &node) {
+	// Do not serialize base data GTL - Message::serialize(node);
+	node["begin"] >> begin;
+	node["end"] >> end;
+	node["limit"] >> limit;
+	node["count"] >> count;
+	node["next"] >> next;
+	const YAML::Node &nodeSeq=node["nodes"];
+	for (unsigned i=0;i<nodeSeq.size();i++) {
+		std::string str;
+		nodeSeq[i] >> str;
+		nodes.push_back(NodeIdentifier::from_string(str));
+	}
+	const YAML::Node &typeSeq=node["types"];
+	for (unsigned i=0;i<typeSeq.size();i++) {
+		unsigned int t;
+		typeSeq[i] >> t;
+		types.push_back(static_cast<MessageType>(t));
+	}
+	const YAML::Node &layerSeq=node["layers"];
+	for (unsigned i=0;i<layerSeq.size();i++) {
+		GUILayer l;
+		layerSeq[i] >> l;
+		layers.push_back(l);
+	}
+	return node;
+}
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,79 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file eventQueryMessage.h
+ */
+#ifndef EVENT_QUERY_MESSAGE_H
+#define EVENT_QUERY_MESSAGE_H
+
+#include <vector>
+#include <yaml-cpp/yaml.h>
+#include "message.h"
+
+namespace watcher {
+	namespace event {
+		/**
+		 * Request a targeted set of events from the watcherd event database.
+		 *
+		 * Each selection set which is left empty matches everything, so a
+		 * default constructed query returns the entire database.  watcherd
+		 * replies with the matching events in timestamp order followed by
+		 * a copy of this message with @ref count filled in, which marks the
+		 * end of the result set.
+		 *
+		 * watcherd sends a limited number of events per reply.  When a
+		 * result is cut short the reply's @ref next is not Infinity; send
+		 * the query again with @ref begin set to it (and @ref limit reduced
+		 * by @ref count, if one was given) for the rest.
+		 */
+		class EventQueryMessage : public Message {
+			public:
+				EventQueryMessage(Timestamp begin = 0, Timestamp end = Infinity);
+				/*virtual*/ std::ostream& toStream(std::ostream&) const;
+
+				Timestamp begin;		//< first timestamp to match (inclusive)
+				Timestamp end;			//< last timestamp to match (inclusive), Infinity for no bound
+				std::vector<NodeIdentifier> nodes;	//< originating nodes to match
+				std::vector<MessageType> types;		//< event types to match
+				std::vector<GUILayer> layers;		//< layers to match
+				uint32_t limit;			//< max number of events to return, 0 for no limit
+				uint32_t count;			//< number of events returned (set by watcherd in the reply)
+				Timestamp next;			//< where the rest of the result begins, Infinity if there is no more (set by watcherd in the reply)
+
+				/** Serialize this message using a YAML::Emitter
+				 * @param e the emitter to serialize to
+				 * @return the emitter emitted to.
+				 */
+				virtual YAML::Emitter &serialize(YAML::Emitter &e) const;
+
+				/** Serialize from a YAML::Parser.
+				 * @param p the Parser to read from
+				 * @return the parser read from.
+				 */
+				virtual YAML::Node &serialize(YAML::Node &n);
+			private:
+				DECLARE_LOGGER();
+		};
+
+		typedef boost::shared_ptr<EventQueryMessage> EventQueryMessagePtr;
+
+		std::ostream& operator<< (std::ostream& os, const EventQueryMessage& p);
+		bool operator== (const EventQueryMessage& lhs, const EventQueryMessage& rhs);
+	}
+}
+#endif
@@ -53,7 +53,8 @@ namespace watcher {
 			version(other.version), 
 			type(other.type), 
 			timestamp(other.timestamp), 
-			fromNodeID(other.fromNodeID)
+			fromNodeID(other.fromNodeID),
+			trace(other.trace)
 		{
 			TRACE_ENTER();
 			TRACE_EXIT();
@@ -80,6 +81,7 @@ namespace watcher {
 			type=other.type;
 			timestamp=other.timestamp;
 			fromNodeID=other.fromNodeID;
+			trace=other.trace;
 			TRACE_EXIT();
 			return *this;
 		}
@@ -110,9 +112,9 @@ namespace watcher {
 		MessagePtr Message::unpack(YAML::Node &node) { 
 			// This is a little awkward: read the base message, create a derived message, 
 			// then copy the base data into the derived data. 
-			MessagePtr header(new Message); 
+			Message header; 
 			try { 
-				header->serialize(node); 
+				header.serialize(node); 
 			}
 			catch (YAML::ParserException &e) {
 				return MessagePtr();  // equiv to NULL
@@ -123,15 +125,15 @@ namespace watcher {
 			}
 
 			// create derived message instance based on type. 
-			MessagePtr m(createMessage(header->type)); 
+			MessagePtr m(createMessage(header.type)); 
 
 			// We use the data already read from the stream to 
 			// populate the base class data in the derived class 
 			// instance. This is not really a good thing, but due to
 			// limitions of the yaml-cpp library (see issue #148) and
 			// my lack of cleverness, it'll have to do "for now". 
-			// NOTE: typecast derived to base for oper=().
-			(static_cast<MessagePtr>(m))->operator=(*header);  
+			// NOTE: base class oper=() only.
+			m->Message::operator=(header);  
 
 			// Now read the rest of the YAML doc that contains the 
 			// data for the derived Message instance. 
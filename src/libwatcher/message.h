@@ -24,6 +24,7 @@
 #ifndef BASE_MESSAGE_H
 #define BASE_MESSAGE_H
 
+#include <vector>
 #include <boost/shared_ptr.hpp>
 #include <yaml-cpp/yaml.h>
 
@@ -39,6 +40,25 @@ namespace watcher {
      */
     namespace event {
 
+        /** The points along a message's path at which it can be trace stamped.
+         * See messageTrace.h.
+         */
+        enum TraceHop {
+            TRACE_FEEDER_SEND,  //< handed to the network by a feeder
+            TRACE_SERVER_RECV,  //< unmarshalled by watcherd
+            TRACE_DB_COMMIT,    //< written to the event database
+            TRACE_REPLAY,       //< sent to a stream's subscribers by the replay timer
+            TRACE_CLIENT_RECV,  //< received by a MessageStream client
+            TRACE_HOP_COUNT
+        };
+
+        /** When a message passed a hop, in microseconds since the epoch. */
+        struct TraceStamp {
+            TraceHop hop;
+            long long usec;
+        };
+        typedef std::vector<TraceStamp> TraceStamps;
+
         /** 
          * Base class for all messages generated from the test node daemon.
          */
@@ -76,6 +96,13 @@ namespace watcher {
 				 * it gets the message */
 				NodeIdentifier fromNodeID;
 
+				/** Trace stamps added as the message travels from its feeder to a
+				 * client, empty unless tracing is enabled.  They are not part of
+				 * the event: pack() leaves them out, so they are never stored in
+				 * the event database, and operator== ignores them.  DataMarshaller
+				 * sends them over the network alongside the message. */
+				TraceStamps trace;
+
 				/** Create a message. Should not be done directly */
 				Message();
 
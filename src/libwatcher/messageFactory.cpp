@@ -20,6 +20,7 @@
  * @author Geoff Lawler <geoff.lawler@sparta.com> 
  * @date 2009-07-15
  */
+#include "messageFactory.h"
 #include "messageTypesAndVersions.h"
 #include "message.h"
 #include "messageStatus.h"
@@ -38,6 +39,9 @@
 #include "subscribeStreamMessage.h"
 #include "streamDescriptionMessage.h" 
 #include "listStreamsMessage.h"
+#include "eventQueryMessage.h"
+#include "metricsMessage.h"
+#include "dataSeriesMessage.h"
 #include "dataPointMessage.h"
 #include "nodePropertiesMessage.h"
 
@@ -54,57 +58,66 @@ namespace watcher {
 					return MessagePtr(); 
 					break;
                 case MESSAGE_STATUS_TYPE:
-                    return MessageStatusPtr(new MessageStatus);
+                    return newPooledMessage<MessageStatus>();
                 case GPS_MESSAGE_TYPE:
-                    return GPSMessagePtr(new GPSMessage);
+                    return newPooledMessage<GPSMessage>();
                     break;
                 case LABEL_MESSAGE_TYPE:
-                    return LabelMessagePtr(new LabelMessage);
+                    return newPooledMessage<LabelMessage>();
                     break;
                 case EDGE_MESSAGE_TYPE:
-                    return EdgeMessagePtr(new EdgeMessage);
+                    return newPooledMessage<EdgeMessage>();
                     break;
                 case COLOR_MESSAGE_TYPE:
-                    return ColorMessagePtr(new ColorMessage);
+                    return newPooledMessage<ColorMessage>();
                     break;
                 case CONNECTIVITY_MESSAGE_TYPE:
-                    return ConnectivityMessagePtr(new ConnectivityMessage);
+                    return newPooledMessage<ConnectivityMessage>();
                     break;
                 case NODE_STATUS_MESSAGE_TYPE:
-                    return NodeStatusMessagePtr(new NodeStatusMessage);
+                    return newPooledMessage<NodeStatusMessage>();
                     break;
                 case DATA_POINT_MESSAGE_TYPE:
-                    return DataPointMessagePtr(new DataPointMessage);
+                    return newPooledMessage<DataPointMessage>();
                     break;
                 case NODE_PROPERTIES_MESSAGE_TYPE:
-                    return NodePropertiesMessagePtr(new NodePropertiesMessage);
+                    return newPooledMessage<NodePropertiesMessage>();
                     break;
                 case SEEK_MESSAGE_TYPE:
-                    return SeekMessagePtr(new SeekMessage);
+                    return newPooledMessage<SeekMessage>();
                     break;
                 case START_MESSAGE_TYPE:
-                    return StartMessagePtr(new StartMessage);
+                    return newPooledMessage<StartMessage>();
                     break;
                 case STOP_MESSAGE_TYPE:
-                    return StopMessagePtr(new StopMessage);
+                    return newPooledMessage<StopMessage>();
                     break;
                 case SPEED_MESSAGE_TYPE:
-                    return SpeedMessagePtr(new SpeedMessage);
+                    return newPooledMessage<SpeedMessage>();
                     break;
                 case PLAYBACK_TIME_RANGE_MESSAGE_TYPE:
-                    return PlaybackTimeRangeMessagePtr(new PlaybackTimeRangeMessage);
+                    return newPooledMessage<PlaybackTimeRangeMessage>();
                     break;
                 case MESSAGE_STREAM_FILTER_MESSAGE_TYPE:
-                    return MessageStreamFilterMessagePtr(new MessageStreamFilterMessage);
+                    return newPooledMessage<MessageStreamFilterMessage>();
                     break;
                 case SUBSCRIBE_STREAM_MESSAGE_TYPE:
-                    return SubscribeStreamMessagePtr(new SubscribeStreamMessage);
+                    return newPooledMessage<SubscribeStreamMessage>();
                     break;
                 case STREAM_DESCRIPTION_MESSAGE_TYPE:
-                    return StreamDescriptionMessagePtr(new StreamDescriptionMessage);
+                    return newPooledMessage<StreamDescriptionMessage>();
                     break;
                 case LIST_STREAMS_MESSAGE_TYPE:
-                    return ListStreamsMessagePtr(new ListStreamsMessage);
+                    return newPooledMessage<ListStreamsMessage>();
+                    break;
+                case EVENT_QUERY_MESSAGE_TYPE:
+                    return newPooledMessage<EventQueryMessage>();
+                    break;
+                case METRICS_MESSAGE_TYPE:
+                    return newPooledMessage<MetricsMessage>();
+                    break;
+                case DATA_SERIES_MESSAGE_TYPE:
+                    return newPooledMessage<DataSeriesMessage>();
                     break;
 				case USER_DEFINED_MESSAGE_TYPE:
 					return MessagePtr(); 
@@ -95,3 +95,9 @@ bool MessageHandler::handleMessagesSent(const std::vector<event::MessagePtr> &me
     return false;
 }
 
+// virtual 
+void MessageHandler::handleConnect(ConnectionPtr)
+{
+    TRACE_ENTER();
+    TRACE_EXIT();
+}
@@ -80,6 +80,16 @@ namespace watcher
              */
             virtual bool handleMessagesSent(const std::vector<event::MessagePtr> &messages);
 
+            /**
+             * Notification that a client connection has been established, each time it
+             * is, including when it is reestablished after being lost.  Messages sent
+             * from here go out before any which were queued while disconnected.
+             * Default does nothing.
+             *
+             * @param[in] conn the connection
+             */
+            virtual void handleConnect(ConnectionPtr conn);
+
         private:
 
             DECLARE_LOGGER();
@@ -17,8 +17,10 @@
  */
 
 #include <assert.h>
+#include <boost/foreach.hpp>
 
 #include "messageStream.h"
+#include "clientConnection.h"
 #include "libwatcher/startWatcherMessage.h"
 #include "libwatcher/stopWatcherMessage.h"
 #include "libwatcher/seekWatcherMessage.h"
@@ -28,6 +30,10 @@
 #include "libwatcher/listStreamsMessage.h"
 #include "libwatcher/subscribeStreamMessage.h"
 #include "libwatcher/streamDescriptionMessage.h"
+#include "libwatcher/eventQueryMessage.h"
+#include "libwatcher/metricsMessage.h"
+#include "libwatcher/dataSeriesMessage.h"
+#include "libwatcher/messageTrace.h"
 #include "logger.h"
 
 using namespace watcher;
@@ -46,6 +52,7 @@ MessageStream::MessageStream(
     messagesArrived(0),
     messagesDropped(0),
     messageStreamFilters(),
+    messageFilteringEnabled(false),
     streamRate(streamRate_),
     streamStartTime(startTime_),
     serverName(serverName_),
@@ -53,7 +60,14 @@ MessageStream::MessageStream(
     connection(),
     messageCache(),
     messageCacheMutex(),
-    readReady(false)
+    readReady(false),
+    connections(0),
+    received(false),
+    lastReceived(0),
+    live(false),
+    playing(false),
+    subscribed(false),
+    subscribedStream(0)
 {
     TRACE_ENTER();
     connection=ClientPtr(new Client(serverName, serviceName)); 
@@ -91,9 +105,20 @@ void MessageStream::initConnection()
     TRACE_ENTER();
     connection->removeMessageHandler(shared_from_this()); 
     connection->addMessageHandler(shared_from_this()); 
-    // sending a message will attempt connection if not connected. 
-    setStreamTimeStart(streamStartTime);
-    setStreamRate(streamRate);
+    connection->setReconnect(true);
+    bool resuming;
+    {
+        lock_guard<mutex> lock(resumeMutex);
+        resuming=connections>0;
+    }
+    if (resuming) {
+        // handleConnect() puts the stream back where it was
+        connection->connect(true);
+    } else {
+        // sending a message will attempt connection if not connected. 
+        setStreamTimeStart(streamStartTime);
+        setStreamRate(streamRate);
+    }
     TRACE_EXIT();
 }
 
@@ -108,6 +133,12 @@ bool MessageStream::setStreamTimeStart(const Timestamp &startTime)
 {
     TRACE_ENTER();
     LOG_DEBUG("Setting stream start time to " << startTime); 
+    {
+        lock_guard<mutex> lock(resumeMutex);
+        streamStartTime=startTime;
+        received=false;
+        live=(startTime==SeekMessage::eof);
+    }
     SeekMessagePtr mess(new SeekMessage(startTime)); 
     bool retVal=connection->sendMessage(mess); 
     TRACE_EXIT_RET(retVal);
@@ -118,6 +149,12 @@ bool MessageStream::setStreamRate(const float &messageStreamRate)
 {
     TRACE_ENTER();
     LOG_DEBUG("Setting message stream rate to " << messageStreamRate); 
+    {
+        lock_guard<mutex> lock(resumeMutex);
+        streamRate=messageStreamRate;
+        if (messageStreamRate<1.0)
+            live=false;         // falls behind, or goes back from, the live end
+    }
     SpeedMessagePtr mess(new SpeedMessage(messageStreamRate)); 
     bool retVal=connection->sendMessage(mess); 
     TRACE_EXIT_RET(retVal);
@@ -142,6 +179,31 @@ bool MessageStream::getNextMessage(MessagePtr &newMessage)
     readReady=messageCache.size()>0; 
     LOG_DEBUG("Setting readReady to " << (readReady?"true":"false")); 
     LOG_DEBUG("MessageCache size: " << messageCache.size()); 
+    lock.unlock();
+
+    TRACE_EXIT_RET(true);
+    return true;
+}
+
+bool MessageStream::getNextMessages(vector<MessagePtr> &messages, const posix_time::time_duration &timeout)
+{
+    TRACE_ENTER();
+    if(!connection) 
+    {
+        TRACE_EXIT_RET(false);
+        return false;
+    }
+
+    unique_lock<mutex> lock(messageCacheMutex); 
+    if (!readReady && timeout>posix_time::time_duration(0, 0, 0)) {
+        posix_time::ptime until=posix_time::microsec_clock::universal_time()+timeout;
+        while(!readReady && messageCacheCond.timed_wait(lock, until))
+            ;
+    }
+    messages.insert(messages.end(), messageCache.begin(), messageCache.end());
+    messageCache.clear();
+    readReady=false;
+    lock.unlock();
 
     TRACE_EXIT_RET(true);
     return true;
@@ -158,6 +220,10 @@ bool MessageStream::isStreamReadable() const
 bool MessageStream::addMessageFilter(const MessageStreamFilterPtr filter)
 {
     TRACE_ENTER();
+    {
+        lock_guard<mutex> lock(resumeMutex);
+        messageStreamFilters.push_back(filter);
+    }
     MessageStreamFilterMessagePtr mess(new MessageStreamFilterMessage(*filter));
     mess->applyFilter=true;
     mess->enableAllFiltering=messageFilteringEnabled;
@@ -169,6 +235,14 @@ bool MessageStream::addMessageFilter(const MessageStreamFilterPtr filter)
 bool MessageStream::removeMessageFilter(const MessageStreamFilterPtr filter)
 {
     TRACE_ENTER();
+    {
+        lock_guard<mutex> lock(resumeMutex);
+        for (MessageStreamFilterListIterator f=messageStreamFilters.begin(); f!=messageStreamFilters.end(); )
+            if (**f==*filter)
+                f=messageStreamFilters.erase(f);
+            else
+                ++f;
+    }
     MessageStreamFilterMessagePtr mess(new MessageStreamFilterMessage(*filter));
     mess->applyFilter=false;
     mess->enableAllFiltering=messageFilteringEnabled;
@@ -203,6 +277,10 @@ std::ostream &MessageStream::toStream(std::ostream &out) const
 bool MessageStream::startStream()
 {
     TRACE_ENTER();
+    {
+        lock_guard<mutex> lock(resumeMutex);
+        playing=true;
+    }
     StartMessagePtr mess(new StartMessage); 
     bool retVal=connection->sendMessage(mess); 
     TRACE_EXIT_RET((retVal==true?"true":"false")); 
@@ -212,6 +290,10 @@ bool MessageStream::startStream()
 bool MessageStream::stopStream()
 {
     TRACE_ENTER();
+    {
+        lock_guard<mutex> lock(resumeMutex);
+        playing=false;
+    }
     StopMessagePtr mess(new StopMessage); 
     bool retVal=connection->sendMessage(mess); 
     TRACE_EXIT_RET((retVal==true?"true":"false")); 
@@ -225,6 +307,11 @@ bool MessageStream::handleMessageArrive(ConnectionPtr conn, const MessagePtr &me
 
     messagesArrived++; 
 
+    if (!message->trace.empty()) {
+        traceStamp(*message, TRACE_CLIENT_RECV);
+        recordTrace(*message);
+    }
+
     // if (messageCache.size()>750)  { // Whoa, start dropping messages - the GUI cannot keep up.
     //     // messagesDropped++;
     //     // TRACE_EXIT_RET_BOOL(false);
@@ -234,6 +321,7 @@ bool MessageStream::handleMessageArrive(ConnectionPtr conn, const MessagePtr &me
 
     // We don't really add anything yet to a generic watcherdAPI client.
     bool retVal=WatcherdAPIMessageHandler::handleMessageArrive(conn, message); 
+    noteReceived(message);
     {
         lock_guard<mutex> lock(messageCacheMutex);
         messageCache.push_back(message); 
@@ -288,6 +376,60 @@ bool MessageStream::handleMessagesSent(const vector<MessagePtr> &messages)
     return retVal;
 }
 
+void MessageStream::noteReceived(const MessagePtr &message)
+{
+    if (!isFeederEvent(message->type))
+        return;
+    lock_guard<mutex> lock(resumeMutex);
+    received=true;
+    lastReceived=message->timestamp;
+}
+
+//virtual 
+void MessageStream::handleConnect(ConnectionPtr conn)
+{
+    TRACE_ENTER();
+
+    vector<MessagePtr> resume;
+    {
+        lock_guard<mutex> lock(resumeMutex);
+        if (connections++==0) {
+            // The first time, whatever was asked for before connecting goes out as it is.
+            TRACE_EXIT();
+            return;
+        }
+
+        if (subscribed) {
+            LOG_INFO("Reconnected, subscribing to stream " << subscribedStream << " again");
+            resume.push_back(MessagePtr(new SubscribeStreamMessage(subscribedStream)));
+        } else {
+            // Messages already received are still in the cache for the caller to read, so
+            // carry on after them, unless the stream was live, when it stays live.
+            Timestamp from=(live || !received) ? streamStartTime : lastReceived;
+            LOG_INFO("Reconnected, resuming stream from " << from << " at rate " << streamRate);
+            resume.push_back(MessagePtr(new SeekMessage(from)));
+            resume.push_back(MessagePtr(new SpeedMessage(streamRate)));
+            BOOST_FOREACH(const MessageStreamFilterPtr &f, messageStreamFilters) {
+                MessageStreamFilterMessagePtr mess(new MessageStreamFilterMessage(*f));
+                mess->applyFilter=true;
+                mess->enableAllFiltering=messageFilteringEnabled;
+                resume.push_back(mess);
+            }
+        }
+        if (!description.empty())
+            resume.push_back(MessagePtr(new StreamDescriptionMessage(description)));
+        if (playing && !subscribed)
+            resume.push_back(MessagePtr(new StartMessage));
+    }
+
+    // These go out before anything sent while we were disconnected.
+    ClientConnectionPtr cc(dynamic_pointer_cast<ClientConnection>(conn));
+    if (cc)
+        cc->sendMessages(resume);
+
+    TRACE_EXIT();
+}
+
 void MessageStream::clearMessageCache()
 {
     TRACE_ENTER();
@@ -312,6 +454,7 @@ bool MessageStream::connect(bool async)
     TRACE_ENTER();
     connection->removeMessageHandler(shared_from_this());  // cannot do this in ctor as "this" is not well formed at the time. 
     connection->addMessageHandler(shared_from_this()); 
+    connection->setReconnect(true);
     bool rv = connection->connect(async);
     TRACE_EXIT_RET_BOOL(rv);
     return rv;
@@ -320,6 +463,11 @@ bool MessageStream::connect(bool async)
 bool MessageStream::subscribeToStream(uint32_t uid)
 {
     TRACE_ENTER();
+    {
+        lock_guard<mutex> lock(resumeMutex);
+        subscribed=true;
+        subscribedStream=uid;
+    }
     MessagePtr mess (new SubscribeStreamMessage(uid));
     bool retVal=connection->sendMessage(mess);
     TRACE_EXIT_RET(retVal);
@@ -335,9 +483,38 @@ bool MessageStream::listStreams()
     return retVal;
 }
 
+bool MessageStream::queryEvents(const EventQueryMessagePtr& query)
+{
+    TRACE_ENTER();
+    bool retVal=connection->sendMessage(query);
+    TRACE_EXIT_RET(retVal);
+    return retVal;
+}
+
+bool MessageStream::requestMetrics()
+{
+    TRACE_ENTER();
+    MessagePtr mess (new MetricsMessage());
+    bool retVal=connection->sendMessage(mess);
+    TRACE_EXIT_RET(retVal);
+    return retVal;
+}
+
+bool MessageStream::requestDataSeries(const DataSeriesMessagePtr& request)
+{
+    TRACE_ENTER();
+    bool retVal=connection->sendMessage(request);
+    TRACE_EXIT_RET(retVal);
+    return retVal;
+}
+
 bool MessageStream::setDescription(const std::string& desc)
 {
     TRACE_ENTER();
+    {
+        lock_guard<mutex> lock(resumeMutex);
+        description=desc;
+    }
     MessagePtr mess (new StreamDescriptionMessage(desc));
     bool retVal=connection->sendMessage(mess);
     TRACE_EXIT_RET(retVal);
@@ -347,7 +524,7 @@ bool MessageStream::setDescription(const std::string& desc)
 void MessageStream::reconnect()
 {
     TRACE_ENTER();
-    // close existing connection and create a new one.
+    // close existing connection and create a new one, which picks up where this one was.
     connection->close();
     connection = ClientPtr(new Client(serverName, serviceName)); 
     initConnection();
@@ -27,11 +27,14 @@
 
 #include <string>
 #include <deque>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/noncopyable.hpp>
 
 #include "libwatcher/watcherTypes.h"    // for Timestamp
 #include "libwatcher/message.h"         // for MessagePtr
+#include "libwatcher/watcherMessageFwd.h" // for EventQueryMessagePtr
 #include "declareLogger.h"
 
 #include "client.h"
@@ -47,6 +50,15 @@ namespace watcher
 
     /** 
      * The MessageStream class can be tested using the command line based client @ref messageStream2Text. 
+     *
+     * If the connection to the server is lost, the stream reconnects by itself, with backoff,
+     * and picks up where it left off: from the time of the last feeder message received, so
+     * nothing still waiting to be read by getNextMessage(s) comes again, at the same rate,
+     * with the same filters and description, playing or not as before.  A live stream (one
+     * last started at SeekMessage::eof and not slowed or reversed since) goes back to live.
+     * A stream subscribed to another with subscribeToStream() subscribes to it again, as that
+     * stream's owner decides where it is.  Messages at the same millisecond as the last one
+     * may be delivered again.
      */
     class MessageStream : 
         public WatcherdAPIMessageHandler, 
@@ -134,6 +146,16 @@ namespace watcher
          */
         bool getNextMessage(MessagePtr &newMessage);
 
+        /**
+         * Take all the messages which have arrived, waiting up to timeout for one to arrive 
+         * if there are none yet. Takes the cache lock once for the lot, so clients which 
+         * handle messages in batches should use this rather than getNextMessage().
+         * @param messages the messages are appended to this
+         * @param timeout how long to wait if no messages are waiting. 
+         * @return false on read message error - watcherd disconnect
+         */
+        bool getNextMessages(std::vector<MessagePtr> &messages, const boost::posix_time::time_duration &timeout); 
+
         /**
          * Returns true if a call to getNextMessage() would return immediately.
          * @retval true if getNextMessage() would not block
@@ -181,8 +203,8 @@ namespace watcher
 
         /**
          * Connect to the server.
-         * @param async, If true, connect() will attempt to connect once, and return true/false on success/failure.
-         *          If false, connect() will not return until connected, retrying every 2 seconds. Returns true.
+         * @param async, If true, connect() will wait for one connection attempt, and return true/false on success/failure.
+         *          If false, connect() will not return until connected, retrying with backoff. Returns true.
          * @retval true connection was established
          * @retval false connection failed
          */
@@ -218,6 +240,35 @@ namespace watcher
 	 */
 	bool listStreams();
 
+	/** Request a targeted set of events from the watcher server's event
+	 * database.  The matching events arrive through getNextMessage()
+	 * followed by an EventQueryMessage whose count field gives the number
+	 * of events returned.  The server returns a large result a page at a
+	 * time: if the reply's next field is not Infinity, query again from
+	 * there for the rest.
+	 * @param query the selection criteria
+	 * @retval true message was sent.
+	 * @retval false message send failed.
+	 */
+	bool queryEvents(const EventQueryMessagePtr& query);
+
+	/** Request a snapshot of the watcher server's counters and latency
+	 * histograms.  The reply arrives through getNextMessage() as a
+	 * MetricsMessage.
+	 * @retval true message was sent.
+	 * @retval false message send failed.
+	 */
+	bool requestMetrics();
+
+	/** Request a DataPointMessage series from the watcher server, summarized
+	 * into buckets of the request's resolution.  The reply arrives through
+	 * getNextMessage() as a DataSeriesMessage.
+	 * @param request the node, data name, time range and resolution wanted
+	 * @retval true message was sent.
+	 * @retval false message send failed.
+	 */
+	bool requestDataSeries(const DataSeriesMessagePtr& request);
+
 	/** Specify a human readable string used to identify this stream.
 	 * Watcher GUI clients can request a list of the shared streams using
 	 * the ListStreamsMessage.  This string will be associated with the UID
@@ -225,7 +276,8 @@ namespace watcher
 	 */
 	bool setDescription(const std::string& desc);
 
-	/** Closes the connection to the server and reconnects.
+	/** Closes the connection to the server and reconnects, resuming the stream
+	 * from where it was.
 	 */
 	void reconnect();
 
@@ -252,6 +304,12 @@ namespace watcher
         virtual bool handleMessageSent(const event::MessagePtr &message); 
         virtual bool handleMessagesSent(const std::vector<event::MessagePtr> &messages);
 
+        /**
+         * Put the stream back where it was, when the connection is reestablished.
+         * Overridden from base class.
+         */
+        virtual void handleConnect(ConnectionPtr conn);
+
         private:
         DECLARE_LOGGER();
 
@@ -284,6 +342,24 @@ namespace watcher
         boost::condition_variable messageCacheCond;
         bool readReady;
 
+        /** 
+         * Where the stream is, to resume it from after reconnecting.  Protected by 
+         * resumeMutex, as is messageStreamFilters. streamStartTime and streamRate are
+         * the last asked for.
+         **/
+        boost::mutex resumeMutex;
+        unsigned int connections;       // made so far, including lost ones
+        bool received;                  // lastReceived is set
+        Timestamp lastReceived;         // of the last feeder message to arrive
+        bool live;                      // following the live end of the stream
+        bool playing;
+        bool subscribed;
+        uint32_t subscribedStream;
+        std::string description;
+
+        /** Note the time of a message which arrived, if it is a feeder message. */
+        void noteReceived(const MessagePtr &message);
+
         /** 
          * private methods 
          **/
@@ -21,6 +21,17 @@
  * @date 2010-11-10
  */
 
+
+#include <map>
+#include <deque>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/unordered_set.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
 #include "messageStreamReactor.h"
 #include "logger.h"
 #include "gpsMessage.h"
@@ -28,6 +39,7 @@
 namespace watcher {
 
     using namespace boost;
+    using namespace boost::posix_time;
 
     INIT_LOGGER(MessageStreamReactor, "MessageStreamReactor");
 
@@ -37,7 +49,124 @@ namespace watcher {
      */
     class MSRImpl {
         public: 
-            MSRImpl(MessageStreamPtr ms) : mStream(ms), ioThread(NULL) {
+            class Worker;
+
+            /** A callback, how it's run, and how it's doing. */
+            struct Subscriber {
+                Subscriber(const std::string &n, const MessageStreamReactor::MessageCallbackFunction &f, MessageStreamReactor::Dispatch d) : 
+                    name(n), call(f), dispatch(d), worker(NULL), calls(0), totalLatency(0), maxLatency(0), backlog(0) { 
+                }
+                std::string name;
+                MessageStreamReactor::MessageCallbackFunction call;
+                MessageStreamReactor::Dispatch dispatch;
+                Worker *worker;             // for DISPATCH_THREAD
+
+                mutable boost::mutex statsMutex;
+                unsigned long calls;
+                long long totalLatency, maxLatency;     // microseconds
+                unsigned long backlog;
+
+                void queued() { 
+                    boost::mutex::scoped_lock lock(statsMutex);
+                    ++backlog;
+                }
+                void run(const MessagePtr &m, const ptime &arrived, bool wasQueued) { 
+                    call(m); 
+                    long long latency=(microsec_clock::universal_time()-arrived).total_microseconds(); 
+                    boost::mutex::scoped_lock lock(statsMutex);
+                    ++calls;
+                    totalLatency+=latency;
+                    if (latency>maxLatency)
+                        maxLatency=latency;
+                    if (wasQueued) 
+                        --backlog;
+                }
+            };
+
+            struct Job {
+                Subscriber *subscriber;
+                MessagePtr message;
+                ptime arrived;
+            };
+
+            /** A thread which runs the callbacks queued for it, in order. */
+            class Worker {
+                public:
+                    Worker() : stopping(false), thread(boost::bind(&Worker::run, this)) { }
+                    /** Stops the thread, dropping anything still queued. */
+                    ~Worker() {
+                        {
+                            boost::mutex::scoped_lock lock(mutex);
+                            stopping=true;
+                        }
+                        cond.notify_all(); 
+                        thread.join(); 
+                    }
+                    void push(const Job &job) {
+                        job.subscriber->queued(); 
+                        {
+                            boost::mutex::scoped_lock lock(mutex);
+                            jobs.push_back(job); 
+                        }
+                        cond.notify_one(); 
+                    }
+                private:
+                    void run() {
+                        while (true) {
+                            Job job;
+                            {
+                                boost::mutex::scoped_lock lock(mutex);
+                                while (jobs.empty() && !stopping)
+                                    cond.wait(lock); 
+                                if (stopping)
+                                    return;
+                                job=jobs.front();
+                                jobs.pop_front(); 
+                            }
+                            job.subscriber->run(job.message, job.arrived, true); 
+                        }
+                    }
+                    boost::mutex mutex;
+                    boost::condition_variable cond;
+                    std::deque<Job> jobs;
+                    bool stopping;
+                    boost::thread thread;       // last, so the rest is ready when it starts
+            };
+
+            typedef std::vector<Subscriber*> Subscribers;
+
+            /** 
+             * Who gets what. The reactor thread works from a snapshot, and 
+             * adding a callback replaces it, so callbacks can be added at 
+             * any time (even from a callback) without locking every message. 
+             */
+            struct Routes {
+                Subscribers feeder, control, newNode, newLayer, location;
+                /** addMessageTypeCallback() callbacks, by typeSlot() */
+                std::vector<Subscribers> byType;
+                /** and for types with no slot */
+                std::map<watcher::event::MessageType, Subscribers> otherTypes;
+                std::vector<Worker*> pool;
+            };
+
+            /** 
+             * Feeder and control message types are numbered from 0 and 0xff00, 
+             * so they fit in an array. 
+             */
+            static const size_t typeSlots=0x200;
+            static size_t typeSlot(watcher::event::MessageType type) {
+                unsigned int t=type;
+                if (t<0x100)
+                    return t;
+                if (t>=watcher::event::SEEK_MESSAGE_TYPE && t<watcher::event::SEEK_MESSAGE_TYPE+0x100)
+                    return 0x100+t-watcher::event::SEEK_MESSAGE_TYPE;
+                return typeSlots;
+            }
+
+            MSRImpl(MessageStreamPtr ms, unsigned int threads) : 
+                ioThread(NULL), mStream(ms), routes(new Routes), poolThreads(threads) {
+                if (!poolThreads)
+                    poolThreads=std::max(boost::thread::hardware_concurrency(), 2u); 
             }; 
             ~MSRImpl() {
                 if (ioThread) {
@@ -46,45 +175,92 @@ namespace watcher {
                     delete ioThread;
                     ioThread=NULL;
                 }
+                // Nothing is queued for the workers now, stop them before their subscribers go. 
+                BOOST_FOREACH(Worker *w, routes->pool) 
+                    delete w;
+                BOOST_FOREACH(Subscriber *s, subscribers) {
+                    delete s->worker; 
+                    delete s;
+                }
             } 
             
             boost::thread *ioThread;
 
-            // These need to be very fast lookup. 
-            // Maybe use tr1 unordered_list
-            // or a hash
-            typedef std::map<std::string, bool> SeenLayerMap;
-            SeenLayerMap seenLayerMap;
-            typedef std::map<unsigned int, bool> SeenNodeMap;
-            SeenNodeMap seenNodeMap;
+            // Only touched by the reactor thread. 
+            boost::unordered_set<unsigned long> seenNodes;
+            boost::unordered_set<std::string> seenLayers;
 
             MessageStreamPtr mStream;
 
-            // keep track of callbacks in multimap indexed by message type
-            typedef std::multimap<watcher::event::MessageType, MessageStreamReactor::MessageCallbackFunction> CallbackTable;
-            typedef std::pair<watcher::event::MessageType, MessageStreamReactor::MessageCallbackFunction> CallbackTablePair;
-            typedef std::pair<CallbackTable::const_iterator, CallbackTable::const_iterator> CallbackRange;
-            CallbackTable callbackTable; 
-
-            // Keep track of non-generic callbacks in vectors of functions.
-            typedef std::vector<MessageStreamReactor::NodeLocationUpdateFunction> NodeLocationUpdateFunctions; 
-            NodeLocationUpdateFunctions nodeLocationUpdateFunctions;
-
-            // Keep track of generic callbacks in vector as well.
-            typedef std::vector<MessageStreamReactor::MessageCallbackFunction> CallbackVector;
-            CallbackVector feederMessageCallbacks;
-            CallbackVector controlMessageCallbacks;
-            CallbackVector newNodeSeenCallbacks;
-            CallbackVector newLayerSeenCallbacks;
-
-            void doMessageCallbacks(const CallbackVector &v, MessagePtr m) { 
-                MSRImpl::CallbackVector::const_iterator i;
-                for (i=v.begin(); i!=v.end(); ++i)
-                    (*i)(m); 
+            // Every subscriber, in the order added; owned here. 
+            Subscribers subscribers; 
+            boost::shared_ptr<const Routes> routes;
+            mutable boost::mutex routesMutex;
+            unsigned int poolThreads;
+
+            /** Make a subscriber and let add() put it where it goes in a new Routes. */
+            void subscribe(const std::string &kind, const MessageStreamReactor::MessageCallbackFunction &f, 
+                    MessageStreamReactor::Dispatch dispatch, Subscribers Routes::*list, watcher::event::MessageType type=watcher::event::UNKNOWN_MESSAGE_TYPE) {
+                boost::mutex::scoped_lock lock(routesMutex);
+                Subscriber *s=new Subscriber(kind + " " + boost::lexical_cast<std::string>(subscribers.size()+1), f, dispatch); 
+                subscribers.push_back(s); 
+                if (dispatch==MessageStreamReactor::DISPATCH_THREAD) 
+                    s->worker=new Worker;
+
+                boost::shared_ptr<Routes> r(new Routes(*routes)); 
+                if (dispatch==MessageStreamReactor::DISPATCH_POOL && r->pool.empty()) 
+                    for (unsigned int i=0; i<poolThreads; i++) 
+                        r->pool.push_back(new Worker); 
+                if (list) 
+                    ((*r).*list).push_back(s); 
+                else {
+                    size_t slot=typeSlot(type); 
+                    if (slot<typeSlots) {
+                        r->byType.resize(typeSlots); 
+                        r->byType[slot].push_back(s); 
+                    }
+                    else
+                        r->otherTypes[type].push_back(s); 
+                }
+                routes=r;
+            }
+
+            boost::shared_ptr<const Routes> currentRoutes() const { 
+                boost::mutex::scoped_lock lock(routesMutex);
+                return routes;
+            }
+
+            static void dispatch(const Routes &r, const Subscribers &v, const MessagePtr &m, unsigned long node, const ptime &arrived) { 
+                BOOST_FOREACH(Subscriber *s, v) {
+                    switch (s->dispatch) {
+                        case MessageStreamReactor::DISPATCH_THREAD: {
+                            Job job={ s, m, arrived }; 
+                            s->worker->push(job); 
+                            break;
+                        }
+                        case MessageStreamReactor::DISPATCH_POOL: {
+                            Job job={ s, m, arrived }; 
+                            r.pool[node%r.pool.size()]->push(job);      // a node's messages always go to the same thread
+                            break;
+                        }
+                        default:
+                            s->run(m, arrived, false); 
+                    }
+                }
             }
     };
-    MessageStreamReactor::MessageStreamReactor(MessageStreamPtr ms) : 
-        impl(new MSRImpl(ms)) {
+
+    namespace {
+        /** Adapts a NodeLocationUpdateFunction to a GPS message callback */
+        void callNodeLocationUpdate(const MessageStreamReactor::NodeLocationUpdateFunction &f, MessagePtr m) {
+            // Only GPS messages are routed here, no need to check the cast. 
+            GPSMessagePtr gm=boost::static_pointer_cast<GPSMessage>(m); 
+            f(gm->x, gm->y, gm->z, gm->fromNodeID.to_string()); 
+        }
+    }
+
+    MessageStreamReactor::MessageStreamReactor(MessageStreamPtr ms, unsigned int poolThreads) : 
+        impl(new MSRImpl(ms, poolThreads)) {
         TRACE_ENTER();
         impl->mStream=ms;
         if (!impl->ioThread) 
@@ -93,63 +269,87 @@ namespace watcher {
     }
     MessageStreamReactor::~MessageStreamReactor() {
     }
-    void MessageStreamReactor::addNodeLocationUpdateFunction(NodeLocationUpdateFunction f) {
-       impl->nodeLocationUpdateFunctions.push_back(f);  
+    void MessageStreamReactor::addNodeLocationUpdateFunction(NodeLocationUpdateFunction f, Dispatch d) {
+        impl->subscribe("GPS", boost::bind(callNodeLocationUpdate, f, _1), d, &MSRImpl::Routes::location); 
     }
-    void MessageStreamReactor::addNewNodeSeenCallback(MessageCallbackFunction f) {
-       impl->newNodeSeenCallbacks.push_back(f);  
+    void MessageStreamReactor::addNewNodeSeenCallback(MessageCallbackFunction f, Dispatch d) {
+        impl->subscribe("new node", f, d, &MSRImpl::Routes::newNode); 
     }
-    void MessageStreamReactor::addNewLayerSeenCallback(MessageCallbackFunction f) {
-       impl->newLayerSeenCallbacks.push_back(f);  
+    void MessageStreamReactor::addNewLayerSeenCallback(MessageCallbackFunction f, Dispatch d) {
+        impl->subscribe("new layer", f, d, &MSRImpl::Routes::newLayer); 
     }
-    void MessageStreamReactor::addFeederMessageCallback(MessageCallbackFunction f) {
-       impl->feederMessageCallbacks.push_back(f);  
+    void MessageStreamReactor::addFeederMessageCallback(MessageCallbackFunction f, Dispatch d) {
+        impl->subscribe("feeder", f, d, &MSRImpl::Routes::feeder); 
     }
-    void MessageStreamReactor::addControlMessageCallback(MessageCallbackFunction f) {
-       impl->controlMessageCallbacks.push_back(f);  
+    void MessageStreamReactor::addControlMessageCallback(MessageCallbackFunction f, Dispatch d) {
+        impl->subscribe("control", f, d, &MSRImpl::Routes::control); 
     }
-    void MessageStreamReactor::addMessageTypeCallback(MessageCallbackFunction f, watcher::event::MessageType t) {
-        impl->callbackTable.insert(MSRImpl::CallbackTablePair(t,f)); 
+    void MessageStreamReactor::addMessageTypeCallback(MessageCallbackFunction f, watcher::event::MessageType t, Dispatch d) {
+        impl->subscribe("type " + boost::lexical_cast<std::string>(static_cast<unsigned int>(t)), f, d, NULL, t); 
+    }
+    void MessageStreamReactor::getCallbackStats(std::vector<CallbackStats> &stats) const {
+        boost::mutex::scoped_lock lock(impl->routesMutex);
+        stats.clear();
+        BOOST_FOREACH(const MSRImpl::Subscriber *s, impl->subscribers) {
+            CallbackStats cs;
+            cs.name=s->name;
+            cs.dispatch=s->dispatch;
+            boost::mutex::scoped_lock statsLock(s->statsMutex);
+            cs.calls=s->calls;
+            cs.meanLatency=s->calls ? s->totalLatency/1000.0/s->calls : 0.0;
+            cs.maxLatency=s->maxLatency/1000.0;
+            cs.backlog=s->backlog;
+            stats.push_back(cs); 
+        }
     }
     void MessageStreamReactor::getMessageLoop() {
+        std::vector<MessagePtr> messages;
         while (true) {
             this_thread::interruption_point();
-            MessagePtr message;
-            while(impl->mStream && impl->mStream->getNextMessage(message)) {
+            messages.clear();
+            if (!impl->mStream || !impl->mStream->getNextMessages(messages, milliseconds(250))) {
+                this_thread::sleep(milliseconds(250));   // not connected, don't spin
+                continue;
+            }
+            if (messages.empty())
+                continue;
+
+            boost::shared_ptr<const MSRImpl::Routes> routes=impl->currentRoutes(); 
+            const MSRImpl::Routes &r=*routes;
+            ptime arrived=microsec_clock::universal_time();
+            BOOST_FOREACH(const MessagePtr &message, messages) {
                 LOG_DEBUG("Got message in MessageStreamReactor::getMessageLoop, type: " << message->type); 
+                unsigned long node=message->fromNodeID.to_v4().to_ulong(); 
                 if (!isFeederEvent(message->type)) {
-                    impl->doMessageCallbacks(impl->controlMessageCallbacks, message); 
-                    LOG_DEBUG("Sent control message to " << impl->controlMessageCallbacks.size() << " subscribers"); 
+                    MSRImpl::dispatch(r, r.control, message, node, arrived); 
+                    LOG_DEBUG("Sent control message to " << r.control.size() << " subscribers"); 
                 }
                 else {
-                    impl->doMessageCallbacks(impl->feederMessageCallbacks, message); 
-                    LOG_DEBUG("Sent feeder message to " << impl->feederMessageCallbacks.size() << " subscribers"); 
-                    if (impl->seenNodeMap.end()==impl->seenNodeMap.find(message->fromNodeID.to_v4().to_ulong())) {
-                        impl->doMessageCallbacks(impl->newNodeSeenCallbacks, message); 
-                        LOG_DEBUG("Invoked new node callback " << impl->newNodeSeenCallbacks.size() << " times."); 
-                        impl->seenNodeMap[message->fromNodeID.to_v4().to_ulong()]=true;
+                    MSRImpl::dispatch(r, r.feeder, message, node, arrived); 
+                    LOG_DEBUG("Sent feeder message to " << r.feeder.size() << " subscribers"); 
+                    if (impl->seenNodes.insert(node).second) {
+                        MSRImpl::dispatch(r, r.newNode, message, node, arrived); 
+                        LOG_DEBUG("Invoked new node callback " << r.newNode.size() << " times."); 
                     }
                     if (message->type==GPS_MESSAGE_TYPE) {
-                        GPSMessagePtr gm=boost::dynamic_pointer_cast<GPSMessage>(message);
-                        MSRImpl::NodeLocationUpdateFunctions::const_iterator i;
-                        for (i=impl->nodeLocationUpdateFunctions.begin(); i!=impl->nodeLocationUpdateFunctions.end(); ++i)
-                            (*i)(gm->x, gm->y, gm->z, gm->fromNodeID.to_string()); 
-                        LOG_DEBUG("Invoked node location update callback " << impl->nodeLocationUpdateFunctions.size() << " times."); 
+                        MSRImpl::dispatch(r, r.location, message, node, arrived); 
+                        LOG_DEBUG("Invoked node location update callback " << r.location.size() << " times."); 
                     }
                     GUILayer layer;
-                    if (hasLayer(message, layer) && impl->seenLayerMap.end()==impl->seenLayerMap.find(layer)) {
-                        impl->doMessageCallbacks(impl->newLayerSeenCallbacks, message); 
-                        LOG_DEBUG("Invoked new layer callback " << impl->newLayerSeenCallbacks.size() << " times."); 
-                        impl->seenLayerMap[layer]=true;
+                    if (hasLayer(message, layer) && impl->seenLayers.insert(layer).second) {
+                        MSRImpl::dispatch(r, r.newLayer, message, node, arrived); 
+                        LOG_DEBUG("Invoked new layer callback " << r.newLayer.size() << " times."); 
                     }
                 }
-                if (impl->callbackTable.size()) { 
-                    MSRImpl::CallbackRange range;
-                    range=impl->callbackTable.equal_range(message->type); 
-                    unsigned int cnt=0;
-                    for (MSRImpl::CallbackTable::const_iterator i=range.first; i!=range.second; ++i, cnt++)
-                        i->second(message); 
-                    LOG_DEBUG("Sent type " << message->type << " message to " << cnt << " subscribers"); 
+                size_t slot=MSRImpl::typeSlot(message->type); 
+                if (slot<r.byType.size()) {
+                    MSRImpl::dispatch(r, r.byType[slot], message, node, arrived); 
+                    LOG_DEBUG("Sent type " << message->type << " message to " << r.byType[slot].size() << " subscribers"); 
+                }
+                else if (!r.otherTypes.empty()) {
+                    std::map<watcher::event::MessageType, MSRImpl::Subscribers>::const_iterator i=r.otherTypes.find(message->type); 
+                    if (i!=r.otherTypes.end())
+                        MSRImpl::dispatch(r, i->second, message, node, arrived); 
                 }
             }
         }
@@ -23,6 +23,8 @@
 #ifndef WATCHER_MESSAGE_STREAM_REACTOR_H
 #define WATCHER_MESSAGE_STREAM_REACTOR_H
 
+#include <string>
+#include <vector>
 #include <boost/scoped_ptr.hpp>
 #include <boost/function.hpp>
 #include "libwatcher/messageTypesAndVersions.h"
@@ -37,14 +39,33 @@ namespace watcher {
     /**
      * MessageStreamReactor is a wrapper around messages stream that 
      * calls functions when there is an action on a message stream. 
+     *
+     * Messages are read from the stream on the reactor's own thread. Each 
+     * callback is run as its Dispatch says: right there on the reactor's 
+     * thread, on a thread of its own, or on a pool of threads shared by 
+     * the reactor's pooled callbacks. A callback which is slow, like one 
+     * which updates a scene graph, should not be run inline as it holds 
+     * up every other callback and backs up the message stream. 
      */
     class MessageStreamReactor
     {
         public: 
+            /** Where a callback is run. */
+            enum Dispatch {
+                /** On the reactor's thread, in the order messages arrive. */
+                DISPATCH_INLINE,
+                /** On a thread of its own, in the order messages arrive. */
+                DISPATCH_THREAD,
+                /** On one of the reactor's pool of threads. Messages from the same node are handled in order. */
+                DISPATCH_POOL
+            };
+
             /** 
              * @param ms The messageStream to monitor for events. 
+             * @param poolThreads number of threads for DISPATCH_POOL callbacks, 0 
+             * for one per processor. They are only started if needed. 
              */
-            MessageStreamReactor(MessageStreamPtr ms); 
+            MessageStreamReactor(MessageStreamPtr ms, unsigned int poolThreads=0); 
             virtual ~MessageStreamReactor();
 
             /**
@@ -58,7 +79,7 @@ namespace watcher {
             typedef boost::function<bool (double x, double y, double z, const std::string &nodeID)> NodeLocationUpdateFunction;
 
             /** Add a function callback when a node's GPS data is updated. */
-            void addNodeLocationUpdateFunction(NodeLocationUpdateFunction); 
+            void addNodeLocationUpdateFunction(NodeLocationUpdateFunction, Dispatch dispatch=DISPATCH_INLINE); 
 
             /**
              * Basic function callback is a function called with the relevant message.
@@ -66,21 +87,34 @@ namespace watcher {
             typedef boost::function<void (MessagePtr m)> MessageCallbackFunction;
 
             /** Called when a feeder message arrives. */
-            void addFeederMessageCallback(MessageCallbackFunction); 
+            void addFeederMessageCallback(MessageCallbackFunction, Dispatch dispatch=DISPATCH_INLINE); 
 
             /** Called when a control message arrives. */
-            void addControlMessageCallback(MessageCallbackFunction); 
+            void addControlMessageCallback(MessageCallbackFunction, Dispatch dispatch=DISPATCH_INLINE); 
 
             /** Called when a new node is seen for the first time. */
-            void addNewNodeSeenCallback(MessageCallbackFunction); 
+            void addNewNodeSeenCallback(MessageCallbackFunction, Dispatch dispatch=DISPATCH_INLINE); 
 
             /** Called when a new layer is seen for the first time. */
-            void addNewLayerSeenCallback(MessageCallbackFunction); 
+            void addNewLayerSeenCallback(MessageCallbackFunction, Dispatch dispatch=DISPATCH_INLINE); 
 
             /**
              * Callback for specfic message type. A generic "subscription" API. 
              */
-            void addMessageTypeCallback(MessageCallbackFunction, watcher::event::MessageType type); 
+            void addMessageTypeCallback(MessageCallbackFunction, watcher::event::MessageType type, Dispatch dispatch=DISPATCH_INLINE); 
+
+            /** How a callback has been doing. */
+            struct CallbackStats {
+                std::string name;           // the kind of callback and the order it was added in, "feeder 1", "GPS 2", ...
+                Dispatch dispatch;
+                unsigned long calls;
+                double meanLatency;         // milliseconds from the reactor reading a message to the callback returning
+                double maxLatency;
+                unsigned long backlog;      // messages waiting for the callback
+            };
+
+            /** Get the stats of every callback, in the order they were added. */
+            void getCallbackStats(std::vector<CallbackStats> &stats) const; 
 
         protected:
 
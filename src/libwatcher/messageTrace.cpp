@@ -0,0 +1,131 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file messageTrace.cpp
+ */
+#include <cstdlib>
+#include <cstring>
+#include <ostream>
+#include <sys/time.h>
+#include <boost/foreach.hpp>
+#include <boost/thread/once.hpp>
+
+#include "messageTrace.h"
+#include "metrics.h"
+
+using namespace watcher;
+using namespace watcher::event;
+
+namespace {
+    const char *hopNames[TRACE_HOP_COUNT] = {
+        "feeder_send", "server_recv", "db_commit", "replay", "client_recv"
+    };
+
+    bool envTracing()
+    {
+        const char *s = getenv("WATCHER_TRACE");
+        return s && *s && strcmp(s, "0");
+    }
+
+    bool& tracing()
+    {
+        static bool enabled = envTracing();
+        return enabled;
+    }
+
+    /* Declared on first use, so that only processes which trace use up histogram slots. */
+    metrics::Histogram& hopHistogram(int hop)
+    {
+        static metrics::Histogram *hist[TRACE_HOP_COUNT + 1];
+        static boost::once_flag once = BOOST_ONCE_INIT;
+        struct Init {
+            static void declare()
+            {
+                for (int i = 0; i < TRACE_HOP_COUNT; ++i)
+                    hist[i] = new metrics::Histogram(std::string("trace.") + hopNames[i] + "_usec");
+                hist[TRACE_HOP_COUNT] = new metrics::Histogram("trace.end_to_end_usec");
+            }
+        };
+        boost::call_once(once, &Init::declare);
+        return *hist[hop];
+    }
+
+    void record(int hop, long long usec)
+    {
+        hopHistogram(hop).record(usec < 0 ? 0 : usec);
+    }
+}
+
+namespace watcher {
+    namespace event {
+
+        bool tracingEnabled()
+        {
+            return tracing();
+        }
+
+        void enableTracing(bool enable)
+        {
+            tracing() = enable;
+        }
+
+        const char *traceHopName(TraceHop hop)
+        {
+            return hop < TRACE_HOP_COUNT ? hopNames[hop] : "unknown";
+        }
+
+        void traceStamp(Message& m, TraceHop hop)
+        {
+            traceStamp(m.trace, hop);
+        }
+
+        void traceStamp(TraceStamps& trace, TraceHop hop)
+        {
+            timeval now;
+            gettimeofday(&now, 0);
+            TraceStamp stamp = { hop, now.tv_sec * 1000000LL + now.tv_usec };
+            trace.push_back(stamp);
+        }
+
+        void recordTrace(const Message& m)
+        {
+            recordTrace(m.timestamp, m.trace);
+        }
+
+        void recordTrace(Timestamp timestamp, const TraceStamps& trace)
+        {
+            if (trace.empty())
+                return;
+            long long prev = timestamp * 1000;
+            BOOST_FOREACH(const TraceStamp& t, trace) {
+                record(t.hop, t.usec - prev);
+                prev = t.usec;
+            }
+            record(TRACE_HOP_COUNT, prev - timestamp * 1000);
+        }
+
+        void reportTrace(std::ostream& os)
+        {
+            metrics::Snapshot snap;
+            metrics::snapshot(snap);
+            BOOST_FOREACH(const metrics::HistogramSummary& h, snap.histograms)
+                if (h.name.compare(0, 6, "trace.") == 0 && h.count)
+                    os << h << '\n';
+        }
+    }
+}
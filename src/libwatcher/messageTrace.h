@@ -0,0 +1,77 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file messageTrace.h
+ * Per-hop latency tracing of feeder events.
+ *
+ * When tracing is enabled a feeder stamps each event as it is sent, and
+ * watcherd and the receiving client add a stamp at each hop (see TraceHop).
+ * The stamps are not part of the event.  DataMarshaller sends them in a
+ * document of their own ahead of the message, they are never stored in the
+ * event database, and the replay starts a fresh set.  A message may be in use
+ * on several threads once it has been handed on, so watcherd stamps the
+ * db_commit hop on a copy of the stamps rather than on the message.  Each
+ * process adds the latencies it can see to the metrics histograms
+ * "trace.<hop>_usec" (the time from the previous stamp, or from the event's
+ * own timestamp for the first stamp) and "trace.end_to_end_usec":
+ *
+ * - watcherd reports feeder_send, server_recv, db_commit;
+ * - clients report replay (event timestamp to replay, so only meaningful
+ *   for live playback) and client_recv.
+ *
+ * Stamps are wall clock times, so hops between hosts include any clock
+ * offset between them.  Negative latencies are recorded as zero.
+ */
+#ifndef WATCHER_MESSAGE_TRACE_H
+#define WATCHER_MESSAGE_TRACE_H
+
+#include <iosfwd>
+#include "message.h"
+
+namespace watcher {
+    namespace event {
+
+        /** True if new trace stamps should be started.  Defaults to whether
+         * the WATCHER_TRACE environment variable is set to a non-zero value. */
+        bool tracingEnabled();
+
+        /** Turn tracing on or off for this process. */
+        void enableTracing(bool enable);
+
+        /** Return the name of a hop, e.g. "db_commit". */
+        const char *traceHopName(TraceHop hop);
+
+        /** Stamp a message with the current time. */
+        void traceStamp(Message& m, TraceHop hop);
+
+        /** Add a stamp with the current time to a set of stamps. */
+        void traceStamp(TraceStamps& trace, TraceHop hop);
+
+        /** Add the latencies between a message's stamps to the trace histograms. */
+        void recordTrace(const Message& m);
+
+        /** Add the latencies between the stamps of an event with the given
+         * timestamp to the trace histograms. */
+        void recordTrace(Timestamp timestamp, const TraceStamps& trace);
+
+        /** Write the trace histograms of this process, one per line. */
+        void reportTrace(std::ostream& os);
+    }
+}
+
+#endif /* WATCHER_MESSAGE_TRACE_H */
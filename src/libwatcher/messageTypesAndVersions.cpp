@@ -29,7 +29,7 @@ using namespace std;
 
 namespace watcher {
     namespace event {
-        bool hasLayer(MessagePtr m, GUILayer &layer)
+        bool hasLayer(const MessagePtr &m, GUILayer &layer)
         {
             bool retVal=
                 m->type==LABEL_MESSAGE_TYPE || 
@@ -122,6 +122,15 @@ namespace watcher {
 		case STREAM_DESCRIPTION_MESSAGE_TYPE:
                     out << static_cast<int>(STREAM_DESCRIPTION_MESSAGE_TYPE) << " (stream description)";
 		    break;
+		case EVENT_QUERY_MESSAGE_TYPE:
+                    out << static_cast<int>(EVENT_QUERY_MESSAGE_TYPE) << " (event query)";
+		    break;
+		case METRICS_MESSAGE_TYPE:
+                    out << static_cast<int>(METRICS_MESSAGE_TYPE) << " (metrics)";
+		    break;
+		case DATA_SERIES_MESSAGE_TYPE:
+                    out << static_cast<int>(DATA_SERIES_MESSAGE_TYPE) << " (data series)";
+		    break;
 
                 case USER_DEFINED_MESSAGE_TYPE: 
                     out << static_cast<int>(USER_DEFINED_MESSAGE_TYPE) << " (user defined)";
@@ -57,6 +57,9 @@ namespace watcher {
             SUBSCRIBE_STREAM_MESSAGE_TYPE = 0x0000ff06,
             STREAM_DESCRIPTION_MESSAGE_TYPE = 0x0000ff07,
             LIST_STREAMS_MESSAGE_TYPE = 0x0000ff08,
+            EVENT_QUERY_MESSAGE_TYPE = 0x0000ff09,
+            METRICS_MESSAGE_TYPE = 0x0000ff0a,
+            DATA_SERIES_MESSAGE_TYPE = 0x0000ff0b,
 
             USER_DEFINED_MESSAGE_TYPE = 0xffff0000
         } MessageType;
@@ -88,6 +91,9 @@ namespace watcher {
 	const unsigned int SUBSCRIBE_STREAM_MESSAGE_VERSION = 1;
 	const unsigned int STREAM_DESCRIPTION_MESSAGE_VERSION = 1;
 	const unsigned int LIST_STREAMS_MESSAGE_VERSION = 1;
+	const unsigned int EVENT_QUERY_MESSAGE_VERSION = 1;
+	const unsigned int METRICS_MESSAGE_VERSION = 1;
+	const unsigned int DATA_SERIES_MESSAGE_VERSION = 1;
 
         /**
          * GUI bits in the watcher have a concept of a layer which can be turned on or off.
@@ -127,7 +133,7 @@ namespace watcher {
          * @retval true if it does and the layer is put in 'layer'
          * @retval false if it does not.
          */
-        bool hasLayer(MessagePtr m, GUILayer &layer);
+        bool hasLayer(const MessagePtr &m, GUILayer &layer);
     }
 }
 
@@ -0,0 +1,386 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file metrics.cpp
+ */
+#include <cstring>
+#include <list>
+#include <ostream>
+#include <boost/thread.hpp>
+#include <boost/foreach.hpp>
+
+#include "metrics.h"
+#include "watcherTypes.h"
+
+using namespace watcher::metrics;
+
+namespace {
+
+    /* Metrics are read by snapshot() while other threads update them.
+     * Relaxed atomic loads and stores compile to plain moves, but keep the
+     * compiler from tearing or caching the values. */
+    template <typename T> T load(const T& v) { return __atomic_load_n(&v, __ATOMIC_RELAXED); }
+    template <typename T> void store(T& v, T x) { __atomic_store_n(&v, x, __ATOMIC_RELAXED); }
+
+    /* One thread's copy of every metric.  Only the owning thread writes to
+     * it, so it does so with plain relaxed stores; snapshot() reads it from
+     * another thread without a lock, so a snapshot can be a few updates
+     * behind but never blocks the thread being measured.  Slot
+     * max{Counters,Histograms} absorbs updates to metrics declared beyond
+     * the limit.
+     */
+    struct ThreadBlock {
+        int64_t counters[maxCounters + 1];
+        uint64_t buckets[maxHistograms + 1][histogramBuckets];
+        uint64_t sum[maxHistograms + 1];
+        uint64_t min[maxHistograms + 1];
+        uint64_t max[maxHistograms + 1];
+
+        ThreadBlock()
+        {
+            memset(this, 0, sizeof(*this));
+            for (size_t i = 0; i <= maxHistograms; ++i)
+                min[i] = ~uint64_t(0);
+        }
+
+        void merge(const ThreadBlock& b)
+        {
+            for (size_t i = 0; i < maxCounters; ++i)
+                counters[i] += load(b.counters[i]);
+            for (size_t h = 0; h < maxHistograms; ++h) {
+                for (size_t i = 0; i < histogramBuckets; ++i)
+                    buckets[h][i] += load(b.buckets[h][i]);
+                sum[h] += load(b.sum[h]);
+                uint64_t bmin = load(b.min[h]), bmax = load(b.max[h]);
+                if (bmin < min[h])
+                    min[h] = bmin;
+                if (bmax > max[h])
+                    max[h] = bmax;
+            }
+        }
+    };
+
+    void retire(ThreadBlock *b);
+
+    class Registry {
+        public:
+            /* Never destroyed, as threads may still exit (and retire their
+             * blocks) while static objects are being torn down. */
+            static Registry& instance()
+            {
+                static Registry *r = new Registry;
+                return *r;
+            }
+
+            size_t declareCounter(const std::string& name) { return declare(counterNames_, maxCounters, name); }
+            size_t declareHistogram(const std::string& name) { return declare(histogramNames_, maxHistograms, name); }
+
+            /* An object's metrics are added as it is created and removed
+             * before it is destroyed, so snapshot() never sees a dead one. */
+            void add(const InstanceCounter *c)
+            {
+                boost::mutex::scoped_lock lock(lock_);
+                instanceCounters_.push_back(c);
+            }
+            void remove(const InstanceCounter *c)
+            {
+                boost::mutex::scoped_lock lock(lock_);
+                instanceCounters_.remove(c);
+            }
+            void add(const InstanceHistogram *h)
+            {
+                boost::mutex::scoped_lock lock(lock_);
+                instanceHistograms_.push_back(h);
+            }
+            void remove(const InstanceHistogram *h)
+            {
+                boost::mutex::scoped_lock lock(lock_);
+                instanceHistograms_.remove(h);
+            }
+
+            ThreadBlock& local()
+            {
+                ThreadBlock *b = tls_.get();
+                if (!b) {
+                    b = new ThreadBlock;
+                    {
+                        boost::mutex::scoped_lock lock(lock_);
+                        threads_.push_back(b);
+                    }
+                    tls_.reset(b);
+                }
+                return *b;
+            }
+
+            /* Called as a thread exits: keep its totals. */
+            void retire(ThreadBlock *b)
+            {
+                boost::mutex::scoped_lock lock(lock_);
+                retired_.merge(*b);
+                threads_.remove(b);
+                delete b;
+            }
+
+            void snapshot(Snapshot& out)
+            {
+                ThreadBlock *total = new ThreadBlock;   // too big for some thread stacks
+                std::vector<std::string> counterNames, histogramNames;
+                std::vector<std::pair<std::string, int64_t> > instanceCounters;
+                std::vector<HistogramSummary> instanceHistograms;
+                {
+                    boost::mutex::scoped_lock lock(lock_);
+                    total->merge(retired_);
+                    BOOST_FOREACH(ThreadBlock *b, threads_)
+                        total->merge(*b);
+                    counterNames = counterNames_;
+                    histogramNames = histogramNames_;
+                    BOOST_FOREACH(const InstanceCounter *c, instanceCounters_)
+                        instanceCounters.push_back(std::make_pair(c->name(), c->value()));
+                    BOOST_FOREACH(const InstanceHistogram *h, instanceHistograms_)
+                        instanceHistograms.push_back(h->summary());
+                }
+
+                out.time = watcher::getCurrentTime();
+                out.counters.clear();
+                out.histograms.clear();
+                for (size_t i = 0; i < counterNames.size(); ++i)
+                    out.counters.push_back(std::make_pair(counterNames[i], total->counters[i]));
+                for (size_t h = 0; h < histogramNames.size(); ++h)
+                    out.histograms.push_back(summarize(histogramNames[h], total->buckets[h], total->sum[h], total->min[h], total->max[h]));
+                out.counters.insert(out.counters.end(), instanceCounters.begin(), instanceCounters.end());
+                out.histograms.insert(out.histograms.end(), instanceHistograms.begin(), instanceHistograms.end());
+
+                delete total;
+            }
+
+            static HistogramSummary summarize(const std::string& name, const uint64_t *buckets, uint64_t sum, uint64_t min, uint64_t max)
+            {
+                HistogramSummary s;
+                s.name = name;
+                for (size_t i = 0; i < histogramBuckets; ++i)
+                    s.count += buckets[i];
+                if (!s.count)
+                    return s;
+
+                s.min = min;
+                s.max = max;
+                s.sum = sum;
+
+                const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+                uint64_t *results[] = { &s.p50, &s.p90, &s.p99, &s.p999 };
+                uint64_t seen = 0;
+                size_t q = 0;
+                for (size_t i = 0; i < histogramBuckets && q < 4; ++i) {
+                    seen += buckets[i];
+                    while (q < 4 && seen >= quantiles[q] * s.count) {
+                        uint64_t v = bucketUpperBound(i);
+                        *results[q++] = v > s.max ? s.max : v;
+                    }
+                }
+                return s;
+            }
+
+        private:
+            Registry() : tls_(&::retire) { }
+
+            size_t declare(std::vector<std::string>& names, size_t limit, const std::string& name)
+            {
+                boost::mutex::scoped_lock lock(lock_);
+                for (size_t i = 0; i < names.size(); ++i)
+                    if (names[i] == name)
+                        return i;
+                if (names.size() == limit)
+                    return limit;   // the overflow slot, which is never reported
+                names.push_back(name);
+                return names.size() - 1;
+            }
+
+            boost::mutex lock_;
+            std::vector<std::string> counterNames_;
+            std::vector<std::string> histogramNames_;
+            boost::thread_specific_ptr<ThreadBlock> tls_;
+            std::list<ThreadBlock*> threads_;
+            ThreadBlock retired_;
+            std::list<const InstanceCounter*> instanceCounters_;
+            std::list<const InstanceHistogram*> instanceHistograms_;
+    };
+
+    void retire(ThreadBlock *b)
+    {
+        Registry::instance().retire(b);
+    }
+}
+
+namespace watcher {
+    namespace metrics {
+
+        size_t bucketIndex(uint64_t value)
+        {
+            const uint64_t subBuckets = 1 << subBucketBits;
+            if (value < subBuckets)
+                return value;
+            if (value >> maxValueBits)
+                value = (uint64_t(1) << maxValueBits) - 1;
+
+            unsigned int msb = 0;   // position of the highest bit set
+            for (uint64_t v = value; v >>= 1; )
+                ++msb;
+            unsigned int shift = msb - subBucketBits;
+            return ((shift + 1) << subBucketBits) + ((value >> shift) & (subBuckets - 1));
+        }
+
+        uint64_t bucketUpperBound(size_t index)
+        {
+            const uint64_t subBuckets = 1 << subBucketBits;
+            if (index < subBuckets)
+                return index;
+            unsigned int shift = (index >> subBucketBits) - 1;
+            uint64_t sub = index & (subBuckets - 1);
+            return ((subBuckets + sub + 1) << shift) - 1;
+        }
+
+        Counter::Counter(const std::string& name) :
+            id_(Registry::instance().declareCounter(name))
+        {
+        }
+
+        void Counter::add(int64_t n)
+        {
+            int64_t& c = Registry::instance().local().counters[id_];
+            store(c, c + n);
+        }
+
+        Histogram::Histogram(const std::string& name) :
+            id_(Registry::instance().declareHistogram(name))
+        {
+        }
+
+        void Histogram::record(uint64_t value)
+        {
+            ThreadBlock& b = Registry::instance().local();
+            uint64_t& bucket = b.buckets[id_][bucketIndex(value)];
+            store(bucket, bucket + 1);
+            store(b.sum[id_], b.sum[id_] + value);
+            if (value < b.min[id_])
+                store(b.min[id_], value);
+            if (value > b.max[id_])
+                store(b.max[id_], value);
+        }
+
+        InstanceCounter::InstanceCounter(const std::string& name) : name_(name), value_(0)
+        {
+            Registry::instance().add(this);
+        }
+
+        InstanceCounter::~InstanceCounter()
+        {
+            Registry::instance().remove(this);
+        }
+
+        void InstanceCounter::add(int64_t n)
+        {
+            __atomic_fetch_add(&value_, n, __ATOMIC_RELAXED);
+        }
+
+        int64_t InstanceCounter::value() const
+        {
+            return load(value_);
+        }
+
+        InstanceHistogram::InstanceHistogram(const std::string& name) :
+            name_(name), sum_(0), min_(~uint64_t(0)), max_(0)
+        {
+            memset(buckets_, 0, sizeof(buckets_));
+            Registry::instance().add(this);
+        }
+
+        InstanceHistogram::~InstanceHistogram()
+        {
+            Registry::instance().remove(this);
+        }
+
+        void InstanceHistogram::record(uint64_t value)
+        {
+            __atomic_fetch_add(&buckets_[bucketIndex(value)], 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&sum_, value, __ATOMIC_RELAXED);
+            uint64_t m = load(min_);
+            while (value < m && !__atomic_compare_exchange_n(&min_, &m, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                ;
+            m = load(max_);
+            while (value > m && !__atomic_compare_exchange_n(&max_, &m, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                ;
+        }
+
+        HistogramSummary InstanceHistogram::summary() const
+        {
+            uint64_t buckets[histogramBuckets];
+            for (size_t i = 0; i < histogramBuckets; ++i)
+                buckets[i] = load(buckets_[i]);
+            return Registry::summarize(name_, buckets, load(sum_), load(min_), load(max_));
+        }
+
+        ScopedTimer::~ScopedTimer()
+        {
+            uint64_t usec = elapsed();
+            hist_.record(usec);
+            if (instance_)
+                instance_->record(usec);
+        }
+
+        uint64_t ScopedTimer::elapsed() const
+        {
+            timeval now;
+            gettimeofday(&now, 0);
+            int64_t usec = (now.tv_sec - start_.tv_sec) * 1000000LL + (now.tv_usec - start_.tv_usec);
+            return usec < 0 ? 0 : usec;    // the clock was set back
+        }
+
+        void snapshot(Snapshot& out)
+        {
+            Registry::instance().snapshot(out);
+        }
+
+        std::ostream& operator<< (std::ostream& os, const HistogramSummary& h)
+        {
+            return os << h.name << " count=" << h.count << " min=" << h.min << " mean=" << (h.count ? h.sum / h.count : 0) <<
+                " p50=" << h.p50 << " p90=" << h.p90 << " p99=" << h.p99 << " p99.9=" << h.p999 << " max=" << h.max;
+        }
+
+        std::ostream& operator<< (std::ostream& os, const Snapshot& s)
+        {
+            typedef std::pair<std::string, int64_t> CounterValue;
+            BOOST_FOREACH(const CounterValue& c, s.counters)
+                os << c.first << ' ' << c.second << '\n';
+            BOOST_FOREACH(const HistogramSummary& h, s.histograms)
+                os << h << '\n';
+            return os;
+        }
+
+        bool operator== (const HistogramSummary& a, const HistogramSummary& b)
+        {
+            return a.name == b.name && a.count == b.count && a.min == b.min && a.max == b.max &&
+                a.sum == b.sum && a.p50 == b.p50 && a.p90 == b.p90 && a.p99 == b.p99 && a.p999 == b.p999;
+        }
+
+        bool operator== (const Snapshot& a, const Snapshot& b)
+        {
+            return a.time == b.time && a.counters == b.counters && a.histograms == b.histograms;
+        }
+
+    } // namespace
+} // namespace
@@ -0,0 +1,177 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file metrics.h
+ * Counters and latency histograms for watching a process under load.
+ *
+ * Metrics are declared once, usually at namespace scope in the file that
+ * updates them:
+ * @code
+ * metrics::Counter messagesIn("connection.messages_in");
+ * metrics::Histogram unmarshalTime("connection.unmarshal_usec");
+ * ...
+ * messagesIn.add(n);
+ * metrics::ScopedTimer t(unmarshalTime);
+ * @endcode
+ *
+ * Each thread updates its own copy of every metric, so recording takes no
+ * lock.  snapshot() adds up the copies from all threads.
+ *
+ * Metrics for one of many objects, such as a connection or a stream, are
+ * InstanceCounters and InstanceHistograms held by the object and named
+ * after it, e.g. "connection.3.messages_in".  They are reported for as
+ * long as they exist.
+ */
+#ifndef WATCHER_METRICS_H
+#define WATCHER_METRICS_H
+
+#include <stdint.h>
+#include <sys/time.h>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+namespace watcher {
+    namespace metrics {
+
+        /** Maximum number of counters and histograms a process can declare. */
+        const size_t maxCounters = 128;
+        const size_t maxHistograms = 32;
+
+        /** Histograms keep 2^subBucketBits buckets for each power of two, so a
+         * recorded value is known to within 1/2^subBucketBits (12.5%).  Values
+         * up to 2^maxValueBits-1 are recorded; larger ones are clamped.
+         */
+        const unsigned int subBucketBits = 3;
+        const unsigned int maxValueBits = 36;
+        const size_t histogramBuckets = (maxValueBits - subBucketBits + 1) << subBucketBits;
+
+        /** Return the bucket holding a value. */
+        size_t bucketIndex(uint64_t value);
+
+        /** Return the largest value which falls in a bucket. */
+        uint64_t bucketUpperBound(size_t index);
+
+        /** A value which can be added to from any thread.  Counters may go
+         * down as well as up, for use as gauges (e.g. queue depth).
+         */
+        class Counter {
+            public:
+                /** Declare a counter.  Declaring the same name twice refers to the same counter. */
+                explicit Counter(const std::string& name);
+                void add(int64_t n = 1);
+                void sub(int64_t n = 1) { add(-n); }
+            private:
+                size_t id_;
+        };
+
+        /** A distribution of values, typically latencies in microseconds. */
+        class Histogram {
+            public:
+                /** Declare a histogram.  Declaring the same name twice refers to the same histogram. */
+                explicit Histogram(const std::string& name);
+                void record(uint64_t value);
+            private:
+                size_t id_;
+        };
+
+        /** The state of a histogram at the time of a snapshot. */
+        struct HistogramSummary {
+            std::string name;
+            uint64_t count;
+            uint64_t min;
+            uint64_t max;
+            uint64_t sum;
+            uint64_t p50;
+            uint64_t p90;
+            uint64_t p99;
+            uint64_t p999;
+
+            HistogramSummary() : count(0), min(0), max(0), sum(0), p50(0), p90(0), p99(0), p999(0) { }
+        };
+
+        /** A counter belonging to one object.  Updates are atomic adds, so
+         * any thread may make them.
+         */
+        class InstanceCounter : private boost::noncopyable {
+            public:
+                explicit InstanceCounter(const std::string& name);
+                ~InstanceCounter();
+                void add(int64_t n = 1);
+                void sub(int64_t n = 1) { add(-n); }
+                const std::string& name() const { return name_; }
+                int64_t value() const;
+            private:
+                std::string name_;
+                int64_t value_;
+        };
+
+        /** A histogram belonging to one object.  Updates are atomic, so any
+         * thread may make them.
+         */
+        class InstanceHistogram : private boost::noncopyable {
+            public:
+                explicit InstanceHistogram(const std::string& name);
+                ~InstanceHistogram();
+                void record(uint64_t value);
+                HistogramSummary summary() const;
+            private:
+                std::string name_;
+                uint64_t buckets_[histogramBuckets];
+                uint64_t sum_;
+                uint64_t min_;
+                uint64_t max_;
+        };
+
+        /** Records the microseconds between its construction and destruction
+         * into a histogram, and optionally into an object's histogram too. */
+        class ScopedTimer {
+            public:
+                explicit ScopedTimer(Histogram& h) : hist_(h), instance_(0) { gettimeofday(&start_, 0); }
+                ScopedTimer(Histogram& h, InstanceHistogram& i) : hist_(h), instance_(&i) { gettimeofday(&start_, 0); }
+                ~ScopedTimer();
+                /** Microseconds since construction. */
+                uint64_t elapsed() const;
+            private:
+                Histogram& hist_;
+                InstanceHistogram *instance_;
+                timeval start_;
+        };
+
+        /** The values of all metrics at one point in time. */
+        struct Snapshot {
+            Snapshot() : time(0) { }
+            int64_t time;  //< when the snapshot was taken (ms since the epoch)
+            std::vector<std::pair<std::string, int64_t> > counters;
+            std::vector<HistogramSummary> histograms;
+        };
+
+        /** Write a snapshot as text, one metric per line. */
+        std::ostream& operator<< (std::ostream&, const Snapshot&);
+        std::ostream& operator<< (std::ostream&, const HistogramSummary&);
+        bool operator== (const HistogramSummary&, const HistogramSummary&);
+        bool operator== (const Snapshot&, const Snapshot&);
+
+        /** Add up the metrics from all threads. */
+        void snapshot(Snapshot& out);
+
+    } // namespace
+} // namespace
+
+#endif /* WATCHER_METRICS_H */
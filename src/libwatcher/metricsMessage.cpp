@@ -0,0 +1,126 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file metricsMessage.cpp
+ */
+#include "metricsMessage.h"
+#include "logger.h"
+#include <boost/foreach.hpp>
+
+namespace watcher {
+namespace event {
+
+INIT_LOGGER(MetricsMessage, "Message.MetricsMessage");
+
+MetricsMessage::MetricsMessage() :
+    Message(METRICS_MESSAGE_TYPE, METRICS_MESSAGE_VERSION)
+{
+    TRACE_ENTER();
+    TRACE_EXIT();
+}
+
+std::ostream& operator<< (std::ostream& os, const MetricsMessage& p)
+{
+    return os << "[MetricsMessage time=" << p.snapshot.time << " counters=" << p.snapshot.counters.size() <<
+	" histograms=" << p.snapshot.histograms.size() << "]";
+}
+
+bool operator== (const MetricsMessage& lhs, const MetricsMessage& rhs)
+{
+    return lhs.snapshot == rhs.snapshot;
+}
+
+// virtual
+std::ostream& MetricsMessage::toStream(std::ostream& os) const
+{
+    return Message::toStream(os) << *this;
+}
+
+YAML::Emitter &MetricsMessage::serialize(YAML::Emitter &e) const {
+	typedef std::pair<std::string, int64_t> CounterValue;
+	e << YAML::Flow << YAML::BeginMap;
+	Message::serialize(e);
+	e << YAML::Key << "time" << YAML::Value << static_cast<long long>(snapshot.time);
+	e << YAML::Key << "counters" << YAML::Value;
+		e << YAML::Flow << YAML::BeginSeq;
+		BOOST_FOREACH(const CounterValue& c, snapshot.counters) {
+			e << YAML::Flow << YAML::BeginMap;
+			e << YAML::Key << "name" << YAML::Value << c.first;
+			e << YAML::Key << "value" << YAML::Value << static_cast<long long>(c.second);
+			e << YAML::EndMap;
+		}
+		e << YAML::EndSeq;
+	e << YAML::Key << "histograms" << YAML::Value;
+		e << YAML::Flow << YAML::BeginSeq;
+		BOOST_FOREACH(const metrics::HistogramSummary& h, snapshot.histograms) {
+			e << YAML::Flow << YAML::BeginMap;
+			e << YAML::Key << "name" << YAML::Value << h.name;
+			e << YAML::Key << "count" << YAML::Value << static_cast<unsigned long long>(h.count);
+			e << YAML::Key << "min" << YAML::Value << static_cast<unsigned long long>(h.min);
+			e << YAML::Key << "max" << YAML::Value << static_cast<unsigned long long>(h.max);
+			e << YAML::Key << "sum" << YAML::Value << static_cast<unsigned long long>(h.sum);
+			e << YAML::Key << "p50" << YAML::Value << static_cast<unsigned long long>(h.p50);
+			e << YAML::Key << "p90" << YAML::Value << static_cast<unsigned long long>(h.p90);
+			e << YAML::Key << "p99" << YAML::Value << static_cast<unsigned long long>(h.p99);
+			e << YAML::Key << "p999" << YAML::Value << static_cast<unsigned long long>(h.p999);
+			e << YAML::EndMap;
+		}
+		e << YAML::EndSeq;
+	e << YAML::EndMap;
+	return e;
+}
+
+YAML::Node &MetricsMessage::serialize(YAML::Node &node) {
+	// Do not serialize base data GTL - Message::serialize(node);
+	long long t;
+	node["time"] >> t;
+	snapshot.time = t;
+
+	snapshot.counters.clear();
+	const YAML::Node &counters=node["counters"];
+	for (unsigned i=0;i<counters.size();i++) {
+		std::string name;
+		long long val;
+		counters[i]["name"] >> name;
+		counters[i]["value"] >> val;
+		snapshot.counters.push_back(std::make_pair(name, static_cast<int64_t>(val)));
+	}
+
+	snapshot.histograms.clear();
+	const YAML::Node &histograms=node["histograms"];
+	for (unsigned i=0;i<histograms.size();i++) {
+		const YAML::Node &n=histograms[i];
+		metrics::HistogramSummary h;
+		unsigned long long v;
+		n["name"] >> h.name;
+		n["count"] >> v; h.count=v;
+		n["min"] >> v; h.min=v;
+		n["max"] >> v; h.max=v;
+		n["sum"] >> v; h.sum=v;
+		n["p50"] >> v; h.p50=v;
+		n["p90"] >> v; h.p90=v;
+		n["p99"] >> v; h.p99=v;
+		n["p999"] >> v; h.p999=v;
+		snapshot.histograms.push_back(h);
+	}
+	return node;
+}
+
+} // namespace
+
+} // namespace
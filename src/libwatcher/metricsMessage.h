@@ -0,0 +1,64 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file metricsMessage.h
+ */
+#ifndef METRICS_MESSAGE_H
+#define METRICS_MESSAGE_H
+
+#include <yaml-cpp/yaml.h>
+#include "message.h"
+#include "metrics.h"
+
+namespace watcher {
+	namespace event {
+		/**
+		 * Request the current metrics from watcherd.
+		 *
+		 * A client sends an empty MetricsMessage and watcherd replies with a
+		 * copy holding a snapshot of its counters and latency histograms.
+		 */
+		class MetricsMessage : public Message {
+			public:
+				MetricsMessage();
+				/*virtual*/ std::ostream& toStream(std::ostream&) const;
+
+				metrics::Snapshot snapshot;	//< filled in by watcherd in the reply
+
+				/** Serialize this message using a YAML::Emitter
+				 * @param e the emitter to serialize to
+				 * @return the emitter emitted to.
+				 */
+				virtual YAML::Emitter &serialize(YAML::Emitter &e) const;
+
+				/** Serialize from a YAML::Parser.
+				 * @param p the Parser to read from
+				 * @return the parser read from.
+				 */
+				virtual YAML::Node &serialize(YAML::Node &n);
+			private:
+				DECLARE_LOGGER();
+		};
+
+		typedef boost::shared_ptr<MetricsMessage> MetricsMessagePtr;
+
+		std::ostream& operator<< (std::ostream& os, const MetricsMessage& p);
+		bool operator== (const MetricsMessage& lhs, const MetricsMessage& rhs);
+	}
+}
+#endif
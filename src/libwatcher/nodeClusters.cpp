@@ -0,0 +1,211 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file nodeClusters.cpp
+ */
+#include <cmath>
+
+#include "nodeClusters.h"
+
+using namespace std;
+using namespace watcher;
+
+const size_t NodeClusters::none = static_cast<size_t>(-1);
+
+namespace {
+    // Keep cell coordinates well inside a long, whatever is asked for.
+    long toCell(double v)
+    {
+        const double limit = 1e15;
+        v = floor(v);
+        return static_cast<long>(v < -limit ? -limit : v > limit ? limit : v);
+    }
+}
+
+NodeClusters::NodeClusters() :
+    count(0), size_(1.0), sizeExponent(0), numRegroupings(0)
+{
+}
+
+void NodeClusters::update(size_t node, double x, double y, double z)
+{
+    boost::mutex::scoped_lock lock(mutex);
+
+    if (node >= locations.size())
+        locations.resize(node + 1);
+    Location& l = locations[node];
+
+    if (l.cluster == none) {
+        l.x = x, l.y = y, l.z = z;
+        insert(node);
+        ++count;
+        return;
+    }
+
+    Cluster& c = clusterList[l.cluster];
+    if (cellOf(x, y) == c.cell) {
+        c.sumX += x - l.x, c.sumY += y - l.y, c.sumZ += z - l.z;
+        l.x = x, l.y = y, l.z = z;
+    } else {
+        remove(node);
+        l.x = x, l.y = y, l.z = z;
+        insert(node);
+    }
+}
+
+void NodeClusters::clear()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    locations.clear();
+    clusterList.clear();
+    freeClusters.clear();
+    cellClusters.clear();
+    count = 0;
+}
+
+bool NodeClusters::setCellSize(double size)
+{
+    if (!(size > 0) || size > 1e300)
+        return false;
+
+    // Round up to a power of two.
+    int exponent;
+    double mantissa = frexp(size, &exponent);
+    if (mantissa == 0.5)
+        --exponent;
+
+    boost::mutex::scoped_lock lock(mutex);
+    if (exponent == sizeExponent)
+        return false;
+    sizeExponent = exponent;
+    size_ = ldexp(1.0, exponent);
+    regroup();
+    return true;
+}
+
+double NodeClusters::cellSize() const
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return size_;
+}
+
+size_t NodeClusters::size() const
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return count;
+}
+
+unsigned long NodeClusters::regroupings() const
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return numRegroupings;
+}
+
+size_t NodeClusters::clusters(vector<Summary>& out) const
+{
+    boost::mutex::scoped_lock lock(mutex);
+    size_t before = out.size();
+    for (size_t i = 0; i < clusterList.size(); ++i) {
+        const Cluster& c = clusterList[i];
+        if (c.members.empty())
+            continue;
+        Summary s;
+        s.id = i;
+        s.count = c.members.size();
+        s.node = c.members.front();
+        s.x = c.sumX / s.count;
+        s.y = c.sumY / s.count;
+        s.z = c.sumZ / s.count;
+        out.push_back(s);
+    }
+    return out.size() - before;
+}
+
+void NodeClusters::membership(vector<size_t>& out) const
+{
+    boost::mutex::scoped_lock lock(mutex);
+    out.resize(locations.size());
+    for (size_t n = 0; n < locations.size(); ++n)
+        out[n] = locations[n].cluster;
+}
+
+NodeClusters::Cell NodeClusters::cellOf(double x, double y) const
+{
+    return Cell(toCell(x / size_), toCell(y / size_));
+}
+
+void NodeClusters::insert(size_t node)
+{
+    Location& l = locations[node];
+    Cell cell = cellOf(l.x, l.y);
+
+    map<Cell, size_t>::iterator i = cellClusters.find(cell);
+    if (i == cellClusters.end()) {
+        size_t id;
+        if (freeClusters.empty()) {
+            id = clusterList.size();
+            clusterList.push_back(Cluster());
+        } else {
+            id = freeClusters.back();
+            freeClusters.pop_back();
+        }
+        Cluster& c = clusterList[id];
+        c.cell = cell;
+        c.sumX = c.sumY = c.sumZ = 0.0;
+        i = cellClusters.insert(make_pair(cell, id)).first;
+    }
+
+    Cluster& c = clusterList[i->second];
+    l.cluster = i->second;
+    l.slot = c.members.size();
+    c.members.push_back(node);
+    c.sumX += l.x, c.sumY += l.y, c.sumZ += l.z;
+}
+
+void NodeClusters::remove(size_t node)
+{
+    Location& l = locations[node];
+    Cluster& c = clusterList[l.cluster];
+
+    // Fill the hole with the last member.
+    size_t last = c.members.back();
+    c.members[l.slot] = last;
+    locations[last].slot = l.slot;
+    c.members.pop_back();
+
+    if (c.members.empty()) {
+        cellClusters.erase(c.cell);
+        freeClusters.push_back(l.cluster);
+    } else
+        c.sumX -= l.x, c.sumY -= l.y, c.sumZ -= l.z;
+    l.cluster = none;
+}
+
+void NodeClusters::regroup()
+{
+    clusterList.clear();
+    freeClusters.clear();
+    cellClusters.clear();
+    for (size_t n = 0; n < locations.size(); ++n) {
+        if (locations[n].cluster != none) {
+            locations[n].cluster = none;
+            insert(n);
+        }
+    }
+    ++numRegroupings;
+}
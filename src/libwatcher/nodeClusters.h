@@ -0,0 +1,125 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file nodeClusters.h
+ * Grouping nearby nodes, for drawing large networks.
+ */
+#ifndef WATCHER_NODE_CLUSTERS_H
+#define WATCHER_NODE_CLUSTERS_H
+
+#include <map>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+namespace watcher {
+
+    /** Nodes grouped by square cells of the x, y plane, so a GUI can draw one
+     * glyph for a crowd of nodes which would only be a blob on screen.
+     *
+     * The GUI picks the cell size from how many pixels a cell should cover,
+     * so the clusters split up as it zooms in.  The size is rounded up to a
+     * power of two, so the nodes are only regrouped when the zoom has changed
+     * by a factor of two, not every frame.  Between regroupings, a node which
+     * moves is taken out of its old cluster and put in its new one, so the
+     * cost of keeping the clusters up to date is in the number of nodes that
+     * move, not the number of nodes.
+     *
+     * Clusters are numbered.  A cluster keeps its number while it has nodes
+     * in it; the numbers of empty clusters are reused.
+     *
+     * Nodes are identified by the index WatcherGraph gives them.  All member
+     * functions may be called from any thread.
+     */
+    class NodeClusters {
+        public:
+            /** What a GUI needs to know to draw a cluster. */
+            struct Summary {
+                size_t id;              // the cluster's number
+                size_t count;           // nodes in it
+                size_t node;            // one of the nodes, the only one if count is 1
+                double x, y, z;         // centre of the nodes
+            };
+
+            /** Number of a node which is not in a cluster. */
+            static const size_t none;
+
+            NodeClusters();
+
+            /** Add node at (x, y, z), or move it there if it is already clustered. */
+            void update(size_t node, double x, double y, double z);
+
+            /** Forget all nodes. */
+            void clear();
+
+            /** Set the size of the cells nodes are grouped by. Rounded up to a power of two.
+             * @return true if the nodes were regrouped
+             */
+            bool setCellSize(double size);
+
+            /** The (rounded) cell size in use. */
+            double cellSize() const;
+
+            /** Number of nodes clustered. */
+            size_t size() const;
+
+            /** Get the clusters with nodes in them, in no particular order.
+             * @return the number of clusters
+             */
+            size_t clusters(std::vector<Summary> &out) const;
+
+            /** Get the cluster of every node: out[node] is the cluster's number, or none. */
+            void membership(std::vector<size_t> &out) const;
+
+            /** Number of times all the nodes were regrouped. */
+            unsigned long regroupings() const;
+
+        private:
+            typedef std::pair<long, long> Cell;
+
+            struct Location {
+                Location() : cluster(none) { }
+                size_t cluster;
+                size_t slot;            // where the node is in its cluster's members
+                double x, y, z;
+            };
+
+            struct Cluster {
+                Cell cell;
+                std::vector<size_t> members;
+                double sumX, sumY, sumZ;
+            };
+
+            Cell cellOf(double x, double y) const;
+            void insert(size_t node);
+            void remove(size_t node);
+            void regroup();
+
+            mutable boost::mutex mutex;
+            std::vector<Location> locations;
+            std::vector<Cluster> clusterList;
+            std::vector<size_t> freeClusters;
+            std::map<Cell, size_t> cellClusters;
+            size_t count;
+
+            double size_;
+            int sizeExponent;
+            unsigned long numRegroupings;
+    };
+}
+
+#endif // WATCHER_NODE_CLUSTERS_H
@@ -0,0 +1,62 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file nodeIdList.cpp
+ */
+#include "nodeIdList.h"
+
+using namespace watcher;
+
+void NodeIdList::push_back(const NodeIdentifier &id)
+{
+    if (!wide && id.is_v4()) {
+        v4Ids.push_back(id.to_v4().to_ulong());
+        return;
+    }
+    if (!wide)
+        widen();
+    wideIds.push_back(id);
+}
+
+void NodeIdList::clear()
+{
+    wide = false;
+    v4Ids.clear();
+    wideIds.clear();
+}
+
+bool NodeIdList::operator==(const NodeIdList &other) const
+{
+    if (!wide && !other.wide)
+        return v4Ids == other.v4Ids;
+    if (size() != other.size())
+        return false;
+    for (size_type i = 0; i < size(); ++i)
+        if ((*this)[i] != other[i])
+            return false;
+    return true;
+}
+
+void NodeIdList::widen()
+{
+    wideIds.reserve(v4Ids.size() + 1);
+    for (size_type i = 0; i < v4Ids.size(); ++i)
+        wideIds.push_back(boost::asio::ip::address_v4(v4Ids[i]));
+    v4Ids.clear();
+    wide = true;
+}
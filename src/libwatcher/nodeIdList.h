@@ -0,0 +1,120 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file nodeIdList.h
+ */
+#ifndef WATCHER_NODE_ID_LIST_H
+#define WATCHER_NODE_ID_LIST_H
+
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/iterator/iterator_facade.hpp>
+
+#include "smallVector.h"
+#include "watcherTypes.h"
+
+namespace watcher {
+
+    /**
+     * A list of node identifiers, kept in 4 bytes each while they are all
+     * IPv4 addresses.
+     *
+     * A NodeIdentifier has room for an IPv6 address and scope, so a
+     * std::vector of them spends about 8 times what an IPv4 network needs.
+     * Here IPv4 addresses are kept as 32 bit integers, the first few inside
+     * the list itself. Adding an IPv6 address moves the whole list over to
+     * full NodeIdentifiers.
+     *
+     * Elements are read by value, and are changed by clearing and adding,
+     * or by assigning a whole list.
+     */
+    class NodeIdList {
+        public:
+            typedef NodeIdentifier value_type;
+            typedef size_t size_type;
+
+            class const_iterator : public boost::iterator_facade<
+                                   const_iterator, const NodeIdentifier,
+                                   boost::random_access_traversal_tag, NodeIdentifier> {
+                public:
+                    const_iterator() : list(0), i(0) { }
+                    const_iterator(const NodeIdList *list_, size_t i_) : list(list_), i(i_) { }
+                private:
+                    friend class boost::iterator_core_access;
+                    NodeIdentifier dereference() const { return (*list)[i]; }
+                    bool equal(const const_iterator &other) const { return i == other.i; }
+                    void increment() { ++i; }
+                    void decrement() { --i; }
+                    void advance(ptrdiff_t n) { i += n; }
+                    ptrdiff_t distance_to(const const_iterator &other) const { return other.i - i; }
+                    const NodeIdList *list;
+                    size_t i;
+            };
+            typedef const_iterator iterator;
+
+            NodeIdList() : wide(false) { }
+            NodeIdList(const std::vector<NodeIdentifier> &ids) : wide(false) { assign(ids.begin(), ids.end()); }
+
+            NodeIdList &operator=(const std::vector<NodeIdentifier> &ids)
+            {
+                assign(ids.begin(), ids.end());
+                return *this;
+            }
+
+            template <class InputIterator>
+            void assign(InputIterator first, InputIterator last)
+            {
+                clear();
+                for (; first != last; ++first)
+                    push_back(*first);
+            }
+
+            const_iterator begin() const { return const_iterator(this, 0); }
+            const_iterator end() const { return const_iterator(this, size()); }
+
+            size_type size() const { return wide ? wideIds.size() : v4Ids.size(); }
+            bool empty() const { return size() == 0; }
+
+            NodeIdentifier operator[](size_type i) const
+            {
+                return wide ? wideIds[i] : NodeIdentifier(boost::asio::ip::address_v4(v4Ids[i]));
+            }
+
+            void push_back(const NodeIdentifier &id);
+            void clear();
+
+            /** Are all the identifiers IPv4 addresses, kept compactly? */
+            bool compact() const { return !wide; }
+
+            bool operator==(const NodeIdList &other) const;
+            bool operator!=(const NodeIdList &other) const { return !(*this == other); }
+
+        private:
+            /** Move to full NodeIdentifiers, to make room for an IPv6 address. */
+            void widen();
+
+            bool wide;
+            SmallVector<boost::uint32_t, 8> v4Ids;
+            std::vector<NodeIdentifier> wideIds;
+    };
+}
+
+#endif // WATCHER_NODE_ID_LIST_H
+
+// vim:sw=4
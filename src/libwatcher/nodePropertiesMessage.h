@@ -28,6 +28,7 @@
 #include <yaml-cpp/yaml.h>
 
 #include "message.h"
+#include "smallVector.h"
 #include "watcherColors.h"
 
 namespace watcher {
@@ -76,7 +77,7 @@ namespace watcher {
                 static std::string displayEffectToString(const NodePropertiesMessage::DisplayEffect &e); 
                 /** Convert a string into an effect. Sets argument to empty string if unsuccessful. */
                 static bool stringToDisplayEffect(const std::string &s, DisplayEffect &e); 
-                typedef std::vector<DisplayEffect> DisplayEffectList;
+                typedef SmallVector<DisplayEffect, 4> DisplayEffectList;
 
                 /** Suggested effects */
                 DisplayEffectList displayEffects;
@@ -99,7 +100,7 @@ namespace watcher {
                 static std::string nodePropertyToString(const NodeProperty &p);
                 /** Convert a string into a property. Sets argument to empty string if unsuccessful. */
                 static bool stringToNodeProperty(const std::string &s, NodeProperty &p);
-                typedef std::vector<NodeProperty> NodePropertyList;
+                typedef SmallVector<NodeProperty, 4> NodePropertyList;
 
                 /** Properties of the node */
                 NodePropertyList nodeProperties;
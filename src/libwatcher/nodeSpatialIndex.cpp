@@ -0,0 +1,259 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file nodeSpatialIndex.cpp
+ */
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "nodeSpatialIndex.h"
+
+using namespace std;
+using namespace watcher;
+
+namespace {
+    // Keep cell coordinates well inside a long, whatever is asked for.
+    long toCell(double v)
+    {
+        const double limit = 1e15;
+        v = floor(v);
+        return static_cast<long>(v < -limit ? -limit : v > limit ? limit : v);
+    }
+
+    void emptyBox(SpatialBox& b)
+    {
+        b.xMin = b.yMin = b.zMin = DBL_MAX;
+        b.xMax = b.yMax = b.zMax = -DBL_MAX;
+    }
+}
+
+NodeSpatialIndex::NodeSpatialIndex() :
+    count(0), cellSize(1.0), laidOutFor(0), laidOutExtent(0.0), xyValid(true), zValid(true), numRebuilds(0)
+{
+    emptyBox(box);
+}
+
+void NodeSpatialIndex::update(size_t node, double x, double y, double z)
+{
+    boost::mutex::scoped_lock lock(mutex);
+
+    if (node >= locations.size())
+        locations.resize(node + 1);
+    Location& l = locations[node];
+
+    if (l.indexed) {
+        if (l.x == x && l.y == y && l.z == z)
+            return;
+        // A node leaving the edge of the box may shrink it.
+        if ((l.x == box.xMin && x > l.x) || (l.x == box.xMax && x < l.x) ||
+            (l.y == box.yMin && y > l.y) || (l.y == box.yMax && y < l.y))
+            xyValid = false;
+        if ((l.z == box.zMin && z > l.z) || (l.z == box.zMax && z < l.z))
+            zValid = false;
+
+        Cell c = cellOf(x, y);
+        if (c != l.cell) {
+            remove(node);
+            l.x = x, l.y = y, l.z = z;
+            insert(node);
+        } else
+            l.x = x, l.y = y, l.z = z;
+    } else {
+        l.indexed = true;
+        l.x = x, l.y = y, l.z = z;
+        insert(node);
+        ++count;
+    }
+
+    if (xyValid) {
+        box.xMin = min(box.xMin, x), box.xMax = max(box.xMax, x);
+        box.yMin = min(box.yMin, y), box.yMax = max(box.yMax, y);
+    }
+    if (zValid) {
+        box.zMin = min(box.zMin, z), box.zMax = max(box.zMax, z);
+    }
+
+    // Lay the grid out again if the nodes have outgrown it.
+    if (count > 2 * laidOutFor)
+        layout();
+    else if (xyValid) {
+        double extent = max(box.xMax - box.xMin, box.yMax - box.yMin);
+        if (extent > 2 * laidOutExtent || extent < laidOutExtent / 4)
+            layout();
+    }
+}
+
+void NodeSpatialIndex::clear()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    locations.clear();
+    cells.clear();
+    count = 0;
+    cellSize = 1.0;
+    laidOutFor = 0;
+    laidOutExtent = 0.0;
+    emptyBox(box);
+    xyValid = zValid = true;
+}
+
+size_t NodeSpatialIndex::size() const
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return count;
+}
+
+unsigned long NodeSpatialIndex::rebuilds() const
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return numRebuilds;
+}
+
+bool NodeSpatialIndex::bounds(SpatialBox& b) const
+{
+    boost::mutex::scoped_lock lock(mutex);
+    if (!count)
+        return false;
+    recomputeBounds();
+    b = box;
+    return true;
+}
+
+size_t NodeSpatialIndex::query(double xMin, double yMin, double xMax, double yMax, vector<size_t>& found) const
+{
+    boost::mutex::scoped_lock lock(mutex);
+    if (cells.empty() || xMin > xMax || yMin > yMax)
+        return 0;
+
+    size_t before = found.size();
+    Cell c0 = cellOf(xMin, yMin), c1 = cellOf(xMax, yMax);
+    long firstColumn = max(c0.first, cells.begin()->first.first);
+    long lastColumn = min(c1.first, cells.rbegin()->first.first);
+    if (firstColumn > lastColumn)
+        return 0;
+
+    // Look up each column of the query, unless that would be more work than
+    // looking at every occupied cell in between.
+    if (static_cast<unsigned long>(lastColumn - firstColumn) < cells.size()) {
+        for (long column = firstColumn; column <= lastColumn; ++column)
+            queryCells(cells.lower_bound(Cell(column, c0.second)), cells.upper_bound(Cell(column, c1.second)),
+                    xMin, yMin, xMax, yMax, c0.second, c1.second, found);
+    } else
+        queryCells(cells.lower_bound(Cell(firstColumn, c0.second)), cells.upper_bound(Cell(lastColumn, c1.second)),
+                xMin, yMin, xMax, yMax, c0.second, c1.second, found);
+    return found.size() - before;
+}
+
+void NodeSpatialIndex::queryCells(Cells::const_iterator c, Cells::const_iterator end, double xMin, double yMin, double xMax, double yMax,
+        long bottom, long top, vector<size_t>& found) const
+{
+    for (; c != end; ++c) {
+        if (c->first.second < bottom || c->first.second > top)
+            continue;
+        for (vector<size_t>::const_iterator n = c->second.begin(); n != c->second.end(); ++n) {
+            const Location& l = locations[*n];
+            if (l.x >= xMin && l.x <= xMax && l.y >= yMin && l.y <= yMax)
+                found.push_back(*n);
+        }
+    }
+}
+
+NodeSpatialIndex::Cell NodeSpatialIndex::cellOf(double x, double y) const
+{
+    return Cell(toCell(x / cellSize), toCell(y / cellSize));
+}
+
+void NodeSpatialIndex::insert(size_t node)
+{
+    Location& l = locations[node];
+    l.cell = cellOf(l.x, l.y);
+    cells[l.cell].push_back(node);
+}
+
+void NodeSpatialIndex::remove(size_t node)
+{
+    Cells::iterator c = cells.find(locations[node].cell);
+    if (c == cells.end())
+        return;
+    vector<size_t>& v = c->second;
+    vector<size_t>::iterator i = find(v.begin(), v.end(), node);
+    if (i != v.end()) {
+        *i = v.back();
+        v.pop_back();
+    }
+    if (v.empty())
+        cells.erase(c);
+}
+
+void NodeSpatialIndex::layout()
+{
+    recomputeBounds();
+
+    // Aim for a couple of nodes per cell, if they were spread evenly.
+    double extent = count ? max(box.xMax - box.xMin, box.yMax - box.yMin) : 0.0;
+    double perSide = ceil(sqrt(count / 2.0));
+    cellSize = extent > 0 && perSide > 0 ? extent / perSide : 1.0;
+    laidOutFor = count;
+    laidOutExtent = extent;
+
+    cells.clear();
+    for (size_t n = 0; n < locations.size(); ++n)
+        if (locations[n].indexed)
+            insert(n);
+    ++numRebuilds;
+}
+
+void NodeSpatialIndex::recomputeBounds() const
+{
+    if (xyValid && zValid)
+        return;
+
+    if (!xyValid) {
+        box.xMin = box.yMin = DBL_MAX;
+        box.xMax = box.yMax = -DBL_MAX;
+        if (!cells.empty()) {
+            // The extremes are in the outermost occupied rows and columns.
+            long left = cells.begin()->first.first, right = cells.rbegin()->first.first;
+            long bottom = cells.begin()->first.second, top = bottom;
+            for (Cells::const_iterator c = cells.begin(); c != cells.end(); ++c) {
+                bottom = min(bottom, c->first.second);
+                top = max(top, c->first.second);
+            }
+            for (Cells::const_iterator c = cells.begin(); c != cells.end(); ++c) {
+                if (c->first.first != left && c->first.first != right &&
+                    c->first.second != bottom && c->first.second != top)
+                    continue;
+                for (vector<size_t>::const_iterator n = c->second.begin(); n != c->second.end(); ++n) {
+                    const Location& l = locations[*n];
+                    box.xMin = min(box.xMin, l.x), box.xMax = max(box.xMax, l.x);
+                    box.yMin = min(box.yMin, l.y), box.yMax = max(box.yMax, l.y);
+                }
+            }
+        }
+        xyValid = true;
+    }
+
+    if (!zValid) {
+        box.zMin = DBL_MAX;
+        box.zMax = -DBL_MAX;
+        for (vector<Location>::const_iterator l = locations.begin(); l != locations.end(); ++l)
+            if (l->indexed)
+                box.zMin = min(box.zMin, l->z), box.zMax = max(box.zMax, l->z);
+        zValid = true;
+    }
+}
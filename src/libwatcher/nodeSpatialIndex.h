@@ -0,0 +1,115 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file nodeSpatialIndex.h
+ * Finding nodes by location.
+ */
+#ifndef WATCHER_NODE_SPATIAL_INDEX_H
+#define WATCHER_NODE_SPATIAL_INDEX_H
+
+#include <map>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+namespace watcher {
+
+    /** An axis aligned box. */
+    struct SpatialBox {
+        double xMin, yMin, zMin;
+        double xMax, yMax, zMax;
+    };
+
+    /** A uniform grid over node locations, so the nodes in an area can be found
+     * without looking at every node.
+     *
+     * Nodes are bucketed by x and y into square cells; z is ignored for
+     * bucketing as exercises are mostly flat.  The cell size follows the
+     * spread and number of nodes: when either has grown (or the spread shrunk)
+     * a lot since the grid was laid out, it is laid out again, so cells hold a
+     * couple of nodes each.  Occupied cells are kept in a map, so an empty
+     * part of the grid costs nothing and finding a cell is O(log cells).
+     *
+     * The bounding box of all the nodes is kept as nodes move.  When a node on
+     * the edge of the box moves inward the box is recomputed on the next call
+     * to bounds(), from the nodes in the cells on the edge of the grid.
+     *
+     * Nodes are identified by the index WatcherGraph gives them.  All member
+     * functions may be called from any thread.
+     */
+    class NodeSpatialIndex {
+        public:
+            NodeSpatialIndex();
+
+            /** Add node at (x, y, z), or move it there if it is already indexed. */
+            void update(size_t node, double x, double y, double z);
+
+            /** Forget all nodes. */
+            void clear();
+
+            /** Number of nodes indexed. */
+            size_t size() const;
+
+            /** Get the box which holds every node.
+             * @return false if there are no nodes.
+             */
+            bool bounds(SpatialBox &box) const;
+
+            /** Find the nodes whose x and y are in the given rectangle.
+             * @param found the nodes are appended to this, in no particular order
+             * @return the number of nodes found
+             */
+            size_t query(double xMin, double yMin, double xMax, double yMax, std::vector<size_t> &found) const;
+
+            /** Number of times the grid has been laid out. */
+            unsigned long rebuilds() const;
+
+        private:
+            typedef std::pair<long, long> Cell;
+            typedef std::map<Cell, std::vector<size_t> > Cells;
+
+            struct Location {
+                Location() : indexed(false) { }
+                bool indexed;
+                double x, y, z;
+                Cell cell;
+            };
+
+            Cell cellOf(double x, double y) const;
+            void insert(size_t node);
+            void remove(size_t node);
+            void layout();
+            void recomputeBounds() const;
+            void queryCells(Cells::const_iterator c, Cells::const_iterator end, double xMin, double yMin, double xMax, double yMax,
+                    long bottom, long top, std::vector<size_t>& found) const;
+
+            mutable boost::mutex mutex;
+            std::vector<Location> locations;
+            Cells cells;
+            size_t count;
+
+            double cellSize;
+            size_t laidOutFor;          // number of nodes the cell size was chosen for
+            double laidOutExtent;       // and their spread
+
+            mutable SpatialBox box;
+            mutable bool xyValid, zValid;       // false if a node moved in from that edge of box
+            unsigned long numRebuilds;
+    };
+}
+
+#endif // WATCHER_NODE_SPATIAL_INDEX_H
@@ -0,0 +1,132 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file replayClock.cpp
+ */
+#include <cmath>
+#include <time.h>
+
+#include "replayClock.h"
+
+using namespace watcher;
+
+namespace watcher {
+    int64_t monotonicTime()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+    }
+}
+
+ReplayClock::ReplayClock(Timestamp t, float f) :
+    wall_(monotonicTime()), stream_(t), speed_(f), running_(false)
+{
+}
+
+double ReplayClock::position(int64_t wall) const
+{
+    if (!running_)
+        return stream_;
+    return stream_ + (wall - wall_) / 1000.0 * speed_;
+}
+
+void ReplayClock::rebase(int64_t wall)
+{
+    stream_ = position(wall);
+    wall_ = wall;
+}
+
+Timestamp ReplayClock::now() const
+{
+    boost::mutex::scoped_lock L(lock_);
+    return static_cast<Timestamp>(floor(position(monotonicTime())));
+}
+
+void ReplayClock::seek(Timestamp t)
+{
+    boost::mutex::scoped_lock L(lock_);
+    wall_ = monotonicTime();
+    stream_ = t;
+}
+
+void ReplayClock::speed(float f)
+{
+    boost::mutex::scoped_lock L(lock_);
+    rebase(monotonicTime());
+    speed_ = f;
+}
+
+float ReplayClock::speed() const
+{
+    boost::mutex::scoped_lock L(lock_);
+    return speed_;
+}
+
+void ReplayClock::start()
+{
+    boost::mutex::scoped_lock L(lock_);
+    if (!running_) {
+        wall_ = monotonicTime();
+        running_ = true;
+    }
+}
+
+void ReplayClock::stop()
+{
+    boost::mutex::scoped_lock L(lock_);
+    rebase(monotonicTime());
+    running_ = false;
+}
+
+bool ReplayClock::running() const
+{
+    boost::mutex::scoped_lock L(lock_);
+    return running_;
+}
+
+bool ReplayClock::due(Timestamp t) const
+{
+    boost::mutex::scoped_lock L(lock_);
+    double pos = position(monotonicTime());
+    return speed_ >= 0 ? t <= pos : t >= pos;
+}
+
+int64_t ReplayClock::wallTime(Timestamp t) const
+{
+    boost::mutex::scoped_lock L(lock_);
+    if (!running_ || speed_ == 0)
+        return -1;
+    return wall_ + static_cast<int64_t>(ceil((t - stream_) / speed_ * 1000.0));
+}
+
+int64_t ReplayClock::lateness(Timestamp t) const
+{
+    boost::mutex::scoped_lock L(lock_);
+    if (!running_ || speed_ == 0)
+        return 0;
+    double late = (position(monotonicTime()) - t) / speed_ * 1000.0;
+    return late > 0 ? static_cast<int64_t>(late) : 0;
+}
+
+int64_t ReplayClock::nextTick(int64_t wall, int64_t tick)
+{
+    if (tick <= 1)
+        return wall;
+    return (wall + tick - 1) / tick * tick;
+}
@@ -0,0 +1,122 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file replayClock.h
+ * Timekeeping for event playback.
+ *
+ * Playback is driven by the monotonic clock rather than gettimeofday(), so
+ * setting the system time (by hand or by NTP) does not speed up, stall or
+ * skip a replay.  A ReplayClock maps monotonic time onto the event stream's
+ * timeline at some speed.  As the mapping is a single anchor point, changing
+ * the speed or seeking never makes the clock drift: every event's due time
+ * is computed from the same anchor rather than from the previous timer.
+ */
+#ifndef WATCHER_REPLAY_CLOCK_H
+#define WATCHER_REPLAY_CLOCK_H
+
+#include <stdint.h>
+#include <boost/asio.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "watcherTypes.h"
+
+namespace watcher {
+
+    /** Microseconds since an arbitrary point, from a clock which only moves forward. */
+    int64_t monotonicTime();
+
+    /** Time traits letting boost::asio timers wait on monotonicTime() values. */
+    struct MonotonicTimeTraits {
+        typedef int64_t time_type;
+        typedef boost::posix_time::time_duration duration_type;
+
+        static time_type now() { return monotonicTime(); }
+        static time_type add(const time_type& t, const duration_type& d) { return t + d.total_microseconds(); }
+        static duration_type subtract(const time_type& t1, const time_type& t2) { return boost::posix_time::microseconds(t1 - t2); }
+        static bool less_than(const time_type& t1, const time_type& t2) { return t1 < t2; }
+        static boost::posix_time::time_duration to_posix_duration(const duration_type& d) { return d; }
+    };
+
+    /** A timer whose expiry times are monotonicTime() values. */
+    typedef boost::asio::basic_deadline_timer<int64_t, MonotonicTimeTraits> MonotonicTimer;
+
+    /** The current position in an event stream during playback.
+     *
+     * The clock is anchored at a (monotonic time, stream position) pair and
+     * advances at speed() stream milliseconds per real millisecond, which is
+     * negative when playing in reverse.  Changing the speed moves the anchor
+     * to the current position under the same lock, so readers see either the
+     * old mapping or the new one and the position never jumps.
+     *
+     * All member functions may be called from any thread.
+     */
+    class ReplayClock {
+        public:
+            /** Create a stopped clock at position t. */
+            explicit ReplayClock(Timestamp t = 0, float speed = 1.0f);
+
+            /** Return the current position in the stream (milliseconds). */
+            Timestamp now() const;
+
+            /** Move to a position in the stream.  The clock keeps running if it was. */
+            void seek(Timestamp t);
+
+            /** Change the playback speed, starting from the current position. */
+            void speed(float f);
+            float speed() const;
+
+            /** Start advancing from the current position. */
+            void start();
+
+            /** Stop advancing.  now() stays at the position it had reached. */
+            void stop();
+
+            bool running() const;
+
+            /** Return true if an event at stream time t should have been played
+             * by now.  Works in either direction of playback. */
+            bool due(Timestamp t) const;
+
+            /** Return the monotonicTime() at which the clock reaches (or
+             * reached) stream time t, or -1 if the clock is not moving. */
+            int64_t wallTime(Timestamp t) const;
+
+            /** Return how long ago, in real microseconds, the clock passed
+             * stream time t; 0 if it has not got there yet. */
+            int64_t lateness(Timestamp t) const;
+
+            /** Round a monotonicTime() up to the next multiple of tick
+             * microseconds.  Waking only on these ticks bundles all the events
+             * which fall due within one tick into one timer expiry. */
+            static int64_t nextTick(int64_t wall, int64_t tick);
+
+        private:
+            /** Move the anchor to the current position.  Call with lock_ held. */
+            void rebase(int64_t wall);
+            double position(int64_t wall) const;
+
+            mutable boost::mutex lock_;
+            int64_t wall_;      //< monotonicTime() at the anchor
+            double stream_;     //< stream position at the anchor (ms, unrounded)
+            float speed_;
+            bool running_;
+    };
+
+} // namespace
+
+#endif /* WATCHER_REPLAY_CLOCK_H */
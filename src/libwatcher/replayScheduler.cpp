@@ -0,0 +1,297 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file replayScheduler.cpp
+ */
+#include <algorithm>
+#include <boost/bind.hpp>
+
+#include "replayScheduler.h"
+#include "metrics.h"
+#include "logger.h"
+
+using namespace watcher;
+using namespace watcher::event;
+
+INIT_LOGGER(ReplayScheduler, "ReplayScheduler");
+
+namespace {
+    const unsigned int DEFAULT_BUFFER_SIZE = 50U; /* events */
+    const unsigned int DEFAULT_STEP = 10U; /* ms */
+    const unsigned int DEFAULT_EOF_POLL = 250U; /* ms */
+
+    metrics::Histogram lateness("replay.lateness_usec");
+    metrics::Histogram refillTime("replay.refill_usec");
+    metrics::Histogram queueDepth("replay.queue_depth");
+    metrics::Histogram batchSize("replay.batch_size");
+}
+
+ReplayScheduler::ReplayScheduler(boost::asio::io_service& ios, const Fetch& fetch, const Deliver& deliver,
+        const End& end, Timestamp t, float f) :
+    fetch_(fetch), deliver_(deliver), end_(end), timer_(ios), clock_(t, f), lastEvent_(t),
+    bufsiz_(DEFAULT_BUFFER_SIZE), step_(DEFAULT_STEP), eofPoll_(DEFAULT_EOF_POLL), running_(false),
+    resync_(t == 0 || t == -1), resyncPos_(t), generation_(0)
+{
+    TRACE_ENTER();
+    TRACE_EXIT();
+}
+
+ReplayScheduler::~ReplayScheduler()
+{
+    TRACE_ENTER();
+    TRACE_EXIT();
+}
+
+void ReplayScheduler::play()
+{
+    TRACE_ENTER();
+    boost::mutex::scoped_lock L(lock_);
+    if (!running_) {
+        LOG_DEBUG("starting playback timer");
+        running_ = true;
+        clock_.start();
+        run();
+    } else
+        LOG_DEBUG("play was called but timer is already running");
+    TRACE_EXIT();
+}
+
+void ReplayScheduler::pause()
+{
+    TRACE_ENTER();
+    boost::mutex::scoped_lock L(lock_);
+    if (running_) {
+        LOG_DEBUG("cancelling timer");
+        timer_.cancel();
+        ++generation_;
+        clock_.stop();
+        running_ = false;
+    } else
+        LOG_DEBUG("pause was called, but timer is not running");
+    TRACE_EXIT();
+}
+
+bool ReplayScheduler::playing() const
+{
+    boost::mutex::scoped_lock L(lock_);
+    return running_;
+}
+
+Timestamp ReplayScheduler::tell() const
+{
+    TRACE_ENTER();
+    /* Not under lock_: the Deliver function may want the position, and it
+     * is called with lock_ held. */
+    Timestamp t = resync_ ? resyncPos_ : clock_.now();
+    TRACE_EXIT_RET(t);
+    return t;
+}
+
+void ReplayScheduler::seek(Timestamp t)
+{
+    TRACE_ENTER();
+    boost::mutex::scoped_lock L(lock_);
+    LOG_DEBUG("seeking to " << t);
+    position(t);
+    if (running_)
+        run(); // play from the new position now rather than when the timer expires
+    TRACE_EXIT();
+}
+
+void ReplayScheduler::speed(float f)
+{
+    TRACE_ENTER();
+    boost::mutex::scoped_lock L(lock_);
+    LOG_DEBUG("set speed to " << f);
+
+    // positive*negative==negative
+    bool reversed = (clock_.speed() * f < 0);
+
+    /* The clock carries on from its current position at the new rate. */
+    clock_.speed(f);
+
+    if (reversed) {
+        LOG_DEBUG("direction of playback changed, clearing event queue");
+        events_.clear();
+
+        /* Fetch from where the clock has got to, unless it is still
+         * waiting to find out where the stream starts. */
+        if (!resync_)
+            lastEvent_ = clock_.now();
+    }
+
+    /* Reschedule a running timer, as the next event is now due at a
+     * different time (or is not the next event at all). */
+    if (running_)
+        run();
+    TRACE_EXIT();
+}
+
+float ReplayScheduler::speed() const
+{
+    return clock_.speed();
+}
+
+void ReplayScheduler::buffer_size(unsigned int n)
+{
+    boost::mutex::scoped_lock L(lock_);
+    bufsiz_ = n;
+}
+
+void ReplayScheduler::time_step(unsigned int n)
+{
+    boost::mutex::scoped_lock L(lock_);
+    step_ = n;
+}
+
+void ReplayScheduler::eof_poll(unsigned int n)
+{
+    boost::mutex::scoped_lock L(lock_);
+    eofPoll_ = n;
+}
+
+void ReplayScheduler::position(Timestamp t)
+{
+    events_.clear();
+    resync_ = (t == 0 || t == -1);
+    resyncPos_ = t;
+    if (t == -1)
+        lastEvent_ = end_();
+    else {
+        clock_.seek(t);
+        lastEvent_ = t;
+    }
+}
+
+bool ReplayScheduler::refill()
+{
+    TRACE_ENTER();
+
+    if (events_.empty()) {
+        bool forward = clock_.speed() >= 0;
+        LOG_DEBUG("fetching events " << (forward ? "> " : "< ") << lastEvent_);
+        {
+            metrics::ScopedTimer t(refillTime);
+            fetch_(lastEvent_, forward, bufsiz_, events_);
+        }
+
+        if (!events_.empty()) {
+            LOG_DEBUG("fetched " << events_.size() << " events");
+            /* Position 0 or -1 becomes the timestamp of the first event
+             * fetched.  When playing in reverse that is the last event in
+             * the stream. */
+            if (resync_) {
+                clock_.seek(events_.front()->timestamp);
+                resync_ = false;
+            }
+            // carry on from here next time, so nothing is fetched twice
+            lastEvent_ = events_.back()->timestamp;
+        }
+    }
+
+    TRACE_EXIT_RET(!events_.empty());
+    return !events_.empty();
+}
+
+void ReplayScheduler::run()
+{
+    schedule(refill());
+}
+
+/* The timer only expires on multiples of the time step, so all of the events
+ * which fall due within one step are sent together.  The expiry time comes
+ * from the replay clock, which maps every event to an absolute time, so late
+ * wakeups do not add up over the course of a replay. */
+void ReplayScheduler::schedule(bool more)
+{
+    TRACE_ENTER();
+
+    const int64_t tick = step_ * 1000;
+    const int64_t now = monotonicTime();
+    int64_t next;
+
+    if (more) {
+        next = clock_.wallTime(events_.front()->timestamp);
+        if (next < 0)
+            next = now + tick;
+    } else {
+        LOG_DEBUG("reached end of stream");
+        next = now + eofPoll_ * 1000;
+
+        /* Send the next event to arrive as soon as it is seen. */
+        resync_ = true;
+        resyncPos_ = -1;
+
+        /* a weird corner case is when  0 < speed < 1.0 and we reach the end of the stream.
+         * currently this *increases* the speed to 1.0. */
+        if (clock_.speed() > 0.0)
+            clock_.speed(1.0); // FIXME shared stream subscribers must be notified of this change
+    }
+
+    /* Never wake up before the next tick, or a tick that is already
+     * passing would fire straight away with nothing to send. */
+    next = std::max(ReplayClock::nextTick(next, tick), ReplayClock::nextTick(now + 1, tick));
+
+    timer_.cancel();
+    timer_.expires_at(next);
+    timer_.async_wait(boost::bind(&ReplayScheduler::timer_handler, shared_from_this(), ++generation_,
+                boost::asio::placeholders::error));
+    LOG_DEBUG("next wakeup in " << (next - now) << " us");
+
+    TRACE_EXIT();
+}
+
+void ReplayScheduler::timer_handler(unsigned long generation, const boost::system::error_code& ec)
+{
+    TRACE_ENTER();
+
+    boost::mutex::scoped_lock L(lock_);
+
+    if (ec == boost::asio::error::operation_aborted || generation != generation_)
+        LOG_DEBUG("timer was cancelled");
+    else if (!running_)
+        LOG_WARN("timer expired but playback is paused!");
+    else {
+        std::vector<MessagePtr> msgs;
+
+        queueDepth.record(events_.size());
+        bool more;
+        while ((more = refill())) {
+            MessagePtr m = events_.front();
+            if (!clock_.due(m->timestamp))
+                break;
+            lateness.record(clock_.lateness(m->timestamp));
+            msgs.push_back(m);
+            events_.pop_front();
+        }
+        if (!msgs.empty())
+            batchSize.record(msgs.size());
+
+        if (deliver_(msgs))
+            schedule(more);
+        else {
+            LOG_WARN("nobody is listening any more - pausing");
+            running_ = false;
+            clock_.stop();
+        }
+    }
+
+    TRACE_EXIT();
+}
+
+// vim:sw=4
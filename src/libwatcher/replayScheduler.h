@@ -0,0 +1,157 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file replayScheduler.h
+ * Timing of event playback, apart from where the events come from.
+ */
+#ifndef WATCHER_REPLAY_SCHEDULER_H
+#define WATCHER_REPLAY_SCHEDULER_H
+
+#include <deque>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "message.h"
+#include "replayClock.h"
+#include "declareLogger.h"
+
+namespace watcher {
+
+    /** Plays back a stream of events, sending each one when a ReplayClock
+     * reaches its timestamp.
+     *
+     * Events are read a block at a time through a Fetch function, and the
+     * ones which have fallen due are handed to a Deliver function in bulk.
+     * watcherd's ReplayState reads from the event database and delivers to
+     * a SharedStream; the tests read from a list in memory.
+     *
+     * A position of 0 means the first event there is and -1 the last.
+     * Either way the clock jumps to the timestamp of the next event
+     * fetched, and at the end of the stream playback carries on at normal
+     * speed with whatever arrives next.
+     *
+     * The timer handlers keep the scheduler alive, so it must be owned by
+     * a shared_ptr.  All member functions may be called from any thread.
+     */
+    class ReplayScheduler : public boost::enable_shared_from_this<ReplayScheduler>, private boost::noncopyable {
+        public:
+            /** Append up to n events after (or, if !forward, before)
+             * timestamp t to out, in the order they are to be played. */
+            typedef boost::function<void(Timestamp t, bool forward, unsigned int n, std::deque<event::MessagePtr>& out)> Fetch;
+
+            /** Send the events which have fallen due.  Called on every
+             * wakeup, with an empty list if there is nothing to send.
+             * Return false if nobody is listening any more, which pauses
+             * playback. */
+            typedef boost::function<bool(const std::vector<event::MessagePtr>&)> Deliver;
+
+            /** Return the timestamp of the last event in the stream. */
+            typedef boost::function<Timestamp()> End;
+
+            ReplayScheduler(boost::asio::io_service& ios, const Fetch& fetch, const Deliver& deliver,
+                    const End& end, Timestamp t = 0, float speed = 1.0f);
+            ~ReplayScheduler();
+
+            void play();
+            void pause();
+            bool playing() const;
+
+            /** Return the current position in the stream. */
+            Timestamp tell() const;
+
+            /** Move to a position in the stream, dropping any events already fetched. */
+            void seek(Timestamp t);
+
+            /** Change the playback speed.  Reversing direction drops the
+             * events already fetched. */
+            void speed(float f);
+            float speed() const;
+
+            /** Set the number of events fetched at a time. */
+            void buffer_size(unsigned int n);
+
+            /** Set the granularity of the timer, in milliseconds.
+             *
+             * The timer only expires on multiples of the time step, and all
+             * events that have fallen due are sent out in bulk, so no event
+             * is sent early and none more than one time step late.
+             */
+            void time_step(unsigned int n);
+
+            /** Set how often, in milliseconds, to look for new events once
+             * the end of the stream has been reached. */
+            void eof_poll(unsigned int n);
+
+        private:
+            /* The rest assume lock_ is held. */
+
+            /** Set the position, as for a seek. */
+            void position(Timestamp t);
+
+            /** Fetch a block of events if none are left.  Return false at
+             * the end of the stream. */
+            bool refill();
+
+            /** Fetch if need be and schedule the timer for the next event. */
+            void run();
+
+            /** Schedule the timer for the next event, or to look for new
+             * events at the end of the stream (more == false). */
+            void schedule(bool more);
+
+            void timer_handler(unsigned long generation, const boost::system::error_code& ec);
+
+            Fetch fetch_;
+            Deliver deliver_;
+            End end_;
+
+            std::deque<event::MessagePtr> events_;
+            MonotonicTimer timer_;
+            ReplayClock clock_;
+            Timestamp lastEvent_;       //< timestamp of the last event fetched
+            unsigned int bufsiz_;       //< number of events to fetch at a time
+            Timestamp step_;            //< tick granularity (ms)
+            unsigned int eofPoll_;      //< ms between looks for new events at the end
+            bool running_;
+
+            /* When set, the clock jumps to the timestamp of the next event
+             * fetched.  Until then tell() reports resyncPos_: 0 for the
+             * start of the stream, -1 for the end. */
+            bool resync_;
+            Timestamp resyncPos_;
+
+            /* Incremented whenever the timer is rescheduled, so that a
+             * handler which was already queued when the timer got
+             * cancelled can tell. */
+            unsigned long generation_;
+
+            /* seek() and friends are called from other threads than the
+             * timer handlers. */
+            mutable boost::mutex lock_;
+
+            DECLARE_LOGGER();
+    };
+
+} // namespace
+
+#endif /* WATCHER_REPLAY_SCHEDULER_H */
+
+// vim:sw=4
@@ -0,0 +1,161 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file seriesRollup.cpp
+ */
+#include <algorithm>
+
+#include "seriesRollup.h"
+
+using namespace watcher;
+
+namespace {
+    const Timestamp msPerHour = 60 * 60 * 1000;
+
+    bool bucketBefore(const SeriesRollup::Bucket& b, Timestamp t) { return b.time < t; }
+}
+
+const SeriesRollup::Level SeriesRollup::levels[] = {
+    { 1000, 10 * 60 * 1000 },
+    { 10 * 1000, 6 * msPerHour },
+    { 60 * 1000, 48 * msPerHour },
+    { 10 * 60 * 1000, 30 * 24 * msPerHour },
+    { msPerHour, 0 }
+};
+const size_t SeriesRollup::numLevels;
+
+void SeriesRollup::Bucket::add(Timestamp ts, double v)
+{
+    if (!count || v < min)
+        min = v;
+    if (!count || v > max)
+        max = v;
+    if (!count || ts >= lastTime) {
+        lastTime = ts;
+        last = v;
+    }
+    sum += v;
+    ++count;
+}
+
+void SeriesRollup::Bucket::merge(const Bucket& b)
+{
+    if (!b.count)
+        return;
+    if (!count || b.min < min)
+        min = b.min;
+    if (!count || b.max > max)
+        max = b.max;
+    if (!count || b.lastTime >= lastTime) {
+        lastTime = b.lastTime;
+        last = b.last;
+    }
+    sum += b.sum;
+    count += b.count;
+}
+
+void SeriesRollup::LevelData::add(const Level& l, Timestamp ts, double v)
+{
+    Timestamp t = ts - ts % l.width;
+
+    // the common case: the newest point so far
+    if (buckets.empty() || t > buckets.back().time) {
+        buckets.push_back(Bucket(t));
+        buckets.back().add(ts, v);
+        while (l.retention && buckets.back().time - buckets.front().time >= l.retention) {
+            buckets.pop_front();
+            trimmed = true;
+        }
+        return;
+    }
+    if (t == buckets.back().time) {
+        buckets.back().add(ts, v);
+        return;
+    }
+
+    if (l.retention && buckets.back().time - t >= l.retention) {
+        trimmed = true;
+        return;
+    }
+    std::deque<Bucket>::iterator i = std::lower_bound(buckets.begin(), buckets.end(), t, bucketBefore);
+    if (i == buckets.end() || i->time != t)
+        i = buckets.insert(i, Bucket(t));
+    i->add(ts, v);
+}
+
+void SeriesRollup::add(Timestamp ts, double v)
+{
+    for (size_t l = 0; l < numLevels; ++l)
+        data_[l].add(levels[l], ts, v);
+}
+
+size_t SeriesRollup::levelFor(Timestamp resolution)
+{
+    size_t l = 0;
+    while (l + 1 < numLevels && levels[l + 1].width <= resolution)
+        ++l;
+    return l;
+}
+
+size_t SeriesRollup::level(Timestamp begin, Timestamp resolution) const
+{
+    size_t l = levelFor(resolution);
+    while (l + 1 < numLevels && data_[l].trimmed &&
+            (data_[l].buckets.empty() || data_[l].buckets.front().time > begin))
+        ++l;
+    return l;
+}
+
+Timestamp SeriesRollup::bucketWidth(size_t level, Timestamp resolution)
+{
+    const Timestamp width = levels[level].width;
+    return resolution < width ? width : (resolution + width - 1) / width * width;
+}
+
+Timestamp SeriesRollup::query(Timestamp begin, Timestamp end, Timestamp resolution, BucketList& out, Timestamp from) const
+{
+    size_t l = level(std::max(begin, from), resolution);
+    const Timestamp res = bucketWidth(l, resolution);
+
+    const std::deque<Bucket>& b = data_[l].buckets;
+    std::deque<Bucket>::const_iterator i = std::lower_bound(b.begin(), b.end(), std::max(begin - begin % res, from), bucketBefore);
+    for (; i != b.end() && (end == Infinity || i->time <= end); ++i) {
+        Timestamp t = i->time - i->time % res;
+        if (out.empty() || out.back().time != t)
+            out.push_back(Bucket(t));
+        out.back().merge(*i);
+    }
+    return res;
+}
+
+void SeriesRollup::merge(BucketList& a, const BucketList& b)
+{
+    BucketList merged;
+    merged.reserve(a.size() + b.size());
+    BucketList::const_iterator i = a.begin(), j = b.begin();
+    while (i != a.end() || j != b.end()) {
+        const Bucket& next = (j == b.end() || (i != a.end() && i->time <= j->time)) ? *i++ : *j++;
+        if (merged.empty() || merged.back().time != next.time)
+            merged.push_back(next);
+        else
+            merged.back().merge(next);
+    }
+    a.swap(merged);
+}
+
+// vim:sw=4
@@ -0,0 +1,118 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file seriesRollup.h
+ * Summaries of a series of values at several resolutions.
+ */
+#ifndef WATCHER_SERIES_ROLLUP_H
+#define WATCHER_SERIES_ROLLUP_H
+
+#include <deque>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+#include "watcherTypes.h"
+
+namespace watcher {
+
+    /** One series of timestamped values, kept as min/max/mean/last buckets
+     * at 1s, 10s, 1m, 10m and 1h resolution.
+     *
+     * The finer levels only keep recent buckets (10 minutes, 6 hours, 2
+     * days and 30 days respectively, counted back from the newest bucket);
+     * the hourly buckets are kept for good.  Values may be added in any
+     * order.
+     *
+     * Not thread safe; watcherd's DataRollup keeps one per data series,
+     * each under its own lock.
+     */
+    class SeriesRollup {
+        public:
+            /** The values which fell within one span of time. */
+            struct Bucket {
+                Timestamp time;         //< start of the bucket
+                Timestamp lastTime;     //< timestamp of the value in last
+                boost::uint32_t count;
+                double min;
+                double max;
+                double sum;
+                double last;
+
+                explicit Bucket(Timestamp t = 0) :
+                    time(t), lastTime(0), count(0), min(0), max(0), sum(0), last(0) { }
+
+                void add(Timestamp ts, double v);
+                void merge(const Bucket& b);
+                double mean() const { return count ? sum / count : 0; }
+            };
+            typedef std::vector<Bucket> BucketList;
+
+            /** One resolution at which the series is summarized. */
+            struct Level {
+                Timestamp width;        //< bucket width (milliseconds)
+                Timestamp retention;    //< how far back from the newest bucket to keep, 0 for everything
+            };
+            static const Level levels[];
+            static const size_t numLevels = 5;
+
+            void add(Timestamp ts, double v);
+
+            /** Return the coarsest level no wider than resolution. */
+            static size_t levelFor(Timestamp resolution);
+
+            /** Return the level to take buckets from for a query starting at
+             * begin: levelFor(resolution), or a coarser one if that no longer
+             * goes back to begin. */
+            size_t level(Timestamp begin, Timestamp resolution) const;
+
+            /** Round a resolution up to a multiple of a level's width. */
+            static Timestamp bucketWidth(size_t level, Timestamp resolution);
+
+            /** Append the buckets from begin to end (Infinity for no bound)
+             * to out, merged to the resolution, which is rounded up to a
+             * multiple of the width of the level they are taken from.  Only
+             * that level's buckets which start at or after from are used.
+             * @return the width of the buckets appended
+             */
+            Timestamp query(Timestamp begin, Timestamp end, Timestamp resolution, BucketList& out, Timestamp from = 0) const;
+
+            /** Merge b into a.  Both are in time order, and any buckets
+             * with the same start time are combined. */
+            static void merge(BucketList& a, const BucketList& b);
+
+            /** The buckets at one level, oldest first. */
+            const std::deque<Bucket>& buckets(size_t level) const { return data_[level].buckets; }
+
+            /** Has some of the data at a level been dropped for being too old? */
+            bool trimmed(size_t level) const { return data_[level].trimmed; }
+
+        private:
+            struct LevelData {
+                std::deque<Bucket> buckets;
+                bool trimmed;
+                LevelData() : trimmed(false) { }
+                void add(const Level& l, Timestamp ts, double v);
+            };
+            LevelData data_[numLevels];
+    };
+
+} // namespace
+
+#endif /* WATCHER_SERIES_ROLLUP_H */
+
+// vim:sw=4
@@ -0,0 +1,154 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file smallVector.h
+ */
+#ifndef WATCHER_SMALL_VECTOR_H
+#define WATCHER_SMALL_VECTOR_H
+
+#include <cstddef>
+#include <cstring>
+
+namespace watcher {
+
+    /**
+     * A vector which keeps its first N elements inside itself, and only goes
+     * to the heap when it grows past them.
+     *
+     * Most of the lists in messages are short - a handful of neighbors, one or
+     * two node properties - so most messages never allocate for them. It has
+     * the parts of std::vector's interface the messages use.
+     *
+     * Elements are copied with memcpy(), so T must be a plain value: an enum,
+     * an integer, or a struct of those.
+     */
+    template <class T, size_t N>
+    class SmallVector {
+        public:
+            typedef T value_type;
+            typedef T &reference;
+            typedef const T &const_reference;
+            typedef T *iterator;
+            typedef const T *const_iterator;
+            typedef size_t size_type;
+
+            SmallVector() : data_(inline_), size_(0), capacity_(N) { }
+
+            SmallVector(const SmallVector &other) : data_(inline_), size_(0), capacity_(N)
+            {
+                assign(other.begin(), other.end());
+            }
+
+            ~SmallVector()
+            {
+                if (data_ != inline_)
+                    delete [] data_;
+            }
+
+            SmallVector &operator=(const SmallVector &other)
+            {
+                if (this != &other)
+                    assign(other.begin(), other.end());
+                return *this;
+            }
+
+            template <class InputIterator>
+            void assign(InputIterator first, InputIterator last)
+            {
+                clear();
+                for (; first != last; ++first)
+                    push_back(*first);
+            }
+
+            iterator begin() { return data_; }
+            iterator end() { return data_ + size_; }
+            const_iterator begin() const { return data_; }
+            const_iterator end() const { return data_ + size_; }
+
+            size_type size() const { return size_; }
+            size_type capacity() const { return capacity_; }
+            bool empty() const { return size_ == 0; }
+
+            /** Are the elements kept inside the vector? */
+            bool isInline() const { return data_ == inline_; }
+
+            reference operator[](size_type i) { return data_[i]; }
+            const_reference operator[](size_type i) const { return data_[i]; }
+            reference front() { return data_[0]; }
+            const_reference front() const { return data_[0]; }
+            reference back() { return data_[size_ - 1]; }
+            const_reference back() const { return data_[size_ - 1]; }
+
+            void push_back(const T &t)
+            {
+                if (size_ == capacity_)
+                    reserve(capacity_ * 2);
+                data_[size_++] = t;
+            }
+
+            void pop_back() { --size_; }
+
+            /** Remove an element, keeping the order of the rest.
+             * @return the element after the one removed
+             */
+            iterator erase(iterator pos)
+            {
+                memmove(pos, pos + 1, (end() - pos - 1) * sizeof(T));
+                --size_;
+                return pos;
+            }
+
+            /** Empty the vector. Memory from the heap is kept for reuse. */
+            void clear() { size_ = 0; }
+
+            void reserve(size_type n)
+            {
+                if (n <= capacity_)
+                    return;
+                T *bigger = new T[n];
+                memcpy(bigger, data_, size_ * sizeof(T));
+                if (data_ != inline_)
+                    delete [] data_;
+                data_ = bigger;
+                capacity_ = n;
+            }
+
+            bool operator==(const SmallVector &other) const
+            {
+                if (size_ != other.size_)
+                    return false;
+                for (size_type i = 0; i < size_; ++i)
+                    if (!(data_[i] == other.data_[i]))
+                        return false;
+                return true;
+            }
+
+            bool operator!=(const SmallVector &other) const { return !(*this == other); }
+
+        private:
+            T *data_;
+            size_type size_;
+            size_type capacity_;
+            T inline_[N];
+    };
+}
+
+#endif // WATCHER_SMALL_VECTOR_H
+
+// vim:sw=4
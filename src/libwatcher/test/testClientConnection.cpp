@@ -0,0 +1,167 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define BOOST_TEST_MODULE watcher::ClientConnection test
+#include <boost/test/unit_test.hpp>
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+
+#include "../client.h"
+#include "../clientConnection.h"
+#include "../dataMarshaller.h"
+#include "../labelMessage.h"
+#include "../messageHandler.h"
+
+using namespace std;
+using namespace boost;
+using namespace boost::asio::ip;
+using namespace watcher;
+using namespace watcher::event;
+
+namespace {
+    // A port nobody is listening on, for now.
+    unsigned short freePort()
+    {
+        asio::io_service io;
+        tcp::acceptor a(io, tcp::endpoint(address_v4::loopback(), 0));
+        return a.local_endpoint().port();
+    }
+
+    MessagePtr label(const string &text)
+    {
+        return MessagePtr(new LabelMessage(text));
+    }
+
+    // Read the labels of the messages in the next write from the client.
+    vector<string> readLabels(tcp::socket &s)
+    {
+        vector<string> labels;
+        char header[DataMarshaller::header_length];
+        asio::read(s, asio::buffer(header, sizeof(header)));
+        size_t payloadSize;
+        unsigned short messageNum;
+        BOOST_REQUIRE(DataMarshaller::unmarshalHeader(header, sizeof(header), payloadSize, messageNum));
+        vector<char> payload(payloadSize);
+        asio::read(s, asio::buffer(payload));
+        vector<MessagePtr> messages;
+        BOOST_REQUIRE(DataMarshaller::unmarshalPayload(messages, messageNum, &payload[0], payloadSize));
+        for (size_t i=0; i<messages.size(); ++i)
+            labels.push_back(dynamic_pointer_cast<LabelMessage>(messages[i])->label);
+        return labels;
+    }
+
+    // Read labels until there are n, as the client may send them in one write or several.
+    vector<string> readLabels(tcp::socket &s, size_t n)
+    {
+        vector<string> labels;
+        while (labels.size()<n) {
+            vector<string> more=readLabels(s);
+            labels.insert(labels.end(), more.begin(), more.end());
+        }
+        return labels;
+    }
+
+    // Says hello each time the connection is made.
+    class HelloHandler : public MessageHandler {
+        public:
+            HelloHandler() : connects(0) { }
+            void handleConnect(ConnectionPtr conn) {
+                ++connects;
+                dynamic_pointer_cast<ClientConnection>(conn)->sendMessage(label("hello"));
+            }
+            int connects;
+    };
+}
+
+BOOST_AUTO_TEST_CASE( send_before_server_test )
+{
+    unsigned short port=freePort();
+    Client client("127.0.0.1", lexical_cast<string>(port));
+
+    // Nobody is listening: sending neither blocks nor fails.
+    posix_time::ptime start=posix_time::microsec_clock::universal_time();
+    BOOST_CHECK(client.sendMessage(label("one")));
+    BOOST_CHECK(client.sendMessage(label("two")));
+    BOOST_CHECK(posix_time::microsec_clock::universal_time()-start < posix_time::milliseconds(500));
+    BOOST_CHECK(!client.connected());
+
+    // The messages go out, in order, once there is a server.
+    asio::io_service io;
+    tcp::acceptor acceptor(io, tcp::endpoint(address_v4::loopback(), port));
+    tcp::socket s(io);
+    acceptor.accept(s);
+    vector<string> labels=readLabels(s, 2);
+    BOOST_REQUIRE_EQUAL(labels.size(), 2u);
+    BOOST_CHECK_EQUAL(labels[0], "one");
+    BOOST_CHECK_EQUAL(labels[1], "two");
+    BOOST_CHECK(client.connect(true));
+    BOOST_CHECK(client.connected());
+
+    client.close();
+}
+
+BOOST_AUTO_TEST_CASE( reconnect_test )
+{
+    unsigned short port=freePort();
+    asio::io_service io;
+    tcp::acceptor acceptor(io, tcp::endpoint(address_v4::loopback(), port));
+
+    Client client("127.0.0.1", lexical_cast<string>(port));
+    boost::shared_ptr<HelloHandler> hello(new HelloHandler);
+    client.addMessageHandler(hello);
+    client.setReconnect(true);
+
+    tcp::socket s(io);
+    boost::thread connecting(boost::bind(&Client::connect, &client, false));
+    acceptor.accept(s);
+    connecting.join();
+    BOOST_CHECK(client.connected());
+    BOOST_CHECK_EQUAL(hello->connects, 1);
+    BOOST_CHECK_EQUAL(readLabels(s, 1).front(), "hello");
+
+    // The server goes away; what is sent meanwhile waits.
+    s.close();
+    for (int i=0; i<50 && client.connected(); ++i)
+        boost::this_thread::sleep(posix_time::milliseconds(20));
+    BOOST_CHECK(!client.connected());
+    client.sendMessage(label("one"));
+    client.sendMessage(label("two"));
+
+    // It reconnects by itself, and the handler's message goes first.
+    tcp::socket s2(io);
+    acceptor.accept(s2);
+    vector<string> labels=readLabels(s2, 3);
+    BOOST_REQUIRE_EQUAL(labels.size(), 3u);
+    BOOST_CHECK_EQUAL(labels[0], "hello");
+    BOOST_CHECK_EQUAL(labels[1], "one");
+    BOOST_CHECK_EQUAL(labels[2], "two");
+    BOOST_CHECK_EQUAL(hello->connects, 2);
+
+    client.close();
+}
+
+BOOST_AUTO_TEST_CASE( connect_attempt_test )
+{
+    unsigned short port=freePort();
+    Client client("127.0.0.1", lexical_cast<string>(port));
+
+    // One attempt, which fails, and close() stops the ones after.
+    BOOST_CHECK(!client.connect(true));
+    BOOST_CHECK(!client.connected());
+    client.close();
+}
@@ -0,0 +1,75 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ * 
+ * This file is part of WATCHER.
+ * 
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ * 
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ * 
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define BOOST_TEST_MODULE data_series_message_test test
+
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+
+#include "../dataSeriesMessage.h"
+
+using namespace std;
+using namespace watcher;
+using namespace watcher::event;
+using namespace boost;
+
+BOOST_AUTO_TEST_CASE( ctor_test )
+{
+    BOOST_REQUIRE_NO_THROW( DataSeriesMessage() );
+    DataSeriesMessage dsm(NodeIdentifier::from_string("192.168.1.1"), "cpu");
+    BOOST_TEST_MESSAGE("dsm=" << dsm);
+
+    BOOST_CHECK_EQUAL(dsm.dataName, "cpu");
+    BOOST_CHECK_EQUAL(dsm.begin, 0);
+    BOOST_CHECK_EQUAL(dsm.end, Infinity);
+    BOOST_CHECK_EQUAL(dsm.resolution, 1000);
+    BOOST_CHECK(dsm.buckets.empty());
+}
+
+BOOST_AUTO_TEST_CASE( pack_test )
+{
+    DataSeriesMessagePtr messages[] = {
+        DataSeriesMessagePtr(new DataSeriesMessage),            // a request for nothing in particular
+        DataSeriesMessagePtr(new DataSeriesMessage(NodeIdentifier::from_string("192.168.1.1"), "cpu load", 1000, 5000, 2000)),
+    };
+    DataSeriesMessage::Bucket b;
+    b.time = 0;
+    b.count = 3;
+    b.min = -1.5;
+    b.max = 2.25;
+    b.mean = 0.5;
+    b.last = 2.25;
+    messages[1]->buckets.push_back(b);
+    b.time = 2000;
+    b.count = 1;
+    b.min = b.max = b.mean = b.last = 1024.125;
+    messages[1]->buckets.push_back(b);
+
+    for (size_t i = 0; i < sizeof(messages) / sizeof(messages[0]); i++) {
+        ostringstream os;
+        messages[i]->pack(os);
+        BOOST_TEST_MESSAGE("flattened message: " << os.str());
+        istringstream is(os.str());
+        MessagePtr newmsg = Message::unpack(is);
+        BOOST_REQUIRE(newmsg.get() != 0);
+
+        DataSeriesMessagePtr pnewmsg = dynamic_pointer_cast<DataSeriesMessage>(newmsg);
+        BOOST_REQUIRE(pnewmsg.get() != 0);
+        BOOST_CHECK_EQUAL(*messages[i], *pnewmsg);
+        BOOST_TEST_MESSAGE("new message:" << *pnewmsg);
+    }
+}
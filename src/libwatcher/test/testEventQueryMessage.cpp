@@ -0,0 +1,74 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ * 
+ * This file is part of WATCHER.
+ * 
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ * 
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ * 
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define BOOST_TEST_MODULE event_query_message_test test
+
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+
+#include "../eventQueryMessage.h"
+
+using namespace std;
+using namespace watcher;
+using namespace watcher::event;
+using namespace boost;
+
+BOOST_AUTO_TEST_CASE( ctor_test )
+{
+    /* Ensure the class can be instantiated */
+    BOOST_REQUIRE_NO_THROW( watcher::event::EventQueryMessage() );
+    watcher::event::EventQueryMessage eqm;
+    BOOST_TEST_MESSAGE("eqm=" << eqm);
+
+    BOOST_CHECK_EQUAL(eqm.begin, 0);
+    BOOST_CHECK_EQUAL(eqm.end, Infinity);
+    BOOST_CHECK_EQUAL(eqm.limit, 0u);
+    BOOST_CHECK_EQUAL(eqm.next, Infinity);
+    BOOST_CHECK(eqm.nodes.empty() && eqm.types.empty() && eqm.layers.empty());
+}
+
+BOOST_AUTO_TEST_CASE( pack_test ) {
+	EventQueryMessagePtr messages[] = { 
+		EventQueryMessagePtr(new EventQueryMessage),			// match everything
+		EventQueryMessagePtr(new EventQueryMessage(1000, 2000)),	// time range only
+		EventQueryMessagePtr(new EventQueryMessage(1000)),		// will have all sets filled in
+	};
+	messages[2]->nodes.push_back(NodeIdentifier::from_string("192.168.1.1"));
+	messages[2]->nodes.push_back(NodeIdentifier::from_string("192.168.1.2"));
+	messages[2]->types.push_back(DATA_POINT_MESSAGE_TYPE);
+	messages[2]->types.push_back(EDGE_MESSAGE_TYPE);
+	messages[2]->layers.push_back(PHYSICAL_LAYER);
+	messages[2]->layers.push_back("a layer with spaces, and a comma");
+	messages[2]->limit=500;
+	messages[2]->count=42;
+	messages[2]->next=1500;
+
+	for (int i=0; i<sizeof(messages)/sizeof(messages[0]); i++) {
+		ostringstream os;
+		messages[i]->pack(os);
+		BOOST_TEST_MESSAGE("flattened message: " << os.str()); 
+		istringstream is(os.str());
+		MessagePtr newmsg = Message::unpack(is);
+		BOOST_REQUIRE(newmsg.get() != 0);
+
+		EventQueryMessagePtr pnewmsg = dynamic_pointer_cast<EventQueryMessage>(newmsg);
+		BOOST_REQUIRE(pnewmsg.get() != 0);
+		BOOST_CHECK_EQUAL(*messages[i], *pnewmsg);
+		BOOST_TEST_MESSAGE("message:" << *messages[i]);
+		BOOST_TEST_MESSAGE("new message:" << *pnewmsg);
+	}
+}
@@ -21,6 +21,8 @@
 
 #include "../messageFactory.h"
 #include "../messageTypesAndVersions.h"
+#include "../messageTrace.h"
+#include "../dataMarshaller.h"
 
 using namespace std;
 using namespace boost;
@@ -114,3 +116,57 @@ BOOST_AUTO_TEST_CASE( multi_parse_test )
 
 
 
+
+BOOST_AUTO_TEST_CASE( trace_test )
+{
+	MessagePtr from=createMessage(GPS_MESSAGE_TYPE);
+	from->timestamp=getCurrentTime();
+
+	traceStamp(*from, TRACE_FEEDER_SEND);
+	traceStamp(*from, TRACE_SERVER_RECV);
+
+	// stamps are not part of the packed event
+	{
+		stringstream ss;
+		from->pack(ss);
+		BOOST_CHECK(ss.str().find("trace")==string::npos);
+		MessagePtr plain=Message::unpack(ss);
+		BOOST_REQUIRE(plain.get()!=0);
+		BOOST_CHECK(plain->trace.empty());
+		BOOST_CHECK(*plain==*from);
+	}
+
+	// but are sent alongside it, without upsetting the messages around it
+	vector<MessagePtr> sent;
+	sent.push_back(createMessage(GPS_MESSAGE_TYPE));
+	sent.push_back(from);
+	sent.push_back(createMessage(GPS_MESSAGE_TYPE));
+	DataMarshaller::NetworkMarshalBuffers buffers;
+	BOOST_REQUIRE(DataMarshaller::marshalPayload(sent, buffers));
+	string payload;
+	for (size_t i=1; i<buffers.size(); i++) {      // skip the header
+		boost::asio::const_buffer b(buffers[i]);
+		payload.append(boost::asio::buffer_cast<const char*>(b), boost::asio::buffer_size(b));
+	}
+	vector<MessagePtr> received;
+	unsigned short num=sent.size();
+	BOOST_REQUIRE(DataMarshaller::unmarshalPayload(received, num, payload.data(), payload.size()));
+	BOOST_REQUIRE_EQUAL(received.size(), 3u);
+	BOOST_CHECK(received[0]->trace.empty());
+	BOOST_CHECK(received[2]->trace.empty());
+	MessagePtr to=received[1];
+	BOOST_REQUIRE_EQUAL(to->trace.size(), 2u);
+	for (size_t i=0; i<2; i++) {
+		BOOST_CHECK_EQUAL(to->trace[i].hop, from->trace[i].hop);
+		BOOST_CHECK_EQUAL(to->trace[i].usec, from->trace[i].usec);
+	}
+	BOOST_CHECK(to->trace[0].usec <= to->trace[1].usec);
+	BOOST_CHECK(*to==*from);
+
+	ostringstream report;
+	recordTrace(*from);
+	reportTrace(report);
+	BOOST_TEST_MESSAGE(report.str());
+	BOOST_CHECK(report.str().find("trace.server_recv_usec count=1")!=string::npos);
+	BOOST_CHECK(report.str().find("trace.end_to_end_usec count=1")!=string::npos);
+}
@@ -0,0 +1,167 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ * 
+ * This file is part of WATCHER.
+ * 
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ * 
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ * 
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define BOOST_TEST_MODULE metrics_test test
+
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "../metrics.h"
+#include "../metricsMessage.h"
+
+using namespace std;
+using namespace watcher;
+using namespace watcher::event;
+using namespace boost;
+
+BOOST_AUTO_TEST_CASE( bucket_test )
+{
+    /* Small values get a bucket each */
+    for (uint64_t v = 0; v < (1u << metrics::subBucketBits); ++v)
+        BOOST_CHECK_EQUAL(metrics::bucketUpperBound(metrics::bucketIndex(v)), v);
+
+    /* Every value falls in a bucket whose upper bound is within 12.5% of it */
+    size_t last = 0;
+    for (uint64_t v = 1; v < 5000000; v += v / 7 + 1) {
+        size_t i = metrics::bucketIndex(v);
+        BOOST_REQUIRE(i < metrics::histogramBuckets);
+        BOOST_CHECK(i >= last);
+        BOOST_CHECK(metrics::bucketUpperBound(i) >= v);
+        BOOST_CHECK(metrics::bucketUpperBound(i) - v <= v / 8);
+        last = i;
+    }
+
+    /* Huge values are clamped to the last bucket */
+    BOOST_CHECK_EQUAL(metrics::bucketIndex(~uint64_t(0)), metrics::histogramBuckets - 1);
+}
+
+namespace {
+    const metrics::HistogramSummary *findHistogram(const metrics::Snapshot& s, const string& name)
+    {
+        for (size_t i = 0; i < s.histograms.size(); ++i)
+            if (s.histograms[i].name == name)
+                return &s.histograms[i];
+        return 0;
+    }
+
+    int64_t findCounter(const metrics::Snapshot& s, const string& name)
+    {
+        for (size_t i = 0; i < s.counters.size(); ++i)
+            if (s.counters[i].first == name)
+                return s.counters[i].second;
+        return -1;
+    }
+
+    metrics::Counter testCounter("test.counter");
+    metrics::Histogram testHistogram("test.histogram");
+
+    void record(int n)
+    {
+        for (int i = 1; i <= n; ++i) {
+            testCounter.add();
+            testHistogram.record(i);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( snapshot_test )
+{
+    /* updates from a thread which has exited are kept */
+    boost::thread t(boost::bind(record, 1000));
+    t.join();
+    record(1000);
+    metrics::Counter("test.counter").sub(500);  // same name, same counter
+
+    metrics::Snapshot s;
+    metrics::snapshot(s);
+    BOOST_TEST_MESSAGE(s);
+
+    BOOST_CHECK_EQUAL(findCounter(s, "test.counter"), 1500);
+    const metrics::HistogramSummary *h = findHistogram(s, "test.histogram");
+    BOOST_REQUIRE(h != 0);
+    BOOST_CHECK_EQUAL(h->count, 2000u);
+    BOOST_CHECK_EQUAL(h->min, 1u);
+    BOOST_CHECK_EQUAL(h->max, 1000u);
+    BOOST_CHECK_EQUAL(h->sum, 2u * 500500);
+    BOOST_CHECK(h->p50 >= 500 && h->p50 <= 500 + 500 / 8);
+    BOOST_CHECK(h->p99 >= 990 && h->p99 <= 1000);
+}
+
+BOOST_AUTO_TEST_CASE( pack_test )
+{
+    MetricsMessagePtr messages[] = {
+        MetricsMessagePtr(new MetricsMessage),          // a request
+        MetricsMessagePtr(new MetricsMessage)           // a reply
+    };
+    metrics::snapshot(messages[1]->snapshot);
+    BOOST_REQUIRE(!messages[1]->snapshot.counters.empty() && !messages[1]->snapshot.histograms.empty());
+
+    for (size_t i=0; i<sizeof(messages)/sizeof(messages[0]); i++) {
+        ostringstream os;
+        messages[i]->pack(os);
+        BOOST_TEST_MESSAGE("flattened message: " << os.str());
+        istringstream is(os.str());
+        MessagePtr newmsg = Message::unpack(is);
+        BOOST_REQUIRE(newmsg.get() != 0);
+
+        MetricsMessagePtr pnewmsg = dynamic_pointer_cast<MetricsMessage>(newmsg);
+        BOOST_REQUIRE(pnewmsg.get() != 0);
+        BOOST_CHECK_EQUAL(*messages[i], *pnewmsg);
+    }
+}
+
+namespace {
+    void recordInstance(metrics::InstanceCounter *c, metrics::InstanceHistogram *h, int n)
+    {
+        for (int i = 1; i <= n; ++i) {
+            c->add();
+            h->record(i);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( instance_test )
+{
+    {
+        metrics::InstanceCounter c("test.7.counter");
+        metrics::InstanceHistogram h("test.7.histogram");
+
+        /* any number of threads may update an object's metrics */
+        boost::thread_group threads;
+        for (int i = 0; i < 4; ++i)
+            threads.create_thread(boost::bind(recordInstance, &c, &h, 1000));
+        threads.join_all();
+
+        metrics::Snapshot s;
+        metrics::snapshot(s);
+        BOOST_CHECK_EQUAL(findCounter(s, "test.7.counter"), 4000);
+        const metrics::HistogramSummary *hs = findHistogram(s, "test.7.histogram");
+        BOOST_REQUIRE(hs != 0);
+        BOOST_CHECK_EQUAL(hs->count, 4000u);
+        BOOST_CHECK_EQUAL(hs->min, 1u);
+        BOOST_CHECK_EQUAL(hs->max, 1000u);
+        BOOST_CHECK_EQUAL(hs->sum, 4u * 500500);
+    }
+
+    /* and they are no longer reported once it is gone */
+    metrics::Snapshot s;
+    metrics::snapshot(s);
+    BOOST_CHECK_EQUAL(findCounter(s, "test.7.counter"), -1);
+    BOOST_CHECK(findHistogram(s, "test.7.histogram") == 0);
+}
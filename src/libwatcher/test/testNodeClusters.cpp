@@ -0,0 +1,172 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define BOOST_TEST_MODULE node_clusters test
+
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#include "../nodeClusters.h"
+
+using namespace std;
+using namespace watcher;
+
+namespace {
+    struct Point { double x, y, z; };
+
+    double random(double lo, double hi)
+    {
+        return lo + (hi - lo) * (rand() / (RAND_MAX + 1.0));
+    }
+
+    // Group the points from scratch and compare with what the clusters say.
+    void checkClusters(const NodeClusters& clusters, const vector<Point>& points)
+    {
+        double size = clusters.cellSize();
+        map<pair<double, double>, vector<size_t> > expected;
+        for (size_t i = 0; i < points.size(); ++i)
+            expected[make_pair(floor(points[i].x / size), floor(points[i].y / size))].push_back(i);
+
+        vector<NodeClusters::Summary> found;
+        size_t n = clusters.clusters(found);
+        BOOST_CHECK_EQUAL(n, found.size());
+        BOOST_REQUIRE_EQUAL(found.size(), expected.size());
+
+        vector<size_t> membership;
+        clusters.membership(membership);
+        BOOST_REQUIRE_EQUAL(membership.size(), points.size());
+
+        for (size_t c = 0; c < found.size(); ++c) {
+            const NodeClusters::Summary& s = found[c];
+            BOOST_REQUIRE(s.node < points.size());
+            BOOST_CHECK_EQUAL(membership[s.node], s.id);
+
+            const vector<size_t>& members =
+                expected[make_pair(floor(points[s.node].x / size), floor(points[s.node].y / size))];
+            BOOST_CHECK_EQUAL(s.count, members.size());
+            double x = 0, y = 0, z = 0;
+            for (size_t m = 0; m < members.size(); ++m) {
+                BOOST_CHECK_EQUAL(membership[members[m]], s.id);
+                x += points[members[m]].x, y += points[members[m]].y, z += points[members[m]].z;
+            }
+            BOOST_CHECK_CLOSE(s.x, x / members.size(), 1e-6);
+            BOOST_CHECK_CLOSE(s.y, y / members.size(), 1e-6);
+            BOOST_CHECK_CLOSE(s.z, z / members.size(), 1e-6);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(empty_test)
+{
+    NodeClusters clusters;
+    vector<NodeClusters::Summary> found;
+    BOOST_CHECK_EQUAL(clusters.clusters(found), 0u);
+    BOOST_CHECK_EQUAL(clusters.size(), 0u);
+    BOOST_CHECK(clusters.setCellSize(16));
+    BOOST_CHECK_EQUAL(clusters.clusters(found), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(cell_size_test)
+{
+    NodeClusters clusters;
+    BOOST_CHECK_EQUAL(clusters.cellSize(), 1.0);
+    BOOST_CHECK(clusters.setCellSize(3));
+    BOOST_CHECK_EQUAL(clusters.cellSize(), 4.0);
+    BOOST_CHECK(!clusters.setCellSize(4));      // the same power of two does nothing
+    BOOST_CHECK(!clusters.setCellSize(3.5));
+    BOOST_CHECK(clusters.setCellSize(0.3));
+    BOOST_CHECK_EQUAL(clusters.cellSize(), 0.5);
+    BOOST_CHECK(!clusters.setCellSize(0));
+    BOOST_CHECK(!clusters.setCellSize(-2));
+    BOOST_CHECK_EQUAL(clusters.cellSize(), 0.5);
+    BOOST_CHECK_EQUAL(clusters.regroupings(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(zoom_test)
+{
+    srand(1);
+    NodeClusters clusters;
+    vector<Point> points(500);
+    for (size_t i = 0; i < points.size(); ++i) {
+        Point p = { random(-100, 100), random(-100, 100), random(0, 10) };
+        points[i] = p;
+        clusters.update(i, p.x, p.y, p.z);
+    }
+    BOOST_CHECK_EQUAL(clusters.size(), points.size());
+
+    double sizes[] = { 1, 8, 50, 1000, 0.01, 20 };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        clusters.setCellSize(sizes[s]);
+        checkClusters(clusters, points);
+    }
+
+    // Zoomed all the way out, there's a cluster for each quadrant about the origin.
+    clusters.setCellSize(1e6);
+    vector<NodeClusters::Summary> found;
+    BOOST_CHECK_EQUAL(clusters.clusters(found), 4u);
+}
+
+BOOST_AUTO_TEST_CASE(move_test)
+{
+    srand(2);
+    NodeClusters clusters;
+    clusters.setCellSize(32);
+    vector<Point> points(200);
+    for (size_t i = 0; i < points.size(); ++i) {
+        Point p = { 0, 0, 0 };         // nodes start at the origin until they hear from GPS
+        points[i] = p;
+        clusters.update(i, p.x, p.y, p.z);
+    }
+    checkClusters(clusters, points);
+
+    // Spread out, then move around a little at a time, then huddle together.
+    for (int round = 0; round < 5; ++round) {
+        for (size_t i = 0; i < points.size(); ++i) {
+            Point p = { random(-1000, 1000), random(-1000, 1000), random(0, 100) };
+            points[i] = p;
+            clusters.update(i, p.x, p.y, p.z);
+        }
+        checkClusters(clusters, points);
+    }
+    for (int round = 0; round < 20; ++round) {
+        for (size_t i = 0; i < points.size(); i += 3) {
+            points[i].x += random(-20, 20), points[i].y += random(-20, 20);
+            clusters.update(i, points[i].x, points[i].y, points[i].z);
+        }
+        checkClusters(clusters, points);
+    }
+    for (size_t i = 0; i < points.size(); ++i) {
+        Point p = { random(0, 30), random(0, 30), 0 };
+        points[i] = p;
+        clusters.update(i, p.x, p.y, p.z);
+    }
+    checkClusters(clusters, points);
+
+    vector<NodeClusters::Summary> found;
+    BOOST_CHECK_EQUAL(clusters.clusters(found), 1u);
+    BOOST_CHECK_EQUAL(found[0].count, points.size());
+    BOOST_CHECK_EQUAL(clusters.regroupings(), 1u);    // only when the cell size was set
+    BOOST_CHECK_EQUAL(clusters.size(), points.size());
+
+    clusters.clear();
+    BOOST_CHECK_EQUAL(clusters.size(), 0u);
+    found.clear();
+    BOOST_CHECK_EQUAL(clusters.clusters(found), 0u);
+}
@@ -0,0 +1,114 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define BOOST_TEST_MODULE node_id_list test
+
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#include <vector>
+
+#include "../nodeIdList.h"
+#include "../smallVector.h"
+
+using namespace std;
+using namespace watcher;
+using namespace boost::asio::ip;
+
+BOOST_AUTO_TEST_CASE(small_vector_test)
+{
+    SmallVector<int, 4> v;
+    BOOST_CHECK(v.empty());
+    for (int i = 0; i < 4; ++i)
+        v.push_back(i);
+    BOOST_CHECK(v.isInline());
+
+    // Past the inline room it goes to the heap, keeping what it had.
+    for (int i = 4; i < 100; ++i)
+        v.push_back(i);
+    BOOST_CHECK(!v.isInline());
+    BOOST_REQUIRE_EQUAL(v.size(), 100u);
+    for (int i = 0; i < 100; ++i)
+        BOOST_CHECK_EQUAL(v[i], i);
+
+    SmallVector<int, 4> copy(v);
+    BOOST_CHECK(copy == v);
+    copy.erase(copy.begin() + 10);
+    BOOST_CHECK(copy != v);
+    BOOST_CHECK_EQUAL(copy.size(), 99u);
+    BOOST_CHECK_EQUAL(copy[10], 11);
+    BOOST_CHECK_EQUAL(copy.back(), 99);
+
+    SmallVector<int, 4> small;
+    small.push_back(7);
+    v = small;
+    BOOST_CHECK(v == small);
+    BOOST_CHECK_EQUAL(v.front(), 7);
+    v.clear();
+    BOOST_CHECK(v.empty());
+}
+
+BOOST_AUTO_TEST_CASE(v4_test)
+{
+    NodeIdList ids;
+    vector<NodeIdentifier> expected;
+    for (unsigned long i = 1; i <= 20; ++i) {
+        ids.push_back(address_v4(0xc0a80100 + i));
+        expected.push_back(address_v4(0xc0a80100 + i));
+    }
+    BOOST_CHECK(ids.compact());
+    BOOST_REQUIRE_EQUAL(ids.size(), expected.size());
+    BOOST_CHECK(equal(ids.begin(), ids.end(), expected.begin()));
+    BOOST_CHECK_EQUAL(ids[0], NodeIdentifier::from_string("192.168.1.1"));
+
+    size_t n = 0;
+    BOOST_FOREACH(const NodeIdList::value_type &id, ids)
+        BOOST_CHECK_EQUAL(id, expected[n++]);
+    BOOST_CHECK_EQUAL(n, expected.size());
+
+    NodeIdList fromVector;
+    fromVector = expected;
+    BOOST_CHECK(fromVector == ids);
+    ids.clear();
+    BOOST_CHECK(ids.empty());
+    BOOST_CHECK(fromVector != ids);
+}
+
+BOOST_AUTO_TEST_CASE(v6_test)
+{
+    NodeIdList ids;
+    ids.push_back(NodeIdentifier::from_string("10.0.0.1"));
+    ids.push_back(NodeIdentifier::from_string("10.0.0.2"));
+    ids.push_back(NodeIdentifier::from_string("fe80::1"));
+    ids.push_back(NodeIdentifier::from_string("10.0.0.3"));
+    BOOST_CHECK(!ids.compact());
+    BOOST_REQUIRE_EQUAL(ids.size(), 4u);
+    BOOST_CHECK_EQUAL(ids[0], NodeIdentifier::from_string("10.0.0.1"));
+    BOOST_CHECK_EQUAL(ids[1], NodeIdentifier::from_string("10.0.0.2"));
+    BOOST_CHECK_EQUAL(ids[2], NodeIdentifier::from_string("fe80::1"));
+    BOOST_CHECK_EQUAL(ids[3], NodeIdentifier::from_string("10.0.0.3"));
+    BOOST_CHECK_EQUAL(ids.begin()->to_string(), "10.0.0.1");
+
+    // The same addresses compare equal however they are kept.
+    NodeIdList v4;
+    v4.push_back(NodeIdentifier::from_string("10.0.0.1"));
+    NodeIdList widened;
+    widened.push_back(NodeIdentifier::from_string("::1"));
+    widened.clear();
+    BOOST_CHECK(widened.compact());
+    widened.push_back(NodeIdentifier::from_string("10.0.0.1"));
+    BOOST_CHECK(v4 == widened);
+}
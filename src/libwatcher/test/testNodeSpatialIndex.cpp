@@ -0,0 +1,146 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define BOOST_TEST_MODULE node_spatial_index test
+
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "../nodeSpatialIndex.h"
+
+using namespace std;
+using namespace watcher;
+
+namespace {
+    struct Point { double x, y, z; };
+
+    double random(double lo, double hi)
+    {
+        return lo + (hi - lo) * (rand() / (RAND_MAX + 1.0));
+    }
+
+    vector<size_t> bruteForce(const vector<Point>& points, double xMin, double yMin, double xMax, double yMax)
+    {
+        vector<size_t> found;
+        for (size_t i = 0; i < points.size(); ++i)
+            if (points[i].x >= xMin && points[i].x <= xMax && points[i].y >= yMin && points[i].y <= yMax)
+                found.push_back(i);
+        return found;
+    }
+
+    void checkBounds(const NodeSpatialIndex& index, const vector<Point>& points)
+    {
+        SpatialBox box;
+        BOOST_REQUIRE(index.bounds(box));
+        double xMin = points[0].x, xMax = xMin, yMin = points[0].y, yMax = yMin, zMin = points[0].z, zMax = zMin;
+        for (size_t i = 1; i < points.size(); ++i) {
+            xMin = min(xMin, points[i].x), xMax = max(xMax, points[i].x);
+            yMin = min(yMin, points[i].y), yMax = max(yMax, points[i].y);
+            zMin = min(zMin, points[i].z), zMax = max(zMax, points[i].z);
+        }
+        BOOST_CHECK_EQUAL(box.xMin, xMin);
+        BOOST_CHECK_EQUAL(box.xMax, xMax);
+        BOOST_CHECK_EQUAL(box.yMin, yMin);
+        BOOST_CHECK_EQUAL(box.yMax, yMax);
+        BOOST_CHECK_EQUAL(box.zMin, zMin);
+        BOOST_CHECK_EQUAL(box.zMax, zMax);
+    }
+
+    void checkQueries(const NodeSpatialIndex& index, const vector<Point>& points, double extent)
+    {
+        for (int q = 0; q < 50; ++q) {
+            double x = random(-extent, extent), y = random(-extent, extent);
+            double w = random(0, extent / 2), h = random(0, extent / 2);
+            vector<size_t> found;
+            size_t n = index.query(x, y, x + w, y + h, found);
+            BOOST_CHECK_EQUAL(n, found.size());
+            sort(found.begin(), found.end());
+            vector<size_t> expected = bruteForce(points, x, y, x + w, y + h);
+            BOOST_CHECK(found == expected);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(empty_test)
+{
+    NodeSpatialIndex index;
+    SpatialBox box;
+    vector<size_t> found;
+    BOOST_CHECK(!index.bounds(box));
+    BOOST_CHECK_EQUAL(index.query(-1, -1, 1, 1, found), 0u);
+    BOOST_CHECK_EQUAL(index.size(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(query_test)
+{
+    srand(1);
+    NodeSpatialIndex index;
+    vector<Point> points(500);
+    for (size_t i = 0; i < points.size(); ++i) {
+        Point p = { random(-100, 100), random(-100, 100), random(0, 10) };
+        points[i] = p;
+        index.update(i, p.x, p.y, p.z);
+    }
+    BOOST_CHECK_EQUAL(index.size(), points.size());
+    checkBounds(index, points);
+    checkQueries(index, points, 100);
+
+    // A query box much bigger than the nodes, and one way off to the side.
+    vector<size_t> found;
+    BOOST_CHECK_EQUAL(index.query(-1e300, -1e300, 1e300, 1e300, found), points.size());
+    found.clear();
+    BOOST_CHECK_EQUAL(index.query(1000, 1000, 2000, 2000, found), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(move_test)
+{
+    srand(2);
+    NodeSpatialIndex index;
+    vector<Point> points(200);
+    for (size_t i = 0; i < points.size(); ++i) {
+        Point p = { 0, 0, 0 };         // nodes start at the origin until they hear from GPS
+        points[i] = p;
+        index.update(i, p.x, p.y, p.z);
+    }
+
+    // Spread out, then move around, then huddle together.
+    double extents[] = { 1000, 1000, 10 };
+    for (size_t e = 0; e < sizeof(extents) / sizeof(extents[0]); ++e) {
+        for (int round = 0; round < 5; ++round) {
+            for (size_t i = 0; i < points.size(); ++i) {
+                Point p = { random(-extents[e], extents[e]), random(-extents[e], extents[e]), random(0, extents[e] / 10) };
+                points[i] = p;
+                index.update(i, p.x, p.y, p.z);
+            }
+            checkBounds(index, points);
+            checkQueries(index, points, extents[e]);
+        }
+    }
+
+    // The node on the edge moving in shrinks the box.
+    size_t edge = 0;
+    for (size_t i = 1; i < points.size(); ++i)
+        if (points[i].x > points[edge].x)
+            edge = i;
+    points[edge].x = 0;
+    index.update(edge, points[edge].x, points[edge].y, points[edge].z);
+    checkBounds(index, points);
+    BOOST_CHECK(index.rebuilds() > 1);
+    BOOST_CHECK_EQUAL(index.size(), points.size());
+}
@@ -0,0 +1,424 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ *
+ * This file is part of WATCHER.
+ *
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ *
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define BOOST_TEST_MODULE replay_clock test
+
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "../replayClock.h"
+#include "../replayScheduler.h"
+#include "../messageTypesAndVersions.h"
+
+using namespace std;
+using namespace watcher;
+using namespace watcher::event;
+
+namespace {
+    /* An event stream in memory, read the way the event database is:
+     * strictly after (or before) the given time, a block at a time. */
+    struct Source {
+        vector<Timestamp> stamps;      // in order
+        size_t fetches;
+
+        Source(const vector<Timestamp>& s = vector<Timestamp>()) : stamps(s), fetches(0) { }
+
+        void fetch(Timestamp t, bool forward, unsigned int n, deque<MessagePtr>& out)
+        {
+            ++fetches;
+            for (size_t i = 0; i < stamps.size() && n > 0; ++i) {
+                Timestamp ts = forward ? stamps[i] : stamps[stamps.size() - 1 - i];
+                if (forward ? ts > t : ts < t) {
+                    MessagePtr m(new Message(GPS_MESSAGE_TYPE, GPS_MESSAGE_VERSION));
+                    m->timestamp = ts;
+                    out.push_back(m);
+                    --n;
+                }
+            }
+        }
+
+        Timestamp end() { return stamps.empty() ? 0 : stamps.back(); }
+    };
+
+    /* Collects what the scheduler sends, and when.  Returning false once
+     * it has all it wants pauses playback, so the io_service runs out of
+     * work and the test carries on. */
+    struct Sink {
+        vector<Timestamp> sent;
+        vector<int64_t> when;          // monotonicTime() each event was sent
+        size_t wakeups;
+        size_t want;
+
+        explicit Sink(size_t w) : wakeups(0), want(w) { }
+
+        bool deliver(const vector<MessagePtr>& msgs)
+        {
+            ++wakeups;
+            int64_t now = monotonicTime();
+            for (size_t i = 0; i < msgs.size(); ++i) {
+                sent.push_back(msgs[i]->timestamp);
+                when.push_back(now);
+            }
+            return sent.size() < want;
+        }
+
+        /* Several events may share a timestamp at slow speeds. */
+        bool inOrder(bool forward) const
+        {
+            for (size_t i = 1; i < sent.size(); ++i)
+                if (forward ? sent[i] < sent[i - 1] : sent[i] > sent[i - 1])
+                    return false;
+            return true;
+        }
+    };
+
+    /* Where the stream should be at a point in real time: a list of
+     * (real time, stream time, speed) anchors, one per speed change. */
+    struct Timeline {
+        struct Anchor { int64_t wall; Timestamp stream; float speed; };
+        vector<Anchor> anchors;
+
+        void add(int64_t wall, Timestamp stream, float speed)
+        {
+            Anchor a = { wall, stream, speed };
+            anchors.push_back(a);
+        }
+
+        /* When stream time t should be reached. */
+        int64_t due(Timestamp t) const
+        {
+            const Anchor *a = &anchors.front();
+            for (size_t i = 1; i < anchors.size(); ++i)
+                if ((t - anchors[i].stream) * anchors[i].speed >= 0)
+                    a = &anchors[i];
+            return a->wall + static_cast<int64_t>((t - a->stream) * 1000.0 / a->speed);
+        }
+
+        /* How late each event was; negative if it went early. */
+        vector<int64_t> lateness(const Sink& s) const
+        {
+            vector<int64_t> late;
+            for (size_t i = 0; i < s.sent.size(); ++i)
+                late.push_back(s.when[i] - due(s.sent[i]));
+            return late;
+        }
+    };
+
+    int64_t maxOf(const vector<int64_t>& v) { return *std::max_element(v.begin(), v.end()); }
+    int64_t minOf(const vector<int64_t>& v) { return *std::min_element(v.begin(), v.end()); }
+    int64_t meanOf(const vector<int64_t>& v)
+    {
+        int64_t sum = 0;
+        for (size_t i = 0; i < v.size(); ++i)
+            sum += v[i];
+        return sum / static_cast<int64_t>(v.size());
+    }
+
+    /* count events spread evenly over wallMs of playback at the given speed */
+    vector<Timestamp> makeEvents(size_t count, int64_t wallMs, double speed)
+    {
+        const Timestamp base = 1262304000000LL;
+        double span = wallMs * (speed < 0 ? -speed : speed);
+        vector<Timestamp> events;
+        for (size_t i = 0; i < count; ++i)
+            events.push_back(base + static_cast<Timestamp>(i * span / count));
+        return events;
+    }
+
+    boost::shared_ptr<ReplayScheduler> makeScheduler(boost::asio::io_service& ios, Source& src, Sink& sink,
+            Timestamp t = 0, float speed = 1.0f)
+    {
+        return boost::shared_ptr<ReplayScheduler>(new ReplayScheduler(ios,
+                    boost::bind(&Source::fetch, &src, _1, _2, _3, _4),
+                    boost::bind(&Sink::deliver, &sink, _1),
+                    boost::bind(&Source::end, &src), t, speed));
+    }
+
+    /* Run f after ms milliseconds of the io_service running. */
+    void after(MonotonicTimer& timer, unsigned int ms, const boost::function<void()>& f)
+    {
+        timer.expires_at(monotonicTime() + ms * 1000);
+        timer.async_wait(boost::bind(f));
+    }
+}
+
+BOOST_AUTO_TEST_CASE( mapping_test )
+{
+    ReplayClock c(1000, 2.0);
+    BOOST_CHECK(!c.running());
+    BOOST_CHECK_EQUAL(c.wallTime(2000), -1);
+    boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+    BOOST_CHECK_EQUAL(c.now(), 1000);           // a stopped clock does not move
+
+    int64_t started = monotonicTime();
+    c.start();
+    boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+    Timestamp t = c.now();
+    BOOST_CHECK(t >= 1100);                     // at least 50ms at 2x
+    BOOST_CHECK(t <= 1000 + (monotonicTime() - started) / 500);
+    BOOST_CHECK(c.due(1100));
+    BOOST_CHECK(!c.due(t + 100000));
+
+    c.speed(0.5);                               // carries on from where it was
+    BOOST_CHECK(c.now() >= t);
+
+    int64_t before = monotonicTime();
+    int64_t w = c.wallTime(c.now() + 100);     // 100ms of stream time at 0.5x
+    BOOST_CHECK(w - before <= 200000);
+    BOOST_CHECK(w - monotonicTime() > 0);
+
+    c.stop();
+    t = c.now();
+    boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+    BOOST_CHECK_EQUAL(c.now(), t);
+
+    c.seek(500);
+    BOOST_CHECK_EQUAL(c.now(), 500);
+
+    /* reverse playback */
+    c.speed(-1.0);
+    c.start();
+    boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+    BOOST_CHECK(c.now() < 500);
+    BOOST_CHECK(c.due(501));                    // already passed
+    BOOST_CHECK(!c.due(c.now() - 100000));
+    BOOST_CHECK(c.lateness(500) >= 20000);
+    BOOST_CHECK_EQUAL(c.lateness(0), 0);
+}
+
+BOOST_AUTO_TEST_CASE( tick_test )
+{
+    BOOST_CHECK_EQUAL(ReplayClock::nextTick(0, 10000), 0);
+    BOOST_CHECK_EQUAL(ReplayClock::nextTick(1, 10000), 10000);
+    BOOST_CHECK_EQUAL(ReplayClock::nextTick(10000, 10000), 10000);
+    BOOST_CHECK_EQUAL(ReplayClock::nextTick(10001, 10000), 20000);
+    BOOST_CHECK_EQUAL(ReplayClock::nextTick(12345, 0), 12345);
+}
+
+/* Play 200 events over 200ms of real time at speeds from 0.1x to 100x,
+ * fetching them 20 at a time, and check that none is sent early or more
+ * than one tick late, give or take the scheduler.  Slow speeds have
+ * several events per tick; fast ones have many more, and all of an
+ * instant's events still go out in one wakeup. */
+BOOST_AUTO_TEST_CASE( drift_test )
+{
+    const unsigned int step = 10;
+    const int64_t tick = step * 1000;
+    const float speeds[] = { 0.1f, 0.5f, 1.0f, 2.0f, 10.0f, 100.0f, -1.0f, -100.0f };
+
+    for (size_t s = 0; s < sizeof(speeds) / sizeof(speeds[0]); ++s) {
+        boost::asio::io_service ios;
+        vector<Timestamp> events = makeEvents(200, 200, speeds[s]);
+        Source src(events);
+        Sink sink(events.size());
+        boost::shared_ptr<ReplayScheduler> p = makeScheduler(ios, src, sink, 0, speeds[s]);
+        p->buffer_size(20);
+        p->time_step(step);
+
+        /* Forward playback starts at the first event.  Reverse starts just
+         * after the last, as the database is read strictly before it. */
+        Timestamp origin = speeds[s] > 0 ? events.front() : events.back() + 1;
+        if (speeds[s] < 0)
+            p->seek(origin);
+        Timeline line;
+        int64_t begin = monotonicTime();
+        line.add(begin, origin, speeds[s]);
+        p->play();
+        ios.run();
+        int64_t elapsed = monotonicTime() - begin;
+
+        BOOST_REQUIRE_EQUAL(sink.sent.size(), events.size());
+        vector<int64_t> late = line.lateness(sink);
+        BOOST_TEST_MESSAGE("speed " << speeds[s] << ": " << sink.sent.size() << " events in " <<
+                sink.wakeups << " wakeups and " << src.fetches << " fetches over " << elapsed / 1000 <<
+                "ms, lateness mean " << meanOf(late) << "us max " << maxOf(late) << "us");
+        BOOST_CHECK(sink.inOrder(speeds[s] > 0));
+        BOOST_CHECK(!p->playing());                             // paused once the sink was done
+        BOOST_CHECK(src.fetches >= events.size() / 20);         // refilled as it went
+        BOOST_CHECK(sink.wakeups <= 200000 / tick + 25);        // one per tick at most
+        BOOST_CHECK(minOf(late) >= -1000);                      // none early, bar rounding to ms
+        BOOST_CHECK(meanOf(late) < tick + 5000);
+        BOOST_CHECK(maxOf(late) < tick + 50000);
+        BOOST_CHECK(elapsed < 200000 + tick + 50000);           // no drift accumulates
+    }
+}
+
+namespace {
+    void changeSpeed(boost::shared_ptr<ReplayScheduler> p, Timeline *line, float f)
+    {
+        int64_t now = monotonicTime();
+        p->speed(f);
+        line->add(now, p->tell(), f);
+    }
+}
+
+/* Changing speed halfway through does not disturb the timing of the rest. */
+BOOST_AUTO_TEST_CASE( speed_change_test )
+{
+    const int64_t tick = 10000;
+    boost::asio::io_service ios;
+    // 100 events over 100ms at 1x, then 100 over 100ms at 10x
+    vector<Timestamp> events = makeEvents(100, 100, 1.0);
+    vector<Timestamp> fast = makeEvents(100, 100, 10.0);
+    Timestamp offset = events.back() + 1 - fast.front();
+    for (size_t i = 0; i < fast.size(); ++i)
+        events.push_back(fast[i] + offset);
+
+    Source src(events);
+    Sink sink(events.size());
+    boost::shared_ptr<ReplayScheduler> p = makeScheduler(ios, src, sink);
+    MonotonicTimer timer(ios);
+    Timeline line;
+    int64_t begin = monotonicTime();
+    line.add(begin, events.front(), 1.0);
+    after(timer, 100, boost::bind(changeSpeed, p, &line, 10.0f));
+    p->play();
+    ios.run();
+    int64_t elapsed = monotonicTime() - begin;
+
+    BOOST_REQUIRE_EQUAL(sink.sent.size(), events.size());
+    vector<int64_t> late = line.lateness(sink);
+    BOOST_TEST_MESSAGE("speed change: lateness mean " << meanOf(late) << "us max " << maxOf(late) <<
+            "us over " << elapsed / 1000 << "ms");
+    BOOST_CHECK(sink.inOrder(true));
+    BOOST_CHECK_EQUAL(p->speed(), 10.0f);
+    BOOST_CHECK(maxOf(late) < tick + 50000);
+    BOOST_CHECK(elapsed < 200000 + tick + 50000);
+}
+
+namespace {
+    struct ResyncCheck {
+        boost::shared_ptr<ReplayScheduler> p;
+        Source *src;
+        Timestamp first;                // timestamp of the events to add
+        Timestamp pos;
+        float speed;
+        int64_t added;
+        void operator()()
+        {
+            pos = p->tell();
+            speed = p->speed();
+            added = monotonicTime();
+            src->stamps.push_back(first);
+            src->stamps.push_back(first + 5);
+        }
+    };
+}
+
+/* At the end of the stream the scheduler waits for more at normal speed,
+ * and sends what turns up straight away however old its timestamp. */
+BOOST_AUTO_TEST_CASE( resync_test )
+{
+    boost::asio::io_service ios;
+    Source src;
+    Sink sink(2);
+    boost::shared_ptr<ReplayScheduler> p = makeScheduler(ios, src, sink, 0, 0.5f);
+    p->eof_poll(20);
+    BOOST_CHECK_EQUAL(p->tell(), 0);            // the start, wherever that turns out to be
+
+    MonotonicTimer timer(ios);
+    ResyncCheck check = { p, &src, 1000, 0, 0.0f, 0 };
+    after(timer, 50, boost::ref(check));
+    p->play();
+    ios.run();
+
+    BOOST_CHECK_EQUAL(check.pos, -1);           // waiting at the end
+    BOOST_CHECK_EQUAL(check.speed, 1.0f);       // at normal speed
+    BOOST_REQUIRE_EQUAL(sink.sent.size(), 2u);
+    BOOST_CHECK_EQUAL(sink.sent[0], 1000);
+    BOOST_CHECK_EQUAL(sink.sent[1], 1005);
+    BOOST_CHECK(sink.when[0] - check.added < 20000 + 10000 + 50000);   // within a poll, give or take
+
+    /* Seeking to the end skips what is already there. */
+    boost::asio::io_service ios2;
+    Source old(makeEvents(10, 10, 1.0));
+    Sink sink2(1);
+    p = makeScheduler(ios2, old, sink2);
+    p->eof_poll(20);
+    p->seek(-1);
+    BOOST_CHECK_EQUAL(p->tell(), -1);
+    MonotonicTimer timer2(ios2);
+    Timestamp newest = old.stamps.back() + 100;
+    ResyncCheck check2 = { p, &old, newest, 0, 0.0f, 0 };
+    after(timer2, 50, boost::ref(check2));
+    p->play();
+    ios2.run();
+    BOOST_REQUIRE(!sink2.sent.empty());
+    BOOST_CHECK_EQUAL(sink2.sent[0], newest);
+}
+
+namespace {
+    void seekTo(boost::shared_ptr<ReplayScheduler> p, Timestamp t)
+    {
+        p->seek(t);
+        for (int i = 0; i < 20; ++i)
+            p->speed(1.0);                      // reschedules every time
+    }
+
+    void pauseAndCount(boost::shared_ptr<ReplayScheduler> p, Sink *sink, size_t *count)
+    {
+        p->pause();
+        *count = sink->sent.size();
+    }
+}
+
+/* Every seek, speed change and pause cancels the timer, but a handler may
+ * already be queued.  Those stale handlers must not send anything, or
+ * events would go out twice or after a pause. */
+BOOST_AUTO_TEST_CASE( generation_test )
+{
+    boost::asio::io_service ios;
+    vector<Timestamp> events = makeEvents(100, 100, 1.0);   // one a millisecond
+    Source src(events);
+    Sink sink(events.size());
+    boost::shared_ptr<ReplayScheduler> p = makeScheduler(ios, src, sink);
+    p->buffer_size(10);
+    MonotonicTimer timer(ios), stop(ios);
+    after(timer, 30, boost::bind(seekTo, p, events[60]));
+    after(stop, 200, boost::bind(&boost::asio::io_service::stop, &ios));
+    p->play();
+    ios.run();
+
+    // the sink never got all 100, so playback carried on to the end
+    BOOST_CHECK(p->playing());
+    BOOST_CHECK(sink.inOrder(true));
+    BOOST_CHECK(adjacent_find(sink.sent.begin(), sink.sent.end()) == sink.sent.end());    // none twice
+    BOOST_REQUIRE(!sink.sent.empty());
+    BOOST_CHECK_EQUAL(sink.sent.back(), events.back());
+    BOOST_CHECK(find(sink.sent.begin(), sink.sent.end(), events[60]) == sink.sent.end());  // skipped
+    BOOST_CHECK(sink.sent.size() < events.size());
+    BOOST_CHECK(sink.wakeups <= 100000 / 10000 + 25);
+    p->pause();
+
+    /* Nothing goes out after a pause. */
+    boost::asio::io_service ios2;
+    Source src2(events);
+    Sink sink2(events.size());
+    p = makeScheduler(ios2, src2, sink2);
+    MonotonicTimer timer2(ios2);
+    size_t atPause = 0;
+    after(timer2, 30, boost::bind(pauseAndCount, p, &sink2, &atPause));
+    p->play();
+    ios2.run();
+    BOOST_CHECK(!p->playing());
+    BOOST_CHECK(atPause > 0);
+    BOOST_CHECK_EQUAL(sink2.sent.size(), atPause);
+}
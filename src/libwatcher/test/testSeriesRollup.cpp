@@ -0,0 +1,187 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ * 
+ * This file is part of WATCHER.
+ * 
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ * 
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ * 
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define BOOST_TEST_MODULE series_rollup test
+
+#include <boost/test/unit_test.hpp>
+
+#include "../seriesRollup.h"
+
+using namespace std;
+using namespace watcher;
+
+namespace {
+    const Timestamp T0 = 1262304000000LL;      // on the hour
+    const Timestamp minute = 60 * 1000;
+}
+
+/* Points out of order land in the right buckets, at every level. */
+BOOST_AUTO_TEST_CASE( add_test )
+{
+    SeriesRollup r;
+    r.add(T0 + 5500, 5);
+    r.add(T0 + 1200, 1);
+    r.add(T0 + 3000, 3);
+    r.add(T0 + 1700, 7);
+    r.add(T0 + 1100, 2);
+
+    const deque<SeriesRollup::Bucket>& secs = r.buckets(0);
+    BOOST_REQUIRE_EQUAL(secs.size(), 3u);
+    BOOST_CHECK_EQUAL(secs[0].time, T0 + 1000);
+    BOOST_CHECK_EQUAL(secs[1].time, T0 + 3000);
+    BOOST_CHECK_EQUAL(secs[2].time, T0 + 5000);
+    BOOST_CHECK_EQUAL(secs[0].count, 3u);
+    BOOST_CHECK_EQUAL(secs[0].min, 1);
+    BOOST_CHECK_EQUAL(secs[0].max, 7);
+    BOOST_CHECK_EQUAL(secs[0].last, 7);         // latest timestamp, not latest added
+    BOOST_CHECK_CLOSE(secs[0].mean(), 10.0 / 3, 0.0001);
+
+    for (size_t l = 1; l < SeriesRollup::numLevels; ++l) {
+        BOOST_REQUIRE_EQUAL(r.buckets(l).size(), 1u);
+        const SeriesRollup::Bucket& b = r.buckets(l).front();
+        BOOST_CHECK_EQUAL(b.time, T0);
+        BOOST_CHECK_EQUAL(b.count, 5u);
+        BOOST_CHECK_EQUAL(b.min, 1);
+        BOOST_CHECK_EQUAL(b.max, 7);
+        BOOST_CHECK_EQUAL(b.last, 5);
+        BOOST_CHECK(!r.trimmed(l));
+    }
+}
+
+/* The finer levels only keep their retention, counted back from the newest bucket. */
+BOOST_AUTO_TEST_CASE( trim_test )
+{
+    SeriesRollup r;
+    r.add(T0, 1);
+    BOOST_CHECK(!r.trimmed(0));
+    r.add(T0 + 10 * minute, 2);                 // the 1s level keeps 10 minutes
+    BOOST_CHECK(r.trimmed(0));
+    BOOST_REQUIRE_EQUAL(r.buckets(0).size(), 1u);
+    BOOST_CHECK_EQUAL(r.buckets(0).front().time, T0 + 10 * minute);
+    BOOST_CHECK(!r.trimmed(1));
+    BOOST_CHECK_EQUAL(r.buckets(1).size(), 2u);
+
+    r.add(T0 + 1000, 3);                        // late, but still within 10 minutes
+    BOOST_CHECK_EQUAL(r.buckets(0).size(), 2u);
+    BOOST_CHECK_EQUAL(r.buckets(0).front().time, T0 + 1000);
+
+    r.add(T0 - 1000, 4);                        // too old for the 1s level
+    BOOST_CHECK_EQUAL(r.buckets(0).size(), 2u);
+    BOOST_CHECK_EQUAL(r.buckets(0).front().time, T0 + 1000);
+    BOOST_CHECK_EQUAL(r.buckets(1).front().time, T0 - 10000);
+    BOOST_CHECK_EQUAL(r.buckets(4).front().time, T0 - 60 * minute);
+    BOOST_CHECK_EQUAL(r.buckets(4).size(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE( level_test )
+{
+    BOOST_CHECK_EQUAL(SeriesRollup::levelFor(500), 0u);
+    BOOST_CHECK_EQUAL(SeriesRollup::levelFor(1000), 0u);
+    BOOST_CHECK_EQUAL(SeriesRollup::levelFor(30000), 1u);
+    BOOST_CHECK_EQUAL(SeriesRollup::levelFor(minute), 2u);
+    BOOST_CHECK_EQUAL(SeriesRollup::levelFor(120 * minute), 4u);
+
+    BOOST_CHECK_EQUAL(SeriesRollup::bucketWidth(0, 500), 1000);
+    BOOST_CHECK_EQUAL(SeriesRollup::bucketWidth(1, 30000), 30000);
+    BOOST_CHECK_EQUAL(SeriesRollup::bucketWidth(1, 45000), 50000);
+    BOOST_CHECK_EQUAL(SeriesRollup::bucketWidth(4, 120 * minute), 120 * minute);
+
+    /* A trimmed level is passed over if it no longer reaches the start. */
+    SeriesRollup r;
+    r.add(T0, 1);
+    r.add(T0 + 20 * minute, 2);
+    BOOST_CHECK(r.trimmed(0));
+    BOOST_CHECK_EQUAL(r.level(T0, 1000), 1u);
+    BOOST_CHECK_EQUAL(r.level(T0 + 20 * minute, 1000), 0u);
+    BOOST_CHECK_EQUAL(r.level(T0, minute), 2u);
+
+    SeriesRollup::BucketList out;
+    BOOST_CHECK_EQUAL(r.query(T0, Infinity, 1000, out), 10000);
+    BOOST_REQUIRE_EQUAL(out.size(), 2u);
+    BOOST_CHECK_EQUAL(out[0].time, T0);
+    BOOST_CHECK_EQUAL(out[1].time, T0 + 20 * minute);
+}
+
+/* Buckets are merged up to the resolution asked for. */
+BOOST_AUTO_TEST_CASE( query_test )
+{
+    SeriesRollup r;
+    for (int i = 0; i < 60; ++i)
+        r.add(T0 + i * 1000, i);
+
+    SeriesRollup::BucketList out;
+    BOOST_CHECK_EQUAL(r.query(T0, Infinity, 30000, out), 30000);
+    BOOST_REQUIRE_EQUAL(out.size(), 2u);
+    BOOST_CHECK_EQUAL(out[0].time, T0);
+    BOOST_CHECK_EQUAL(out[0].count, 30u);
+    BOOST_CHECK_EQUAL(out[0].min, 0);
+    BOOST_CHECK_EQUAL(out[0].max, 29);
+    BOOST_CHECK_EQUAL(out[0].last, 29);
+    BOOST_CHECK_CLOSE(out[0].mean(), 14.5, 0.0001);
+    BOOST_CHECK_EQUAL(out[1].time, T0 + 30000);
+    BOOST_CHECK_EQUAL(out[1].count, 30u);
+    BOOST_CHECK_EQUAL(out[1].min, 30);
+    BOOST_CHECK_EQUAL(out[1].last, 59);
+
+    /* The bucket holding begin is included whole; end is inclusive. */
+    out.clear();
+    r.query(T0 + 15000, T0 + 29999, 30000, out);
+    BOOST_REQUIRE_EQUAL(out.size(), 1u);
+    BOOST_CHECK_EQUAL(out[0].count, 30u);
+
+    /* Nothing before from is used. */
+    out.clear();
+    r.query(T0, Infinity, 30000, out, T0 + 20000);
+    BOOST_REQUIRE_EQUAL(out.size(), 2u);
+    BOOST_CHECK_EQUAL(out[0].time, T0);
+    BOOST_CHECK_EQUAL(out[0].count, 10u);
+    BOOST_CHECK_EQUAL(out[0].min, 20);
+    BOOST_CHECK_EQUAL(out[1].count, 30u);
+
+    out.clear();
+    r.query(T0 + 2 * minute, Infinity, 1000, out);
+    BOOST_CHECK(out.empty());
+}
+
+BOOST_AUTO_TEST_CASE( merge_test )
+{
+    SeriesRollup::BucketList a, b;
+    a.push_back(SeriesRollup::Bucket(T0));
+    a.back().add(T0 + 10, 1);
+    a.back().add(T0 + 20, 2);
+    b.push_back(SeriesRollup::Bucket(T0));
+    b.back().add(T0 + 15, 3);
+    b.push_back(SeriesRollup::Bucket(T0 + 30000));
+    b.back().add(T0 + 30000, 4);
+
+    SeriesRollup::merge(a, b);
+    BOOST_REQUIRE_EQUAL(a.size(), 2u);
+    BOOST_CHECK_EQUAL(a[0].time, T0);
+    BOOST_CHECK_EQUAL(a[0].count, 3u);
+    BOOST_CHECK_EQUAL(a[0].min, 1);
+    BOOST_CHECK_EQUAL(a[0].max, 3);
+    BOOST_CHECK_EQUAL(a[0].last, 2);            // T0 + 20 is the latest
+    BOOST_CHECK_EQUAL(a[1].time, T0 + 30000);
+    BOOST_CHECK_EQUAL(a[1].count, 1u);
+
+    SeriesRollup::BucketList empty;
+    SeriesRollup::merge(a, empty);
+    BOOST_CHECK_EQUAL(a.size(), 2u);
+    SeriesRollup::merge(empty, a);
+    BOOST_CHECK_EQUAL(empty.size(), 2u);
+    BOOST_CHECK_EQUAL(empty[0].count, 3u);
+}
@@ -41,7 +41,7 @@ using namespace watcher::event;
 INIT_LOGGER(WatcherGraph, "WatcherGraph");
 
 WatcherGraph::WatcherGraph(const size_t &maxNodes, const size_t &maxLayers) : 
-    maxNumNodes(maxNodes), maxNumLayers(maxLayers), timeForward(true), numValidNodes(0), numValidLayers(0)
+    maxNumNodes(maxNodes), maxNumLayers(maxLayers), timeForward(true), changes(0), numValidNodes(0), numValidLayers(0)
 {
     layers=new WatcherLayerData[maxLayers];
     if (!layers) { 
@@ -108,6 +108,7 @@ size_t WatcherGraph::name2LayerIndex(const std::string &name)
         layerIndexMap[name]=numValidLayers; 
         LOG_DEBUG("new layer added: " << name << " at location " << numValidLayers); 
         numValidLayers++;
+        ++changes;
         return numValidLayers-1;
     }
     return layer->second;
@@ -122,6 +123,7 @@ void WatcherGraph::clear()
     // clear layers.
     for (size_t i=0; i<numValidLayers; i++) 
         layers[i].clear();
+    ++changes;
 }
 
 void WatcherGraph::setTimeDirectionForward(bool forward)
@@ -165,7 +167,10 @@ size_t WatcherGraph::nid2Index(const NodeIdentifier &nid)
         nid2IndexMap[addr]=numValidNodes;       // creates entry for addr
         index2nidMap[numValidNodes]=addr;       // writes into exising new'd memory   
         nodes[numValidNodes].loadConfiguration(PHYSICAL_LAYER, nid); // nodes are always on the physical layer. (for now). 
+        spatialIndex.update(numValidNodes, nodes[numValidNodes].x, nodes[numValidNodes].y, nodes[numValidNodes].z); 
+        clusters.update(numValidNodes, nodes[numValidNodes].x, nodes[numValidNodes].y, nodes[numValidNodes].z); 
         numValidNodes++;
+        ++changes;
         LOG_INFO("Loaded configuration for node " << nid << ". This is node number " << numValidNodes-1); 
         return numValidNodes-1;
     }
@@ -254,6 +259,7 @@ bool WatcherGraph::addEdge(const EdgeMessagePtr &message)
 void WatcherGraph::doMaintanence(const watcher::Timestamp &ts)
 {
     Timestamp now=ts==0?watcher::getCurrentTime():ts;
+    bool changed=false;
     for (size_t l=0; l!=numValidLayers; l++)  {
         if (!layers[l].isActive) 
             continue;
@@ -261,8 +267,12 @@ void WatcherGraph::doMaintanence(const watcher::Timestamp &ts)
             WatcherLayerData::UpgradeLock lock(layers[l].floatingLabelsMutex); 
             WatcherLayerData::WriteLock writeLock(lock); 
             for (WatcherLayerData::FloatingLabels::iterator label=layers[l].floatingLabels.begin(); label!=layers[l].floatingLabels.end(); ) {
-                if (label->expiration!=Infinity && (timeForward ? (now > label->expiration) : (now < label->expiration))) 
+                if (label->expiration!=Infinity && (timeForward ? (now > label->expiration) : (now < label->expiration))) {
+                    if (labelExpiredFunction)
+                        labelExpiredFunction(*label);
                     layers[l].floatingLabels.erase(label++); 
+                    changed=true;
+                }
                 else
                     ++label;
             }
@@ -277,14 +287,19 @@ void WatcherGraph::doMaintanence(const watcher::Timestamp &ts)
                             if ((timeForward ? (now > layers[l].edgeExpirations[n][n2]) : (now < layers[l].edgeExpirations[n][n2]))) { 
                                 layers[l].edges[n][n2]=0; 
                                 layers[l].edgeExpirations[n][n2]=Infinity; 
+                                changed=true;
                             }
                         }
                     }
                     WatcherLayerData::UpgradeLock lock(layers[l].edgeLabelsMutexes[n][n2]);
                     WatcherLayerData::WriteLock writeLock(lock);
                     for (WatcherLayerData::EdgeLabels::iterator label=layers[l].edgeLabels[n][n2].begin(); label!=layers[l].edgeLabels[n][n2].end(); ) {
-                        if (label->expiration!=Infinity && (timeForward ? (now > label->expiration) : (now < label->expiration))) 
+                        if (label->expiration!=Infinity && (timeForward ? (now > label->expiration) : (now < label->expiration))) {
+                            if (labelExpiredFunction)
+                                labelExpiredFunction(*label);
                             layers[l].edgeLabels[n][n2].erase(label++); 
+                            changed=true;
+                        }
                         else
                             ++label;
                     }
@@ -292,14 +307,21 @@ void WatcherGraph::doMaintanence(const watcher::Timestamp &ts)
                 WatcherLayerData::UpgradeLock lock(layers[l].nodeLabelsMutexes[n]); 
                 WatcherLayerData::WriteLock writeLock(lock); 
                 for (WatcherLayerData::NodeLabels::iterator label=layers[l].nodeLabels[n].begin(); label!=layers[l].nodeLabels[n].end(); ) {
-                    if (label->expiration!=Infinity && (timeForward ? (now > label->expiration) : (now < label->expiration))) 
+                    if (label->expiration!=Infinity && (timeForward ? (now > label->expiration) : (now < label->expiration))) {
+                        if (labelExpiredFunction)
+                            labelExpiredFunction(*label);
                         layers[l].nodeLabels[n].erase(label++); 
+                        changed=true;
+                    }
                     else
                         ++label;
                 }
             }
         }
     }
+    if (changed)
+        ++changes;
+
     // May add these back as toggable functionality for use in smaller test bed scenarios
     // removed: support for flashing
     // removed: support for spinning
@@ -314,6 +336,8 @@ bool WatcherGraph::updateNodeLocation(const GPSMessagePtr &message)
     nodes[index].z=message->z;
     if (locationTranslationFunction) 
         locationTranslationFunction(nodes[index].x, nodes[index].y, nodes[index].z, message->dataFormat); 
+    spatialIndex.update(index, nodes[index].x, nodes[index].y, nodes[index].z); 
+    clusters.update(index, nodes[index].x, nodes[index].y, nodes[index].z); 
     return true;
 }
 
@@ -418,6 +442,8 @@ bool WatcherGraph::updateGraph(const MessagePtr &message)
             retVal=false;
             break;
     }
+    if (retVal)
+        ++changes;
 
     TRACE_EXIT_RET(retVal);
     return retVal;
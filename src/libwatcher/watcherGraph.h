@@ -25,12 +25,15 @@
 #define WATCHER_GRAPH_H_WHAT_DO_VEGAN_ZOMBIES_EAT_____GRAINS__GRAINS
 
 #include <boost/function.hpp>
+#include <boost/detail/atomic_count.hpp>
 
 #include <map>
 // #include <unordered_map>        // TR1 requires extra compile flag to get functionality
 
 #include "watcherLayerData.h"
 #include "nodeDisplayInfo.h"
+#include "nodeSpatialIndex.h"
+#include "nodeClusters.h"
 
 #include "connectivityMessage.h"
 #include "gpsMessage.h"
@@ -96,6 +99,21 @@ namespace watcher
             /** numner of valid nodes in nodes */
             size_t numValidNodes;
 
+            /**
+             * Where the nodes are, by index into nodes. Kept up to date as 
+             * nodes are heard from and move, so GUIs can find the nodes in an 
+             * area (to pick or cull them) and the extent of the nodes without 
+             * going through every node. 
+             */
+            NodeSpatialIndex spatialIndex;
+
+            /**
+             * The nodes grouped by where they are, kept up to date along with 
+             * spatialIndex. GUIs set the cell size from their zoom and draw a 
+             * cluster of nodes as one when there are too many to draw. 
+             */
+            NodeClusters clusters;
+
             /**
              * Convert a watcher nodeId into an integer that cna be used to index
              * into the various arrays of nodes, edges, and labels. This function 
@@ -172,6 +190,16 @@ namespace watcher
             typedef boost::function<bool (double &x, double &y, double &z, const GPSMessage::DataFormat &f)> LocationTranslateFunction;
             LocationTranslateFunction locationTranslationFunction;
 
+            /**
+             * If set, doMaintanence() calls this with each node, edge, and floating 
+             * label it expires, just before the label is removed. It is called from 
+             * the thread which calls doMaintanence() with the label's lock held, so
+             * it should be quick. GUIs which cache things per label (rendered text, 
+             * say) can use it to throw away what they cached.
+             */
+            typedef boost::function<void (const LabelDisplayInfo &label)> LabelExpiredFunction;
+            LabelExpiredFunction labelExpiredFunction;
+
             /**
              * Update Graph internals (component experations, etc). 
              * Should be called periodically. If a timestamp is given,
@@ -195,6 +223,18 @@ namespace watcher
              */
             void clear();
 
+            /**
+             * A count of the changes made to the graph. It goes up whenever updateGraph(), 
+             * doMaintanence(), or clear() change something, so a GUI which keeps 
+             * anything built from the graph (vertex buffers, say) can compare it to the
+             * value it saw last time and only rebuild when it differs. Code which 
+             * modifies the public data directly should call markChanged().
+             */
+            unsigned long changeCount() const { return changes; }
+
+            /** Note that the graph has been changed outside of updateGraph(). */
+            void markChanged() { ++changes; }
+
             /**
              * Save current configuration of all labels, nodes, and edges to the SingletonCconfig 
              * instance. Call this before saving system configuration to a cfg file. 
@@ -276,6 +316,9 @@ namespace watcher
             /** Keep track of which direction we're going in time. */
             bool timeForward;
 
+            /** see changeCount() */
+            boost::detail::atomic_count changes;
+
             /** Build a map of ipv4 addresses to indexes. These indexes are used to index into 
              * the node array and the edges arrays. 
              */
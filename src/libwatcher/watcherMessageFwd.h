@@ -31,12 +31,18 @@ namespace event {
     class SpeedMessage;
     class PlaybackTimeRangeMessage;
     class StreamDescriptionMessage;
+    class EventQueryMessage;
+    class MetricsMessage;
+    class DataSeriesMessage;
 
     typedef boost::shared_ptr<Message> MessagePtr;
     typedef boost::shared_ptr<SeekMessage> SeekMessagePtr;
     typedef boost::shared_ptr<SpeedMessage> SpeedMessagePtr;
     typedef boost::shared_ptr<PlaybackTimeRangeMessage> PlaybackTimeRangeMessagePtr;
     typedef boost::shared_ptr<StreamDescriptionMessage> StreamDescriptionMessagePtr;
+    typedef boost::shared_ptr<EventQueryMessage> EventQueryMessagePtr;
+    typedef boost::shared_ptr<MetricsMessage> MetricsMessagePtr;
+    typedef boost::shared_ptr<DataSeriesMessage> DataSeriesMessagePtr;
 } // namespace
 
 } // namespace
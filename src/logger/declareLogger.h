@@ -27,12 +27,25 @@
  */
 
 #ifndef DISABLE_LOGGING
+    namespace log4cxx { class Logger; }
+
+    /* The name of a logger along with the log4cxx logger it refers to, which
+     * is looked up the first time it is used.  This saves going through the
+     * log4cxx repository (and its lock) on every log statement.  It is kept
+     * an aggregate so that it is initialized before any constructor can run
+     * and log something.
+     */
+    struct LoggerHandle {
+        const char *name;
+        mutable log4cxx::Logger *logger;
+    };
+
     // Use these two to declare module (class level or namespace level) loggers. 
-    #define DECLARE_LOGGER()            static const char *loggerName; 
-    #define INIT_LOGGER(class,name)     const char *class::loggerName=name
+    #define DECLARE_LOGGER()            static const LoggerHandle loggerName; 
+    #define INIT_LOGGER(class,name)     const LoggerHandle class::loggerName = { name, 0 }
 
     // Use this to declare a global logger. There can be onlu one global logger, be careful.
-    #define DECLARE_GLOBAL_LOGGER(name) static  const char *loggerName=name
+    #define DECLARE_GLOBAL_LOGGER(name) static const LoggerHandle loggerName = { name, 0 }
 
 #else
     #define DECLARE_LOGGER() 
@@ -47,22 +47,89 @@ using namespace log4cxx;
 //
 //
 
+// Log statements below a minimum level can be compiled out entirely by
+// defining WATCHER_MIN_LOG_LEVEL to one of the levels below, e.g.
+// -DWATCHER_MIN_LOG_LEVEL=WATCHER_LOG_LEVEL_INFO removes all the TRACE_ and
+// LOG_TRACE/LOG_DEBUG statements.  By default everything is compiled in and
+// the level is chosen at runtime with the log properties file.
+//
+#define WATCHER_LOG_LEVEL_TRACE 0
+#define WATCHER_LOG_LEVEL_DEBUG 1
+#define WATCHER_LOG_LEVEL_INFO  2
+#define WATCHER_LOG_LEVEL_WARN  3
+#define WATCHER_LOG_LEVEL_ERROR 4
+#define WATCHER_LOG_LEVEL_FATAL 5
+
+#ifndef WATCHER_MIN_LOG_LEVEL
+#define WATCHER_MIN_LOG_LEVEL WATCHER_LOG_LEVEL_TRACE
+#endif
+
 #ifndef DISABLE_LOGGING
 
+// Return the log4cxx logger for a handle, looking it up on first use. Loggers
+// are never removed from the log4cxx repository; the extra reference makes sure
+// the cached pointer stays good. Threads racing here each look the logger up,
+// and the first to publish it with compare-and-swap wins; the others drop
+// their reference and use the published pointer. The swap is a full barrier,
+// so the logger is visible to anyone who reads the pointer.
+inline log4cxx::Logger *getCachedLogger(const LoggerHandle &h)
+{
+    log4cxx::Logger *cached = h.logger;
+    if (!cached) {
+        LoggerPtr l = Logger::getLogger(h.name);
+        l->addRef();
+        cached = __sync_val_compare_and_swap(&h.logger, static_cast<log4cxx::Logger *>(0), &*l);
+        if (cached)
+            l->releaseRef();
+        else
+            cached = &*l;
+    }
+    return cached;
+}
+
 // Log4cxx is crashing, so these are wrapped in try/catch blocks. Which is really annoying. 
-#define LOG_TRACE(message, ...)     do { try{ LOG4CXX_TRACE(log4cxx::Logger::getLogger(loggerName), message ## __VA_ARGS__); } catch(std::exception &e) { std::cerr << "Exception in logging: " << e.what() << std::endl; } } while(0)
-#define LOG_DEBUG(message, ...)     do { try{ LOG4CXX_DEBUG(log4cxx::Logger::getLogger(loggerName), message ## __VA_ARGS__); } catch(std::exception &e) { std::cerr << "Exception in logging: " << e.what() << std::endl; } } while(0)
-#define LOG_INFO(message, ...)      do { try{ LOG4CXX_INFO(log4cxx::Logger::getLogger(loggerName), message ## __VA_ARGS__); } catch(std::exception &e) { std::cerr << "Exception in logging: " << e.what() << std::endl; } } while(0) 
-#define LOG_WARN(message, ...)      do { try{ LOG4CXX_WARN(log4cxx::Logger::getLogger(loggerName), message ## __VA_ARGS__); } catch(std::exception &e) { std::cerr << "Exception in logging: " << e.what() << std::endl; } } while(0)
-#define LOG_ERROR(message, ...)     do { try{ LOG4CXX_ERROR(log4cxx::Logger::getLogger(loggerName), message ## __VA_ARGS__); } catch(std::exception &e) { std::cerr << "Exception in logging: " << e.what() << std::endl; } } while(0)
-#define LOG_FATAL(message, ...)     do { try{ LOG4CXX_FATAL(log4cxx::Logger::getLogger(loggerName), message ## __VA_ARGS__); } catch(std::exception &e) { std::cerr << "Exception in logging: " << e.what() << std::endl; } } while(0)
-
-#define LOG_ASSERT(condition, message, ...) LOG4CXX_ASSERT(log4cxx::Logger::getLogger(loggerName), condition, message ## __VA_ARGS)
-
-#define TRACE_ENTER()       do { try{ LOG_TRACE("Enter: " << __PRETTY_FUNCTION__); } catch(std::exception &e) { std::cerr << "Exception in logging: " << e.what() << std::endl; } } while(0)
-#define TRACE_EXIT()        do { try{ LOG_TRACE("Exit: "  << __PRETTY_FUNCTION__); } catch(std::exception &e) { std::cerr << "Exception in logging: " << e.what() << std::endl; } } while(0)
-#define TRACE_EXIT_RET(val) do { try{ LOG_TRACE("Exit: "  << __PRETTY_FUNCTION__ << ": Returned --> " << val); } catch(std::exception &e) { std::cerr << "Exception in logging: " << e.what() << std::endl; } } while(0)
-#define TRACE_EXIT_RET_BOOL(val) do { try{ LOG_TRACE("Exit: "  << __PRETTY_FUNCTION__ << ": Returned --> " << (val ? "true":"false")); } catch(std::exception &e) { std::cerr << "Exception in logging: " << e.what() << std::endl; } } while(0)
+#define WATCHER_LOG_(level, ...) do { try{ level(getCachedLogger(loggerName), __VA_ARGS__); } catch(std::exception &e) { std::cerr << "Exception in logging: " << e.what() << std::endl; } } while(0)
+
+#if WATCHER_MIN_LOG_LEVEL <= WATCHER_LOG_LEVEL_TRACE
+#define LOG_TRACE(message, ...)     WATCHER_LOG_(LOG4CXX_TRACE, message ## __VA_ARGS__)
+#else
+#define LOG_TRACE(message, ...)     do { } while(0)
+#endif
+#if WATCHER_MIN_LOG_LEVEL <= WATCHER_LOG_LEVEL_DEBUG
+#define LOG_DEBUG(message, ...)     WATCHER_LOG_(LOG4CXX_DEBUG, message ## __VA_ARGS__)
+#else
+#define LOG_DEBUG(message, ...)     do { } while(0)
+#endif
+#if WATCHER_MIN_LOG_LEVEL <= WATCHER_LOG_LEVEL_INFO
+#define LOG_INFO(message, ...)      WATCHER_LOG_(LOG4CXX_INFO, message ## __VA_ARGS__)
+#else
+#define LOG_INFO(message, ...)      do { } while(0)
+#endif
+#if WATCHER_MIN_LOG_LEVEL <= WATCHER_LOG_LEVEL_WARN
+#define LOG_WARN(message, ...)      WATCHER_LOG_(LOG4CXX_WARN, message ## __VA_ARGS__)
+#else
+#define LOG_WARN(message, ...)      do { } while(0)
+#endif
+#if WATCHER_MIN_LOG_LEVEL <= WATCHER_LOG_LEVEL_ERROR
+#define LOG_ERROR(message, ...)     WATCHER_LOG_(LOG4CXX_ERROR, message ## __VA_ARGS__)
+#else
+#define LOG_ERROR(message, ...)     do { } while(0)
+#endif
+#define LOG_FATAL(message, ...)     WATCHER_LOG_(LOG4CXX_FATAL, message ## __VA_ARGS__)
+
+#define LOG_ASSERT(condition, message, ...) LOG4CXX_ASSERT(getCachedLogger(loggerName), condition, message ## __VA_ARGS)
+
+#if WATCHER_MIN_LOG_LEVEL <= WATCHER_LOG_LEVEL_TRACE
+#define TRACE_ENTER()       LOG_TRACE("Enter: " << __PRETTY_FUNCTION__)
+#define TRACE_EXIT()        LOG_TRACE("Exit: "  << __PRETTY_FUNCTION__)
+#define TRACE_EXIT_RET(val) LOG_TRACE("Exit: "  << __PRETTY_FUNCTION__ << ": Returned --> " << val)
+#define TRACE_EXIT_RET_BOOL(val) LOG_TRACE("Exit: "  << __PRETTY_FUNCTION__ << ": Returned --> " << (val ? "true":"false"))
+#else
+#define TRACE_ENTER()  do { } while(0)
+#define TRACE_EXIT()  do { } while(0)
+#define TRACE_EXIT_RET(val) do { } while(0)
+#define TRACE_EXIT_RET_BOOL(val) do { } while(0)
+#endif
 
 #define LOAD_LOG_PROPS(file) { try{ PropertyConfigurator::configure(file); } catch(std::exception &e) { std::cerr << "Exception while loding log properties: " << e.what() << std::endl; } }
 
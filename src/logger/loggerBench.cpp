@@ -0,0 +1,99 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ * 
+ * This file is part of WATCHER.
+ * 
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ * 
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ * 
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* @file loggerBench.cpp
+ * Measure what a disabled log statement costs a message handling path.
+ * Each loop iteration stands in for one message and makes a TRACE_ENTER,
+ * a LOG_DEBUG and a TRACE_EXIT call with the root logger at INFO, so none
+ * of them produce output.  The same loop is timed looking the logger up on
+ * every call (as the macros used to), with the cached logger handle, and
+ * with the statements compiled out (see loggerBenchElided.cpp).
+ *
+ * Usage: loggerBench [iterations]
+ */
+
+#include <cstdlib>
+#include <sys/time.h>
+
+#include "logger.h"
+
+DECLARE_GLOBAL_LOGGER("LoggerBench");
+
+// The logging macros as they were before logger handles were cached.
+#define UNCACHED_LOG_TRACE(message) do { try{ LOG4CXX_TRACE(log4cxx::Logger::getLogger(loggerName.name), message); } catch(std::exception &e) { std::cerr << "Exception in logging: " << e.what() << std::endl; } } while(0)
+#define UNCACHED_LOG_DEBUG(message) do { try{ LOG4CXX_DEBUG(log4cxx::Logger::getLogger(loggerName.name), message); } catch(std::exception &e) { std::cerr << "Exception in logging: " << e.what() << std::endl; } } while(0)
+
+// defined in loggerBenchElided.cpp
+unsigned long elidedLoop(unsigned long iterations);
+
+namespace {
+    double now()
+    {
+        struct timeval tv;
+        gettimeofday(&tv, 0);
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+    unsigned long uncachedLoop(unsigned long iterations)
+    {
+        unsigned long sum = 0;
+        for (unsigned long i = 0; i < iterations; ++i) {
+            UNCACHED_LOG_TRACE("Enter: " << __PRETTY_FUNCTION__);
+            UNCACHED_LOG_DEBUG("handling message " << i);
+            sum += i;
+            UNCACHED_LOG_TRACE("Exit: " << __PRETTY_FUNCTION__);
+        }
+        return sum;
+    }
+
+    unsigned long cachedLoop(unsigned long iterations)
+    {
+        unsigned long sum = 0;
+        for (unsigned long i = 0; i < iterations; ++i) {
+            TRACE_ENTER();
+            LOG_DEBUG("handling message " << i);
+            sum += i;
+            TRACE_EXIT();
+        }
+        return sum;
+    }
+
+    void report(const char *name, unsigned long (*loop)(unsigned long), unsigned long iterations)
+    {
+        double start = now();
+        volatile unsigned long sum = loop(iterations);
+        (void)sum;
+        double elapsed = now() - start;
+        std::cout << name << ": " << elapsed * 1e9 / iterations << " ns per message" << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+
+    BasicConfigurator::configure();
+    Logger::getRootLogger()->setLevel(Level::getInfo());
+
+    std::cout << iterations << " messages, each making 3 disabled log calls" << std::endl;
+    report("logger looked up on every call", uncachedLoop, iterations);
+    report("cached logger handle", cachedLoop, iterations);
+    report("compiled out (WATCHER_MIN_LOG_LEVEL=INFO)", elidedLoop, iterations);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,42 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ * 
+ * This file is part of WATCHER.
+ * 
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ * 
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ * 
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* @file loggerBenchElided.cpp
+ * The loggerBench message loop built as if configured with
+ * --with-min-log-level=info, so that its TRACE and DEBUG statements are
+ * compiled out.
+ */
+
+#undef WATCHER_MIN_LOG_LEVEL      // configure puts one on every command line
+#define WATCHER_MIN_LOG_LEVEL WATCHER_LOG_LEVEL_INFO
+#include "logger.h"
+#undef WATCHER_MIN_LOG_LEVEL
+
+DECLARE_GLOBAL_LOGGER("LoggerBench");
+
+unsigned long elidedLoop(unsigned long iterations)
+{
+    unsigned long sum = 0;
+    for (unsigned long i = 0; i < iterations; ++i) {
+        TRACE_ENTER();
+        LOG_DEBUG("handling message " << i);
+        sum += i;
+        TRACE_EXIT();
+    }
+    return sum;
+}
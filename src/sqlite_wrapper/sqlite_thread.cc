@@ -25,6 +25,8 @@
 //#include <iostream>
 #include <unistd.h>
 
+#include "sqlite_wrapper.h"
+
 #if 0
 namespace
 {
@@ -33,7 +35,9 @@ namespace
 }
 #endif
 
-extern "C" int busy_handler(void *, int)
+/* ptr is the Stats object of the Connection, count is the number of times
+ * the handler has been called for this lock. */
+extern "C" int busy_handler(void *ptr, int count)
 {
     //std::cout << "busy_handler: enter (thread " << pthread_self() << ")\n";
 #if 0
@@ -42,8 +46,14 @@ extern "C" int busy_handler(void *, int)
     pthread_mutex_unlock(&busy_lock);
 #else
 
-#define BUSY_SLEEP 20 /* milliseconds */
-    usleep(BUSY_SLEEP);
+    if (ptr)
+        ++static_cast<sqlite_wrapper::Stats*>(ptr)->busy_retries;
+
+    /* back off exponentially, 1ms doubling up to BUSY_SLEEP_MAX, so that
+     * short waits stay short without spinning on long ones */
+#define BUSY_SLEEP_MAX 64 /* milliseconds */
+    int ms = count < 6 ? (1 << count) : BUSY_SLEEP_MAX;
+    usleep(ms * 1000);
 #endif
 
     //std::cout << "busy_handler: exit (thread " << pthread_self() << ")\n";
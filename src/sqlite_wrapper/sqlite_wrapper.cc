@@ -23,6 +23,7 @@
 
 #include <cassert>
 #include <sstream>
+#include <sys/time.h>
 #include "sqlite_wrapper.h"
 #include "sqlite_thread.h"
 
@@ -57,7 +58,7 @@ Connection::Connection(const std::string& path, flags f) : db_(0)
      * access would be blocked.  This will make blocked threads wait on pthread_cond_wait()
      * to be awoken when the currently executing thread is done.
      */
-    sqlite3_busy_handler(db_, busy_handler, 0);
+    sqlite3_busy_handler(db_, busy_handler, &stats_);
 }
 
 void Connection::close(bool nothrow)
@@ -66,6 +67,7 @@ void Connection::close(bool nothrow)
         // explicitly clear the prepared statements to force the deleters on the
         // shared pointers to execute
         statements_.clear();
+        cache_.clear();
 
         int res = sqlite3_close(db_);
         if (!nothrow)
@@ -76,13 +78,40 @@ void Connection::close(bool nothrow)
 
 ImplPtr Connection::prepare(const std::string& s)
 {
+    /* sqlite3_sql() returns the text the statement was compiled from */
+    for (std::list<shared_ptr<sqlite3_stmt> >::iterator it = cache_.begin(); it != cache_.end(); ++it) {
+        if (s == sqlite3_sql(it->get())) {
+            ++stats_.cache_hits;
+            statements_.push_front(*it);
+            cache_.erase(it);
+            return ImplPtr( new Impl(*this, weak_ptr<sqlite3_stmt>( statements_.front() )));
+        }
+    }
+
     sqlite3_stmt *stmt;
     int res = sqlite3_prepare_v2(db_, s.c_str(), -1, &stmt, 0);
     error_check(res);
+    ++stats_.prepares;
     statements_.push_front(shared_ptr<sqlite3_stmt>(stmt, sqlite3_finalize) );
     return ImplPtr( new Impl(*this, weak_ptr<sqlite3_stmt>( statements_.front() )));
 }
 
+/** Return a statement which is no longer in use to the statement cache,
+ * discarding the least recently used one if the cache is full.
+ */
+void Connection::release(shared_ptr<sqlite3_stmt> p)
+{
+    statements_.remove(p);
+
+    // leave the statement ready for reuse, and don't hold any locks while idle
+    sqlite3_reset(p.get());
+    sqlite3_clear_bindings(p.get());
+
+    cache_.push_front(p);
+    if (cache_.size() > cache_size)
+        cache_.pop_back();
+}
+
 Statement::Statement(Connection& conn, const std::string& s)
     : pos_(1), impl_(conn.prepare(s))
 {
@@ -134,7 +163,7 @@ Statement::~Statement()
     try {
         // will throw bad_weak_ptr if the db connection has gone away
         shared_ptr<sqlite3_stmt> p = impl_->stmt.lock();
-        impl_->conn.statements_.remove(p);
+        impl_->conn.release(p);
     } catch (bad_weak_ptr) {
         //ignore
     }
@@ -153,10 +182,24 @@ void Row::step()
 
     shared_ptr<sqlite3_stmt> p = impl_->stmt.lock();
 
+    timeval start, end;
+    gettimeofday(&start, 0);
+
     int res = sqlite3_step(p.get());
 
+    gettimeofday(&end, 0);
+
     busy_done(); // wake up any waiting threads
 
+    Stats& stats = impl_->conn.stats_;
+    long long usec = (end.tv_sec - start.tv_sec) * 1000000LL + (end.tv_usec - start.tv_usec);
+    if (usec < 0)
+        usec = 0; // clock stepped backwards
+    ++stats.steps;
+    stats.step_usec += usec;
+    if (static_cast<unsigned long long>(usec) > stats.max_step_usec)
+        stats.max_step_usec = usec;
+
     switch(res) {
         case SQLITE_ROW:
             ++impl_->nrows;
@@ -191,6 +234,13 @@ void Row::step()
     }
 }
 
+std::ostream& sqlite_wrapper::operator<< (std::ostream& os, const Stats& s)
+{
+    return os << "prepares=" << s.prepares << " cache_hits=" << s.cache_hits <<
+        " busy_retries=" << s.busy_retries << " steps=" << s.steps <<
+        " step_usec=" << s.step_usec << " max_step_usec=" << s.max_step_usec;
+}
+
 Connection::~Connection()
 {
     // can't throw on error
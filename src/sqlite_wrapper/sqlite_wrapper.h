@@ -33,6 +33,7 @@
 #include <boost/utility.hpp>
 #include <vector>
 #include <cstring>
+#include <iosfwd>
 
 // include the forward decls to ensure consistency
 #include "sqlite_wrapper_fwd.h"
@@ -73,7 +74,27 @@ namespace sqlite_wrapper {
         return ConnectionFlags(static_cast<int>(a) | static_cast<int>(b));
     }
 
-    /** A class representing a connection to a specific database. */
+    /** Counters describing the work done on a Connection. */
+    struct Stats {
+        unsigned long prepares;     //< statements compiled with sqlite3_prepare_v2()
+        unsigned long cache_hits;   //< statements reused from the statement cache
+        unsigned long busy_retries; //< invocations of the busy handler
+        unsigned long steps;        //< calls to sqlite3_step()
+        unsigned long long step_usec;       //< total time spent in sqlite3_step() (microseconds)
+        unsigned long long max_step_usec;   //< longest single sqlite3_step() (microseconds)
+        Stats() : prepares(0), cache_hits(0), busy_retries(0), steps(0), step_usec(0), max_step_usec(0) {}
+    };
+
+    std::ostream& operator<< (std::ostream&, const Stats&);
+
+    /** A class representing a connection to a specific database.
+     *
+     * Prepared statements are kept in a cache keyed by their SQL text once
+     * the Statement object using them is destroyed, so code which builds the
+     * same query repeatedly only pays for compiling it once.  A Connection
+     * is not meant to be shared between threads, so neither the cache nor
+     * the statistics are locked.
+     */
     class Connection : private boost::noncopyable {
         public:
             typedef ConnectionFlags flags;
@@ -84,22 +105,32 @@ namespace sqlite_wrapper {
             static const flags readonly = cf_readonly;
             static const flags create = cf_create;
 
+            /** maximum number of idle statements kept in the statement cache */
+            static const size_t cache_size = 64;
+
             Connection(const std::string&, flags f = none);
             ~Connection();
             void close(bool nothrow = false);
             void execute(const std::string&);
 
+            /** Return the statistics gathered for this connection. */
+            const Stats& stats() const { return stats_; }
+
         private:
             friend class Statement;
             friend class Row;
             friend class Column;
             sqlite3 *db_;
             std::list<boost::shared_ptr<sqlite3_stmt> > statements_;
+            /// idle prepared statements, most recently used first
+            std::list<boost::shared_ptr<sqlite3_stmt> > cache_;
+            Stats stats_;
             void error_check(int res) {
                 if (res != SQLITE_OK)
                     throw Exception(sqlite3_errmsg(db_));
             }
             ImplPtr prepare(const std::string&);
+            void release(boost::shared_ptr<sqlite3_stmt>);
     };
 
     /** A class for iterating over column values in a Row. */
@@ -0,0 +1,285 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ * 
+ * This file is part of WATCHER.
+ * 
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ * 
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ * 
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@file
+ * @date 2010-06-22
+ */
+
+#include <algorithm>
+#include <boost/bind.hpp>
+
+#include "libwatcher/dataPointMessage.h"
+#include "libwatcher/dataSeriesMessage.h"
+#include "libwatcher/eventQueryMessage.h"
+#include "libwatcher/metrics.h"
+#include "libwatcher/seriesRollup.h"
+#include "dataRollup.h"
+#include "database.h"
+#include "watcherdConfig.h"
+#include "logger.h"
+
+using namespace watcher;
+using namespace watcher::event;
+
+INIT_LOGGER(DataRollup, "DataRollup");
+
+namespace {
+    const Timestamp msPerHour = 60 * 60 * 1000;
+
+    metrics::Counter seriesCount("rollup.series");
+    metrics::Counter pointsAdded("rollup.points");
+    metrics::Histogram queryTime("rollup.query_usec");
+    metrics::Histogram fallbackTime("rollup.fallback_usec");
+}
+
+struct DataRollup::Series {
+    boost::mutex lock;
+    SeriesRollup rollup;
+};
+
+DataRollup::DataRollup(libconfig::Config& cfg) :
+    history_(0), split_(0), loadBegin_(0), covered_(0), loading_(false)
+{
+    TRACE_ENTER();
+    int hours = 24;
+    if (!cfg.lookupValue(dataRollupHours, hours))
+        cfg.getRoot().add(dataRollupHours, libconfig::Setting::TypeInt) = hours;
+    history_ = hours * msPerHour;
+    LOG_INFO("loading " << hours << " hours of data points at startup");
+    TRACE_EXIT();
+}
+
+DataRollup::~DataRollup()
+{
+    TRACE_ENTER();
+    stop();
+    TRACE_EXIT();
+}
+
+/* The split between stored and live points is taken here rather than in
+ * the loader, so that no point arrives between reading the database's
+ * newest timestamp and starting to add live ones.  The covered range moves
+ * back an hour at a time, so that no bucket at any level straddles it. */
+void DataRollup::start()
+{
+    TRACE_ENTER();
+    TimeRange r = event_range();
+    split_ = r.second;
+    covered_ = split_ - split_ % msPerHour + msPerHour;
+    Timestamp begin = std::max(r.first, split_ - history_);
+    loadBegin_ = history_ > 0 && split_ > 0 ? begin - begin % msPerHour : covered_;
+    if (loadBegin_ < covered_) {
+        LOG_INFO("loading data points from " << loadBegin_ << " to " << split_);
+        loading_ = true;
+        thread_ = boost::thread(boost::bind(&DataRollup::load, this));
+    }
+    TRACE_EXIT();
+}
+
+void DataRollup::stop()
+{
+    TRACE_ENTER();
+    if (thread_.joinable()) {
+        thread_.interrupt();
+        thread_.join();
+    }
+    TRACE_EXIT();
+}
+
+DataRollup::SeriesPtr DataRollup::find(const SeriesKey& key) const
+{
+    boost::shared_lock<boost::shared_mutex> lock(lock_);
+    SeriesMap::const_iterator i = series_.find(key);
+    return i == series_.end() ? SeriesPtr() : i->second;
+}
+
+void DataRollup::add(const DataPointMessage& m)
+{
+    TRACE_ENTER();
+    if (m.dataPoints.empty()) {
+        TRACE_EXIT();
+        return;
+    }
+
+    /* A point no newer than the split belongs to the history.  Before the
+     * covered range, queries read it from the database.  If the loader has
+     * yet to get there it is added now, and noted in case the loader's
+     * query for its hour comes after it has been stored. */
+    if (m.timestamp <= split_) {
+        boost::mutex::scoped_lock lock(loadLock_);
+        if (m.timestamp < covered_) {
+            if (!loading_ || m.timestamp < loadBegin_) {
+                TRACE_EXIT();
+                return;
+            }
+            late_.insert(LatePoint(m.fromNodeID, m.dataName, m.timestamp, m.dataPoints.front()));
+        }
+    }
+    insert(m);
+    TRACE_EXIT();
+}
+
+void DataRollup::insert(const DataPointMessage& m)
+{
+    SeriesKey key(m.fromNodeID, m.dataName);
+    SeriesPtr s = find(key);
+    if (!s) {
+        boost::unique_lock<boost::shared_mutex> lock(lock_);
+        SeriesPtr& p = series_[key];
+        if (!p) {
+            p.reset(new Series);
+            seriesCount.add();
+        }
+        s = p;
+    }
+
+    {
+        boost::mutex::scoped_lock lock(s->lock);
+        s->rollup.add(m.timestamp, m.dataPoints.front());
+    }
+    pointsAdded.add();
+}
+
+namespace {
+    /* function object for bucketing the points of one series read from the database */
+    struct series_output {
+        const DataSeriesMessage& q;
+        Timestamp res;
+        SeriesRollup::BucketList& out;
+        series_output(const DataSeriesMessage& qq, Timestamp r, SeriesRollup::BucketList& o) : q(qq), res(r), out(o) {}
+        void operator() (const MessagePtr &m)
+        {
+            if (m->type != DATA_POINT_MESSAGE_TYPE)
+                return;
+            const DataPointMessage& dp = static_cast<const DataPointMessage&>(*m);
+            if (dp.dataName != q.dataName || dp.dataPoints.empty())
+                return;
+            Timestamp t = dp.timestamp - dp.timestamp % res;
+            if (out.empty() || out.back().time != t)
+                out.push_back(SeriesRollup::Bucket(t));
+            out.back().add(dp.timestamp, dp.dataPoints.front());
+        }
+    };
+}
+
+void DataRollup::query(DataSeriesMessage& q) const
+{
+    TRACE_ENTER();
+    metrics::ScopedTimer t(queryTime);
+
+    q.buckets.clear();
+    Timestamp covered;
+    {
+        boost::mutex::scoped_lock lock(loadLock_);
+        covered = covered_;
+    }
+
+    SeriesRollup::BucketList buckets;
+    Timestamp res = 0;
+    SeriesPtr s = find(SeriesKey(q.node, q.dataName));
+    if (s && (q.end == Infinity || q.end >= covered)) {
+        boost::mutex::scoped_lock lock(s->lock);
+        res = s->rollup.query(q.begin, q.end, q.resolution, buckets, covered);
+    }
+
+    // The rollups have nothing before covered, so read that from the database.
+    if (q.begin < covered) {
+        metrics::ScopedTimer t(fallbackTime);
+        if (!res)
+            res = SeriesRollup::bucketWidth(SeriesRollup::levelFor(q.resolution), q.resolution);
+        EventQueryMessage eq(q.begin, q.end == Infinity ? covered - 1 : std::min(q.end, covered - 1));
+        eq.types.push_back(DATA_POINT_MESSAGE_TYPE);
+        eq.nodes.push_back(q.node);
+        SeriesRollup::BucketList old;
+        unsigned int n = query_events(series_output(q, res, old), eq);
+        LOG_DEBUG("read " << n << " data points before " << covered << " from the database");
+        SeriesRollup::merge(buckets, old);
+    }
+    q.resolution = res;
+
+    q.buckets.reserve(buckets.size());
+    for (SeriesRollup::BucketList::const_iterator b = buckets.begin(); b != buckets.end(); ++b) {
+        DataSeriesMessage::Bucket out;
+        out.time = b->time;
+        out.count = b->count;
+        out.min = b->min;
+        out.max = b->max;
+        out.mean = b->mean();
+        out.last = b->last;
+        q.buckets.push_back(out);
+    }
+    LOG_DEBUG("returning " << q.buckets.size() << " buckets of " << res << "ms");
+    TRACE_EXIT();
+}
+
+/** Add a data point read by the loader, unless it was added live already. */
+void DataRollup::loaded(const MessagePtr& m)
+{
+    if (m->type != DATA_POINT_MESSAGE_TYPE)
+        return;
+    const DataPointMessage& dp = static_cast<const DataPointMessage&>(*m);
+    if (dp.dataPoints.empty())
+        return;
+    {
+        boost::mutex::scoped_lock lock(loadLock_);
+        if (!late_.empty()) {
+            std::multiset<LatePoint>::iterator i =
+                late_.find(LatePoint(dp.fromNodeID, dp.dataName, dp.timestamp, dp.dataPoints.front()));
+            if (i != late_.end()) {
+                late_.erase(i);
+                return;
+            }
+        }
+    }
+    insert(dp);
+}
+
+/** Load data points from the database an hour at a time, newest first,
+ * stopping early if interrupted.  Each hour becomes part of the covered range
+ * once it is loaded.
+ */
+void DataRollup::load()
+{
+    TRACE_ENTER();
+    try {
+        EventQueryMessage q;
+        q.types.push_back(DATA_POINT_MESSAGE_TYPE);
+        boost::function<void(MessagePtr)> cb(boost::bind(&DataRollup::loaded, this, _1));
+        unsigned int n = 0;
+        for (Timestamp t = covered_ - msPerHour; t >= loadBegin_; t -= msPerHour) {
+            boost::this_thread::interruption_point();
+            q.begin = t;
+            q.end = std::min(t + msPerHour - 1, split_);
+            n += query_events(cb, q);
+            boost::mutex::scoped_lock lock(loadLock_);
+            covered_ = t;
+        }
+        LOG_INFO("loaded " << n << " data points");
+    } catch (boost::thread_interrupted&) {
+        LOG_INFO("stopped loading data points");
+    } catch (std::exception& e) {
+        LOG_ERROR("unable to load data points: " << e.what());
+    }
+
+    boost::mutex::scoped_lock lock(loadLock_);
+    loading_ = false;
+    late_.clear();
+    TRACE_EXIT();
+}
+
+// vim:sw=4 ts=8
@@ -0,0 +1,121 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ * 
+ * This file is part of WATCHER.
+ * 
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ * 
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ * 
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@file
+ * @date 2010-06-22
+ */
+
+#ifndef data_rollup_h
+#define data_rollup_h
+
+#include <map>
+#include <set>
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
+#include <boost/thread.hpp>
+#include <boost/utility.hpp>
+
+#include "libwatcher/watcherTypes.h"
+#include "libwatcher/message_fwd.h"
+#include "libconfig.h++"
+#include "declareLogger.h"
+
+namespace watcher {
+
+    namespace event {
+        class DataPointMessage;
+        class DataSeriesMessage;
+    }
+
+    /** Summaries of the DataPointMessage series received by watcherd, for
+     * plotting without fetching every value.
+     *
+     * Each series (one per node and dataName) is kept as a SeriesRollup.
+     * Points may arrive out of order.
+     *
+     * On startup a background thread loads the last dataRollupHours of data
+     * points from the event database, newest hour first.  The rollups cover
+     * everything from the oldest hour loaded so far; queries reaching back
+     * before that are answered for that part from the database.
+     */
+    class DataRollup : private boost::noncopyable {
+        public:
+            /** Read the settings, adding defaults for missing ones.
+             * @param[in] cfg the watcherd configuration
+             */
+            DataRollup(libconfig::Config& cfg);
+            ~DataRollup();
+
+            /** Start loading history from the event database.  Must be
+             * called before any data points are added. */
+            void start();
+
+            /** Stop loading history and wait for the thread to exit. */
+            void stop();
+
+            /** Add the value of a data point (the first of its dataPoints)
+             * to its series.  Call before storing it in the database, so
+             * that the history loader can tell it has been counted. */
+            void add(const event::DataPointMessage& m);
+
+            /** Fill in the buckets of a DataSeriesMessage request.  The
+             * request's resolution is rounded up to a multiple of the
+             * level the buckets are taken from.
+             */
+            void query(event::DataSeriesMessage& q) const;
+
+        private:
+            struct Series;
+            typedef boost::shared_ptr<Series> SeriesPtr;
+            typedef std::pair<NodeIdentifier, std::string> SeriesKey;
+            typedef std::map<SeriesKey, SeriesPtr> SeriesMap;
+
+            /* A data point added live while history was being loaded. */
+            typedef boost::tuple<NodeIdentifier, std::string, Timestamp, double> LatePoint;
+
+            SeriesPtr find(const SeriesKey& key) const;
+            void insert(const event::DataPointMessage& m);
+            void load();
+            void loaded(const event::MessagePtr& m);
+
+            SeriesMap series_;
+            mutable boost::shared_mutex lock_;  //< protects series_, not the Series in it
+
+            Timestamp history_;         //< amount of history loaded at startup (milliseconds)
+            boost::thread thread_;
+
+            /* Points up to split_ were stored before start(), and those from
+             * loadBegin_ are loaded from the database.  The rollups hold
+             * every point from covered_ on, and none before it. */
+            Timestamp split_;
+            Timestamp loadBegin_;
+            Timestamp covered_;
+            bool loading_;
+            std::multiset<LatePoint> late_;     //< live points the loader may also read
+            mutable boost::mutex loadLock_;     //< protects covered_, loading_ and late_
+
+            DECLARE_LOGGER();
+    };
+
+} //namespace
+
+#endif /* data_rollup_h */
+
+// vim:sw=4 ts=8
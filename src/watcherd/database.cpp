@@ -26,7 +26,11 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/weak_ptr.hpp>
 
+#include <sstream>
+
 #include "logger.h"
+#include "libwatcher/message.h"
+#include "libwatcher/messageTypesAndVersions.h"
 
 #include "sqliteDatabase.h"
 #include "singletonConfig.h"
@@ -38,12 +42,26 @@ INIT_LOGGER(Database, "Database");
 
 /** Create a new connection to the specified database.
  * @param[in] uri resource name for the database to open.
+ * @param[in] partitionLength length of the time window stored in each partition (milliseconds)
  */
-Database* Database::connect(const std::string& uri)
+Database* Database::connect(const std::string& uri, Timestamp partitionLength)
 {
     TRACE_ENTER();
     TRACE_EXIT();
-    return new SqliteDatabase(uri);
+    return new SqliteDatabase(uri, partitionLength);
+}
+
+void watcher::encode_event(const event::MessagePtr& msg, EncodedEvent& out)
+{
+    std::ostringstream os;
+    msg->pack(os);  // without any trace stamps
+
+    out.ts = msg->timestamp;
+    out.type = msg->type;
+    out.node = msg->fromNodeID.to_string();
+    out.data = os.str();
+    out.layer.clear();
+    event::hasLayer(msg, out.layer);
 }
 
 Database::~Database()
@@ -61,6 +79,55 @@ Database::~Database()
 namespace {
     /// Database handles for each thread in the pool
     boost::thread_specific_ptr<Database> dbh;
+
+    /* All events are written through a single connection shared by the
+     * io threads.  SQLite only allows one writer at a time, so serializing
+     * the writers here keeps them from spinning in the busy handler, and
+     * in WAL mode the per-thread handles above can keep reading while an
+     * insert is in progress.
+     */
+    boost::mutex writerLock;
+    boost::scoped_ptr<Database> writer;
+
+    /* The first and last event timestamps are kept in memory so that range
+     * requests and seeks to EOF do not have to query the database.  The
+     * cache is filled on first use and extended by store_event().  The
+     * database is read without the lock held; events stored meanwhile are
+     * gathered in rangeStored and merged in once the read is done.
+     * rangeGeneration changes on invalidation, so a read which started
+     * before it is not cached.
+     */
+    boost::mutex rangeLock;
+    bool rangeValid = false;
+    TimeRange range(0, 0);
+    TimeRange rangeStored(0, 0);
+    unsigned long rangeGeneration = 0;
+
+    /* Widen r to include ts.  (0, 0) is the empty range. */
+    void extend_range(TimeRange& r, Timestamp ts)
+    {
+        if (r.first == 0 && r.second == 0)
+            r = TimeRange(ts, ts);
+        else if (ts < r.first)
+            r.first = ts;
+        else if (ts > r.second)
+            r.second = ts;
+    }
+}
+
+namespace {
+    /// Open a new connection to the database named in the global config settings.
+    Database* connect_configured()
+    {
+        /* look up the database URI in the global config settings */
+        std::string uri;
+        SingletonConfig::instance().lookupValue(dbPath, uri);
+
+        int minutes = defaultPartitionLength / (60 * 1000);
+        SingletonConfig::instance().lookupValue(partitionMinutes, minutes);
+
+        return Database::connect(uri, static_cast<Timestamp>(minutes) * 60 * 1000);
+    }
 }
 
 Database& watcher::get_db_handle()
@@ -68,23 +135,67 @@ Database& watcher::get_db_handle()
     Database* db = dbh.get(); // Retrive the database handle for this thread.
     if (!db) {
         /* not yet set, create a new connection */
-
-        /* look up the database URI in the global config settings */
-        std::string uri;
-        SingletonConfig::instance().lookupValue(dbPath, uri);
-
-        db = Database::connect(uri);
+        db = connect_configured();
         dbh.reset(db);
     }
     return *db;
 }
 
-void watcher::store_event(event::MessagePtr m)
+void watcher::store_event(const event::MessagePtr &m)
+{
+    {
+        boost::mutex::scoped_lock lock(writerLock);
+        if (!writer)
+            writer.reset(connect_configured());
+        writer->storeEvent(m);
+    }
+
+    boost::mutex::scoped_lock lock(rangeLock);
+    extend_range(rangeValid ? range : rangeStored, m->timestamp);
+}
+
+void watcher::close_event_writer()
 {
-    get_db_handle().storeEvent(m);
+    boost::mutex::scoped_lock lock(writerLock);
+    writer.reset();
 }
 
 TimeRange watcher::event_range()
 {
-    return get_db_handle().eventRange();
+    unsigned long generation;
+    {
+        boost::mutex::scoped_lock lock(rangeLock);
+        if (rangeValid)
+            return range;
+        generation = rangeGeneration;
+    }
+
+    TimeRange r(get_db_handle().eventRange());
+
+    boost::mutex::scoped_lock lock(rangeLock);
+    if (rangeValid)
+        return range;   // filled by another thread meanwhile
+    if (rangeStored.first != 0 || rangeStored.second != 0) {
+        extend_range(r, rangeStored.first);
+        extend_range(r, rangeStored.second);
+    }
+    if (generation == rangeGeneration) {
+        range = r;
+        rangeValid = true;
+        rangeStored = TimeRange(0, 0);
+    }
+    return r;
+}
+
+void watcher::invalidate_event_range()
+{
+    boost::mutex::scoped_lock lock(rangeLock);
+    rangeValid = false;
+    rangeStored = TimeRange(0, 0);
+    ++rangeGeneration;
+}
+
+unsigned int watcher::query_events(boost::function<void(event::MessagePtr)> output, const event::EventQueryMessage& q)
+{
+    return get_db_handle().queryEvents(output, q);
 }
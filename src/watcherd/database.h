@@ -22,26 +22,64 @@
 #include <boost/utility.hpp>
 #include <boost/function.hpp>
 #include <string>
+#include <vector>
 
 #include "libwatcher/message_fwd.h"
+#include "libwatcher/watcherMessageFwd.h"
 #include "libwatcher/watcherTypes.h"
 #include "declareLogger.h"
 
 namespace watcher {
     typedef std::pair<Timestamp, Timestamp> TimeRange;
 
+    /** Default length of the time window stored in each database partition (one hour). */
+    const Timestamp defaultPartitionLength = 60 * 60 * 1000;
+
+    /** An event serialized into the form in which it is stored.  Encoding
+     * is the expensive part of storing an event, so bulk loaders do it on
+     * their own threads with encode_event() and hand whole batches to
+     * Database::storeEvents().
+     */
+    struct EncodedEvent {
+        Timestamp ts;
+        unsigned int type;
+        std::string node;
+        std::string layer;  //< empty for events which are not associated with a layer
+        std::string data;   //< the packed message
+    };
+    typedef std::vector<EncodedEvent> EncodedEventList;
+
+    /** Fill in an EncodedEvent from a message. */
+    void encode_event(const event::MessagePtr& msg, EncodedEvent& out);
+
     /** Abstract class used to provide an interface to a database backend for
      * storing event streams. */
     class Database : private boost::noncopyable {
         public:
-            static Database* connect(const std::string&);
+            static Database* connect(const std::string&, Timestamp partitionLength = defaultPartitionLength);
 
             /** Store an event received from a specified host into the database.
              *
              * @param[in] msg the Event to store
              */
-            virtual void storeEvent(event::MessagePtr msg) = 0;
+            virtual void storeEvent(const event::MessagePtr &msg) = 0;
 
+            /** Store a batch of encoded events in a single transaction.
+             * @param[in] events the events to store, in any order
+             */
+            virtual void storeEvents(const EncodedEventList& events) = 0;
+
+            /** Prepare for loading a large number of events with
+             * storeEvents().  Index maintenance on partitions created during
+             * the load is deferred until endBulkLoad().  Only intended for
+             * offline tools, as queries against those partitions are slow
+             * until the load completes.
+             */
+            virtual void beginBulkLoad() = 0;
+
+            /** Build any indices deferred since beginBulkLoad(), or left
+             * unbuilt by an earlier bulk load which did not finish. */
+            virtual void endBulkLoad() = 0;
 
             enum Direction { forward, reverse };
 
@@ -53,8 +91,33 @@ namespace watcher {
              */
             virtual void getEvents(boost::function<void(event::MessagePtr)> output, Timestamp t, Direction d, unsigned int count) = 0;
 
+            /** Retrieve the events matching a targeted query.  Events are
+             * returned in timestamp order.
+             * @param output a function which accepts the individual events returned from the DB
+             * @param[in] q the time range, node, type and layer sets to match
+             * @return the number of events passed to output
+             */
+            virtual unsigned int queryEvents(boost::function<void(event::MessagePtr)> output, const event::EventQueryMessage& q) = 0;
+
             virtual TimeRange eventRange() = 0;
 
+            /** Remove whole partitions containing only events older than a
+             * given time.
+             * @param[in] before only partitions ending at or before this time are removed
+             * @param[in] archivePath if not empty, the database file the partitions are moved to
+             * @return the number of partitions removed
+             */
+            virtual unsigned int expireEvents(Timestamp before, const std::string& archivePath) = 0;
+
+            /** Downsample the GPS and connectivity updates in partitions
+             * ending at or before a given time, keeping the last update from
+             * each node in every interval.  Each partition is compacted once.
+             * @param[in] before only partitions ending at or before this time are compacted
+             * @param[in] interval the downsampling interval (milliseconds)
+             * @return the number of partitions compacted
+             */
+            virtual unsigned int compactEvents(Timestamp before, Timestamp interval) = 0;
+
             virtual ~Database() = 0;
 
             DECLARE_LOGGER();
@@ -68,13 +131,28 @@ namespace watcher {
      */
     Database& get_db_handle();
 
-    /** Put an event into the database. */
-    void store_event(event::MessagePtr);
+    /** Put an event into the database.  All threads share a single writer
+     * connection. */
+    void store_event(const event::MessagePtr&);
+
+    /** Close the writer connection used by store_event().  Called at
+     * shutdown once no more events will be stored. */
+    void close_event_writer();
 
     
-    /** Return the Timestamps for the first and last event in the database. */
+    /** Return the Timestamps for the first and last event in the database.
+     * The range is read from the database once and then maintained in memory
+     * as events are stored with store_event().
+     */
     TimeRange event_range();
 
+    /** Discard the cached event range so that the next call to event_range()
+     * reads it from the database.  Used after events have been removed. */
+    void invalidate_event_range();
+
+    /** Retrieve the events matching a query from the database. */
+    unsigned int query_events(boost::function<void(event::MessagePtr)> output, const event::EventQueryMessage& q);
+
 } //namespace
 
 #endif /* database_h */
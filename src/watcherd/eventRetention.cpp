@@ -0,0 +1,137 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ * 
+ * This file is part of WATCHER.
+ * 
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ * 
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ * 
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@file
+ * @date 2010-06-01
+ */
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "eventRetention.h"
+#include "database.h"
+#include "watcherdConfig.h"
+#include "logger.h"
+
+using namespace watcher;
+
+INIT_LOGGER(EventRetention, "EventRetention");
+
+namespace {
+    const Timestamp msPerHour = 60 * 60 * 1000;
+
+    /* Look up an integer setting, adding the default to the configuration if it is not present. */
+    int lookup_or_add(libconfig::Config& cfg, const char *key, int def)
+    {
+        int val = def;
+        if (!cfg.lookupValue(key, val))
+            cfg.getRoot().add(key, libconfig::Setting::TypeInt) = def;
+        return val;
+    }
+}
+
+EventRetention::EventRetention(libconfig::Config& cfg) :
+    retention_(0), compactAfter_(0), interval_(0), period_(60)
+{
+    TRACE_ENTER();
+
+    retention_ = lookup_or_add(cfg, retentionHours, 0) * msPerHour;
+    compactAfter_ = lookup_or_add(cfg, compactAfterHours, 0) * msPerHour;
+    interval_ = lookup_or_add(cfg, compactionInterval, 1000);
+    period_ = lookup_or_add(cfg, maintenanceInterval, 60);
+    if (!cfg.lookupValue(archivePath, archive_))
+        cfg.getRoot().add(archivePath, libconfig::Setting::TypeString) = archive_;
+
+    LOG_INFO("retention=" << retention_ << "ms compactAfter=" << compactAfter_ << "ms interval=" << interval_ <<
+             "ms archive=\"" << archive_ << "\" period=" << period_ << "s");
+
+    TRACE_EXIT();
+}
+
+EventRetention::~EventRetention()
+{
+    TRACE_ENTER();
+    stop();
+    TRACE_EXIT();
+}
+
+void EventRetention::start()
+{
+    TRACE_ENTER();
+    if (retention_ <= 0 && compactAfter_ <= 0)
+        LOG_INFO("no event retention or compaction configured");
+    else if (period_ <= 0)
+        LOG_WARN("maintenanceInterval must be positive, event retention disabled");
+    else
+        thread_ = boost::thread(boost::bind(&EventRetention::run, this));
+    TRACE_EXIT();
+}
+
+void EventRetention::stop()
+{
+    TRACE_ENTER();
+    if (thread_.joinable()) {
+        thread_.interrupt();
+        thread_.join();
+    }
+    TRACE_EXIT();
+}
+
+void EventRetention::run()
+{
+    TRACE_ENTER();
+    try {
+        for (;;) {
+            boost::this_thread::sleep(boost::posix_time::seconds(period_));
+            maintain();
+        }
+    } catch (boost::thread_interrupted&) {
+        LOG_DEBUG("maintenance thread stopped");
+    }
+    TRACE_EXIT();
+}
+
+void EventRetention::maintain()
+{
+    TRACE_ENTER();
+    try {
+        Database& db = get_db_handle();
+        Timestamp newest = event_range().second;
+
+        if (retention_ > 0 && newest > retention_) {
+            unsigned int n = db.expireEvents(newest - retention_, archive_);
+            if (n) {
+                LOG_INFO("expired " << n << " partitions");
+                invalidate_event_range();
+            }
+        }
+
+        if (compactAfter_ > 0 && newest > compactAfter_) {
+            unsigned int n = db.compactEvents(newest - compactAfter_, interval_);
+            if (n) {
+                LOG_INFO("compacted " << n << " partitions");
+                invalidate_event_range();
+            }
+        }
+    } catch (std::exception& e) {
+        LOG_ERROR("event database maintenance failed: " << e.what());
+    }
+    TRACE_EXIT();
+}
+
+// vim:sw=4 ts=8
@@ -0,0 +1,79 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ * 
+ * This file is part of WATCHER.
+ * 
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ * 
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ * 
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@file
+ * @date 2010-06-01
+ */
+
+#ifndef event_retention_h
+#define event_retention_h
+
+#include <string>
+#include <boost/thread.hpp>
+#include <boost/utility.hpp>
+
+#include "libwatcher/watcherTypes.h"
+#include "libconfig.h++"
+#include "declareLogger.h"
+
+namespace watcher {
+
+    /** Applies the event retention policy from the watcherd configuration.
+     *
+     * A background thread with its own database handle periodically drops
+     * (or archives) partitions older than the retention period and compacts
+     * partitions older than the compaction age.  Ages are measured back from
+     * the newest event in the database rather than the wall clock, so
+     * replaying an old exercise does not cause it to be expired.
+     */
+    class EventRetention : private boost::noncopyable {
+        public:
+            /** Read the retention policy, adding defaults for missing settings.
+             * @param[in] cfg the watcherd configuration
+             */
+            EventRetention(libconfig::Config& cfg);
+            ~EventRetention();
+
+            /** Start the maintenance thread if any maintenance is configured. */
+            void start();
+
+            /** Stop the maintenance thread and wait for it to exit. */
+            void stop();
+
+            /** Run a single maintenance pass on the calling thread. */
+            void maintain();
+
+        private:
+            void run();
+
+            Timestamp retention_;       //< age at which partitions are expired, 0 for never (milliseconds)
+            Timestamp compactAfter_;    //< age at which partitions are compacted, 0 for never (milliseconds)
+            Timestamp interval_;        //< compaction downsampling interval (milliseconds)
+            std::string archive_;       //< database expired partitions are moved to, empty to discard
+            int period_;                //< seconds between maintenance passes
+
+            boost::thread thread_;
+
+            DECLARE_LOGGER();
+    };
+
+} //namespace
+
+#endif /* event_retention_h */
+
+// vim:sw=4 ts=8
@@ -0,0 +1,103 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ * 
+ * This file is part of WATCHER.
+ * 
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ * 
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ * 
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@file
+ * @date 2010-06-15
+ */
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "libwatcher/metrics.h"
+#include "metricsReporter.h"
+#include "watcherdConfig.h"
+#include "logger.h"
+
+using namespace watcher;
+
+INIT_LOGGER(MetricsReporter, "Metrics");
+
+MetricsReporter::MetricsReporter(libconfig::Config& cfg) : period_(60)
+{
+    TRACE_ENTER();
+    if (!cfg.lookupValue(metricsInterval, period_))
+        cfg.getRoot().add(metricsInterval, libconfig::Setting::TypeInt) = period_;
+    LOG_INFO("metrics reported every " << period_ << "s");
+    TRACE_EXIT();
+}
+
+MetricsReporter::~MetricsReporter()
+{
+    TRACE_ENTER();
+    stop();
+    TRACE_EXIT();
+}
+
+void MetricsReporter::start()
+{
+    TRACE_ENTER();
+    if (period_ <= 0)
+        LOG_INFO("periodic metrics reporting disabled");
+    else
+        thread_ = boost::thread(boost::bind(&MetricsReporter::run, this));
+    TRACE_EXIT();
+}
+
+void MetricsReporter::stop()
+{
+    TRACE_ENTER();
+    if (thread_.joinable()) {
+        thread_.interrupt();
+        thread_.join();
+    }
+    TRACE_EXIT();
+}
+
+void MetricsReporter::run()
+{
+    TRACE_ENTER();
+    try {
+        for (;;) {
+            boost::this_thread::sleep(boost::posix_time::seconds(period_));
+            report();
+        }
+    } catch (boost::thread_interrupted&) {
+        LOG_DEBUG("metrics thread stopped");
+    }
+    TRACE_EXIT();
+}
+
+void MetricsReporter::report()
+{
+    TRACE_ENTER();
+
+    typedef std::pair<std::string, int64_t> CounterValue;
+    metrics::Snapshot snap;
+    metrics::snapshot(snap);
+
+    BOOST_FOREACH(const CounterValue& c, snap.counters)
+        LOG_INFO(c.first << ' ' << c.second);
+    BOOST_FOREACH(const metrics::HistogramSummary& h, snap.histograms)
+        if (h.count)
+            LOG_INFO(h);
+
+    TRACE_EXIT();
+}
+
+// vim:sw=4 ts=8
@@ -0,0 +1,71 @@
+/* Copyright 2010 SPARTA, Inc., dba Cobham Analytic Solutions
+ * 
+ * This file is part of WATCHER.
+ * 
+ *     WATCHER is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Affero General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ * 
+ *     WATCHER is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Affero General Public License for more details.
+ * 
+ *     You should have received a copy of the GNU Affero General Public License
+ *     along with Watcher.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@file
+ * @date 2010-06-15
+ */
+
+#ifndef metrics_reporter_h
+#define metrics_reporter_h
+
+#include <boost/thread.hpp>
+#include <boost/utility.hpp>
+
+#include "libconfig.h++"
+#include "declareLogger.h"
+
+namespace watcher {
+
+    /** Periodically writes watcherd's metrics to the "Metrics" logger.
+     *
+     * Every metricsInterval seconds a snapshot of the counters and latency
+     * histograms is logged at INFO, one metric per line, so that the load on
+     * a running watcherd can be followed from its log.
+     */
+    class MetricsReporter : private boost::noncopyable {
+        public:
+            /** Read the dump interval, adding the default if it is missing.
+             * @param[in] cfg the watcherd configuration
+             */
+            MetricsReporter(libconfig::Config& cfg);
+            ~MetricsReporter();
+
+            /** Start the reporting thread unless reporting is disabled. */
+            void start();
+
+            /** Stop the reporting thread and wait for it to exit. */
+            void stop();
+
+            /** Log a snapshot of the metrics on the calling thread. */
+            void report();
+
+        private:
+            void run();
+
+            int period_;        //< seconds between reports, 0 to disable
+
+            boost::thread thread_;
+
+            DECLARE_LOGGER();
+    };
+
+} //namespace
+
+#endif /* metrics_reporter_h */
+
+// vim:sw=4 ts=8
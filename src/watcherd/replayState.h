@@ -19,22 +19,17 @@
 #ifndef replay_state_h
 #define replay_state_h
 
-#include <boost/scoped_ptr.hpp>
-#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/asio/io_service.hpp>
 
 #include "libwatcher/watcherTypes.h" //for Timestamp
 #include "declareLogger.h"
 #include "sharedStreamFwd.h"
 
-// forward decls
-namespace boost {
-    namespace system {
-        class error_code;
-    }
-}
-
 namespace watcher {
 
+    class ReplayScheduler;
+
     /** Implements replay of events from the database to a specific client
      * connected to watcherd.
      *
@@ -43,11 +38,12 @@ namespace watcher {
      * database.
      *
      * The playback rate, event buffer size and time step may all be
-     * reconfigured at runtime.  NOTE: altering the playback speed may
-     * not take effect immediately because the pending timer is not
-     * rescheduled to take into account the new value.
+     * reconfigured at runtime.  Events are timed by a ReplayClock, so a
+     * change of speed or a seek takes effect straight away and changes to
+     * the system time do not disturb playback.  The timing itself is done
+     * by a ReplayScheduler; this class feeds it from the database.
      */
-    class ReplayState : public boost::enable_shared_from_this<ReplayState> {
+    class ReplayState {
         public:
             /// invalid argument exception
             struct Bad_arg {};
@@ -65,10 +61,7 @@ namespace watcher {
             /** Start event playback. */
             ReplayState& play();
 
-            /** Pause event playback.
-             *
-             * NOTE: the object will be destroyed if no shared_ptr exists.
-             */
+            /** Pause event playback. */
             ReplayState& pause();
             
             /** Return the current position in the event stream. */
@@ -99,9 +92,11 @@ namespace watcher {
 
             /** Adjust the granularity of the timer used to bundle events.
              *
-             * When a timer expires, all events that occur in the next time
-             * step are bundled up and sent out in bulk.  The smaller the
-             * time_step, the more accurate playback will be.
+             * The timer only expires on multiples of the time step, and all
+             * events that have fallen due are sent out in bulk, so no event
+             * is sent early and none more than one time step late.  The
+             * smaller the time_step, the more accurate playback will be, at
+             * the cost of more timer wakeups during bursts of events.
              *
              * @param[in] n positive integer representing the number of
              * milliseconds
@@ -112,11 +107,7 @@ namespace watcher {
             ~ReplayState();
 
         private:
-            struct impl;
-            boost::scoped_ptr<impl> impl_;
-
-	    void run();
-            void timer_handler(const boost::system::error_code& error);
+            boost::shared_ptr<ReplayScheduler> scheduler_;
 
             DECLARE_LOGGER();
     };
@@ -1,9 +1,28 @@
-CREATE TABLE events (
+-- Catalog of the partitions holding events.  Each partition stores the
+-- events for the time window [begin, end) in a table named events_<begin>.
+CREATE TABLE partitions (
+	name		TEXT PRIMARY KEY,	-- name of the partition table
+	begin		INTEGER NOT NULL,	-- start of the window (milliseconds)
+	end		INTEGER NOT NULL,	-- end of the window, exclusive (milliseconds)
+	compacted	INTEGER NOT NULL DEFAULT 0	-- non-zero once GPS/connectivity updates have been downsampled
+);
+
+-- Layout of each partition table, shown here for the window starting at 0.
+CREATE TABLE events_0 (
 	ts	INTEGER NOT NULL,	-- time at which event occurred (milliseconds)
         evtype  INTEGER NOT NULL,       -- event type
 	node	TEXT NOT NULL,		-- IP address of node
-	data	TEXT NOT NULL		-- binary blob containing event payload
+	data	TEXT NOT NULL,		-- binary blob containing event payload
+	layer	TEXT NOT NULL DEFAULT ''	-- GUI layer of the event, empty if none
 );
 
 -- create an index on the timestamp column to allow for speedier access
-CREATE INDEX time ON events ( ts ASC );
+CREATE INDEX events_0_time ON events_0 ( ts ASC );
+
+-- indices for targeted queries by event type, node and layer over a time range
+CREATE INDEX events_0_type_time ON events_0 ( evtype, ts );
+CREATE INDEX events_0_node_time ON events_0 ( node, ts );
+CREATE INDEX events_0_layer_time ON events_0 ( layer, ts );
+
+-- The union of all partitions, rebuilt whenever a partition is added or removed.
+CREATE VIEW events AS SELECT ts, evtype, node, data, layer FROM events_0;
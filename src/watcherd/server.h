@@ -45,6 +45,9 @@ namespace watcher
             /// Stop the Server.
             void stop();
 
+            /// The io_service running the Server's connections.
+            boost::asio::io_service& io_service() { return io_service_; }
+
         private:
             DECLARE_LOGGER();
 
@@ -21,6 +21,7 @@
 #include <vector>
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include <libwatcher/message.h>
 #include <libwatcher/messageStatus.h>
@@ -32,6 +33,11 @@
 #include <libwatcher/subscribeStreamMessage.h>
 #include <libwatcher/listStreamsMessage.h>
 #include <libwatcher/streamDescriptionMessage.h>
+#include <libwatcher/eventQueryMessage.h>
+#include <libwatcher/metricsMessage.h>
+#include <libwatcher/dataSeriesMessage.h>
+#include <libwatcher/metrics.h>
+#include <libwatcher/messageTrace.h>
 
 #include "watcherd.h"
 #include "writeDBMessageHandler.h"
@@ -53,6 +59,60 @@ namespace {
     {
         return !isFeederEvent(m->type);
     }
+
+    /* Totals for all connections.  Each connection also keeps its own
+     * copies, named connection.<n>.<metric>, for as long as it is open. */
+    watcher::metrics::Counter connectionsOpen("connection.open");
+    watcher::metrics::Counter messagesIn("connection.messages_in");
+    watcher::metrics::Counter bytesIn("connection.bytes_in");
+    watcher::metrics::Counter messagesOut("connection.messages_out");
+    watcher::metrics::Counter bytesOut("connection.bytes_out");
+    watcher::metrics::Counter writeQueue("connection.write_queue");
+    watcher::metrics::Histogram writeQueueDepth("connection.write_queue_depth");
+    watcher::metrics::Histogram unmarshalTime("connection.unmarshal_usec");
+
+    unsigned long getNextConnectionNumber()
+    {
+        static unsigned long number = 0;
+        static boost::mutex numberLock;
+
+        boost::mutex::scoped_lock l(numberLock);
+        return ++number;
+    }
+
+    /* Collects the results of an event query into batches, since the
+     * marshalled message count is limited to an unsigned short. */
+    class QueryResultSender {
+        public:
+            QueryResultSender(watcher::ServerConnection& c) : conn(c) {}
+            void operator() (const MessagePtr &m) {
+                batch.push_back(m);
+                if (batch.size() == batchSize)
+                    flush();
+            }
+            void flush() {
+                if (!batch.empty()) {
+                    conn.sendMessage(batch);
+                    batch.clear();
+                }
+            }
+        private:
+            static const size_t batchSize = 1000;
+            watcher::ServerConnection& conn;
+            std::vector<MessagePtr> batch;
+    };
+
+    /* The most events sent in reply to one event query.  Queries run on
+     * the connection's io thread, so the rest of a larger result is left
+     * for the client to ask for. */
+    const uint32_t maxQueryPage = 10000;
+
+    /* function object for accepting events output from query_events() */
+    struct query_page {
+        std::vector<MessagePtr>& events;
+        query_page(std::vector<MessagePtr>& e) : events(e) {}
+        void operator() (const MessagePtr &m) { events.push_back(m); }
+    };
 }
 
 namespace watcher {
@@ -60,6 +120,25 @@ namespace watcher {
 
     INIT_LOGGER(ServerConnection, "Connection.ServerConnection");
 
+    struct ServerConnection::Metrics {
+        Metrics(const string& prefix) :
+            messagesIn(prefix + "messages_in"),
+            bytesIn(prefix + "bytes_in"),
+            messagesOut(prefix + "messages_out"),
+            bytesOut(prefix + "bytes_out"),
+            writeQueue(prefix + "write_queue"),
+            unmarshalTime(prefix + "unmarshal_usec")
+        {
+        }
+
+        metrics::InstanceCounter messagesIn;
+        metrics::InstanceCounter bytesIn;
+        metrics::InstanceCounter messagesOut;
+        metrics::InstanceCounter bytesOut;
+        metrics::InstanceCounter writeQueue;
+        metrics::InstanceHistogram unmarshalTime;
+    };
+
     ServerConnection::ServerConnection(Watcherd& w, boost::asio::io_service& io_service) :
         Connection(io_service),
         watcher(w),
@@ -67,9 +146,11 @@ namespace watcher {
         strand_(io_service),
         write_strand_(io_service),
 	incomingBuffer(DataMarshaller::header_length), // ensure enough space to read the payload header
+	outBuffersDepth(0),
         conn_type(unknown),
         dataNetwork(0),
-        messageStreamFilterEnabled(false)
+        messageStreamFilterEnabled(false),
+        metrics_(new Metrics("connection." + boost::lexical_cast<string>(getNextConnectionNumber()) + "."))
     {
         TRACE_ENTER();
         libconfig::Config &cfg=SingletonConfig::instance();
@@ -89,6 +170,7 @@ namespace watcher {
             LOG_ERROR("Error reading \"dataNetwork\" from configuration at " << e.getPath() << ": " << e.what());
         }
 
+        connectionsOpen.add();
         TRACE_EXIT();
     }
 
@@ -97,6 +179,8 @@ namespace watcher {
         TRACE_ENTER();
         //shared_from_this() not allowed in destructor
         //watcher.unsubscribe(shared_from_this());
+        connectionsOpen.sub();
+	writeQueue.sub(outBuffersDepth);
         TRACE_EXIT();
     }
 
@@ -291,6 +375,89 @@ namespace watcher {
 	TRACE_EXIT();
     }
 
+    /** Run a targeted query against the event database and send the
+     * matching events to the sender, followed by the query message itself
+     * with the count filled in.
+     *
+     * At most maxQueryPage events are sent.  If there may be more, the
+     * page ends before the events at its last timestamp and the reply's
+     * next field is set to that timestamp, so that querying again from
+     * there neither repeats nor skips any events.
+     */
+    void ServerConnection::queryEvents(MessagePtr& m)
+    {
+	TRACE_ENTER();
+	EventQueryMessagePtr p = boost::dynamic_pointer_cast<EventQueryMessage>(m);
+	if (p) {
+	    LOG_DEBUG("running event query: " << *p);
+	    EventQueryMessage q(*p);
+	    if (!q.limit || q.limit > maxQueryPage)
+		q.limit = maxQueryPage;
+	    std::vector<MessagePtr> events;
+	    query_events(query_page(events), q);
+
+	    EventQueryMessagePtr reply(new EventQueryMessage(*p));
+	    reply->next = Infinity;
+	    if (events.size() == q.limit && q.limit != p->limit) {
+		Timestamp last = events.back()->timestamp;
+		size_t n = events.size();
+		while (n && events[n - 1]->timestamp == last)
+		    --n;
+		if (n) {
+		    events.resize(n);
+		    reply->next = last;
+		} else {
+		    LOG_WARN("more than " << q.limit << " events at " << last << ", skipping the rest of them");
+		    if (p->end == Infinity || last < p->end)
+			reply->next = last + 1;
+		}
+	    }
+
+	    QueryResultSender sender(*this);
+	    BOOST_FOREACH(const MessagePtr& e, events)
+		sender(e);
+	    sender.flush();
+	    reply->count = events.size();
+	    sendMessage(reply);
+	} else
+	    LOG_WARN("unable to cast MessagePtr to EventQueryMessagePtr");
+	TRACE_EXIT();
+    }
+
+    /** Reply to the sender with a snapshot of watcherd's metrics. */
+    void ServerConnection::queryMetrics(MessagePtr&)
+    {
+	TRACE_ENTER();
+	MetricsMessagePtr reply(new MetricsMessage);
+	metrics::snapshot(reply->snapshot);
+	sendMessage(reply);
+	TRACE_EXIT();
+    }
+
+    /** Reply to the sender with the requested data point series, downsampled. */
+    void ServerConnection::queryDataSeries(MessagePtr& m)
+    {
+	TRACE_ENTER();
+	DataSeriesMessagePtr p = boost::dynamic_pointer_cast<DataSeriesMessage>(m);
+	if (p) {
+	    DataSeriesMessagePtr reply(new DataSeriesMessage(*p));
+	    watcher.dataRollup().query(*reply);
+	    LOG_DEBUG("data series query: " << *reply);
+	    sendMessage(reply);
+	} else
+	    LOG_WARN("unable to cast MessagePtr to DataSeriesMessagePtr");
+	TRACE_EXIT();
+    }
+
+    void ServerConnection::trackWriteQueue(int delta)
+    {
+	outBuffersDepth += delta;
+	writeQueue.add(delta);
+	metrics_->writeQueue.add(delta);
+	if (delta > 0)
+	    writeQueueDepth.record(outBuffersDepth);
+    }
+
     bool ServerConnection::dispatch_gui_event(MessagePtr& m)
     {
         static const struct {
@@ -306,6 +473,9 @@ namespace watcher {
 	    { SUBSCRIBE_STREAM_MESSAGE_TYPE, &ServerConnection::subscribeToStream },
 	    { STREAM_DESCRIPTION_MESSAGE_TYPE, &ServerConnection::description },
 	    { LIST_STREAMS_MESSAGE_TYPE, &ServerConnection::listStreams },
+	    { EVENT_QUERY_MESSAGE_TYPE, &ServerConnection::queryEvents },
+	    { METRICS_MESSAGE_TYPE, &ServerConnection::queryMetrics },
+	    { DATA_SERIES_MESSAGE_TYPE, &ServerConnection::queryDataSeries },
             { UNKNOWN_MESSAGE_TYPE, 0 }
         };
 
@@ -335,8 +505,18 @@ namespace watcher {
         if (!e)
         {
             vector<MessagePtr> arrivedMessages; 
-            if (DataMarshaller::unmarshalPayload(arrivedMessages, numOfMessages, &incomingBuffer[0], bytes_transferred))
+            bool unmarshalled;
+            {
+                metrics::ScopedTimer t(unmarshalTime, metrics_->unmarshalTime);
+                unmarshalled = DataMarshaller::unmarshalPayload(arrivedMessages, numOfMessages, &incomingBuffer[0], bytes_transferred);
+            }
+            if (unmarshalled)
             {
+                messagesIn.add(arrivedMessages.size());
+                bytesIn.add(DataMarshaller::header_length + bytes_transferred);
+                metrics_->messagesIn.add(arrivedMessages.size());
+                metrics_->bytesIn.add(DataMarshaller::header_length + bytes_transferred);
+
                 boost::system::error_code err;
                 boost::asio::ip::tcp::endpoint ep = getSocket().remote_endpoint(err);
                 if (err) { 
@@ -350,7 +530,7 @@ namespace watcher {
                         (arrivedMessages.size()>1?"s":"") << " from " <<
                         ep.address()); 
 
-                BOOST_FOREACH(MessagePtr m, arrivedMessages) {
+                BOOST_FOREACH(MessagePtr &m, arrivedMessages) {
                     if (isFeederEvent(m->type)) {
 			// sanity check
 			if (conn_type == gui) {
@@ -359,6 +539,9 @@ namespace watcher {
 			    return;
 			}
 
+			if (!m->trace.empty())
+			    traceStamp(*m, TRACE_SERVER_RECV);
+
 			// Add the incoming address to the Message so everyone
 			// knows who the message came from. If there is a dataNetwork, use that 
 			// to mask/modify the incoming ip address to be in the correct network.
@@ -377,7 +560,7 @@ namespace watcher {
                                  * stream to the database.
                                  */
 				    LOG_DEBUG("adding handle to write to event db");
-                                addMessageHandler(MessageHandlerPtr(new WriteDBMessageHandler()));
+                                addMessageHandler(MessageHandlerPtr(new WriteDBMessageHandler(watcher)));
                             }
 			}
                     } else if (conn_type == feeder) { // sanity check, anything else should be a gui control event
@@ -424,10 +607,13 @@ namespace watcher {
 	{
 	    boost::mutex::scoped_lock lock(outBuffersLock);
 	    outBuffers.remove(outBuf);
+	    trackWriteQueue(-1);
 	}
 
         if (!e)
         {
+            bytesOut.add(bytes_transferred);
+            metrics_->bytesOut.add(bytes_transferred);
             LOG_DEBUG("Successfully sent message to client(size=" << bytes_transferred << "): " << message); 
 
             BOOST_FOREACH(MessageHandlerPtr mh, messageHandlers)
@@ -472,7 +658,7 @@ namespace watcher {
     }
 
     /** Send a single message to this connected client. */
-    void ServerConnection::sendMessage(MessagePtr msg)
+    void ServerConnection::sendMessage(const MessagePtr &msg)
     {
         TRACE_ENTER();
 
@@ -496,7 +682,10 @@ namespace watcher {
 	{
 	    boost::mutex::scoped_lock lock(outBuffersLock);
 	    outBuffers.push_back(outBuf);
+	    trackWriteQueue(1);
 	}
+	messagesOut.add();
+	metrics_->messagesOut.add();
 
 
         /// FIXME melkins 2004-04-19
@@ -519,12 +708,12 @@ namespace watcher {
     {
         TRACE_ENTER();
 
-        std::vector<MessagePtr> messageList;
+        // Only copy the messages which pass, when there is filtering to do.
+        std::vector<MessagePtr> filtered;
+        const std::vector<MessagePtr> &messageList=messageStreamFilterEnabled ? filtered : msgs;
 
-        if (!messageStreamFilterEnabled)
-            messageList=msgs;
-        else {
-            BOOST_FOREACH(const MessagePtr m, msgs) { 
+        if (messageStreamFilterEnabled) {
+            BOOST_FOREACH(const MessagePtr &m, msgs) { 
                 bool passed=false;
                 // Need to figure out if filters are ANDed or ORed or something else
                 // for now if it passes any - it's in.
@@ -535,7 +724,7 @@ namespace watcher {
                     }
                 if (passed) {  
                     LOG_DEBUG("Message passed at least one filter - sending it."); 
-                    messageList.push_back(m); 
+                    filtered.push_back(m); 
                 }
                 else 
                     LOG_DEBUG("Not sending message as it did not pass any of the current set of message filters"); 
@@ -557,7 +746,10 @@ namespace watcher {
 	{
 	    boost::mutex::scoped_lock lock(outBuffersLock);
 	    outBuffers.push_back(outBuf);
+	    trackWriteQueue(1);
 	}
+	messagesOut.add(messageList.size());
+	metrics_->messagesOut.add(messageList.size());
 
         /// FIXME melkins 2004-04-19
         // is it safe to call async_write and async_read from different
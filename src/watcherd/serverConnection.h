@@ -34,6 +34,7 @@
 #include <boost/asio.hpp>
 #include <boost/array.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/thread.hpp>
 
@@ -62,7 +63,7 @@ namespace watcher
             void run();
 
             /// Send a message(s) to this client
-            void sendMessage(event::MessagePtr);
+            void sendMessage(const event::MessagePtr&);
             void sendMessage(const std::vector<event::MessagePtr>&);
 
             /// get the io_service associated with this connection
@@ -109,6 +110,7 @@ namespace watcher
 	    //
 	    boost::mutex outBuffersLock;
 	    std::list<DataMarshaller::NetworkMarshalBuffersPtr> outBuffers;
+	    size_t outBuffersDepth;	//< outBuffers.size(), which is not constant time for std::list
 
             /// What type of connection is this?
             enum connection_type { unknown, feeder, gui };
@@ -130,6 +132,16 @@ namespace watcher
 	    void subscribeToStream(MessagePtr&);
 	    void description(MessagePtr&);
 	    void listStreams(MessagePtr&);
+	    void queryEvents(MessagePtr&);
+	    void queryMetrics(MessagePtr&);
+	    void queryDataSeries(MessagePtr&);
+
+	    /// Account for a buffer added to or removed from outBuffers.  outBuffersLock must be held.
+	    void trackWriteQueue(int delta);
+
+	    /// This connection's share of the connection.* metrics.
+	    struct Metrics;
+	    boost::scoped_ptr<Metrics> metrics_;
     };
 
 } // namespace
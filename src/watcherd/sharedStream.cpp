@@ -19,6 +19,7 @@
 #include <list>
 
 #include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include <libwatcher/seekWatcherMessage.h>
 #include <libwatcher/speedWatcherMessage.h>
@@ -26,6 +27,7 @@
 #include <libwatcher/streamDescriptionMessage.h>
 #include <libwatcher/startWatcherMessage.h>
 #include <libwatcher/stopWatcherMessage.h>
+#include <libwatcher/metrics.h>
 
 #include "sharedStream.h"
 #include "replayState.h"
@@ -44,6 +46,9 @@ uint32_t getNextUID()
     return UID;
 }
 
+watcher::metrics::Counter subscribers("stream.subscribers");
+watcher::metrics::Histogram fanoutTime("stream.fanout_usec");
+
 } // namespace
 
 namespace watcher {
@@ -60,7 +65,20 @@ class SharedStreamImpl {
 	boost::shared_mutex lock_;
 	std::list<ServerConnectionPtr> clients_; // clients subscribed to this stream
 
-	SharedStreamImpl(Watcherd& wd) : watcher_(wd), uid_(getNextUID()) {}
+	/* this stream's share of the stream.* metrics */
+	metrics::InstanceCounter subscribers_;
+	metrics::InstanceHistogram fanoutTime_;
+
+	SharedStreamImpl(Watcherd& wd) :
+	    watcher_(wd), uid_(getNextUID()),
+	    subscribers_(metricName(uid_, "subscribers")),
+	    fanoutTime_(metricName(uid_, "fanout_usec"))
+	{}
+
+	static std::string metricName(uint32_t uid, const char *metric)
+	{
+	    return "stream." + boost::lexical_cast<std::string>(uid) + "." + metric;
+	}
 };
 
 using namespace watcher::event;
@@ -158,28 +176,52 @@ void SharedStream::speed(const SpeedMessagePtr& p)
 }
 
 /** Returns a PlaybackTimeRangeMessage event to the sender with the timestamps of
- * the first and last event in the database.
+ * the first and last event in the database.  The range is served from memory,
+ * see event_range().
  */
 void SharedStream::range(ServerConnectionPtr conn)
 {
     TRACE_ENTER();
 
     TimeRange r(event_range());
-    PlaybackTimeRangeMessagePtr p(new PlaybackTimeRangeMessage(r.first, r.second, impl_->replay_->tell())); 
+    Timestamp cur;
+    {
+	boost::shared_lock<boost::shared_mutex> lck(impl_->lock_);
+	cur = impl_->replay_ ? impl_->replay_->tell() : 0;
+    }
+    PlaybackTimeRangeMessagePtr p(new PlaybackTimeRangeMessage(r.first, r.second, cur)); 
     conn->sendMessage(p);
 
     TRACE_EXIT();
 }
 
+/** Pushes a PlaybackTimeRangeMessage to all subscribers when the range of
+ * events in the database changes, so that clients need not poll for it.
+ */
+void SharedStream::sendRange(const TimeRange& r)
+{
+    TRACE_ENTER();
+
+    Timestamp cur;
+    {
+	boost::shared_lock<boost::shared_mutex> lck(impl_->lock_);
+	cur = impl_->replay_ ? impl_->replay_->tell() : 0; // 0 until a client starts playback
+    }
+    sendMessage(PlaybackTimeRangeMessagePtr(new PlaybackTimeRangeMessage(r.first, r.second, cur)));
+
+    TRACE_EXIT();
+}
+
 /** send a message to all clients subscribed to this shared stream. */
-void SharedStream::sendMessage(MessagePtr m)
+void SharedStream::sendMessage(const MessagePtr &m)
 {
     TRACE_ENTER();
 
     int count = 0;
     {
 	boost::shared_lock<boost::shared_mutex> lck(impl_->lock_);
-	BOOST_FOREACH(ServerConnectionPtr conn, impl_->clients_) {
+	metrics::ScopedTimer t(fanoutTime, impl_->fanoutTime_);
+	BOOST_FOREACH(const ServerConnectionPtr &conn, impl_->clients_) {
 	    conn->sendMessage(m);
 	    ++count;
 	}
@@ -196,7 +238,8 @@ void SharedStream::sendMessage(const std::vector<MessagePtr>& msgs)
     int count = 0;
     {
 	boost::shared_lock<boost::shared_mutex> lck(impl_->lock_);
-	BOOST_FOREACH(ServerConnectionPtr conn, impl_->clients_) {
+	metrics::ScopedTimer t(fanoutTime, impl_->fanoutTime_);
+	BOOST_FOREACH(const ServerConnectionPtr &conn, impl_->clients_) {
 	    conn->sendMessage(msgs);
 	    ++count;
 	}
@@ -221,6 +264,8 @@ void SharedStream::subscribe(ServerConnectionPtr p)
 	    impl_->replay_.reset(new ReplayState(p->io_service(), shared_from_this()));
 
 	impl_->clients_.push_front(p);
+	subscribers.add();
+	impl_->subscribers_.add();
     }
 
     // send the current state to the new subscribe
@@ -241,7 +286,10 @@ void SharedStream::unsubscribe(ServerConnectionPtr p)
     TRACE_ENTER();
     LOG_DEBUG("client unsubscribing from stream");
     boost::unique_lock<boost::shared_mutex> lck(impl_->lock_);
+    size_t before = impl_->clients_.size();
     impl_->clients_.remove(p);
+    subscribers.sub(before - impl_->clients_.size());
+    impl_->subscribers_.sub(before - impl_->clients_.size());
     if (impl_->clients_.empty()) {
 	LOG_INFO("no more waiting clients for for stream uid=" << impl_->uid_);
 	impl_->watcher_.removeStream(shared_from_this());
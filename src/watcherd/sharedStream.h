@@ -27,6 +27,7 @@
 
 #include "logger.h"
 #include "libwatcher/watcherMessageFwd.h"
+#include "libwatcher/watcherTypes.h"
 #include "sharedStreamFwd.h"
 #include "serverConnectionFwd.h"
 
@@ -47,6 +48,9 @@ class SharedStream : public boost::enable_shared_from_this<SharedStream> {
 	void speed(const event::SpeedMessagePtr& m);
 	void range(ServerConnectionPtr);
 
+	/** send the given event range to all clients watching this stream. */
+	void sendRange(const std::pair<Timestamp, Timestamp>&);
+
 	/** Add a client to the list which gets events for this stream. */
 	void subscribe(ServerConnectionPtr);
 
@@ -54,7 +58,7 @@ class SharedStream : public boost::enable_shared_from_this<SharedStream> {
 	void unsubscribe(ServerConnectionPtr);
 
 	/** send a message to all clients watching this stream. */
-	void sendMessage(event::MessagePtr);
+	void sendMessage(const event::MessagePtr&);
 
 	/** send messages to all clients watching this stream. */
 	void sendMessage(const std::vector<event::MessagePtr>&);
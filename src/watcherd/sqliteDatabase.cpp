@@ -22,7 +22,9 @@
 
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/foreach.hpp>
 #include <sstream>
+#include <vector>
 
 //external deps
 #include "sqlite_wrapper.h"
@@ -32,6 +34,8 @@
 #include "sqliteDatabase.h"
 
 #include "libwatcher/message.h"
+#include "libwatcher/eventQueryMessage.h"
+#include "libwatcher/metrics.h"
 
 using namespace watcher;
 using namespace watcher::event;
@@ -39,49 +43,545 @@ using namespace sqlite_wrapper;
 
 INIT_LOGGER(SqliteDatabase, "Database.SqliteDatabase");
 
-SqliteDatabase::SqliteDatabase(const std::string& path) :
-    conn_(new Connection(path, Connection::readwrite | Connection::create | Connection::nomutex))
+namespace {
+    /* Provide a conversion for MessageType */
+    Statement& operator<< (Statement& s, MessageType t) { return s << static_cast<int>(t); }
+
+    /* Event types for which hasLayer() returns a layer. */
+    const MessageType layerTypes[] = { LABEL_MESSAGE_TYPE, EDGE_MESSAGE_TYPE, COLOR_MESSAGE_TYPE, CONNECTIVITY_MESSAGE_TYPE };
+
+    /* Event types which are downsampled by compactEvents(). */
+    const MessageType compactTypes[] = { GPS_MESSAGE_TYPE, CONNECTIVITY_MESSAGE_TYPE };
+
+    /* Number of rows copied per transaction when archiving or compacting a
+     * partition, which bounds how long the ingest path can be held off. */
+    const long long copyBatchSize = 10000;
+
+    /* The "events" view covers at most this many of the newest partitions.
+     * SQLite refuses a compound SELECT of more than 500 terms
+     * (SQLITE_MAX_COMPOUND_SELECT); watcherd itself reads the partitions
+     * directly and is not limited by the view. */
+    const int maxViewPartitions = 400;
+
+    /* Column list shared by every partition table. */
+    const char *eventColumns = "ts, evtype, node, data, layer";
+
+    /* Query times include the time taken by the output callback. */
+    metrics::Counter eventsStored("db.events_stored");
+    metrics::Histogram insertTime("db.insert_usec");
+    metrics::Histogram batchInsertTime("db.batch_insert_usec");
+    metrics::Histogram queryTime("db.query_usec");
+
+    /* Append a " AND col IN (?,?,...)" clause with n placeholders, or nothing if n is 0. */
+    void append_in_clause(std::ostream& os, const char *col, size_t n)
+    {
+        if (n) {
+            os << " AND " << col << " IN (";
+            for (size_t i = 0; i < n; ++i)
+                os << (i ? ",?" : "?");
+            os << ')';
+        }
+    }
+
+    template <size_t N> void append_type_list(std::ostream& os, const MessageType (&types)[N])
+    {
+        for (size_t i = 0; i < N; ++i)
+            os << (i ? "," : "") << static_cast<int>(types[i]);
+    }
+
+    /* SQL to create the table and indices for a partition.  The composite
+     * indices allow queryEvents() to pull out a single node, event type or
+     * layer over a time range without walking the entire partition.
+     */
+    std::string partition_table_ddl(const std::string& schema, const std::string& name)
+    {
+        return "CREATE TABLE IF NOT EXISTS " + schema + name + " ( ts INTEGER, evtype INTEGER, node TEXT, data TEXT, layer TEXT NOT NULL DEFAULT '' );";
+    }
+
+    std::string partition_index_ddl(const std::string& schema, const std::string& name)
+    {
+        std::ostringstream os;
+        os << "CREATE INDEX IF NOT EXISTS " << schema << name << "_time ON " << name << " ( ts ASC ); "
+           << "CREATE INDEX IF NOT EXISTS " << schema << name << "_type_time ON " << name << " ( evtype, ts ); "
+           << "CREATE INDEX IF NOT EXISTS " << schema << name << "_node_time ON " << name << " ( node, ts ); "
+           << "CREATE INDEX IF NOT EXISTS " << schema << name << "_layer_time ON " << name << " ( layer, ts );";
+        return os.str();
+    }
+
+    std::string partition_ddl(const std::string& schema, const std::string& name)
+    {
+        return partition_table_ddl(schema, name) + " " + partition_index_ddl(schema, name);
+    }
+
+    /* SQL to create the catalog listing the partitions in a database. */
+    std::string catalog_ddl(const std::string& schema)
+    {
+        return "CREATE TABLE IF NOT EXISTS " + schema + "partitions ( name TEXT PRIMARY KEY, begin INTEGER NOT NULL, end INTEGER NOT NULL, compacted INTEGER NOT NULL DEFAULT 0, indexed INTEGER NOT NULL DEFAULT 1 );";
+    }
+
+    /* Holds a write transaction open for the lifetime of the object, rolling
+     * it back unless commit() is called. */
+    class Transaction {
+        public:
+            Transaction(Connection& c) : conn_(c), done_(false) { conn_.execute("BEGIN IMMEDIATE;"); }
+            ~Transaction() {
+                if (!done_) {
+                    try {
+                        conn_.execute("ROLLBACK;");
+                    } catch (sqlite_wrapper::Exception&) {
+                        // nothing more can be done from a destructor
+                    }
+                }
+            }
+            void commit() { conn_.execute("COMMIT;"); done_ = true; }
+        private:
+            Connection& conn_;
+            bool done_;
+    };
+
+    /* Return a single integer value from the first row of a query, or def if there are no rows. */
+    long long select_int(Connection& conn, const std::string& sql, long long def = 0)
+    {
+        Statement st(conn, sql);
+        Row r(st.rows());
+        if (!r)
+            return def;
+        Column c(r.columns());
+        long long val = def;
+        c >> val;
+        return val;
+    }
+
+    Timestamp window_start(Timestamp ts, Timestamp len)
+    {
+        return ts - ts % len;
+    }
+}
+
+SqliteDatabase::SqliteDatabase(const std::string& path, Timestamp partitionLength) :
+    conn_(new Connection(path, Connection::readwrite | Connection::create | Connection::nomutex)),
+    partitionLength_(partitionLength > 0 ? partitionLength : defaultPartitionLength),
+    bulkLoad_(false)
 {
     TRACE_ENTER();
 
-    /* Create database if it doesn't yet exist */
-    conn_->execute("CREATE TABLE IF NOT EXISTS events ( ts INTEGER, evtype INTEGER, node TEXT, data TEXT ); "
-                   "CREATE INDEX IF NOT EXISTS time ON events ( ts ASC );");
-
-    /* Added to enable higher insert rate.
-     * More concerned with performance than crash integrity
+    /* Write-ahead logging lets the threads replaying events read a
+     * consistent snapshot while the ingest connection appends, so readers
+     * and the writer never wait on each other.  Commits are not synced;
+     * we are still more concerned with insert rate than crash integrity.
      */
+    conn_->execute("PRAGMA journal_mode = WAL;");
     conn_->execute("PRAGMA synchronous = OFF;");
-    conn_->execute("PRAGMA journal_mode = OFF;");
 
-    /*
-     * This must come after the db creation otherwise it will fail saying that
-     * table "events" does not exist.
-     */
-    insert_stmt_.reset(new Statement(*conn_, "INSERT INTO events VALUES (?,?,?,?)"));
+    /* Create database if it doesn't yet exist */
+    conn_->execute(catalog_ddl(""));
+    upgradeCatalog();
+
+    if (tableExists("events"))
+        migrateLegacyTable();
+
+    if (!tableExists("events", "view")) {
+        Transaction t(*conn_);
+        if (!tableExists("events", "view"))
+            rebuildView();
+        t.commit();
+    }
+
+    loadPartitions();
+
+    /* Indices are built when a partition is created or a bulk load ends,
+     * never here: every thread replaying events opens its own handle, and
+     * one may be opened while an import is still running. */
+    long long unindexed = select_int(*conn_, "SELECT COUNT(*) FROM partitions WHERE indexed=0");
+    if (unindexed)
+        LOG_WARN(unindexed << " partitions have no indices, left by an import which did not finish; they will be built when the next import ends");
 
     TRACE_EXIT();
 }
 
-namespace {
-    /* Provide a conversion for MessageType */
-    Statement& operator<< (Statement& s, MessageType t) { return s << static_cast<int>(t); }
+SqliteDatabase::~SqliteDatabase()
+{
+    TRACE_ENTER();
+    LOG_INFO("sqlite statistics: " << conn_->stats());
+    TRACE_EXIT();
+}
+
+bool SqliteDatabase::tableExists(const std::string& name, const char *type)
+{
+    Statement st(*conn_, "SELECT COUNT(*) FROM sqlite_master WHERE type=? AND name=?");
+    st << std::string(type) << name;
+    Row r(st.rows());
+    Column c(r.columns());
+    int n = 0;
+    c >> n;
+    return n > 0;
+}
+
+/* Catalogs written before bulk loads deferred indexing have no indexed
+ * column; all their partitions were indexed when created. */
+void SqliteDatabase::upgradeCatalog()
+{
+    TRACE_ENTER();
+
+    Statement st(*conn_, "PRAGMA table_info(partitions)");
+    for (Row r(st.rows()); r; ++r) {
+        Column c(r.columns());
+        int cid;
+        std::string name;
+        c >> cid >> name;
+        if (name == "indexed") {
+            TRACE_EXIT();
+            return;
+        }
+    }
+
+    LOG_INFO("adding indexed column to the partition catalog");
+    conn_->execute("ALTER TABLE partitions ADD COLUMN indexed INTEGER NOT NULL DEFAULT 1;");
+
+    TRACE_EXIT();
 }
 
-void SqliteDatabase::storeEvent(MessagePtr msg)
+void SqliteDatabase::upgradeSchema()
 {
     TRACE_ENTER();
 
-    // serialize event
+    bool haveLayer = false;
+    {
+        Statement st(*conn_, "PRAGMA table_info(events)");
+        for (Row r(st.rows()); r; ++r) {
+            Column c(r.columns());
+            int cid;
+            std::string name;
+            c >> cid >> name;
+            if (name == "layer")
+                haveLayer = true;
+        }
+    }
+
+    if (haveLayer) {
+        TRACE_EXIT();
+        return;
+    }
+
+    LOG_INFO("adding layer column to the events table");
+    conn_->execute("ALTER TABLE events ADD COLUMN layer TEXT NOT NULL DEFAULT '';");
+
+    /* Fill in the layer for events already in the database.  Collect the
+     * values first rather than updating the table while walking it. */
     std::ostringstream os;
-    msg->pack(os);
+    os << "SELECT rowid, data FROM events WHERE evtype IN (";
+    append_type_list(os, layerTypes);
+    os << ')';
+
+    std::vector<std::pair<long long, GUILayer> > layers;
+    {
+        Statement st(*conn_, os.str());
+        for (Row r(st.rows()); r; ++r) {
+            Column c(r.columns());
+            long long rowid;
+            std::string data;
+            c >> rowid >> data;
+            std::istringstream is(data);
+            MessagePtr msg(Message::unpack(is));
+            GUILayer layer;
+            if (msg && hasLayer(msg, layer))
+                layers.push_back(std::make_pair(rowid, layer));
+        }
+    }
+
+    {
+        Statement st(*conn_, "UPDATE events SET layer=? WHERE rowid=?");
+        for (size_t i = 0; i < layers.size(); ++i) {
+            st << layers[i].second << layers[i].first;
+            sqlite_wrapper::execute(st);
+        }
+    }
+
+    LOG_INFO("set the layer on " << layers.size() << " existing events");
+
+    TRACE_EXIT();
+}
+
+void SqliteDatabase::migrateLegacyTable()
+{
+    TRACE_ENTER();
 
-    //LOG_DEBUG("serialized event: " << os.str());
+    Transaction t(*conn_);
+
+    // another connection may have beaten us to it
+    if (!tableExists("events")) {
+        t.commit();
+        TRACE_EXIT();
+        return;
+    }
+
+    upgradeSchema();
+
+    Timestamp first = select_int(*conn_, "SELECT MIN(ts) FROM events");
+    Timestamp last = select_int(*conn_, "SELECT MAX(ts) FROM events");
+    long long rows = select_int(*conn_, "SELECT COUNT(*) FROM events");
+
+    /* the indices are recreated below with partition specific names */
+    conn_->execute("DROP INDEX IF EXISTS time; "
+                   "DROP INDEX IF EXISTS type_time; "
+                   "DROP INDEX IF EXISTS node_time; "
+                   "DROP INDEX IF EXISTS layer_time;");
+
+    if (rows == 0) {
+        conn_->execute("DROP TABLE events;");
+    } else {
+        /* The partition is widened to window boundaries so that new windows
+         * never overlap it. */
+        Partition p;
+        p.begin = window_start(first, partitionLength_);
+        p.end = window_start(last, partitionLength_) + partitionLength_;
+        std::ostringstream name;
+        name << "events_" << p.begin;
+        p.name = name.str();
+
+        LOG_INFO("moving " << rows << " events into partition " << p.name);
+
+        conn_->execute("ALTER TABLE events RENAME TO " + p.name + ";");
+        conn_->execute(partition_ddl("", p.name));
+
+        Statement st(*conn_, "INSERT INTO partitions ( name, begin, end ) VALUES (?,?,?)");
+        st << p.name << p.begin << p.end;
+        sqlite_wrapper::execute(st);
+    }
+
+    rebuildView();
+    t.commit();
+
+    TRACE_EXIT();
+}
+
+void SqliteDatabase::loadPartitions()
+{
+    TRACE_ENTER();
+
+    partitions_.clear();
+    Statement st(*conn_, "SELECT name, begin, end, compacted FROM partitions ORDER BY begin ASC");
+    for (Row r(st.rows()); r; ++r) {
+        Column c(r.columns());
+        Partition p;
+        int compacted;
+        c >> p.name >> p.begin >> p.end >> compacted;
+        p.compacted = compacted;
+        partitions_.push_back(p);
+    }
+
+    TRACE_EXIT();
+}
+
+/* Must be called with a write transaction open.  The view is only for
+ * external tools, so failing to build it is logged rather than allowed to
+ * stop events being stored. */
+void SqliteDatabase::rebuildView()
+{
+    TRACE_ENTER();
+
+    std::vector<std::string> names;
+    {
+        std::ostringstream os;
+        os << "SELECT name FROM partitions ORDER BY begin DESC LIMIT " << maxViewPartitions + 1;
+        Statement st(*conn_, os.str());
+        for (Row r(st.rows()); r; ++r) {
+            Column c(r.columns());
+            std::string name;
+            c >> name;
+            names.push_back(name);
+        }
+    }
+    if (names.size() > static_cast<size_t>(maxViewPartitions)) {
+        names.pop_back();
+        LOG_INFO("the events view only covers the newest " << maxViewPartitions << " partitions, starting at " << names.back());
+    }
+
+    std::ostringstream os;
+    os << "CREATE VIEW events AS ";
+    for (std::vector<std::string>::const_reverse_iterator it = names.rbegin(); it != names.rend(); ++it) {
+        if (it != names.rbegin())
+            os << " UNION ALL ";
+        os << "SELECT " << eventColumns << " FROM " << *it;
+    }
+    if (names.empty())
+        os << "SELECT 0 AS ts, 0 AS evtype, '' AS node, '' AS data, '' AS layer LIMIT 0";
+    os << ';';
+
+    try {
+        conn_->execute("DROP VIEW IF EXISTS events;");
+        conn_->execute(os.str());
+    } catch (sqlite_wrapper::Exception& e) {
+        LOG_ERROR("unable to rebuild the events view: " << e.what());
+    }
+
+    TRACE_EXIT();
+}
+
+const std::string& SqliteDatabase::partitionFor(Timestamp ts)
+{
+    for (int pass = 0; ; ++pass) {
+        for (PartitionList::const_iterator it = partitions_.begin(); it != partitions_.end(); ++it)
+            if (it->begin <= ts && ts < it->end)
+                return it->name;
+
+        if (pass == 1)
+            break;
+
+        /* Not in our cached copy of the catalog.  Check whether another
+         * connection has created it, otherwise create it ourselves. */
+        Transaction t(*conn_);
+        loadPartitions();
+
+        bool found = false;
+        Partition p;
+        p.begin = window_start(ts, partitionLength_);
+        p.end = p.begin + partitionLength_;
+        p.compacted = false;
+        for (PartitionList::const_iterator it = partitions_.begin(); it != partitions_.end(); ++it) {
+            if (it->begin <= ts && ts < it->end) {
+                found = true;
+                break;
+            }
+            /* clip the new window against its neighbours in case the
+             * partition length has changed since they were created */
+            if (it->end <= ts && it->end > p.begin)
+                p.begin = it->end;
+            if (it->begin > ts && it->begin < p.end)
+                p.end = it->begin;
+        }
+
+        if (!found) {
+            std::ostringstream name;
+            name << "events_" << p.begin;
+            p.name = name.str();
+
+            LOG_INFO("creating partition " << p.name << " for [" << p.begin << ", " << p.end << ")");
+
+            if (bulkLoad_)
+                conn_->execute(partition_table_ddl("", p.name));
+            else
+                conn_->execute(partition_ddl("", p.name));
+            Statement st(*conn_, "INSERT INTO partitions ( name, begin, end, indexed ) VALUES (?,?,?,?)");
+            st << p.name << p.begin << p.end << (bulkLoad_ ? 0 : 1);
+            sqlite_wrapper::execute(st);
+            rebuildView();
+        }
+        t.commit();
+
+        if (!found)
+            loadPartitions();
+    }
+
+    throw sqlite_wrapper::Exception("unable to find or create a partition for event");
+}
+
+void SqliteDatabase::insert(const EncodedEvent& ev)
+{
+    const std::string& name = partitionFor(ev.ts);
+    boost::shared_ptr<Statement>& insert_stmt = insert_stmts_[name];
+    if (!insert_stmt)
+        insert_stmt.reset(new Statement(*conn_, "INSERT INTO " + name + " ( " + eventColumns + " ) VALUES (?,?,?,?,?)"));
 
     // bind values to prepared statement
-    *insert_stmt_ << msg->timestamp << msg->type << msg->fromNodeID.to_string() << os.str();
+    *insert_stmt << ev.ts << static_cast<int>(ev.type) << ev.node << ev.data << ev.layer;
 
-    sqlite_wrapper::execute(*insert_stmt_);
+    sqlite_wrapper::execute(*insert_stmt);
+}
+
+void SqliteDatabase::storeEvent(const MessagePtr &msg)
+{
+    TRACE_ENTER();
+    metrics::ScopedTimer timer(insertTime);
+
+    EncodedEvent ev;
+    encode_event(msg, ev);
+
+    //LOG_DEBUG("serialized event: " << ev.data);
+
+    /* A partition may be dropped by the maintenance thread between
+     * inserts; if so, forget what we know and try once more. */
+    for (int attempt = 0; ; ++attempt) {
+        try {
+            insert(ev);
+            eventsStored.add();
+            break;
+        } catch (sqlite_wrapper::Exception& e) {
+            if (attempt)
+                throw;
+            LOG_WARN("insert failed, reloading partitions: " << e.what());
+            insert_stmts_.clear();
+            loadPartitions();
+        }
+    }
+
+    TRACE_EXIT();
+}
+
+void SqliteDatabase::storeEvents(const EncodedEventList& events)
+{
+    TRACE_ENTER();
+    metrics::ScopedTimer timer(batchInsertTime);
+
+    for (int attempt = 0; ; ++attempt) {
+        try {
+            /* partitionFor() opens its own transaction to create a
+             * partition, so make sure they all exist beforehand. */
+            for (EncodedEventList::const_iterator it = events.begin(); it != events.end(); ++it)
+                partitionFor(it->ts);
+
+            Transaction t(*conn_);
+            for (EncodedEventList::const_iterator it = events.begin(); it != events.end(); ++it)
+                insert(*it);
+            t.commit();
+            eventsStored.add(events.size());
+            break;
+        } catch (sqlite_wrapper::Exception& e) {
+            if (attempt)
+                throw;
+            LOG_WARN("batch insert failed, reloading partitions: " << e.what());
+            insert_stmts_.clear();
+            loadPartitions();
+        }
+    }
+
+    TRACE_EXIT();
+}
+
+void SqliteDatabase::beginBulkLoad()
+{
+    TRACE_ENTER();
+    bulkLoad_ = true;
+    TRACE_EXIT();
+}
+
+void SqliteDatabase::endBulkLoad()
+{
+    TRACE_ENTER();
+
+    /* This includes any partitions left behind by an earlier load which
+     * did not finish. */
+    std::vector<std::string> names;
+    {
+        Statement st(*conn_, "SELECT name FROM partitions WHERE indexed=0");
+        for (Row r(st.rows()); r; ++r) {
+            Column c(r.columns());
+            std::string name;
+            c >> name;
+            names.push_back(name);
+        }
+    }
+
+    BOOST_FOREACH(const std::string& name, names) {
+        LOG_INFO("building indices for partition " << name);
+        Transaction t(*conn_);
+        conn_->execute(partition_index_ddl("", name));
+        Statement st(*conn_, "UPDATE partitions SET indexed=1 WHERE name=?");
+        st << name;
+        sqlite_wrapper::execute(st);
+        t.commit();
+    }
+    bulkLoad_ = false;
 
     TRACE_EXIT();
 }
@@ -90,56 +590,144 @@ void SqliteDatabase::getEvents(boost::function<void(event::MessagePtr)> output,
                                Timestamp t, Direction d, unsigned int count)
 {
     TRACE_ENTER();
+    metrics::ScopedTimer timer(queryTime);
 
     /* the count of how many events we've processed thus far for this query */
     unsigned int nevents = 0;
-
-    std::ostringstream os;
-    os << "SELECT data FROM events WHERE ts" << (d == forward ? ">" : "<") << t <<
-	" ORDER BY ts " << (d == forward ? "ASC" : "DESC");
-    LOG_DEBUG(os.str());
-
-    // read each serialized event from a row, unpack and pass to callback function
     Timestamp last_event = 0;
-    Statement st(*conn_, os.str());
-    for (Row r(st.rows()); r; ++r, ++nevents) {
-	Column c(r.columns());
-	std::string data;
-	c >> data;
-	LOG_DEBUG("attempting to deserialize data from db: " << data);
-	std::istringstream is(data);
-	event::MessagePtr msg(Message::unpack(is));
-
-	/* In the case where more than `count` events occurred during the same
-	 * millisecond, make sure all events are read, even if there are more than
-	 * the user requested.
-	 */
-	if (msg->timestamp > last_event && nevents >= count) {
-	    LOG_DEBUG("stopping at ts " << msg->timestamp << " after reading " << nevents << " events");
-	    break;
-	}
-
-	output(msg);
-	last_event = msg->timestamp;
+    bool done = false;
+
+    loadPartitions();
+
+    /* Walk the partitions in time order so that a replay only touches the
+     * tables near the requested offset. */
+    const size_t np = partitions_.size();
+    for (size_t i = 0; i < np && !done; ++i) {
+        const Partition& p = partitions_[d == forward ? i : np - i - 1];
+        if ((d == forward && p.end <= t) || (d == reverse && p.begin >= t))
+            continue;
+
+        std::ostringstream os;
+        os << "SELECT data FROM " << p.name << " WHERE ts" << (d == forward ? ">" : "<") <<
+            "? ORDER BY ts " << (d == forward ? "ASC" : "DESC");
+        LOG_DEBUG(os.str() << " [" << t << "]");
+
+        // read each serialized event from a row, unpack and pass to callback function
+        Statement st(*conn_, os.str());
+        st << t;
+        for (Row r(st.rows()); r; ++r, ++nevents) {
+            Column c(r.columns());
+            std::string data;
+            c >> data;
+            LOG_DEBUG("attempting to deserialize data from db: " << data);
+            std::istringstream is(data);
+            event::MessagePtr msg(Message::unpack(is));
+
+            /* In the case where more than `count` events occurred during the same
+             * millisecond, make sure all events are read, even if there are more than
+             * the user requested.
+             */
+            if (msg->timestamp != last_event && nevents >= count) {
+                LOG_DEBUG("stopping at ts " << msg->timestamp << " after reading " << nevents << " events");
+                done = true;
+                break;
+            }
+
+            output(msg);
+            last_event = msg->timestamp;
+        }
     }
 
     TRACE_EXIT();
 }
 
+unsigned int SqliteDatabase::queryEvents(boost::function<void(event::MessagePtr)> output,
+                                         const EventQueryMessage& q)
+{
+    TRACE_ENTER();
+    metrics::ScopedTimer timer(queryTime);
+
+    unsigned int nevents = 0;
+
+    loadPartitions();
+
+    for (PartitionList::const_iterator it = partitions_.begin(); it != partitions_.end(); ++it) {
+        if (it->end <= q.begin || (q.end != Infinity && it->begin > q.end))
+            continue;
+
+        /* Values are bound rather than pasted into the SQL so that layer
+         * names need no quoting and the prepared statement can be reused
+         * from the connection's cache. */
+        std::ostringstream os;
+        os << "SELECT data FROM " << it->name << " WHERE ts>=?";
+        if (q.end != Infinity)
+            os << " AND ts<=?";
+        append_in_clause(os, "evtype", q.types.size());
+        append_in_clause(os, "node", q.nodes.size());
+        append_in_clause(os, "layer", q.layers.size());
+        os << " ORDER BY ts ASC LIMIT ?";
+        LOG_DEBUG(os.str());
+
+        Statement st(*conn_, os.str());
+        st << q.begin;
+        if (q.end != Infinity)
+            st << q.end;
+        BOOST_FOREACH(MessageType t, q.types)
+            st << t;
+        BOOST_FOREACH(const NodeIdentifier& n, q.nodes)
+            st << n.to_string();
+        BOOST_FOREACH(const GUILayer& l, q.layers)
+            st << l;
+        st << (q.limit ? static_cast<long long>(q.limit - nevents) : -1LL); // negative means no limit
+
+        for (Row r(st.rows()); r; ++r) {
+            Column c(r.columns());
+            std::string data;
+            c >> data;
+            std::istringstream is(data);
+            event::MessagePtr msg(Message::unpack(is));
+            if (!msg) {
+                LOG_WARN("unable to deserialize event from db: " << data);
+                continue;
+            }
+            output(msg);
+            ++nevents;
+        }
+
+        if (q.limit && nevents >= q.limit)
+            break;
+    }
+
+    LOG_DEBUG("query matched " << nevents << " events");
+
+    TRACE_EXIT_RET(nevents);
+    return nevents;
+}
+
 TimeRange SqliteDatabase::eventRange()
 {
     Timestamp begin = 0, end = 0;
 
     TRACE_ENTER();
 
-    Statement s(*conn_,
-                "SELECT * FROM"
-                "(SELECT ts from events ORDER BY ts ASC LIMIT 1)"
-                "JOIN"
-                "(SELECT ts from events ORDER BY ts DESC LIMIT 1)");
-    Row r(s.rows());
-    Column c(r.columns());
-    c >> begin >> end;
+    loadPartitions();
+
+    /* The first and last partitions may have been created but not yet
+     * written to, so skip over any which are empty. */
+    for (PartitionList::const_iterator it = partitions_.begin(); it != partitions_.end(); ++it) {
+        Timestamp ts = select_int(*conn_, "SELECT ts FROM " + it->name + " ORDER BY ts ASC LIMIT 1", -1);
+        if (ts != -1) {
+            begin = ts;
+            break;
+        }
+    }
+    for (PartitionList::const_reverse_iterator it = partitions_.rbegin(); it != partitions_.rend(); ++it) {
+        Timestamp ts = select_int(*conn_, "SELECT ts FROM " + it->name + " ORDER BY ts DESC LIMIT 1", -1);
+        if (ts != -1) {
+            end = ts;
+            break;
+        }
+    }
 
     LOG_DEBUG("begin=" << begin << " end=" << end);
 
@@ -148,4 +736,166 @@ TimeRange SqliteDatabase::eventRange()
     return TimeRange(begin, end);
 }
 
+unsigned int SqliteDatabase::expireEvents(Timestamp before, const std::string& archivePath)
+{
+    TRACE_ENTER();
+
+    unsigned int nexpired = 0;
+
+    loadPartitions();
+    PartitionList expired;
+    BOOST_FOREACH(const Partition& p, partitions_)
+        if (p.end <= before)
+            expired.push_back(p);
+
+    if (expired.empty()) {
+        TRACE_EXIT_RET(0);
+        return 0;
+    }
+
+    if (!archivePath.empty()) {
+        Statement attach(*conn_, "ATTACH DATABASE ? AS archive");
+        attach << archivePath;
+        sqlite_wrapper::execute(attach);
+        conn_->execute(catalog_ddl("archive."));
+    }
+
+    try {
+        BOOST_FOREACH(const Partition& p, expired) {
+            long long hi = 0;
+            if (!archivePath.empty()) {
+                LOG_INFO("archiving partition " << p.name << " to " << archivePath);
+
+                /* Only the archive is written to here, so copy in batches to
+                 * avoid holding a read lock on the live database for the
+                 * whole partition. */
+                conn_->execute(partition_ddl("archive.", p.name));
+                hi = select_int(*conn_, "SELECT MAX(rowid) FROM " + p.name);
+                for (long long lo = 0; lo < hi; lo += copyBatchSize) {
+                    std::ostringstream os;
+                    os << "INSERT INTO archive." << p.name << " ( " << eventColumns << " ) SELECT " << eventColumns
+                       << " FROM main." << p.name << " WHERE rowid>" << lo << " AND rowid<=" << lo + copyBatchSize;
+                    conn_->execute(os.str());
+                }
+
+                Statement st(*conn_, "INSERT OR REPLACE INTO archive.partitions ( name, begin, end, compacted ) VALUES (?,?,?,?)");
+                st << p.name << p.begin << p.end << static_cast<int>(p.compacted);
+                sqlite_wrapper::execute(st);
+            } else
+                LOG_INFO("dropping partition " << p.name);
+
+            /* Bring along any rows which arrived after the copy was taken. */
+            Transaction t(*conn_);
+            if (!archivePath.empty()) {
+                std::ostringstream late;
+                late << "INSERT INTO archive." << p.name << " ( " << eventColumns << " ) SELECT " << eventColumns
+                     << " FROM main." << p.name << " WHERE rowid>" << hi << ";";
+                conn_->execute(late.str());
+            }
+            conn_->execute("DROP VIEW IF EXISTS events; DROP TABLE IF EXISTS main." + p.name + ";");
+            Statement del(*conn_, "DELETE FROM main.partitions WHERE name=?");
+            del << p.name;
+            sqlite_wrapper::execute(del);
+            rebuildView();
+            t.commit();
+
+            insert_stmts_.erase(p.name);
+            ++nexpired;
+        }
+    } catch (sqlite_wrapper::Exception& e) {
+        LOG_ERROR("error expiring partitions: " << e.what());
+    }
+
+    if (!archivePath.empty())
+        conn_->execute("DETACH DATABASE archive;");
+
+    loadPartitions();
+
+    TRACE_EXIT_RET(nexpired);
+    return nexpired;
+}
+
+unsigned int SqliteDatabase::compactEvents(Timestamp before, Timestamp interval)
+{
+    TRACE_ENTER();
+
+    unsigned int ncompacted = 0;
+
+    if (interval <= 0) {
+        TRACE_EXIT_RET(0);
+        return 0;
+    }
+
+    loadPartitions();
+    PartitionList pending;
+    BOOST_FOREACH(const Partition& p, partitions_)
+        if (p.end <= before && !p.compacted)
+            pending.push_back(p);
+
+    BOOST_FOREACH(const Partition& p, pending) {
+        const std::string tmp(p.name + "_compact");
+
+        LOG_INFO("compacting partition " << p.name);
+
+        std::ostringstream types;
+        append_type_list(types, compactTypes);
+
+        /* Build the compacted copy alongside the live partition in short
+         * transactions.  Of the downsampled event types, the last update
+         * in each interval from each node is kept.  Because the grouping
+         * is done per batch an interval which straddles two batches may
+         * keep two updates.
+         */
+        conn_->execute("DROP TABLE IF EXISTS " + tmp + ";");
+        conn_->execute(partition_table_ddl("", tmp));
+        long long hi = select_int(*conn_, "SELECT MAX(rowid) FROM " + p.name);
+        for (long long lo = 0; lo < hi; lo += copyBatchSize) {
+            std::ostringstream range;
+            range << "rowid>" << lo << " AND rowid<=" << lo + copyBatchSize;
+
+            std::ostringstream os;
+            os << "INSERT INTO " << tmp << " ( " << eventColumns << " ) SELECT " << eventColumns << " FROM " << p.name
+               << " WHERE " << range.str() << " AND ( evtype NOT IN (" << types.str() << ") OR rowid IN ("
+               << "SELECT MAX(rowid) FROM " << p.name << " WHERE " << range.str() << " AND evtype IN (" << types.str() << ")"
+               << " GROUP BY evtype, node, layer, ts / " << interval << " ) )";
+            conn_->execute(os.str());
+        }
+
+        /* Index the copy before swapping it in, so that the writer is not
+         * held up while the indices are built.  They keep the copy's name,
+         * e.g. events_X_compact_time, which nothing depends on. */
+        conn_->execute(partition_index_ddl("", tmp));
+
+        long long before_rows = select_int(*conn_, "SELECT COUNT(*) FROM " + p.name);
+
+        /* Swap the copy in, bringing along any events which arrived for
+         * this window while the copy was being built. */
+        {
+            std::ostringstream late;
+            late << "INSERT INTO " << tmp << " ( " << eventColumns << " ) SELECT " << eventColumns
+                 << " FROM " << p.name << " WHERE rowid>" << hi << ";";
+
+            Transaction t(*conn_);
+            conn_->execute(late.str());
+            conn_->execute("DROP VIEW IF EXISTS events; DROP TABLE " + p.name + "; ALTER TABLE " + tmp + " RENAME TO " + p.name + ";");
+            Statement st(*conn_, "UPDATE partitions SET compacted=1, indexed=1 WHERE name=?");
+            st << p.name;
+            sqlite_wrapper::execute(st);
+            rebuildView();
+            t.commit();
+        }
+
+        insert_stmts_.erase(p.name);
+
+        long long after_rows = select_int(*conn_, "SELECT COUNT(*) FROM " + p.name);
+        LOG_INFO("compacted partition " << p.name << " from " << before_rows << " to " << after_rows << " events");
+        ++ncompacted;
+    }
+
+    loadPartitions();
+
+    TRACE_EXIT_RET(ncompacted);
+    return ncompacted;
+}
+
 // vim:sw=4 ts=8
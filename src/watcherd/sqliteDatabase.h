@@ -24,31 +24,94 @@
 #ifndef sqlite_database_h
 #define sqlite_database_h
 #include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <map>
+#include <vector>
 #include "database.h"
 #include "declareLogger.h"
 #include "sqlite_wrapper_fwd.h"
 
 namespace watcher {
-    /** Implementation of a SQLite backend for the Event database abstraction. */
+    /** Implementation of a SQLite backend for the Event database abstraction.
+     *
+     * Events are stored in a set of tables, one per window of time, so that
+     * old data can be dropped, archived or compacted a window at a time
+     * without touching the table receiving live events.  The "partitions"
+     * table lists the window tables and a view named "events" presents
+     * the union of the newest of them for use by external tools.
+     */
     class SqliteDatabase : public Database {
         public:
             /** Create a new database handle backed by the specified file.
              * @param[in] path pathname for the sqlite database
+             * @param[in] partitionLength length of the time window stored in each partition (milliseconds)
              */
-            SqliteDatabase(const std::string& path);
+            SqliteDatabase(const std::string& path, Timestamp partitionLength = defaultPartitionLength);
+            ~SqliteDatabase();
 
-            void storeEvent(event::MessagePtr msg);
+            void storeEvent(const event::MessagePtr &msg);
+            void storeEvents(const EncodedEventList& events);
+            void beginBulkLoad();
+            void endBulkLoad();
             void getEvents( boost::function<void(event::MessagePtr)> output, Timestamp t, Direction d, unsigned int count );
+            unsigned int queryEvents(boost::function<void(event::MessagePtr)> output, const event::EventQueryMessage& q);
             TimeRange eventRange();
+            unsigned int expireEvents(Timestamp before, const std::string& archivePath);
+            unsigned int compactEvents(Timestamp before, Timestamp interval);
 
         private:
+            /** A table holding the events for the window [begin, end). */
+            struct Partition {
+                std::string name;
+                Timestamp begin;
+                Timestamp end;
+                bool compacted;
+            };
+            typedef std::vector<Partition> PartitionList;
+
+            /** Add the layer column to the events table of a database
+             * created by an older watcherd, filling it in from the stored
+             * events.
+             */
+            void upgradeSchema();
+
+            /** Add the indexed column to a partition catalog created by an
+             * older watcherd. */
+            void upgradeCatalog();
+
+            /** Move the single events table used by older versions of
+             * watcherd into a partition. */
+            void migrateLegacyTable();
+
+            /** Re-read the partition catalog into partitions_. */
+            void loadPartitions();
+
+            /** Return the name of the partition holding ts, creating it if needed. */
+            const std::string& partitionFor(Timestamp ts);
+
+            /** Recreate the "events" view over the current set of partitions. */
+            void rebuildView();
+
+            /** Insert one event into its partition. */
+            void insert(const EncodedEvent& ev);
+
+            bool tableExists(const std::string& name, const char *type = "table");
+
             /** Pointer to the sqlite implementation backing this connection. */
             boost::scoped_ptr<sqlite_wrapper::Connection> conn_;
 
-            /** Prepared statement for resuse for storing events in storeEvent().
-             * This allows * reuse across calls to storeEvent().
+            /** Prepared statements for reuse across calls to storeEvent(),
+             * keyed by partition name.
              */
-            boost::scoped_ptr<sqlite_wrapper::Statement> insert_stmt_;
+            std::map<std::string, boost::shared_ptr<sqlite_wrapper::Statement> > insert_stmts_;
+
+            /** Cached copy of the partition catalog, ordered by time. */
+            PartitionList partitions_;
+
+            Timestamp partitionLength_;
+
+            /** Set between beginBulkLoad() and endBulkLoad(). */
+            bool bulkLoad_;
 
             DECLARE_LOGGER();
     };
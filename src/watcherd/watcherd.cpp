@@ -22,6 +22,9 @@
 #include "singletonConfig.h"
 #include "logger.h"
 #include "sharedStream.h"
+#include "eventRetention.h"
+#include "metricsReporter.h"
+#include "database.h"
 #include <libwatcher/listStreamsMessage.h>
 
 #include <boost/foreach.hpp>
@@ -34,10 +37,19 @@ using namespace boost;
 
 INIT_LOGGER(Watcherd, "Watcherd"); 
 
+namespace {
+    /// Minimum time between event range updates sent to the GUIs (milliseconds)
+    const Timestamp rangeUpdateInterval = 1000;
+}
+
 Watcherd::Watcherd(bool ro) : 
     config_(SingletonConfig::instance()),
     serverMessageHandlerPtr(new ServerMessageHandler),
-    readOnly_(ro)
+    readOnly_(ro),
+    publishedRangeTime(0),
+    publishedRangeBegin(0),
+    publishedRangeEnd(0),
+    rangeFlushPending(false)
 {
     TRACE_ENTER();
     TRACE_EXIT();
@@ -53,16 +65,30 @@ void Watcherd::run(const std::string &address, const std::string &port, const in
 {
     TRACE_ENTER(); 
 
+    // Expires and compacts old events in the background.  Created before
+    // any other threads are running as it may add defaults to the config.
+    EventRetention retention(config_);
+    MetricsReporter reporter(config_);
+    dataRollup_.reset(new DataRollup(config_));
+
     // Block all signals for background thread.
     sigset_t new_mask;
     sigfillset(&new_mask);
     sigset_t old_mask;
     pthread_sigmask(SIG_BLOCK, &new_mask, &old_mask);
 
+    // Data points may arrive as soon as the server runs.
+    dataRollup_->start();
+
     // Run server in background thread.
     serverConnection.reset(new Server(*this, address, port, (size_t)threadNum, serverMessageHandlerPtr));
+    rangeFlushTimer.reset(new asio::deadline_timer(serverConnection->io_service()));
     connectionThread = boost::thread(boost::bind(&watcher::Server::run, serverConnection));
 
+    if (!readOnly_)
+        retention.start();
+    reporter.start();
+
     // Restore previous signals.
     pthread_sigmask(SIG_SETMASK, &old_mask, 0);
 
@@ -77,8 +103,14 @@ void Watcherd::run(const std::string &address, const std::string &port, const in
     sigwait(&wait_mask, &sig);
 
     // Stop the server.
+    retention.stop();
+    dataRollup_->stop();
     serverConnection->stop();
     connectionThread.join();
+    rangeFlushTimer.reset();
+    close_event_writer();
+    reporter.stop();
+    reporter.report();  // final totals
     TRACE_EXIT();
 }
 
@@ -130,4 +162,51 @@ void Watcherd::removeStream(SharedStreamPtr p)
     allStreams.remove(p);
 }
 
+void Watcherd::publishEventRange()
+{
+    TRACE_ENTER();
+
+    TimeRange r(event_range());
+    {
+	boost::mutex::scoped_lock lock(publishedRangeLock);
+	if (r.first == publishedRangeBegin && r.second == publishedRangeEnd) {
+	    TRACE_EXIT();
+	    return;
+	}
+	Timestamp now = getCurrentTime();
+	if (now - publishedRangeTime < rangeUpdateInterval) {
+	    // Too soon.  Send it when the interval is up, in case nothing
+	    // more arrives to do so.
+	    if (!rangeFlushPending && rangeFlushTimer) {
+		rangeFlushPending = true;
+		rangeFlushTimer->expires_from_now(posix_time::milliseconds(rangeUpdateInterval - (now - publishedRangeTime)));
+		rangeFlushTimer->async_wait(bind(&Watcherd::flushEventRange, this, asio::placeholders::error));
+	    }
+	    TRACE_EXIT();
+	    return;
+	}
+	publishedRangeTime = now;
+	publishedRangeBegin = r.first;
+	publishedRangeEnd = r.second;
+    }
+
+    boost::shared_lock<boost::shared_mutex> lock(allStreamsLock);
+    BOOST_FOREACH(SharedStreamPtr stream, allStreams)
+	stream->sendRange(r);
+
+    TRACE_EXIT();
+}
+
+void Watcherd::flushEventRange(const boost::system::error_code& e)
+{
+    TRACE_ENTER();
+    {
+	boost::mutex::scoped_lock lock(publishedRangeLock);
+	rangeFlushPending = false;
+    }
+    if (!e)
+	publishEventRange();
+    TRACE_EXIT();
+}
+
 // vim:sw=4 ts=8
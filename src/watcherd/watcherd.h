@@ -32,11 +32,13 @@
 #define WATCHERD_H
 
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/utility.hpp>
 #include <boost/thread.hpp>
 
 #include <libwatcher/watcherMessageFwd.h>
+#include <libwatcher/watcherTypes.h>
 
 #include "watcherd_fwd.h"
 #include "serverMessageHandler.h"
@@ -44,6 +46,7 @@
 #include "libconfig.h++"
 #include "declareLogger.h"
 #include "sharedStreamFwd.h"
+#include "dataRollup.h"
 
 namespace watcher
 {
@@ -85,10 +88,22 @@ namespace watcher
 	    /** remove a stream from the list of all known streams */
 	    void removeStream(SharedStreamPtr);
 
+	    /** Send the current event range to every stream if it has changed
+	     * since it was last sent.  Updates are sent at most once per
+	     * rangeUpdateInterval so that busy feeders do not flood the
+	     * GUIs; a change held back is sent when the interval is up. */
+	    void publishEventRange();
+
+	    /** The downsampled data point series.  Only valid within run(). */
+	    DataRollup& dataRollup() { return *dataRollup_; }
+
         private:
 
             DECLARE_LOGGER();
 
+            /** Send an event range held back by publishEventRange(). */
+            void flushEventRange(const boost::system::error_code&);
+
             ServerPtr serverConnection;
             boost::thread connectionThread;
             libconfig::Config &config_;
@@ -100,6 +115,16 @@ namespace watcher
 	    // List of *all* shared streams.
 	    std::list<SharedStreamPtr> allStreams;
 	    boost::shared_mutex allStreamsLock;
+
+	    // Last event range sent by publishEventRange()
+	    boost::mutex publishedRangeLock;
+	    Timestamp publishedRangeTime;
+	    Timestamp publishedRangeBegin;
+	    Timestamp publishedRangeEnd;
+	    boost::scoped_ptr<boost::asio::deadline_timer> rangeFlushTimer;
+	    bool rangeFlushPending;  // is rangeFlushTimer waiting?
+
+	    boost::scoped_ptr<DataRollup> dataRollup_;
     };
 }
 
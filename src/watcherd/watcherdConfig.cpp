@@ -19,3 +19,11 @@
 #include "watcherdConfig.h"
 
 const char * watcher::dbPath = "databasePath";
+const char * watcher::partitionMinutes = "partitionMinutes";
+const char * watcher::retentionHours = "retentionHours";
+const char * watcher::archivePath = "archivePath";
+const char * watcher::compactAfterHours = "compactAfterHours";
+const char * watcher::compactionInterval = "compactionInterval";
+const char * watcher::maintenanceInterval = "maintenanceInterval";
+const char * watcher::metricsInterval = "metricsInterval";
+const char * watcher::dataRollupHours = "dataRollupHours";
@@ -21,6 +21,14 @@
 
 namespace watcher {
     extern const char *dbPath; //< config keyword for storing the database filename/uri
+    extern const char *partitionMinutes; //< config keyword for the length of each database partition
+    extern const char *retentionHours; //< config keyword for how long events are kept, 0 to keep forever
+    extern const char *archivePath; //< config keyword for the database expired events are moved to, empty to discard them
+    extern const char *compactAfterHours; //< config keyword for the age at which events are compacted, 0 to never compact
+    extern const char *compactionInterval; //< config keyword for the GPS/connectivity downsampling interval (milliseconds)
+    extern const char *maintenanceInterval; //< config keyword for the number of seconds between retention passes
+    extern const char *metricsInterval; //< config keyword for the number of seconds between metrics dumps, 0 to disable
+    extern const char *dataRollupHours; //< config keyword for the hours of data points summarized at startup, 0 for none
 } //namespace
 
 #endif /* watcherdConfig_h */
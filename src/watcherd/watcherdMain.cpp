@@ -27,6 +27,7 @@
 #include "initConfig.h"
 #include "singletonConfig.h"
 #include "watcherd.h"
+#include "database.h"
 
 #ifndef SYSCONFDIR
 #define SYSCONFDIR "/usr/local/etc"
@@ -196,6 +197,14 @@ int main(int argc, char* argv[])
                 << " and adding this to the configuration file.");
            config.getRoot().add("databasePath", libconfig::Setting::TypeString)=tmpDBPath;
     }
+    int partitionLength = defaultPartitionLength / (60 * 1000);
+    if (!config.lookupValue("partitionMinutes", partitionLength))
+    {
+        LOG_INFO("'partitionMinutes' not found in the configuration file, using default: " << partitionLength
+                << " and adding this to the configuration file.");
+           config.getRoot().add("partitionMinutes", libconfig::Setting::TypeInt)=partitionLength;
+    }
+
 	if (overWrite && dbPath.size()) {
 		if (boost::filesystem::exists(dbPath)) { 
 			if (!boost::filesystem::remove(dbPath)) 
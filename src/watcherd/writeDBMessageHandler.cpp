@@ -25,7 +25,10 @@
 
 #include "writeDBMessageHandler.h"
 #include "database.h"
+#include "watcherd.h"
 #include "libwatcher/connection.h"
+#include "libwatcher/messageTrace.h"
+#include "libwatcher/dataPointMessage.h"
 #include "logger.h"
 
 using namespace watcher;
@@ -33,6 +36,12 @@ using namespace watcher::event;
 
 INIT_LOGGER(WriteDBMessageHandler, "MessageHandler.WriteDBMessageHandler");
 
+WriteDBMessageHandler::WriteDBMessageHandler(Watcherd& w) : watcher(w)
+{
+    TRACE_ENTER();
+    TRACE_EXIT();
+}
+
 bool WriteDBMessageHandler::handleMessageArrive(ConnectionPtr, const MessagePtr& msg)
 {
     TRACE_ENTER();
@@ -40,8 +49,21 @@ bool WriteDBMessageHandler::handleMessageArrive(ConnectionPtr, const MessagePtr&
     bool ret = false; // keep connection open
 
     assert(isFeederEvent(msg->type)); // only store feeder events
+
+    // before storing, as the rollup's history loader may be reading the database
+    if (msg->type == DATA_POINT_MESSAGE_TYPE)
+        watcher.dataRollup().add(static_cast<const DataPointMessage&>(*msg));
+
     store_event(msg); // using the database handle for this thread.
 
+    // the stamps are not stored, so this is where their path ends; msg may
+    // already be in use on other threads, so it is left alone
+    if (!msg->trace.empty()) {
+        TraceStamps trace(msg->trace);
+        traceStamp(trace, TRACE_DB_COMMIT);
+        recordTrace(msg->timestamp, trace);
+    }
+
     TRACE_EXIT_RET(ret);
     return ret;
 }
@@ -52,10 +74,13 @@ bool WriteDBMessageHandler::handleMessagesArrive(ConnectionPtr conn, const std::
 
     bool ret = false; // keep connection open
 
-    BOOST_FOREACH(MessagePtr m, msg) {
+    BOOST_FOREACH(const MessagePtr &m, msg) {
         ret |= handleMessageArrive(conn, m);
     }
 
+    // let GUI clients know the database has grown
+    watcher.publishEventRange();
+
     TRACE_EXIT_RET(ret);
     return ret;
 }
@@ -27,6 +27,7 @@
 #include <string>
 
 #include "libwatcher/messageHandler.h"
+#include "watcherd_fwd.h"
 
 namespace watcher
 {
@@ -37,10 +38,15 @@ namespace watcher
     class WriteDBMessageHandler : public MessageHandler
     {
         public:
+            /** @param[in] w the daemon whose streams are told when the event range changes */
+            WriteDBMessageHandler(Watcherd& w);
+
             bool handleMessageArrive(ConnectionPtr, const event::MessagePtr&);
             bool handleMessagesArrive(ConnectionPtr, const std::vector<event::MessagePtr>&);
 
         private:
+            Watcherd& watcher;
+
             DECLARE_LOGGER();
     };
 